@@ -91,6 +91,7 @@ public:
   ListNode<T>* getNode(size_t index);
   virtual void spliceToFront(ListNode<T>* node);
   ListNode<T>* getHead() { return root; }
+  ListNode<T>* getTail() { return last; }
   T getLast() const { return last == NULL ? T() : last->data; }
 
 };
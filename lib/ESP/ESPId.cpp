@@ -14,4 +14,10 @@ uint32_t getESPId()
     }
     return id;
 }
+#else
+// Host builds (lib/NativeArduino)
+uint32_t getESPId()
+{
+    return ESP.getChipId();
+}
 #endif
\ No newline at end of file
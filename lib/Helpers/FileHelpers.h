@@ -0,0 +1,42 @@
+#include <ProjectFS.h>
+
+#ifndef _FILE_HELPERS_H
+#define _FILE_HELPERS_H
+
+// Files are rewritten by writing a complete copy to a temporary path and then
+// moving it over the original.  The filesystem can't rename over an existing
+// file, so there's a window where only the temporary file exists.  recover()
+// finishes a replacement interrupted there (e.g., by a power loss).
+class FileHelpers {
+public:
+  static void tmpPathFor(const char* path, char* buffer, size_t size) {
+    snprintf(buffer, size, "%s.tmp", path);
+  }
+
+  // Moves tmpPath over path.  Returns false if either step fails, in which
+  // case tmpPath is left in place for recover().
+  static bool replace(FS& fs, const char* tmpPath, const char* path) {
+    if (fs.exists(path) && !fs.remove(path)) {
+      return false;
+    }
+
+    return fs.rename(tmpPath, path);
+  }
+
+  // Call before reading path.  If a replacement was interrupted after path
+  // was removed, moves the temporary file into place.  If path is still
+  // there, the temporary file is an abandoned write and is removed.
+  static void recover(FS& fs, const char* tmpPath, const char* path) {
+    if (!fs.exists(tmpPath)) {
+      return;
+    }
+
+    if (fs.exists(path)) {
+      fs.remove(tmpPath);
+    } else {
+      fs.rename(tmpPath, path);
+    }
+  }
+};
+
+#endif
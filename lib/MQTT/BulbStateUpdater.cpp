@@ -4,8 +4,12 @@ BulbStateUpdater::BulbStateUpdater(Settings& settings, MqttClient& mqttClient, G
   : settings(settings),
     mqttClient(mqttClient),
     stateStore(stateStore),
+    staleGroups(MILIGHT_MAX_STALE_MQTT_GROUPS),
+    fullStateGroups(MILIGHT_MAX_STALE_MQTT_GROUPS),
     lastFlush(0),
     lastQueue(0),
+    overflowed(false),
+    overflowScans(0),
     enabled(true)
 { }
 
@@ -18,24 +22,103 @@ void BulbStateUpdater::disable() {
 }
 
 void BulbStateUpdater::enqueueUpdate(BulbId bulbId, GroupState& groupState) {
-  staleGroups.push(bulbId);
+  if (staleGroups.isFull() && !staleGroups.contains(bulbId)) {
+    // The state stays MQTT dirty, and is picked up by requeueOverflowed
+    overflowed = true;
+  } else {
+    staleGroups.add(bulbId, millis());
+  }
+
   //Remember time, when queue was added for debounce delay
   lastQueue = millis();
 
 }
 
 void BulbStateUpdater::loop() {
-  while (canFlush() && staleGroups.size() > 0) {
-    BulbId bulbId = staleGroups.shift();
-    GroupState* groupState = stateStore.get(bulbId);
+  if (overflowed && staleGroups.isEmpty() && !fullStateGroups.isFull()) {
+    requeueOverflowed();
+  }
+
+  while (canFlush() && !staleGroups.isEmpty()) {
+    flushStale(staleGroups.shift());
+  }
+
+  while (canFlush()
+    && !fullStateGroups.isEmpty()
+    && millis() - fullStateGroups.oldestTime() >= settings.mqttStateFullInterval) {
+    flushFullState(fullStateGroups.shift());
+  }
+}
+
+BulbStateUpdater::Stats BulbStateUpdater::getStats() const {
+  return {
+    .pending = staleGroups.size(),
+    .oldestPendingAge = staleGroups.isEmpty() ? 0 : millis() - staleGroups.oldestTime(),
+    .pendingFullStates = fullStateGroups.size(),
+    .overflowScans = overflowScans
+  };
+}
 
+void BulbStateUpdater::flushStale(const BulbId& bulbId) {
+  GroupState* groupState = stateStore.get(bulbId);
+
+  if (groupState == nullptr) {
+    return;
+  }
+
+  if (isDeltaEnabled()) {
+    if (groupState->hasChangedFields()) {
+      flushDelta(bulbId, *groupState);
+      groupState->clearChangedFields();
+    }
+
+    // The MQTT dirty bit stays set until the full state goes out
     if (groupState->isMqttDirty()) {
-      flushGroup(bulbId, *groupState);
-      groupState->clearMqttDirty();
+      deferFullState(bulbId);
     }
+  } else if (groupState->isMqttDirty()) {
+    flushGroup(bulbId, *groupState);
+    groupState->clearMqttDirty();
   }
 }
 
+void BulbStateUpdater::flushFullState(const BulbId& bulbId) {
+  GroupState* groupState = stateStore.get(bulbId);
+
+  if (groupState != nullptr && groupState->isMqttDirty()) {
+    flushGroup(bulbId, *groupState);
+    groupState->clearMqttDirty();
+  }
+}
+
+void BulbStateUpdater::deferFullState(const BulbId& bulbId) {
+  if (fullStateGroups.isFull() && !fullStateGroups.contains(bulbId)) {
+    // Still MQTT dirty, so requeueOverflowed finds it again
+    overflowed = true;
+  } else {
+    fullStateGroups.add(bulbId, millis());
+  }
+}
+
+// Queues MQTT dirty groups that aren't already waiting.  Requeued groups go
+// through flushStale, which defers the full state if deltas are enabled.
+void BulbStateUpdater::requeueOverflowed() {
+  const unsigned long now = millis();
+
+  overflowed = false;
+  ++overflowScans;
+
+  stateStore.forEachMqttDirty([this, now](const BulbId& bulbId) {
+    if (staleGroups.contains(bulbId) || fullStateGroups.contains(bulbId)) {
+      return;
+    }
+
+    if (!staleGroups.add(bulbId, now)) {
+      overflowed = true;
+    }
+  });
+}
+
 inline void BulbStateUpdater::flushGroup(BulbId bulbId, GroupState& state) {
   StaticJsonDocument<MILIGHT_MQTT_JSON_BUFFER_SIZE> json;
   JsonObject message = json.to<JsonObject>();
@@ -45,16 +128,23 @@ inline void BulbStateUpdater::flushGroup(BulbId bulbId, GroupState& state) {
     Serial.println(F("ERROR: State is too large for MQTT buffer, continuing anyway. Consider increasing MILIGHT_MQTT_JSON_BUFFER_SIZE."));
   }
 
-  size_t documentSize = measureJson(message);
-  char buffer[documentSize + 1];
-  serializeJson(json, buffer, sizeof(buffer));
+  mqttClient.sendState(bulbId, json);
 
-  mqttClient.sendState(
-    *MiLightRemoteConfig::fromType(bulbId.deviceType),
-    bulbId.deviceId,
-    bulbId.groupId,
-    buffer
-  );
+  lastFlush = millis();
+}
+
+inline void BulbStateUpdater::flushDelta(BulbId bulbId, GroupState& state) {
+  StaticJsonDocument<MILIGHT_MQTT_JSON_BUFFER_SIZE> json;
+  JsonObject message = json.to<JsonObject>();
+  state.applyChangedState(message, bulbId, settings.groupStateFields);
+
+  // Nothing to send if none of the changed fields are reported in the current
+  // bulb mode (e.g., hue changed while in white mode)
+  if (message.size() == 0) {
+    return;
+  }
+
+  mqttClient.sendStateDelta(bulbId, json);
 
   lastFlush = millis();
 }
@@ -62,3 +152,7 @@ inline void BulbStateUpdater::flushGroup(BulbId bulbId, GroupState& state) {
 inline bool BulbStateUpdater::canFlush() const {
   return enabled && (millis() > (lastFlush + settings.mqttStateRateLimit) && millis() > (lastQueue + settings.mqttDebounceDelay));
 }
+
+inline bool BulbStateUpdater::isDeltaEnabled() const {
+  return settings.mqttStateDeltaTopicPattern.length() > 0;
+}
@@ -1,10 +1,21 @@
 /**
  * Enqueues updated bulb states and flushes them at the configured interval.
+ *
+ * Each group is queued at most once, and groups are flushed in the order they
+ * were first queued.  If more than MILIGHT_MAX_STALE_MQTT_GROUPS are waiting,
+ * the rest aren't queued.  Their states stay MQTT dirty, and once the queue
+ * drains they're found by scanning the state store.  Every publish goes
+ * through the rate limit either way.
+ *
+ * If mqtt_state_delta_topic_pattern is set, flushes only send the fields that
+ * changed since the last flush, to the delta topic.  Groups that were sent a
+ * delta get a full state published to the (retained) state topic
+ * mqtt_state_full_interval after the first delta.
  */
 
 #include <stddef.h>
 #include <MqttClient.h>
-#include <CircularBuffer.h>
+#include <StaleGroupSet.h>
 #include <Settings.h>
 
 #ifndef MILIGHT_MQTT_JSON_BUFFER_SIZE
@@ -16,6 +27,17 @@
 
 class BulbStateUpdater {
 public:
+  struct Stats {
+    // Groups waiting for a state publish
+    size_t pending;
+    // Milliseconds the longest-waiting group has been queued for
+    unsigned long oldestPendingAge;
+    // Groups waiting for a full state publish after being sent a delta
+    size_t pendingFullStates;
+    // Times the state store was scanned for groups that didn't fit in the queue
+    uint32_t overflowScans;
+  };
+
   BulbStateUpdater(Settings& settings, MqttClient& mqttClient, GroupStateStore& stateStore);
 
   void enqueueUpdate(BulbId bulbId, GroupState& groupState);
@@ -23,17 +45,30 @@ public:
   void enable();
   void disable();
 
+  Stats getStats() const;
+
 private:
   Settings& settings;
   MqttClient& mqttClient;
   GroupStateStore& stateStore;
-  CircularBuffer<BulbId, MILIGHT_MAX_STALE_MQTT_GROUPS> staleGroups;
+  StaleGroupSet staleGroups;
+  // Groups that were sent deltas, and are due a full state publish
+  StaleGroupSet fullStateGroups;
   unsigned long lastFlush;
   unsigned long lastQueue;
+  // Set when a group couldn't be queued
+  bool overflowed;
+  uint32_t overflowScans;
   bool enabled;
 
+  void flushStale(const BulbId& bulbId);
+  void flushFullState(const BulbId& bulbId);
+  void deferFullState(const BulbId& bulbId);
+  void requeueOverflowed();
   inline void flushGroup(BulbId bulbId, GroupState& state);
+  inline void flushDelta(BulbId bulbId, GroupState& state);
   inline bool canFlush() const;
+  inline bool isDeltaEnabled() const;
 };
 
 #endif
@@ -3,7 +3,8 @@
 #include <Units.h>
 #ifdef ESP8266
   #include <ESP8266WiFi.h>
-#elif ESP32
+#else
+  // ESP32, and the stand-in for host builds (lib/NativeArduino)
   #include <WiFi.h>
 #endif
 
@@ -1,7 +1,5 @@
 #include <stddef.h>
 #include <MqttClient.h>
-#include <TokenIterator.h>
-#include <UrlTokenBindings.h>
 #include <IntParsing.h>
 #include <ArduinoJson.h>
 #include <WiFiClient.h>
@@ -13,12 +11,67 @@ static const char* STATUS_CONNECTED = "connected";
 static const char* STATUS_DISCONNECTED = "disconnected_clean";
 static const char* STATUS_LWT_DISCONNECTED = "disconnected_unclean";
 
+static const char* TOPIC_TOKEN_HEX_DEVICE_ID = ":hex_device_id";
+static const char* TOPIC_TOKEN_DEC_DEVICE_ID = ":dec_device_id";
+static const char* TOPIC_TOKEN_DEVICE_ID = ":device_id";
+static const char* TOPIC_TOKEN_GROUP_ID = ":group_id";
+static const char* TOPIC_TOKEN_DEVICE_TYPE = ":device_type";
+static const char* TOPIC_TOKEN_DEVICE_ALIAS = ":device_alias";
+
+// Collects small writes (ArduinoJson writes a few bytes at a time) and passes
+// them to the MQTT client in chunks.  Lives on the stack.
+class ChunkedPublishPrint : public Print {
+public:
+  ChunkedPublishPrint(PubSubClient& client)
+    : client(client),
+      length(0),
+      copiedBytes(0)
+  { }
+
+  virtual size_t write(uint8_t c) override {
+    buffer[length++] = c;
+
+    if (length == sizeof(buffer)) {
+      flush();
+    }
+
+    return 1;
+  }
+
+  virtual size_t write(const uint8_t* data, size_t size) override {
+    for (size_t i = 0; i < size; ++i) {
+      write(data[i]);
+    }
+    return size;
+  }
+
+  virtual void flush() override {
+    if (length > 0) {
+      client.write(buffer, length);
+      copiedBytes += length;
+      length = 0;
+    }
+  }
+
+  size_t getCopiedBytes() const {
+    return copiedBytes;
+  }
+
+private:
+  PubSubClient& client;
+  uint8_t buffer[MQTT_PACKET_CHUNK_SIZE];
+  size_t length;
+  size_t copiedBytes;
+};
+
 MqttClient::MqttClient(Settings& settings, MiLightClient*& milightClient)
   : mqttClient(tcpClient),
     milightClient(milightClient),
     settings(settings),
     lastConnectAttempt(0),
-    connected(false)
+    connected(false),
+    topicMatcher(settings),
+    statePublishStats()
 {
   String strDomain = settings.mqttServer();
   this->domain = new char[strDomain.length() + 1];
@@ -29,13 +82,17 @@ MqttClient::~MqttClient() {
   String aboutStr = generateConnectionStatusMessage(STATUS_DISCONNECTED);
   mqttClient.publish(settings.mqttClientStatusTopic.c_str(), aboutStr.c_str(), true);
   mqttClient.disconnect();
-  delete this->domain;
+  delete[] this->domain;
 }
 
 void MqttClient::onConnect(OnConnectFn fn) {
   this->onConnectFn = fn;
 }
 
+void MqttClient::onSceneActivate(SceneActivateFn fn) {
+  this->sceneActivateFn = fn;
+}
+
 void MqttClient::begin() {
 #ifdef MQTT_DEBUG
   printf_P(
@@ -142,6 +199,57 @@ void MqttClient::sendState(const MiLightRemoteConfig& remoteConfig, uint16_t dev
   publish(settings.mqttStateTopicPattern, remoteConfig, deviceId, groupId, update, true);
 }
 
+void MqttClient::sendState(const BulbId& bulbId, const JsonDocument& state) {
+  streamPublish(settings.mqttStateTopicPattern, bulbId, state, settings.mqttRetain);
+}
+
+void MqttClient::sendStateDelta(const BulbId& bulbId, const JsonDocument& state) {
+  streamPublish(settings.mqttStateDeltaTopicPattern, bulbId, state, false);
+}
+
+const MqttClient::PublishStats& MqttClient::getStatePublishStats() const {
+  return statePublishStats;
+}
+
+void MqttClient::streamPublish(const String& topicPattern, const BulbId& bulbId, const JsonDocument& message, const bool retain) {
+  if (topicPattern.length() == 0) {
+    return;
+  }
+
+  char topic[MQTT_MAX_TOPIC_LENGTH];
+
+  if (bindTopic(topic, sizeof(topic), topicPattern, bulbId) > 0) {
+    streamPublish(topic, message, retain);
+  } else {
+    String boundTopic = bindTopicString(topicPattern, bulbId);
+    ++statePublishStats.heapAllocations;
+
+    streamPublish(boundTopic.c_str(), message, retain);
+  }
+}
+
+void MqttClient::streamPublish(const char* topic, const JsonDocument& message, const bool retain) {
+  const size_t length = measureJson(message);
+
+#ifdef MQTT_DEBUG
+  printf("MqttClient - publishing update to %s\n", topic);
+#endif
+
+  if (! mqttClient.beginPublish(topic, length, retain)) {
+    return;
+  }
+
+  ChunkedPublishPrint out(mqttClient);
+  serializeJson(message, out);
+  out.flush();
+
+  mqttClient.endPublish();
+
+  ++statePublishStats.publishes;
+  statePublishStats.payloadBytes += length;
+  statePublishStats.copiedBytes += out.getCopiedBytes();
+}
+
 void MqttClient::subscribe() {
   String topic = settings.mqttTopicPattern;
 
@@ -157,6 +265,10 @@ void MqttClient::subscribe() {
 #endif
 
   mqttClient.subscribe(topic.c_str());
+
+  if (settings.mqttSceneTopic.length() > 0) {
+    mqttClient.subscribe(settings.mqttSceneTopic.c_str());
+  }
 }
 
 void MqttClient::send(const char* topic, const char* message, const bool retain) {
@@ -209,9 +321,9 @@ void MqttClient::publish(
 }
 
 void MqttClient::publishCallback(char* topic, byte* payload, int length) {
-  uint16_t deviceId = 0;
-  uint8_t groupId = 0;
-  const MiLightRemoteConfig* config = &FUT092Config;
+  uint16_t deviceId;
+  uint8_t groupId;
+  const MiLightRemoteConfig* config;
   char cstrPayload[length + 1];
   cstrPayload[length] = 0;
   memcpy(cstrPayload, payload, sizeof(byte)*length);
@@ -220,47 +332,31 @@ void MqttClient::publishCallback(char* topic, byte* payload, int length) {
   printf("MqttClient - Got message on topic: %s\n%s\n", topic, cstrPayload);
 #endif
 
-  auto patternIterator = std::make_shared<TokenIterator>(settings.mqttTopicPattern.c_str(), settings.mqttTopicPattern.length(), '/');
-  auto topicIterator = std::make_shared<TokenIterator>(topic, strlen(topic), '/');
-  UrlTokenBindings tokenBindings(patternIterator, topicIterator);
-
-  if (tokenBindings.hasBinding("device_alias")) {
-    String alias = tokenBindings.get("device_alias");
-    auto itr = settings.groupIdAliases.find(alias);
+  if (settings.mqttSceneTopic.length() > 0 && settings.mqttSceneTopic == topic) {
+    if (sceneActivateFn && !sceneActivateFn(cstrPayload)) {
+      Serial.printf_P(PSTR("MqttClient - WARNING: could not find scene: `%s'. Ignoring message.\n"), cstrPayload);
+    }
+    return;
+  }
 
-    if (itr == settings.groupIdAliases.end()) {
-      Serial.printf_P(PSTR("MqttClient - WARNING: could not find device alias: `%s'. Ignoring packet.\n"), alias.c_str());
-      return;
-    } else {
-      BulbId bulbId = itr->second.bulbId;
+  if (!topicMatcher.hasToken(MqttTopicMatcher::Token::DEVICE_ALIAS)
+    && !topicMatcher.hasToken(MqttTopicMatcher::Token::DEVICE_TYPE)) {
+    Serial.println(F("MqttClient - WARNING: could not find device_type token.  Defaulting to FUT092.\n"));
+  }
 
-      deviceId = bulbId.deviceId;
-      config = MiLightRemoteConfig::fromType(bulbId.deviceType);
-      groupId = bulbId.groupId;
-    }
-  } else {
-    if (tokenBindings.hasBinding(GroupStateFieldNames::DEVICE_ID)) {
-      deviceId = parseInt<uint16_t>(tokenBindings.get(GroupStateFieldNames::DEVICE_ID));
-    } else if (tokenBindings.hasBinding("hex_device_id")) {
-      deviceId = parseInt<uint16_t>(tokenBindings.get("hex_device_id"));
-    } else if (tokenBindings.hasBinding("dec_device_id")) {
-      deviceId = parseInt<uint16_t>(tokenBindings.get("dec_device_id"));
-    }
+  const char* alias = nullptr;
 
-    if (tokenBindings.hasBinding(GroupStateFieldNames::GROUP_ID)) {
-      groupId = parseInt<uint16_t>(tokenBindings.get(GroupStateFieldNames::GROUP_ID));
-    }
+  switch (topicMatcher.match(topic, deviceId, groupId, config, alias)) {
+    case MqttTopicMatcher::MatchResult::UNKNOWN_ALIAS:
+      Serial.printf_P(PSTR("MqttClient - WARNING: could not find device alias: `%s'. Ignoring packet.\n"), alias);
+      return;
 
-    if (tokenBindings.hasBinding(GroupStateFieldNames::DEVICE_TYPE)) {
-      config = MiLightRemoteConfig::fromType(tokenBindings.get(GroupStateFieldNames::DEVICE_TYPE));
-    } else {
-      Serial.println(F("MqttClient - WARNING: could not find device_type token.  Defaulting to FUT092.\n"));
-    }
-  }
+    case MqttTopicMatcher::MatchResult::UNKNOWN_DEVICE_TYPE:
+      Serial.println(F("MqttClient - ERROR: unknown device_type specified"));
+      return;
 
-  if (config == NULL) {
-    Serial.println(F("MqttClient - ERROR: unknown device_type specified"));
-    return;
+    default:
+      break;
   }
 
   StaticJsonDocument<400> buffer;
@@ -295,6 +391,66 @@ String MqttClient::bindTopicString(const String& topicPattern, const BulbId& bul
   return boundTopic;
 }
 
+size_t MqttClient::bindTopic(char* buffer, size_t size, const String& topicPattern, const BulbId& bulbId) {
+  const char* pattern = topicPattern.c_str();
+  size_t length = 0;
+
+  while (*pattern != 0) {
+    const char* value = nullptr;
+    const char* token = nullptr;
+    char number[8];
+
+    if (*pattern == ':') {
+      if (strncmp(pattern, TOPIC_TOKEN_DEVICE_ID, strlen(TOPIC_TOKEN_DEVICE_ID)) == 0) {
+        token = TOPIC_TOKEN_DEVICE_ID;
+      } else if (strncmp(pattern, TOPIC_TOKEN_HEX_DEVICE_ID, strlen(TOPIC_TOKEN_HEX_DEVICE_ID)) == 0) {
+        token = TOPIC_TOKEN_HEX_DEVICE_ID;
+      }
+
+      if (token != nullptr) {
+        snprintf_P(number, sizeof(number), PSTR("0x%X"), bulbId.deviceId);
+        value = number;
+      } else if (strncmp(pattern, TOPIC_TOKEN_DEC_DEVICE_ID, strlen(TOPIC_TOKEN_DEC_DEVICE_ID)) == 0) {
+        token = TOPIC_TOKEN_DEC_DEVICE_ID;
+        snprintf_P(number, sizeof(number), PSTR("%u"), bulbId.deviceId);
+        value = number;
+      } else if (strncmp(pattern, TOPIC_TOKEN_GROUP_ID, strlen(TOPIC_TOKEN_GROUP_ID)) == 0) {
+        token = TOPIC_TOKEN_GROUP_ID;
+        snprintf_P(number, sizeof(number), PSTR("%u"), bulbId.groupId);
+        value = number;
+      } else if (strncmp(pattern, TOPIC_TOKEN_DEVICE_TYPE, strlen(TOPIC_TOKEN_DEVICE_TYPE)) == 0) {
+        token = TOPIC_TOKEN_DEVICE_TYPE;
+        value = MiLightRemoteTypeHelpers::remoteTypeToName(bulbId.deviceType);
+      } else if (strncmp(pattern, TOPIC_TOKEN_DEVICE_ALIAS, strlen(TOPIC_TOKEN_DEVICE_ALIAS)) == 0) {
+        token = TOPIC_TOKEN_DEVICE_ALIAS;
+        auto it = settings.findAlias(bulbId.deviceType, bulbId.deviceId, bulbId.groupId);
+        value = it != settings.groupIdAliases.end() ? it->first.c_str() : "__unnamed_group";
+      }
+    }
+
+    if (token != nullptr) {
+      const size_t valueLength = strlen(value);
+
+      if (length + valueLength >= size) {
+        return 0;
+      }
+
+      memcpy(buffer + length, value, valueLength);
+      length += valueLength;
+      pattern += strlen(token);
+    } else {
+      if (length + 1 >= size) {
+        return 0;
+      }
+
+      buffer[length++] = *pattern++;
+    }
+  }
+
+  buffer[length] = 0;
+  return length;
+}
+
 String MqttClient::generateConnectionStatusMessage(const char* connectionStatus) {
   if (settings.simpleMqttClientStatus) {
     // Don't expand disconnect type for simple status
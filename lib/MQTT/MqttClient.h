@@ -4,6 +4,7 @@
 #include <WiFiClient.h>
 #include <MiLightRadioConfig.h>
 #include <ESPId.h>
+#include <MqttTopicMatcher.h>
 #include <map>
 #include <pgmspace.h>
 
@@ -15,6 +16,12 @@
 #define MQTT_PACKET_CHUNK_SIZE 128
 #endif
 
+// Topics are bound into a stack buffer of this size when publishing state.
+// Longer topics fall back to a heap-allocated String.
+#ifndef MQTT_MAX_TOPIC_LENGTH
+#define MQTT_MAX_TOPIC_LENGTH 128
+#endif
+
 #ifndef _MQTT_CLIENT_H
 #define _MQTT_CLIENT_H
 
@@ -47,6 +54,19 @@ enum MqttConnectionStatus : int {
 class MqttClient {
 public:
   using OnConnectFn = std::function<void()>;
+  // Returns false if there's no scene with this name
+  using SceneActivateFn = std::function<bool(const char* name)>;
+
+  // Counters for state messages sent with sendState(BulbId, JsonDocument) and
+  // sendStateDelta
+  struct PublishStats {
+    uint32_t publishes;
+    uint32_t payloadBytes;
+    // Bytes copied through intermediate buffers on the way to the connection
+    uint32_t copiedBytes;
+    // Only happens when a topic doesn't fit in MQTT_MAX_TOPIC_LENGTH
+    uint32_t heapAllocations;
+  };
 
   MqttClient(Settings& settings, MiLightClient*& milightClient);
   ~MqttClient();
@@ -56,13 +76,23 @@ public:
   void reconnect();
   void sendUpdate(const MiLightRemoteConfig& remoteConfig, uint16_t deviceId, uint16_t groupId, const char* update);
   void sendState(const MiLightRemoteConfig& remoteConfig, uint16_t deviceId, uint16_t groupId, const char* update);
+  // Serializes state straight into the connection rather than into a temporary buffer
+  void sendState(const BulbId& bulbId, const JsonDocument& state);
+  // Sends a partial state to mqtt_state_delta_topic_pattern.  Never retained.
+  void sendStateDelta(const BulbId& bulbId, const JsonDocument& state);
+  const PublishStats& getStatePublishStats() const;
   void send(const char* topic, const char* message, const bool retain = false);
   void onConnect(OnConnectFn fn);
+  // Called with the payload of messages to mqtt_scene_topic
+  void onSceneActivate(SceneActivateFn fn);
   bool isConnected();
   MqttConnectionStatus getConnectionStatus();
   const __FlashStringHelper* getConnectionStatusString();
 
   String bindTopicString(const String& topicPattern, const BulbId& bulbId);
+  // Same as bindTopicString, but writes into buffer.  Returns the length of the
+  // bound topic, or 0 if it didn't fit.
+  size_t bindTopic(char* buffer, size_t size, const String& topicPattern, const BulbId& bulbId);
 
 private:
   WiFiClient tcpClient;
@@ -72,7 +102,12 @@ private:
   char* domain;
   unsigned long lastConnectAttempt;
   OnConnectFn onConnectFn;
+  SceneActivateFn sceneActivateFn;
   bool connected;
+  // Compiled from settings when the client is created.  Settings changes
+  // recreate the client.
+  MqttTopicMatcher topicMatcher;
+  PublishStats statePublishStats;
 
   void sendBirthMessage();
   bool connect();
@@ -86,6 +121,8 @@ private:
     const char* update,
     const bool retain = false
   );
+  void streamPublish(const char* topic, const JsonDocument& message, const bool retain);
+  void streamPublish(const String& topicPattern, const BulbId& bulbId, const JsonDocument& message, const bool retain);
 
   String generateConnectionStatusMessage(const char* status);
 };
@@ -0,0 +1,180 @@
+#include <MqttTopicMatcher.h>
+#include <IntParsing.h>
+
+static const char* TOKEN_NAMES[] = {
+  nullptr,
+  "device_id",
+  "hex_device_id",
+  "dec_device_id",
+  "group_id",
+  "device_type",
+  "device_alias"
+};
+
+MqttTopicMatcher::MqttTopicMatcher(Settings& settings)
+  : settings(settings),
+    numSegments(0),
+    tokenMask(0)
+{
+  compile();
+}
+
+void MqttTopicMatcher::compile() {
+  compilePattern();
+  compileAliases();
+}
+
+void MqttTopicMatcher::compilePattern() {
+  const char* pattern = settings.mqttTopicPattern.c_str();
+
+  numSegments = 0;
+  tokenMask = 0;
+
+  while (*pattern != 0 && numSegments < MQTT_MAX_TOPIC_SEGMENTS) {
+    const char* end = strchr(pattern, '/');
+    const size_t length = end == nullptr ? strlen(pattern) : end - pattern;
+    Token token = Token::NONE;
+
+    if (*pattern == ':') {
+      for (size_t i = 1; i < static_cast<size_t>(Token::NUM_TOKENS); ++i) {
+        if (strlen(TOKEN_NAMES[i]) == length - 1 && strncmp(pattern + 1, TOKEN_NAMES[i], length - 1) == 0) {
+          token = static_cast<Token>(i);
+          tokenMask |= (1 << i);
+          break;
+        }
+      }
+    }
+
+    segments[numSegments++] = token;
+
+    if (end == nullptr) {
+      break;
+    }
+    pattern = end + 1;
+  }
+}
+
+void MqttTopicMatcher::compileAliases() {
+  size_t capacity = 1;
+  while (capacity < settings.groupIdAliases.size() * 2) {
+    capacity <<= 1;
+  }
+
+  aliasIndex.assign(capacity, AliasIndexEntry{0, nullptr});
+
+  for (auto it = settings.groupIdAliases.begin(); it != settings.groupIdAliases.end(); ++it) {
+    const uint32_t aliasHash = hash(it->second.alias);
+    size_t ix = aliasHash & (capacity - 1);
+
+    while (aliasIndex[ix].alias != nullptr) {
+      ix = (ix + 1) & (capacity - 1);
+    }
+
+    aliasIndex[ix] = AliasIndexEntry{aliasHash, &it->second};
+  }
+}
+
+bool MqttTopicMatcher::hasToken(Token token) const {
+  return (tokenMask & (1 << static_cast<uint8_t>(token))) != 0;
+}
+
+const GroupAlias* MqttTopicMatcher::findAlias(const char* alias) const {
+  const size_t mask = aliasIndex.size() - 1;
+  const uint32_t aliasHash = hash(alias);
+
+  for (size_t ix = aliasHash & mask; aliasIndex[ix].alias != nullptr; ix = (ix + 1) & mask) {
+    const AliasIndexEntry& entry = aliasIndex[ix];
+
+    if (entry.hash == aliasHash && strcmp(entry.alias->alias, alias) == 0) {
+      return entry.alias;
+    }
+  }
+
+  return nullptr;
+}
+
+MqttTopicMatcher::MatchResult MqttTopicMatcher::match(
+  char* topic,
+  uint16_t& deviceId,
+  uint8_t& groupId,
+  const MiLightRemoteConfig*& config,
+  const char*& boundAlias
+) const {
+  const char* bindings[static_cast<size_t>(Token::NUM_TOKENS)] = { };
+
+  for (size_t i = 0; i < numSegments && topic != nullptr; ++i) {
+    char* end = strchr(topic, '/');
+
+    if (end != nullptr) {
+      *end = 0;
+    }
+
+    if (segments[i] != Token::NONE) {
+      bindings[static_cast<size_t>(segments[i])] = topic;
+    }
+
+    topic = end == nullptr ? nullptr : end + 1;
+  }
+
+  deviceId = 0;
+  groupId = 0;
+  config = &FUT092Config;
+  boundAlias = bindings[static_cast<size_t>(Token::DEVICE_ALIAS)];
+
+  if (boundAlias != nullptr) {
+    const GroupAlias* alias = findAlias(boundAlias);
+
+    if (alias == nullptr) {
+      return MatchResult::UNKNOWN_ALIAS;
+    }
+
+    deviceId = alias->bulbId.deviceId;
+    groupId = alias->bulbId.groupId;
+    config = MiLightRemoteConfig::fromType(alias->bulbId.deviceType);
+  } else {
+    const char* boundId = bindings[static_cast<size_t>(Token::DEVICE_ID)];
+
+    if (boundId == nullptr) {
+      boundId = bindings[static_cast<size_t>(Token::HEX_DEVICE_ID)];
+    }
+    if (boundId == nullptr) {
+      boundId = bindings[static_cast<size_t>(Token::DEC_DEVICE_ID)];
+    }
+    if (boundId != nullptr) {
+      deviceId = parseId(boundId);
+    }
+
+    const char* boundGroupId = bindings[static_cast<size_t>(Token::GROUP_ID)];
+    if (boundGroupId != nullptr) {
+      groupId = parseId(boundGroupId);
+    }
+
+    const char* boundType = bindings[static_cast<size_t>(Token::DEVICE_TYPE)];
+    if (boundType != nullptr) {
+      config = MiLightRemoteConfig::fromType(MiLightRemoteTypeHelpers::remoteTypeFromName(boundType));
+    }
+  }
+
+  return config == nullptr ? MatchResult::UNKNOWN_DEVICE_TYPE : MatchResult::OK;
+}
+
+// FNV-1a
+uint32_t MqttTopicMatcher::hash(const char* str) {
+  uint32_t h = 2166136261u;
+
+  while (*str != 0) {
+    h ^= static_cast<uint8_t>(*str++);
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+// Same as parseInt<uint16_t>, but doesn't need a String
+uint16_t MqttTopicMatcher::parseId(const char* str) {
+  if (str[0] == '0' && str[1] == 'x') {
+    return strToHex<uint16_t>(str + 2, strlen(str + 2));
+  } else {
+    return atoi(str);
+  }
+}
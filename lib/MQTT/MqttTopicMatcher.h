@@ -0,0 +1,80 @@
+/**
+ * Matches incoming MQTT command topics against mqtt_topic_pattern.
+ *
+ * The pattern is compiled once into a list of token slots, one per topic
+ * segment.  Matching a topic walks its segments and binds the ones that line
+ * up with a token, without allocating.  Aliases are resolved through a hashed
+ * index built at the same time.
+ */
+
+#include <Arduino.h>
+#include <Settings.h>
+#include <GroupAlias.h>
+#include <MiLightRemoteConfig.h>
+#include <vector>
+
+#ifndef MQTT_MAX_TOPIC_SEGMENTS
+#define MQTT_MAX_TOPIC_SEGMENTS 16
+#endif
+
+#ifndef _MQTT_TOPIC_MATCHER_H
+#define _MQTT_TOPIC_MATCHER_H
+
+class MqttTopicMatcher {
+public:
+  enum class Token : uint8_t {
+    NONE,
+    DEVICE_ID,
+    HEX_DEVICE_ID,
+    DEC_DEVICE_ID,
+    GROUP_ID,
+    DEVICE_TYPE,
+    DEVICE_ALIAS,
+    NUM_TOKENS
+  };
+
+  enum class MatchResult : uint8_t {
+    OK,
+    UNKNOWN_ALIAS,
+    UNKNOWN_DEVICE_TYPE
+  };
+
+  MqttTopicMatcher(Settings& settings);
+
+  // Re-reads mqtt_topic_pattern and the aliases from settings
+  void compile();
+
+  // Binds the tokens in topic and resolves them to a bulb.  Topic is modified
+  // in place (segment separators are replaced with NULs).
+  //
+  // The device type defaults to FUT092 if the topic doesn't bind
+  // :device_type.  On UNKNOWN_ALIAS, boundAlias points at the alias
+  // that couldn't be found.
+  MatchResult match(char* topic, uint16_t& deviceId, uint8_t& groupId, const MiLightRemoteConfig*& config, const char*& boundAlias) const;
+
+  bool hasToken(Token token) const;
+  const GroupAlias* findAlias(const char* alias) const;
+
+private:
+  struct AliasIndexEntry {
+    uint32_t hash;
+    const GroupAlias* alias;
+  };
+
+  Settings& settings;
+
+  Token segments[MQTT_MAX_TOPIC_SEGMENTS];
+  size_t numSegments;
+  uint8_t tokenMask;
+
+  // Open addressing, sized to a power of two at least twice the number of aliases
+  std::vector<AliasIndexEntry> aliasIndex;
+
+  void compilePattern();
+  void compileAliases();
+
+  static uint32_t hash(const char* str);
+  static uint16_t parseId(const char* str);
+};
+
+#endif
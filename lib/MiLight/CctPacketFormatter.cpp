@@ -3,8 +3,8 @@
 
 static const uint8_t CCT_PROTOCOL_ID = 0x5A;
 
-bool CctPacketFormatter::canHandle(const uint8_t *packet, const size_t len) {
-  return len == packetLength && packet[0] == CCT_PROTOCOL_ID;
+PacketSignature CctPacketFormatter::getPacketSignature() const {
+  return PacketSignature{false, 0, 0xFF, CCT_PROTOCOL_ID};
 }
 
 void CctPacketFormatter::initializePacket(uint8_t* packet) {
@@ -42,14 +42,20 @@ void CctPacketFormatter::finalizePacket(uint8_t* packet) {
   // Calculate checksum over packet length .. sequenceNum
   checksum = 7; // Packet length is not part of packet
   for (uint8_t i = 0; i < 6; i++) {
-    checksum += currentPacket[i];
+    checksum += packet[i];
   }
   // Store the checksum in the sixth byte
-  currentPacket[6] = checksum;
+  packet[6] = checksum;
+}
+
+// The checksum covers the sequence number
+void CctPacketFormatter::stampSequenceNum(uint8_t* packet) {
+  packet[5] = sequenceNum++;
+  finalizePacket(packet);
 }
 
 void CctPacketFormatter::updateBrightness(uint8_t value) {
-  const GroupState* state = this->stateStore->get(deviceId, groupId, MiLightRemoteType::REMOTE_TYPE_CCT);
+  const GroupState* state = knownState();
   int8_t knownValue = (state != NULL && state->isSetBrightness()) ? state->getBrightness() / CCT_INTERVALS : -1;
 
   valueByStepFunction(
@@ -62,7 +68,7 @@ void CctPacketFormatter::updateBrightness(uint8_t value) {
 }
 
 void CctPacketFormatter::updateTemperature(uint8_t value) {
-  const GroupState* state = this->stateStore->get(deviceId, groupId, MiLightRemoteType::REMOTE_TYPE_CCT);
+  const GroupState* state = knownState();
   int8_t knownValue = (state != NULL && state->isSetKelvin()) ? state->getKelvin() / CCT_INTERVALS : -1;
 
   valueByStepFunction(
@@ -29,7 +29,7 @@ public:
     : PacketFormatter(REMOTE_TYPE_CCT, 7, 20)
   { }
 
-  virtual bool canHandle(const uint8_t* packet, const size_t len);
+  virtual PacketSignature getPacketSignature() const;
 
   virtual void updateStatus(MiLightStatus status, uint8_t groupId);
   virtual void command(uint8_t command, uint8_t arg);
@@ -46,6 +46,7 @@ public:
   virtual void format(uint8_t const* packet, char* buffer);
   virtual void initializePacket(uint8_t* packet);
   virtual void finalizePacket(uint8_t* packet);
+  virtual void stampSequenceNum(uint8_t* packet);
   virtual BulbId parsePacket(const uint8_t* packet, JsonObject result);
 
   static uint8_t getCctStatusButton(uint8_t groupId, MiLightStatus status);
@@ -21,7 +21,7 @@ void FUT020PacketFormatter::nextMode() {
 }
 
 void FUT020PacketFormatter::updateBrightness(uint8_t value) {
-  const GroupState* state = this->stateStore->get(deviceId, groupId, MiLightRemoteType::REMOTE_TYPE_FUT020);
+  const GroupState* state = knownState();
   int8_t knownValue = (state != NULL && state->isSetBrightness())
     ? state->getBrightness() / FUT02xPacketFormatter::NUM_BRIGHTNESS_INTERVALS
     : -1;
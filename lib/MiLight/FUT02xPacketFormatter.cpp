@@ -16,17 +16,27 @@ void FUT02xPacketFormatter::initializePacket(uint8_t *packet) {
   packet[packetPtr++] = sequenceNum++;
 }
 
-bool FUT02xPacketFormatter::canHandle(const uint8_t* packet, const size_t len) {
-  return len == packetLength && packet[0] == FUT02X_PACKET_HEADER;
+void FUT02xPacketFormatter::stampSequenceNum(uint8_t* packet) {
+  packet[5] = sequenceNum++;
+}
+
+PacketSignature FUT02xPacketFormatter::getPacketSignature() const {
+  return PacketSignature{false, 0, 0xFF, FUT02X_PACKET_HEADER};
+}
+
+bool FUT02xPacketFormatter::supportsTemplates() const {
+  return true;
 }
 
 void FUT02xPacketFormatter::command(uint8_t command, uint8_t arg) {
-  pushPacket();
-  if (held) {
-    command |= 0x10;
+  if (pushTemplate(command, arg)) {
+    return;
   }
-  currentPacket[FUT02X_COMMAND_INDEX] = command;
+
+  pushPacket();
+  currentPacket[FUT02X_COMMAND_INDEX] = held ? (command | 0x10) : command;
   currentPacket[FUT02X_ARGUMENT_INDEX] = arg;
+  saveTemplate(command, arg);
 }
 
 void FUT02xPacketFormatter::pair() {
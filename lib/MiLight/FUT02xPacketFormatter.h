@@ -12,7 +12,7 @@ public:
     : PacketFormatter(type, 6, 10)
   { }
 
-  virtual bool canHandle(const uint8_t* packet, const size_t len) override;
+  virtual PacketSignature getPacketSignature() const override;
 
   virtual void command(uint8_t command, uint8_t arg) override;
 
@@ -20,5 +20,7 @@ public:
   virtual void unpair() override;
 
   virtual void initializePacket(uint8_t* packet) override;
+  virtual void stampSequenceNum(uint8_t* packet) override;
+  virtual bool supportsTemplates() const override;
   virtual void format(uint8_t const* packet, char* buffer) override;
 };
\ No newline at end of file
@@ -3,6 +3,11 @@
 #include <Units.h>
 #include <MiLightCommands.h>
 
+void FUT089PacketFormatter::prepare(uint16_t deviceId, uint8_t groupId) {
+  V2PacketFormatter::prepare(deviceId, groupId);
+  colorSent = false;
+}
+
 void FUT089PacketFormatter::modeSpeedDown() {
   command(FUT089_ON, FUT089_MODE_SPEED_DOWN);
 }
@@ -27,6 +32,7 @@ void FUT089PacketFormatter::updateHue(uint16_t value) {
 
 void FUT089PacketFormatter::updateColorRaw(uint8_t value) {
   command(FUT089_COLOR, FUT089_COLOR_OFFSET + value);
+  colorSent = true;
 }
 
 // change the temperature (kelvin).  Note that temperature and saturation share the same command
@@ -35,7 +41,7 @@ void FUT089PacketFormatter::updateColorRaw(uint8_t value) {
 // back to the original mode.
 void FUT089PacketFormatter::updateTemperature(uint8_t value) {
   // look up our current mode
-  const GroupState* ourState = this->stateStore->get(this->deviceId, this->groupId, REMOTE_TYPE_FUT089);
+  const GroupState* ourState = knownState();
   BulbMode originalBulbMode;
 
   if (ourState != NULL) {
@@ -45,6 +51,9 @@ void FUT089PacketFormatter::updateTemperature(uint8_t value) {
     if (originalBulbMode != BulbMode::BULB_MODE_WHITE) {
       updateColorWhite();
     }
+  } else if (stateless) {
+    // The bulb could be in color mode, where this command changes saturation
+    updateColorWhite();
   }
 
   // now make the temperature change
@@ -62,11 +71,16 @@ void FUT089PacketFormatter::updateTemperature(uint8_t value) {
 // and switch back to the original mode.
 void FUT089PacketFormatter::updateSaturation(uint8_t value) {
   // look up our current mode
-  const GroupState* ourState = this->stateStore->get(this->deviceId, this->groupId, REMOTE_TYPE_FUT089);
+  const GroupState* ourState = knownState();
   BulbMode originalBulbMode = BulbMode::BULB_MODE_WHITE;
 
   if (ourState != NULL) {
     originalBulbMode = ourState->getBulbMode();
+  } else if (stateless && !colorSent) {
+    // The bulb could be in white mode, where this command changes the
+    // temperature.  Switching to color mode needs a hue, so only send
+    // saturation after one.
+    return;
   }
 
   // are we already in color?  If not, we need to flip modes
@@ -85,6 +99,7 @@ void FUT089PacketFormatter::updateSaturation(uint8_t value) {
 
 void FUT089PacketFormatter::updateColorWhite() {
   command(FUT089_ON, FUT089_WHITE_MODE);
+  colorSent = false;
 }
 
 void FUT089PacketFormatter::enableNightMode() {
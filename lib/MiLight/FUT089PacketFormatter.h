@@ -24,9 +24,12 @@ enum MiLightFUT089Arguments {
 class FUT089PacketFormatter : public V2PacketFormatter {
 public:
   FUT089PacketFormatter()
-    : V2PacketFormatter(REMOTE_TYPE_FUT089, 0x25, 8)    // protocol is 0x25, and there are 8 groups
+    : V2PacketFormatter(REMOTE_TYPE_FUT089, 0x25, 8),    // protocol is 0x25, and there are 8 groups
+      colorSent(false)
   { }
 
+  virtual void prepare(uint16_t deviceId, uint8_t groupId);
+
   virtual void updateBrightness(uint8_t value);
   virtual void updateHue(uint16_t value);
   virtual void updateColorRaw(uint8_t value);
@@ -40,6 +43,11 @@ public:
   virtual void updateMode(uint8_t mode);
 
   virtual BulbId parsePacket(const uint8_t* packet, JsonObject result);
+
+private:
+  // Whether a color has been sent since prepare(), which puts the bulb in
+  // color mode.  Used in stateless mode, where the bulb mode isn't known.
+  bool colorSent;
 };
 
 #endif
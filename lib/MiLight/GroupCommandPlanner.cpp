@@ -0,0 +1,121 @@
+#include <GroupCommandPlanner.h>
+#include <GroupStateField.h>
+#include <MiLightRemoteConfig.h>
+
+void GroupCommandPlanner::add(const BulbId& bulbId, const LightCommand& command, JsonObject request) {
+  updates.push_back(Update{bulbId, command, request});
+}
+
+void GroupCommandPlanner::clear() {
+  updates.clear();
+}
+
+size_t GroupCommandPlanner::size() const {
+  return updates.size();
+}
+
+bool GroupCommandPlanner::hasJsonOnlyCommands(JsonObject request) {
+  return !request.isNull()
+    && (request.containsKey(GroupStateFieldNames::COMMAND)
+      || request.containsKey(GroupStateFieldNames::COMMANDS)
+      || request.containsKey("button_id"));
+}
+
+bool GroupCommandPlanner::canCollapse(const Update& update) const {
+  return update.bulbId.groupId != 0
+    && !update.command.isEmpty()
+    && update.command.transition == 0
+    && !hasJsonOnlyCommands(update.request);
+}
+
+GroupCommandPlanner::Result GroupCommandPlanner::run(CommandHandler handler) {
+  std::vector<Plan> plan(updates.size(), Plan::SEND);
+  std::vector<bool> planned(updates.size(), false);
+
+  for (size_t i = 0; i < updates.size(); ++i) {
+    if (planned[i]) {
+      continue;
+    }
+
+    planDevice(i, plan);
+
+    for (size_t j = i; j < updates.size(); ++j) {
+      if (updates[j].bulbId.deviceId == updates[i].bulbId.deviceId
+        && updates[j].bulbId.deviceType == updates[i].bulbId.deviceType) {
+        planned[j] = true;
+      }
+    }
+  }
+
+  Result result = {0, 0, 0};
+
+  for (size_t i = 0; i < updates.size(); ++i) {
+    const Update& update = updates[i];
+
+    if (plan[i] == Plan::SKIP) {
+      continue;
+    }
+
+    ++result.commands;
+
+    if (plan[i] == Plan::SEND) {
+      handler(update.bulbId, update.command, update.request);
+    } else {
+      const size_t numGroups = MiLightRemoteConfig::fromType(update.bulbId.deviceType)->numGroups;
+      const BulbId group0(update.bulbId.deviceId, 0, update.bulbId.deviceType);
+      const size_t packets = handler(group0, update.command, update.request);
+
+      result.collapsedUpdates += numGroups;
+      result.packetsSaved += packets * (numGroups - 1);
+    }
+  }
+
+  updates.clear();
+  return result;
+}
+
+void GroupCommandPlanner::planDevice(size_t first, std::vector<Plan>& plan) const {
+  const Update& firstUpdate = updates[first];
+  const MiLightRemoteConfig* remote = MiLightRemoteConfig::fromType(firstUpdate.bulbId.deviceType);
+
+  // Remotes without groups only have group 0 already
+  if (remote == nullptr || remote->numGroups < 2) {
+    return;
+  }
+
+  // Groups are numbered from 1
+  uint32_t groupsSeen = 0;
+  size_t numUpdates = 0;
+
+  for (size_t i = first; i < updates.size(); ++i) {
+    const Update& update = updates[i];
+
+    if (update.bulbId.deviceId != firstUpdate.bulbId.deviceId
+      || update.bulbId.deviceType != firstUpdate.bulbId.deviceType) {
+      continue;
+    }
+
+    if (update.bulbId.groupId > remote->numGroups
+      || (groupsSeen & (1ul << update.bulbId.groupId)) != 0
+      || !canCollapse(update)
+      || !(update.command == firstUpdate.command)) {
+      return;
+    }
+
+    groupsSeen |= 1ul << update.bulbId.groupId;
+    ++numUpdates;
+  }
+
+  if (numUpdates != remote->numGroups) {
+    return;
+  }
+
+  for (size_t i = first; i < updates.size(); ++i) {
+    if (updates[i].bulbId.deviceId == firstUpdate.bulbId.deviceId
+      && updates[i].bulbId.deviceType == firstUpdate.bulbId.deviceType) {
+      plan[i] = Plan::SKIP;
+    }
+  }
+
+  plan[first] = Plan::SEND_GROUP_0;
+}
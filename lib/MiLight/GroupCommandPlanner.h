@@ -0,0 +1,70 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <BulbId.h>
+#include <LightCommand.h>
+#include <functional>
+#include <vector>
+
+/**
+ * Plans the commands for a batch of updates.  Group 0 addresses every group
+ * paired with a device ID, so when a batch gives each of those groups the
+ * same update, a single group 0 command does the job of one per group.
+ *
+ * A device ID is collapsed only if the batch has exactly one update for each
+ * of its groups and none for group 0.  None of its updates can then depend on
+ * another, so the group 0 command can go where the first of them was.
+ *
+ * Updates with transitions are left alone, since transitions start from each
+ * group's own state.  So are updates with commands only JSON carries
+ * (command, commands, raw button presses).
+ */
+class GroupCommandPlanner {
+public:
+  // Sends a command and returns the number of packets it queued
+  typedef std::function<size_t(const BulbId& bulbId, const LightCommand& command, JsonObject request)> CommandHandler;
+
+  struct Result {
+    // Commands sent
+    size_t commands;
+    // Updates replaced by group 0 commands
+    size_t collapsedUpdates;
+    // Packets the collapsed updates would have queued over the group 0
+    // commands that replaced them
+    size_t packetsSaved;
+  };
+
+  // request is kept for commands only JSON carries, and must outlive run()
+  void add(const BulbId& bulbId, const LightCommand& command, JsonObject request = JsonObject());
+
+  // Sends the planned commands in the order their updates were added, then
+  // clears the plan
+  Result run(CommandHandler handler);
+
+  void clear();
+  size_t size() const;
+
+  // True if request has keys that don't map to a LightCommand
+  static bool hasJsonOnlyCommands(JsonObject request);
+
+private:
+  struct Update {
+    BulbId bulbId;
+    LightCommand command;
+    JsonObject request;
+  };
+
+  enum class Plan : uint8_t {
+    SEND,
+    // Send to group 0 in place of all of the device ID's updates
+    SEND_GROUP_0,
+    // Covered by a group 0 command
+    SKIP
+  };
+
+  std::vector<Update> updates;
+
+  bool canCollapse(const Update& update) const;
+  // Plans the updates for the device ID of updates[first], the first one for it
+  void planDevice(size_t first, std::vector<Plan>& plan) const;
+};
@@ -0,0 +1,305 @@
+#include <LightCommand.h>
+#include <MiLightCommands.h>
+
+// Keys in an update request which are state fields.  Sorted by name so a
+// request's keys can be looked up with a binary search.
+struct FieldParser {
+  const char* name;
+  void (*parse)(LightCommand& command, JsonVariant value);
+};
+
+static void parseBrightness(LightCommand& command, JsonVariant value) {
+  command.setBrightness(value.as<uint16_t>());
+}
+
+static void parseColor(LightCommand& command, JsonVariant value) {
+  command.setColor(ParsedColor::fromJson(value));
+}
+
+static void parseColorTemp(LightCommand& command, JsonVariant value) {
+  command.setColorTemp(value.as<uint16_t>());
+}
+
+static void parseEffect(LightCommand& command, JsonVariant value) {
+  const char* effect = value.as<const char*>();
+
+  if (effect != nullptr && strcmp(effect, MiLightCommandNames::NIGHT_MODE) == 0) {
+    command.fields |= LightCommand::NIGHT_MODE;
+  } else if (effect != nullptr && (strcmp(effect, "white") == 0 || strcmp(effect, "white_mode") == 0)) {
+    command.fields |= LightCommand::WHITE_MODE;
+  } else { // assume we're trying to set mode
+    command.setMode(value.as<String>().toInt());
+  }
+}
+
+static void parseHue(LightCommand& command, JsonVariant value) {
+  command.setHue(value.as<uint16_t>());
+}
+
+static void parseLevel(LightCommand& command, JsonVariant value) {
+  command.setLevel(value.as<uint8_t>());
+}
+
+// update() used to send "mode" and then "effect", so a numeric effect takes
+// precedence if a request has both
+static void parseMode(LightCommand& command, JsonVariant value) {
+  if (!command.has(LightCommand::MODE)) {
+    command.setMode(value.as<uint8_t>());
+  }
+}
+
+static void parseSaturation(LightCommand& command, JsonVariant value) {
+  command.setSaturation(value.as<uint8_t>());
+}
+
+// "status" takes precedence over "state" if a request has both
+static void parseState(LightCommand& command, JsonVariant value) {
+  if (!command.has(LightCommand::STATUS)) {
+    command.setStatus(parseMilightStatus(value));
+  }
+}
+
+static void parseStatus(LightCommand& command, JsonVariant value) {
+  command.setStatus(parseMilightStatus(value));
+}
+
+// "kelvin" and "temperature" are the same field.  update() used to send
+// "kelvin" and then "temperature", so "temperature" takes precedence.
+static void parseKelvin(LightCommand& command, JsonVariant value) {
+  if (!command.has(LightCommand::KELVIN)) {
+    command.setKelvin(value.as<uint8_t>());
+  }
+}
+
+static void parseTemperature(LightCommand& command, JsonVariant value) {
+  command.setKelvin(value.as<uint8_t>());
+}
+
+static void parseTransition(LightCommand& command, JsonVariant value) {
+  if (value.is<float>()) {
+    command.setTransition(value.as<float>());
+  } else if (value.is<size_t>()) {
+    command.setTransition(value.as<size_t>());
+  } else {
+    Serial.println(F("LightCommand - WARN: unsupported transition type.  Must be float or int."));
+  }
+}
+
+static constexpr FieldParser FIELD_PARSERS[] = {
+  {GroupStateFieldNames::BRIGHTNESS,  &parseBrightness},
+  {GroupStateFieldNames::COLOR,       &parseColor},
+  {GroupStateFieldNames::COLOR_TEMP,  &parseColorTemp},
+  {GroupStateFieldNames::EFFECT,      &parseEffect},
+  {GroupStateFieldNames::HUE,         &parseHue},
+  {GroupStateFieldNames::KELVIN,      &parseKelvin},
+  {GroupStateFieldNames::LEVEL,       &parseLevel},
+  {GroupStateFieldNames::MODE,        &parseMode},
+  {GroupStateFieldNames::SATURATION,  &parseSaturation},
+  {GroupStateFieldNames::STATE,       &parseState},
+  {GroupStateFieldNames::STATUS,      &parseStatus},
+  {GroupStateFieldNames::TEMPERATURE, &parseTemperature},
+  {RequestKeys::TRANSITION,           &parseTransition}
+};
+static constexpr size_t NUM_FIELD_PARSERS = sizeof(FIELD_PARSERS) / sizeof(FIELD_PARSERS[0]);
+
+static constexpr int compareNames(const char* a, const char* b) {
+  return (*a != *b || *a == 0) ? (*a - *b) : compareNames(a + 1, b + 1);
+}
+
+static constexpr bool isParserTableValid(size_t ix) {
+  return ix + 1 >= NUM_FIELD_PARSERS
+    || (compareNames(FIELD_PARSERS[ix].name, FIELD_PARSERS[ix + 1].name) < 0
+        && isParserTableValid(ix + 1));
+}
+
+static_assert(isParserTableValid(0), "FIELD_PARSERS must be sorted by name");
+
+static const FieldParser* findFieldParser(const char* name) {
+  size_t lo = 0;
+  size_t hi = NUM_FIELD_PARSERS;
+
+  while (lo < hi) {
+    const size_t mid = (lo + hi) / 2;
+    const int cmp = strcmp(name, FIELD_PARSERS[mid].name);
+
+    if (cmp == 0) {
+      return &FIELD_PARSERS[mid];
+    } else if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  return nullptr;
+}
+
+LightCommand::LightCommand()
+  : fields(0)
+  , status(OFF)
+  , hue(0)
+  , saturation(0)
+  , kelvin(0)
+  , colorTemp(0)
+  , mode(0)
+  , color()
+  , level(0)
+  , brightness(0)
+  , transition(0)
+{ }
+
+bool LightCommand::has(Field field) const {
+  return (fields & field) != 0;
+}
+
+bool LightCommand::isEmpty() const {
+  return fields == 0;
+}
+
+bool LightCommand::operator==(const LightCommand& other) const {
+  return fields == other.fields
+    && transition == other.transition
+    && (!has(STATUS) || status == other.status)
+    && (!has(HUE) || hue == other.hue)
+    && (!has(SATURATION) || saturation == other.saturation)
+    && (!has(KELVIN) || kelvin == other.kelvin)
+    && (!has(COLOR_TEMP) || colorTemp == other.colorTemp)
+    && (!has(MODE) || mode == other.mode)
+    && (!has(COLOR) || (color.success == other.color.success
+      && color.hue == other.color.hue
+      && color.saturation == other.color.saturation
+      && color.r == other.color.r
+      && color.g == other.color.g
+      && color.b == other.color.b))
+    && (!has(LEVEL) || level == other.level)
+    && (!has(BRIGHTNESS) || brightness == other.brightness);
+}
+
+LightCommand& LightCommand::setStatus(MiLightStatus status) {
+  this->status = status;
+  fields |= STATUS;
+  return *this;
+}
+
+LightCommand& LightCommand::setHue(uint16_t hue) {
+  this->hue = hue;
+  fields |= HUE;
+  return *this;
+}
+
+LightCommand& LightCommand::setSaturation(uint8_t saturation) {
+  this->saturation = saturation;
+  fields |= SATURATION;
+  return *this;
+}
+
+LightCommand& LightCommand::setKelvin(uint8_t kelvin) {
+  this->kelvin = kelvin;
+  fields |= KELVIN;
+  return *this;
+}
+
+LightCommand& LightCommand::setColorTemp(uint16_t colorTemp) {
+  this->colorTemp = colorTemp;
+  fields |= COLOR_TEMP;
+  return *this;
+}
+
+LightCommand& LightCommand::setMode(uint8_t mode) {
+  this->mode = mode;
+  fields |= MODE;
+  return *this;
+}
+
+LightCommand& LightCommand::setColor(const ParsedColor& color) {
+  this->color = color;
+  fields |= COLOR;
+  return *this;
+}
+
+LightCommand& LightCommand::setLevel(uint8_t level) {
+  this->level = level;
+  fields |= LEVEL;
+  return *this;
+}
+
+LightCommand& LightCommand::setBrightness(uint8_t brightness) {
+  this->brightness = brightness;
+  fields |= BRIGHTNESS;
+  return *this;
+}
+
+LightCommand& LightCommand::setTransition(float transition) {
+  this->transition = transition;
+  return *this;
+}
+
+bool LightCommand::set(GroupStateField field, uint16_t value) {
+  switch (field) {
+    case GroupStateField::STATE:
+    case GroupStateField::STATUS:
+      setStatus(static_cast<MiLightStatus>(value));
+      return true;
+    case GroupStateField::BRIGHTNESS:
+      setBrightness(value);
+      return true;
+    case GroupStateField::COLOR_TEMP:
+      setColorTemp(value);
+      return true;
+    case GroupStateField::HUE:
+      setHue(value);
+      return true;
+    case GroupStateField::KELVIN:
+      setKelvin(value);
+      return true;
+    case GroupStateField::LEVEL:
+      setLevel(value);
+      return true;
+    case GroupStateField::MODE:
+      setMode(value);
+      return true;
+    case GroupStateField::SATURATION:
+      setSaturation(value);
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint16_t LightCommand::get(GroupStateField field) const {
+  switch (field) {
+    case GroupStateField::STATE:
+    case GroupStateField::STATUS:
+      return status;
+    case GroupStateField::BRIGHTNESS:
+      return brightness;
+    case GroupStateField::COLOR_TEMP:
+      return colorTemp;
+    case GroupStateField::HUE:
+      return hue;
+    case GroupStateField::KELVIN:
+      return kelvin;
+    case GroupStateField::LEVEL:
+      return level;
+    case GroupStateField::MODE:
+      return mode;
+    case GroupStateField::SATURATION:
+      return saturation;
+    default:
+      return 0;
+  }
+}
+
+LightCommand LightCommand::fromJson(JsonObject request) {
+  LightCommand command;
+
+  for (JsonPair kv : request) {
+    const FieldParser* parser = findFieldParser(kv.key().c_str());
+
+    if (parser != nullptr) {
+      parser->parse(command, kv.value());
+    }
+  }
+
+  return command;
+}
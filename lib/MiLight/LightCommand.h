@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <GroupStateField.h>
+#include <MiLightStatus.h>
+#include <ParsedColor.h>
+
+namespace RequestKeys {
+  static constexpr char TRANSITION[] = "transition";
+};
+
+/**
+ * A state update for a bulb, without JSON.  `fields` says which values are
+ * set.
+ *
+ * Bits are declared in the order MiLightClient applies them.  Level and
+ * brightness come last because they're specific to a bulb mode, so the mode
+ * has to be set first.  Status is handled separately: on is applied before
+ * everything else and off after.
+ */
+struct LightCommand {
+  enum Field : uint16_t {
+    STATUS     = 1 << 0,
+    HUE        = 1 << 1,
+    SATURATION = 1 << 2,
+    KELVIN     = 1 << 3,
+    COLOR_TEMP = 1 << 4,
+    MODE       = 1 << 5,
+    NIGHT_MODE = 1 << 6,
+    WHITE_MODE = 1 << 7,
+    COLOR      = 1 << 8,
+    LEVEL      = 1 << 9,
+    BRIGHTNESS = 1 << 10
+  };
+
+  uint16_t fields;
+
+  MiLightStatus status;
+  uint16_t hue;
+  uint8_t saturation;
+  // 0-100
+  uint8_t kelvin;
+  // Mireds
+  uint16_t colorTemp;
+  uint8_t mode;
+  ParsedColor color;
+  // 0-100
+  uint8_t level;
+  // 0-255
+  uint8_t brightness;
+
+  // Seconds.  Zero applies the fields straight away.
+  float transition;
+
+  LightCommand();
+
+  bool has(Field field) const;
+  bool isEmpty() const;
+  // Same fields set to the same values.  Values of unset fields are ignored.
+  bool operator==(const LightCommand& other) const;
+
+  LightCommand& setStatus(MiLightStatus status);
+  LightCommand& setHue(uint16_t hue);
+  LightCommand& setSaturation(uint8_t saturation);
+  LightCommand& setKelvin(uint8_t kelvin);
+  LightCommand& setColorTemp(uint16_t colorTemp);
+  LightCommand& setMode(uint8_t mode);
+  LightCommand& setColor(const ParsedColor& color);
+  LightCommand& setLevel(uint8_t level);
+  LightCommand& setBrightness(uint8_t brightness);
+  LightCommand& setTransition(float transition);
+
+  // Sets a field by the value a transition emits for it.  Returns false if
+  // the field can't be represented.
+  bool set(GroupStateField field, uint16_t value);
+  // Inverse of set().  Returns 0 for fields that aren't numeric.
+  uint16_t get(GroupStateField field) const;
+
+  // Parses the fields of an update request.  Keys that aren't state fields
+  // (commands, raw packets) are left for the caller.
+  static LightCommand fromJson(JsonObject request);
+};
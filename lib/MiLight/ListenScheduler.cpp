@@ -0,0 +1,115 @@
+#include <ListenScheduler.h>
+#include <MiLightRadioConfig.h>
+
+ListenScheduler::ListenScheduler(
+  RadioSwitchboard& radioSwitchboard,
+  PacketHandler packetHandler,
+  size_t listenerIx,
+  size_t numListeners
+) : radioSwitchboard(radioSwitchboard)
+  , packetHandler(packetHandler)
+  , dwellRemaining(0)
+  , dwellElapsed(0)
+{
+  for (size_t i = listenerIx; i < radioSwitchboard.getNumRadios(); i += numListeners) {
+    configs.push_back(i);
+  }
+
+  stats.resize(configs.size(), ConfigStats{0, 0});
+  weights.resize(configs.size(), 0);
+
+  // Start on the last config so that the first advance() moves to the first one
+  currentConfig = configs.size() - 1;
+}
+
+void ListenScheduler::listen(size_t repeats) {
+  if (configs.empty()) {
+    return;
+  }
+
+  if (dwellRemaining == 0 || dwellElapsed >= MILIGHT_LISTEN_MAX_DWELL) {
+    advance();
+  }
+
+  --dwellRemaining;
+  ++dwellElapsed;
+  ++stats[currentConfig].listens;
+
+  std::shared_ptr<MiLightRadio> radio = radioSwitchboard.switchRadio(configs[currentConfig]);
+
+  for (size_t i = 0; i < repeats; i++) {
+    if (radioSwitchboard.available()) {
+      uint8_t readPacket[MILIGHT_MAX_PACKET_LENGTH];
+      size_t packetLen = radioSwitchboard.read(readPacket);
+
+      const MiLightRemoteConfig* remoteConfig = MiLightRemoteConfig::fromReceivedPacket(
+        radio->config(),
+        readPacket,
+        packetLen
+      );
+
+      if (remoteConfig == NULL) {
+        // This can happen under normal circumstances, so not an error condition
+#ifdef DEBUG_PRINTF
+        Serial.println(F("WARNING: Couldn't find remote for received packet"));
+#endif
+        return;
+      }
+
+      recordHit();
+
+      // update state to reflect this packet
+      packetHandler(readPacket, *remoteConfig);
+    }
+  }
+}
+
+RadioSwitchboard& ListenScheduler::getRadioSwitchboard() {
+  return radioSwitchboard;
+}
+
+size_t ListenScheduler::getNumConfigs() const {
+  return configs.size();
+}
+
+size_t ListenScheduler::getConfigIndex(size_t ix) const {
+  return configs[ix];
+}
+
+const ListenScheduler::ConfigStats& ListenScheduler::getStats(size_t ix) const {
+  return stats[ix];
+}
+
+void ListenScheduler::advance() {
+  currentConfig = (currentConfig + 1) % weights.size();
+
+  // Decay once per round so that weights track recent traffic
+  if (currentConfig == 0) {
+    for (uint16_t& weight : weights) {
+      weight -= weight >> WEIGHT_DECAY_SHIFT;
+    }
+  }
+
+  uint32_t totalWeight = 0;
+  for (uint16_t weight : weights) {
+    totalWeight += weight;
+  }
+
+  dwellRemaining = MILIGHT_LISTEN_MIN_DWELL;
+  dwellElapsed = 0;
+
+  if (totalWeight > 0) {
+    dwellRemaining += (static_cast<uint32_t>(weights[currentConfig]) * MILIGHT_LISTEN_EXTRA_DWELL) / totalWeight;
+  }
+}
+
+void ListenScheduler::recordHit() {
+  uint16_t& weight = weights[currentConfig];
+
+  ++stats[currentConfig].hits;
+  weight = weight > UINT16_MAX - HIT_WEIGHT ? UINT16_MAX : weight + HIT_WEIGHT;
+
+  if (dwellRemaining < MILIGHT_LISTEN_HIT_DWELL) {
+    dwellRemaining = MILIGHT_LISTEN_HIT_DWELL;
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <RadioSwitchboard.h>
+#include <MiLightRemoteConfig.h>
+#include <functional>
+#include <vector>
+
+// Number of loops spent listening on a radio config each time it comes up,
+// regardless of traffic.
+#ifndef MILIGHT_LISTEN_MIN_DWELL
+#define MILIGHT_LISTEN_MIN_DWELL 2
+#endif
+
+// Additional loops shared out between radio configs in proportion to how
+// many packets have recently been heard on each
+#ifndef MILIGHT_LISTEN_EXTRA_DWELL
+#define MILIGHT_LISTEN_EXTRA_DWELL 32
+#endif
+
+// Remotes send bursts of repeated packets.  After hearing a packet, stay on
+// the config for at least this many more loops.
+#ifndef MILIGHT_LISTEN_HIT_DWELL
+#define MILIGHT_LISTEN_HIT_DWELL 8
+#endif
+
+// Cap on consecutive loops spent on one config.  Bounds how long other
+// configs go unsampled.
+#ifndef MILIGHT_LISTEN_MAX_DWELL
+#define MILIGHT_LISTEN_MAX_DWELL 64
+#endif
+
+/**
+ * Decides which radio config to listen on.  Configs are visited round-robin,
+ * but the number of loops spent on each depends on its recent hit rate, so
+ * busy configs are listened to more and the radio is reconfigured less often.
+ *
+ * When there are several radios dedicated to listening, each gets its own
+ * scheduler and the configs are split between them: listener i of n takes
+ * configs i, i + n, i + 2n, ...
+ */
+class ListenScheduler {
+public:
+  typedef std::function<void(uint8_t* packet, const MiLightRemoteConfig& config)> PacketHandler;
+
+  struct ConfigStats {
+    uint32_t listens;
+    uint32_t hits;
+  };
+
+  ListenScheduler(
+    RadioSwitchboard& radioSwitchboard,
+    PacketHandler packetHandler,
+    size_t listenerIx = 0,
+    size_t numListeners = 1
+  );
+
+  // Listens on the scheduled radio config, reading up to `repeats` packets
+  void listen(size_t repeats);
+
+  RadioSwitchboard& getRadioSwitchboard();
+
+  // Number of configs this scheduler listens on.  getConfigIndex maps these
+  // to indexes in the RadioSwitchboard.
+  size_t getNumConfigs() const;
+  size_t getConfigIndex(size_t ix) const;
+  const ConfigStats& getStats(size_t ix) const;
+
+private:
+  // Each hit adds this to a config's weight.  Weights decay by 1/8 every round.
+  static const uint16_t HIT_WEIGHT = 256;
+  static const uint8_t WEIGHT_DECAY_SHIFT = 3;
+
+  RadioSwitchboard& radioSwitchboard;
+  PacketHandler packetHandler;
+
+  std::vector<size_t> configs;
+  std::vector<ConfigStats> stats;
+  std::vector<uint16_t> weights;
+
+  size_t currentConfig;
+  size_t dwellRemaining;
+  size_t dwellElapsed;
+
+  void advance();
+  void recordHit();
+};
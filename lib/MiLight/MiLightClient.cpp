@@ -13,56 +13,75 @@ using namespace std::placeholders;
 
 static const uint8_t STATUS_UNDEFINED = 255;
 
-const char* MiLightClient::FIELD_ORDERINGS[] = {
-  // These are handled manually
-  // GroupStateFieldNames::STATE,
-  // GroupStateFieldNames::STATUS,
-  GroupStateFieldNames::HUE,
-  GroupStateFieldNames::SATURATION,
-  GroupStateFieldNames::KELVIN,
-  GroupStateFieldNames::TEMPERATURE,
-  GroupStateFieldNames::COLOR_TEMP,
-  GroupStateFieldNames::MODE,
-  GroupStateFieldNames::EFFECT,
-  GroupStateFieldNames::COLOR,
-  // Level/Brightness must be processed last because they're specific to a particular bulb mode.
-  // So make sure bulb mode is set before applying level/brightness.
-  GroupStateFieldNames::LEVEL,
-  GroupStateFieldNames::BRIGHTNESS,
-  GroupStateFieldNames::COMMAND,
-  GroupStateFieldNames::COMMANDS
+// Fields of a LightCommand other than status, in the order they're applied
+struct FieldHandler {
+  LightCommand::Field bit;
+  // Field that's transitioned when the command has a transition.  UNKNOWN
+  // for fields that can only be applied directly.
+  GroupStateField field;
+  void (*setter)(MiLightClient* client, const LightCommand& command);
 };
 
-const std::map<const char*, std::function<void(MiLightClient*, JsonVariant)>, MiLightClient::cmp_str> MiLightClient::FIELD_SETTERS = {
-  {
-    GroupStateFieldNames::STATUS,
-    [](MiLightClient* client, JsonVariant val) {
-      client->updateStatus(parseMilightStatus(val));
-    }
-  },
-  {GroupStateFieldNames::LEVEL, &MiLightClient::updateBrightness},
-  {
-    GroupStateFieldNames::BRIGHTNESS,
-    [](MiLightClient* client, uint16_t arg) {
-      client->updateBrightness(Units::rescale<uint16_t, uint16_t>(arg, 100, 255));
-    }
-  },
-  {GroupStateFieldNames::HUE, &MiLightClient::updateHue},
-  {GroupStateFieldNames::SATURATION, &MiLightClient::updateSaturation},
-  {GroupStateFieldNames::KELVIN, &MiLightClient::updateTemperature},
-  {GroupStateFieldNames::TEMPERATURE, &MiLightClient::updateTemperature},
-  {
-    GroupStateFieldNames::COLOR_TEMP,
-    [](MiLightClient* client, uint16_t arg) {
-      client->updateTemperature(Units::miredsToWhiteVal(arg, 100));
-    }
-  },
-  {GroupStateFieldNames::MODE, &MiLightClient::updateMode},
-  {GroupStateFieldNames::COLOR, &MiLightClient::updateColor},
-  {GroupStateFieldNames::EFFECT, &MiLightClient::handleEffect},
-  {GroupStateFieldNames::COMMAND, &MiLightClient::handleCommand},
-  {GroupStateFieldNames::COMMANDS, &MiLightClient::handleCommands}
+static void setHue(MiLightClient* client, const LightCommand& command) {
+  client->updateHue(command.hue);
+}
+
+static void setSaturation(MiLightClient* client, const LightCommand& command) {
+  client->updateSaturation(command.saturation);
+}
+
+static void setKelvin(MiLightClient* client, const LightCommand& command) {
+  client->updateTemperature(command.kelvin);
+}
+
+static void setColorTemp(MiLightClient* client, const LightCommand& command) {
+  client->updateTemperature(Units::miredsToWhiteVal(command.colorTemp, 100));
+}
+
+static void setMode(MiLightClient* client, const LightCommand& command) {
+  client->updateMode(command.mode);
+}
+
+static void setNightMode(MiLightClient* client, const LightCommand&) {
+  client->enableNightMode();
+}
+
+static void setWhiteMode(MiLightClient* client, const LightCommand&) {
+  client->updateColorWhite();
+}
+
+static void setColor(MiLightClient* client, const LightCommand& command) {
+  client->updateColor(command.color);
+}
+
+static void setLevel(MiLightClient* client, const LightCommand& command) {
+  client->updateBrightness(command.level);
+}
+
+static void setBrightness(MiLightClient* client, const LightCommand& command) {
+  client->updateBrightness(Units::rescale<uint16_t, uint16_t>(command.brightness, 100, 255));
+}
+
+static constexpr FieldHandler FIELD_HANDLERS[] = {
+  {LightCommand::HUE,        GroupStateField::HUE,        &setHue},
+  {LightCommand::SATURATION, GroupStateField::SATURATION, &setSaturation},
+  {LightCommand::KELVIN,     GroupStateField::KELVIN,     &setKelvin},
+  {LightCommand::COLOR_TEMP, GroupStateField::COLOR_TEMP, &setColorTemp},
+  {LightCommand::MODE,       GroupStateField::MODE,       &setMode},
+  {LightCommand::NIGHT_MODE, GroupStateField::UNKNOWN,    &setNightMode},
+  {LightCommand::WHITE_MODE, GroupStateField::UNKNOWN,    &setWhiteMode},
+  {LightCommand::COLOR,      GroupStateField::COLOR,      &setColor},
+  {LightCommand::LEVEL,      GroupStateField::LEVEL,      &setLevel},
+  {LightCommand::BRIGHTNESS, GroupStateField::BRIGHTNESS, &setBrightness}
 };
+static constexpr size_t NUM_FIELD_HANDLERS = sizeof(FIELD_HANDLERS) / sizeof(FIELD_HANDLERS[0]);
+
+static constexpr bool isFieldTableOrdered(size_t ix) {
+  return ix + 1 >= NUM_FIELD_HANDLERS
+    || (FIELD_HANDLERS[ix].bit < FIELD_HANDLERS[ix + 1].bit && isFieldTableOrdered(ix + 1));
+}
+
+static_assert(isFieldTableOrdered(0), "FIELD_HANDLERS must be in LightCommand field order");
 
 MiLightClient::MiLightClient(
   RadioSwitchboard& radioSwitchboard,
@@ -78,6 +97,9 @@ MiLightClient::MiLightClient(
   , packetSender(packetSender)
   , transitions(transitions)
   , repeatsOverride(0)
+  , hasPriorityOverride(false)
+  , priorityOverride(PacketPriority::NORMAL)
+  , packetCaptureHandler(nullptr)
 { }
 
 void MiLightClient::setHeld(bool held) {
@@ -119,7 +141,7 @@ void MiLightClient::updateHue(const uint16_t hue) {
   Serial.printf_P(PSTR("MiLightClient::updateHue: Change hue to %d\n"), hue);
 #endif
   currentRemote->packetFormatter->updateHue(hue);
-  flushPacket();
+  flushPacket(PacketCommandClass::HUE);
 }
 
 void MiLightClient::updateBrightness(const uint8_t brightness) {
@@ -127,7 +149,7 @@ void MiLightClient::updateBrightness(const uint8_t brightness) {
   Serial.printf_P(PSTR("MiLightClient::updateBrightness: Change brightness to %d\n"), brightness);
 #endif
   currentRemote->packetFormatter->updateBrightness(brightness);
-  flushPacket();
+  flushPacket(PacketCommandClass::BRIGHTNESS);
 }
 
 void MiLightClient::updateMode(uint8_t mode) {
@@ -135,7 +157,7 @@ void MiLightClient::updateMode(uint8_t mode) {
   Serial.printf_P(PSTR("MiLightClient::updateMode: Change mode to %d\n"), mode);
 #endif
   currentRemote->packetFormatter->updateMode(mode);
-  flushPacket();
+  flushPacket(PacketCommandClass::MODE);
 }
 
 void MiLightClient::nextMode() {
@@ -174,7 +196,7 @@ void MiLightClient::updateStatus(MiLightStatus status, uint8_t groupId) {
   Serial.printf_P(PSTR("MiLightClient::updateStatus: Status %s, groupId %d\n"), status == MiLightStatus::OFF ? "OFF" : "ON", groupId);
 #endif
   currentRemote->packetFormatter->updateStatus(status, groupId);
-  flushPacket();
+  flushPacket(PacketCommandClass::NONE, PacketPriority::INTERACTIVE);
 }
 
 void MiLightClient::updateStatus(MiLightStatus status) {
@@ -182,7 +204,7 @@ void MiLightClient::updateStatus(MiLightStatus status) {
   Serial.printf_P(PSTR("MiLightClient::updateStatus: Status %s\n"), status == MiLightStatus::OFF ? "OFF" : "ON");
 #endif
   currentRemote->packetFormatter->updateStatus(status);
-  flushPacket();
+  flushPacket(PacketCommandClass::NONE, PacketPriority::INTERACTIVE);
 }
 
 void MiLightClient::updateSaturation(const uint8_t value) {
@@ -190,7 +212,7 @@ void MiLightClient::updateSaturation(const uint8_t value) {
   Serial.printf_P(PSTR("MiLightClient::updateSaturation: Saturation %d\n"), value);
 #endif
   currentRemote->packetFormatter->updateSaturation(value);
-  flushPacket();
+  flushPacket(PacketCommandClass::SATURATION);
 }
 
 void MiLightClient::updateColorWhite() {
@@ -262,7 +284,7 @@ void MiLightClient::updateTemperature(const uint8_t temperature) {
   Serial.printf_P(PSTR("MiLightClient::updateTemperature: Set temperature to %d\n"), temperature);
 #endif
   currentRemote->packetFormatter->updateTemperature(temperature);
-  flushPacket();
+  flushPacket(PacketCommandClass::TEMPERATURE);
 }
 
 void MiLightClient::command(uint8_t command, uint8_t arg) {
@@ -278,12 +300,14 @@ void MiLightClient::toggleStatus() {
   Serial.printf_P(PSTR("MiLightClient::toggleStatus"));
 #endif
   currentRemote->packetFormatter->toggleStatus();
-  flushPacket();
+  flushPacket(PacketCommandClass::NONE, PacketPriority::INTERACTIVE);
 }
 
 void MiLightClient::updateColor(JsonVariant json) {
-  ParsedColor color = ParsedColor::fromJson(json);
+  updateColor(ParsedColor::fromJson(json));
+}
 
+void MiLightClient::updateColor(const ParsedColor& color) {
   if (!color.success) {
     Serial.println(F("Error parsing color field, unrecognized format"));
     return;
@@ -302,31 +326,25 @@ void MiLightClient::updateColor(JsonVariant json) {
 }
 
 void MiLightClient::update(JsonObject request) {
-  if (this->updateBeginHandler) {
-    this->updateBeginHandler();
-  }
+  update(LightCommand::fromJson(request), request);
+}
 
-  const JsonVariant status = this->extractStatus(request);
-  const uint8_t parsedStatus = this->parseStatus(status);
-  const JsonVariant jsonTransition = request[RequestKeys::TRANSITION];
-  float transition = 0;
+void MiLightClient::apply(const BulbId& bulbId, const LightCommand& command) {
+  prepare(bulbId.deviceType, bulbId.deviceId, bulbId.groupId);
+  update(command);
+}
 
-  if (!jsonTransition.isNull()) {
-    if (jsonTransition.is<float>()) {
-      transition = jsonTransition.as<float>();
-    } else if (jsonTransition.is<size_t>()) {
-      transition = jsonTransition.as<size_t>();
-    } else {
-      Serial.println(F("MiLightClient - WARN: unsupported transition type.  Must be float or int."));
-    }
+void MiLightClient::update(const LightCommand& command, JsonObject request) {
+  if (this->updateBeginHandler) {
+    this->updateBeginHandler();
   }
 
-  JsonVariant brightness = request[GroupStateFieldNames::BRIGHTNESS];
-  JsonVariant level = request[GroupStateFieldNames::LEVEL];
-  const bool isBrightnessDefined = !brightness.isNull() || !level.isNull();
+  const float transition = command.transition;
+  const bool hasStatus = command.has(LightCommand::STATUS);
+  const bool isBrightnessDefined = (command.fields & (LightCommand::LEVEL | LightCommand::BRIGHTNESS)) != 0;
 
   // Always turn on first
-  if (parsedStatus == ON) {
+  if (hasStatus && command.status == ON) {
     if (transition == 0) {
       this->updateStatus(ON);
     }
@@ -343,53 +361,72 @@ void MiLightClient::update(JsonObject request) {
       // transitions only ramp up/down to the max/min.  Otherwise, just turn the bulb on
       // and let field transitions handle the rest.
       if (!isBrightnessDefined) {
-        handleTransition(GroupStateField::STATUS, status, transition, 0);
+        handleTransition(GroupStateField::STATUS, ON, transition, 0);
       } else {
         this->updateStatus(ON);
 
-        if (! brightness.isNull()) {
-          handleTransition(GroupStateField::BRIGHTNESS, brightness, transition, 0);
-        } else if (! level.isNull()) {
-          handleTransition(GroupStateField::LEVEL, level, transition, 0);
+        if (command.has(LightCommand::BRIGHTNESS)) {
+          handleTransition(GroupStateField::BRIGHTNESS, command.brightness, transition, 0);
+        } else {
+          handleTransition(GroupStateField::LEVEL, command.level, transition, 0);
         }
       }
     }
   }
 
-  for (const char* fieldName : FIELD_ORDERINGS) {
-    if (request.containsKey(fieldName)) {
-      auto handler = FIELD_SETTERS.find(fieldName);
-      JsonVariant value = request[fieldName];
+  for (size_t i = 0; i < NUM_FIELD_HANDLERS; ++i) {
+    const FieldHandler& handler = FIELD_HANDLERS[i];
 
-      if (handler != FIELD_SETTERS.end()) {
-        // No transition -- set field directly
-        if (transition == 0) {
-          handler->second(this, value);
-        } else {
-          GroupStateField field = GroupStateFieldHelpers::getFieldByName(fieldName);
-
-          if (   !GroupStateFieldHelpers::isBrightnessField(field)  // If field isn't brightness
-               || parsedStatus == STATUS_UNDEFINED                  // or if there was not a status field
-               || currentState->isOn()                              // or if bulb was already on
-          ) {
-            handleTransition(field, value, transition);
-          }
-        }
+    if (!command.has(handler.bit)) {
+      continue;
+    }
+
+    // No transition -- set field directly
+    if (transition == 0 || handler.field == GroupStateField::UNKNOWN) {
+      handler.setter(this, command);
+    } else if (   !GroupStateFieldHelpers::isBrightnessField(handler.field)  // If field isn't brightness
+               || !hasStatus                                               // or if there was not a status field
+               || currentState->isOn()                                     // or if bulb was already on
+    ) {
+      if (handler.field == GroupStateField::COLOR) {
+        handleColorTransition(command.color, transition);
+      } else {
+        handleTransition(handler.field, command.get(handler.field), transition);
       }
     }
   }
 
-  // Raw packet command/args
-  if (request.containsKey("button_id") && request.containsKey("argument")) {
-    this->command(request["button_id"], request["argument"]);
+  // Commands and raw packets can only be given as JSON
+  if (!request.isNull()) {
+    JsonVariant cmd = request[GroupStateFieldNames::COMMAND];
+    JsonVariant commands = request[GroupStateFieldNames::COMMANDS];
+
+    // Commands can't be transitioned, so they're ignored in a request with a
+    // transition
+    if (transition != 0 && (!cmd.isNull() || !commands.isNull())) {
+      Serial.println(F("MiLightClient - WARN: ignoring commands in a request with a transition"));
+    } else {
+      if (!cmd.isNull()) {
+        this->handleCommand(cmd);
+      }
+
+      if (!commands.isNull()) {
+        this->handleCommands(commands.as<JsonArray>());
+      }
+    }
+
+    // Raw packet command/args
+    if (request.containsKey("button_id") && request.containsKey("argument")) {
+      this->command(request["button_id"], request["argument"]);
+    }
   }
 
   // Always turn off last
-  if (parsedStatus == OFF) {
+  if (hasStatus && command.status == OFF) {
     if (transition == 0) {
       this->updateStatus(OFF);
     } else {
-      handleTransition(GroupStateField::STATUS, status, transition);
+      handleTransition(GroupStateField::STATUS, OFF, transition);
     }
   }
 
@@ -455,31 +492,42 @@ void MiLightClient::handleCommand(JsonVariant command) {
 }
 
 void MiLightClient::handleTransition(GroupStateField field, JsonVariant value, float duration, int16_t startValue) {
-  BulbId bulbId = currentRemote->packetFormatter->currentBulbId();
-  std::shared_ptr<Transition::Builder> transitionBuilder = nullptr;
+  if (field == GroupStateField::COLOR) {
+    handleColorTransition(ParsedColor::fromJson(value), duration);
+  } else if (field == GroupStateField::STATUS || field == GroupStateField::STATE) {
+    handleTransition(field, parseMilightStatus(value), duration, startValue);
+  } else {
+    handleTransition(field, value.as<uint16_t>(), duration, startValue);
+  }
+}
 
-  if (currentState == nullptr) {
-    Serial.println(F("Error planning transition: could not find current bulb state."));
+void MiLightClient::handleColorTransition(const ParsedColor& endColor, float duration) {
+  if (!canPlanTransition(GroupStateField::COLOR)) {
     return;
   }
 
-  if (!currentState->isSetField(field)) {
-    Serial.println(F("Error planning transition: current state for field could not be determined"));
+  BulbId bulbId = currentRemote->packetFormatter->currentBulbId();
+  std::shared_ptr<Transition::Builder> transitionBuilder = transitions.buildColorTransition(
+    bulbId,
+    currentState->getColor(),
+    endColor
+  );
+
+  transitionBuilder->setDuration(duration);
+  transitions.addTransition(transitionBuilder->build());
+}
+
+void MiLightClient::handleTransition(GroupStateField field, uint16_t value, float duration, int16_t startValue) {
+  if (!canPlanTransition(field)) {
     return;
   }
 
-  if (field == GroupStateField::COLOR) {
-    ParsedColor currentColor = currentState->getColor();
-    ParsedColor endColor = ParsedColor::fromJson(value);
+  BulbId bulbId = currentRemote->packetFormatter->currentBulbId();
+  std::shared_ptr<Transition::Builder> transitionBuilder = nullptr;
 
-    transitionBuilder = transitions.buildColorTransition(
-      bulbId,
-      currentColor,
-      endColor
-    );
-  } else if (field == GroupStateField::STATUS || field == GroupStateField::STATE) {
+  if (field == GroupStateField::STATUS || field == GroupStateField::STATE) {
     uint8_t startLevel;
-    MiLightStatus status = parseMilightStatus(value);
+    MiLightStatus status = static_cast<MiLightStatus>(value);
 
     if (startValue == FETCH_VALUE_FROM_STATE || currentState->isOn()) {
       startLevel = currentState->getBrightness();
@@ -490,7 +538,6 @@ void MiLightClient::handleTransition(GroupStateField field, JsonVariant value, f
     transitionBuilder = transitions.buildStatusTransition(bulbId, status, startLevel);
   } else {
     uint16_t currentValue;
-    uint16_t endValue = value;
 
     if (startValue == FETCH_VALUE_FROM_STATE || currentState->isOn()) {
       currentValue = currentState->getParsedFieldValue(field);
@@ -502,7 +549,7 @@ void MiLightClient::handleTransition(GroupStateField field, JsonVariant value, f
       bulbId,
       field,
       currentValue,
-      endValue
+      value
     );
   }
 
@@ -515,6 +562,20 @@ void MiLightClient::handleTransition(GroupStateField field, JsonVariant value, f
   transitions.addTransition(transitionBuilder->build());
 }
 
+bool MiLightClient::canPlanTransition(GroupStateField field) {
+  if (currentState == nullptr) {
+    Serial.println(F("Error planning transition: could not find current bulb state."));
+    return false;
+  }
+
+  if (!currentState->isSetField(field)) {
+    Serial.println(F("Error planning transition: current state for field could not be determined"));
+    return false;
+  }
+
+  return true;
+}
+
 bool MiLightClient::handleTransition(JsonObject args, JsonDocument& responseObj) {
   if (! args.containsKey(FPSTR(TransitionParams::FIELD))
     || ! args.containsKey(FPSTR(TransitionParams::END_VALUE))) {
@@ -651,11 +712,42 @@ void MiLightClient::clearRepeatsOverride() {
   this->repeatsOverride = PacketSender::DEFAULT_PACKET_SENDS_VALUE;
 }
 
-void MiLightClient::flushPacket() {
+void MiLightClient::setPriorityOverride(PacketPriority priority) {
+  this->hasPriorityOverride = true;
+  this->priorityOverride = priority;
+}
+
+void MiLightClient::clearPriorityOverride() {
+  this->hasPriorityOverride = false;
+}
+
+void MiLightClient::setPacketCapture(PacketCaptureHandler handler) {
+  this->packetCaptureHandler = handler;
+}
+
+void MiLightClient::clearPacketCapture() {
+  this->packetCaptureHandler = nullptr;
+}
+
+void MiLightClient::flushPacket(PacketCommandClass commandClass, PacketPriority priority) {
   PacketStream& stream = currentRemote->packetFormatter->buildPackets();
+  const BulbId bulbId = currentRemote->packetFormatter->currentBulbId();
+
+  // Multi-packet commands (e.g., increment sequences) have to be sent in full
+  if (stream.numPackets != 1) {
+    commandClass = PacketCommandClass::NONE;
+  }
+
+  if (hasPriorityOverride) {
+    priority = priorityOverride;
+  }
 
   while (stream.hasNext()) {
-    packetSender.enqueue(stream.next(), currentRemote, repeatsOverride);
+    if (packetCaptureHandler) {
+      packetCaptureHandler(stream.next(), *currentRemote, bulbId, commandClass, priority);
+    } else {
+      packetSender.enqueue(stream.next(), currentRemote, repeatsOverride, bulbId, commandClass, priority);
+    }
   }
 
   currentRemote->packetFormatter->reset();
@@ -7,6 +7,7 @@
 #include <GroupStateStore.h>
 #include <PacketSender.h>
 #include <TransitionController.h>
+#include <LightCommand.h>
 #include <cstring>
 #include <map>
 #include <set>
@@ -17,10 +18,6 @@
 //#define DEBUG_PRINTF
 //#define DEBUG_CLIENT_COMMANDS     // enable to show each individual change command (like hue, brightness, etc)
 
-namespace RequestKeys {
-  static const char TRANSITION[] = "transition";
-};
-
 namespace TransitionParams {
   static const char FIELD[] PROGMEM = "field";
   static const char START_VALUE[] PROGMEM = "start_value";
@@ -48,6 +45,14 @@ public:
   ~MiLightClient() { }
 
   typedef std::function<void(void)> EventHandler;
+  // Receives packets in place of the packet sender while capturing
+  typedef std::function<void(
+    const uint8_t* packet,
+    const MiLightRemoteConfig& remoteConfig,
+    const BulbId& bulbId,
+    PacketCommandClass commandClass,
+    PacketPriority priority
+  )> PacketCaptureHandler;
 
   void prepare(const MiLightRemoteConfig* remoteConfig, const uint16_t deviceId = -1, const uint8_t groupId = -1);
   void prepare(const MiLightRemoteType type, const uint16_t deviceId = -1, const uint8_t groupId = -1);
@@ -79,6 +84,7 @@ public:
   void updateColorRaw(const uint8_t color);
   void enableNightMode();
   void updateColor(JsonVariant json);
+  void updateColor(const ParsedColor& color);
 
   // CCT methods
   void updateTemperature(const uint8_t colorTemperature);
@@ -90,10 +96,17 @@ public:
   void updateSaturation(const uint8_t saturation);
 
   void update(JsonObject object);
+  // Applies command to the prepared bulb.  Commands and raw packets, which
+  // LightCommand doesn't represent, are taken from request if it's given.
+  void update(const LightCommand& command, JsonObject request = JsonObject());
+  // Same as prepare() followed by update(command)
+  void apply(const BulbId& bulbId, const LightCommand& command);
   void handleCommand(JsonVariant command);
   void handleCommands(JsonArray commands);
   bool handleTransition(JsonObject args, JsonDocument& responseObj);
   void handleTransition(GroupStateField field, JsonVariant value, float duration, int16_t startValue = FETCH_VALUE_FROM_STATE);
+  void handleTransition(GroupStateField field, uint16_t value, float duration, int16_t startValue = FETCH_VALUE_FROM_STATE);
+  void handleColorTransition(const ParsedColor& color, float duration);
   void handleEffect(const String& effect);
 
   void onUpdateBegin(EventHandler handler);
@@ -110,18 +123,20 @@ public:
   // Clear the repeats override so that the default is used
   void clearRepeatsOverride();
 
+  // Call to send all packets in the given lane rather than the one chosen for
+  // the command.  Clear with clearPriorityOverride
+  void setPriorityOverride(PacketPriority priority);
+  void clearPriorityOverride();
+
+  // Call to hand built packets to handler rather than queueing them.  Clear
+  // with clearPacketCapture
+  void setPacketCapture(PacketCaptureHandler handler);
+  void clearPacketCapture();
+
   uint8_t parseStatus(JsonVariant object);
   JsonVariant extractStatus(JsonObject object);
 
 protected:
-  struct cmp_str {
-    bool operator()(char const *a, char const *b) const {
-        return std::strcmp(a, b) < 0;
-    }
-  };
-  static const std::map<const char*, std::function<void(MiLightClient*, JsonVariant)>, cmp_str> FIELD_SETTERS;
-  static const char* FIELD_ORDERINGS[];
-
   RadioSwitchboard& radioSwitchboard;
   std::vector<std::shared_ptr<MiLightRadio>> radios;
   std::shared_ptr<MiLightRadio> currentRadio;
@@ -139,7 +154,22 @@ protected:
   // If set, override the number of packet repeats used.
   size_t repeatsOverride;
 
-  void flushPacket();
+  // If set, override the lane packets are queued in.
+  bool hasPriorityOverride;
+  PacketPriority priorityOverride;
+
+  // If set, packets are passed here instead of being queued.
+  PacketCaptureHandler packetCaptureHandler;
+
+  // commandClass is used to coalesce superseded packets.  Ignored unless the
+  // command produced a single packet.
+  void flushPacket(
+    PacketCommandClass commandClass = PacketCommandClass::NONE,
+    PacketPriority priority = PacketPriority::NORMAL
+  );
+
+  // Logs and returns false if there's no current state to transition from
+  bool canPlanTransition(GroupStateField field);
 };
 
 #endif
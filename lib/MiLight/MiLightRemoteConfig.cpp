@@ -30,16 +30,87 @@ const MiLightRemoteConfig* MiLightRemoteConfig::fromType(MiLightRemoteType type)
   return ALL_REMOTES[type];
 }
 
+namespace {
+  // Remotes sharing a radio config are told apart by their signature value.
+  // This is the number of slots they're hashed into, which is plenty for the
+  // handful of remotes on each config.
+  const size_t PACKET_INDEX_SLOTS = 8;
+
+  struct PacketIndexSlot {
+    const MiLightRemoteConfig* remote;
+    size_t packetLength;
+    uint8_t value;
+  };
+
+  struct RadioConfigIndex {
+    // Which byte to look at.  Shared by every remote on the radio config.
+    PacketSignature signature;
+    PacketIndexSlot slots[PACKET_INDEX_SLOTS];
+    bool hasRemotes;
+    // Set if the remotes can't be indexed (different signature bytes, or two
+    // remotes in one slot).  Falls back to trying each remote.
+    bool linear;
+  };
+
+  struct PacketIndex {
+    RadioConfigIndex configs[MiLightRadioConfig::NUM_CONFIGS];
+  };
+
+  PacketIndex buildPacketIndex() {
+    PacketIndex index = { };
+
+    for (size_t i = 0; i < MiLightRemoteConfig::NUM_REMOTES; i++) {
+      const MiLightRemoteConfig* remote = MiLightRemoteConfig::ALL_REMOTES[i];
+      const PacketSignature signature = remote->packetFormatter->getPacketSignature();
+      RadioConfigIndex& entry = index.configs[&remote->radioConfig - MiLightRadioConfig::ALL_CONFIGS];
+      PacketIndexSlot& slot = entry.slots[signature.value % PACKET_INDEX_SLOTS];
+
+      if (!entry.hasRemotes) {
+        entry.signature = signature;
+        entry.hasRemotes = true;
+      } else if (signature.v2Encoded != entry.signature.v2Encoded
+        || signature.index != entry.signature.index
+        || signature.mask != entry.signature.mask) {
+        entry.linear = true;
+      }
+
+      if (slot.remote != NULL) {
+        entry.linear = true;
+      } else {
+        slot = PacketIndexSlot{remote, remote->packetFormatter->getPacketLength(), signature.value};
+      }
+    }
+
+    return index;
+  }
+
+  const PacketIndex& packetIndex() {
+    static const PacketIndex index = buildPacketIndex();
+    return index;
+  }
+}
+
 const MiLightRemoteConfig* MiLightRemoteConfig::fromReceivedPacket(
   const MiLightRadioConfig& radioConfig,
   const uint8_t* packet,
   const size_t len
 ) {
-  for (size_t i = 0; i < MiLightRemoteConfig::NUM_REMOTES; i++) {
-    const MiLightRemoteConfig* config = MiLightRemoteConfig::ALL_REMOTES[i];
-    if (&config->radioConfig == &radioConfig
-      && config->packetFormatter->canHandle(packet, len)) {
-      return config;
+  const RadioConfigIndex& entry = packetIndex().configs[&radioConfig - MiLightRadioConfig::ALL_CONFIGS];
+
+  if (entry.linear) {
+    for (size_t i = 0; i < MiLightRemoteConfig::NUM_REMOTES; i++) {
+      const MiLightRemoteConfig* config = MiLightRemoteConfig::ALL_REMOTES[i];
+      if (&config->radioConfig == &radioConfig
+        && config->packetFormatter->canHandle(packet, len)) {
+        return config;
+      }
+    }
+  } else if (len > entry.signature.index) {
+    const uint8_t key = entry.signature.keyOf(packet);
+    const PacketIndexSlot& slot = entry.slots[key % PACKET_INDEX_SLOTS];
+
+    if (slot.remote != NULL && slot.packetLength == len && slot.value == key) {
+      return slot.remote;
     }
   }
 
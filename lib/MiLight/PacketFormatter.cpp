@@ -1,6 +1,7 @@
 #include <PacketFormatter.h>
+#include <V2RFEncoding.h>
 
-static uint8_t* PACKET_BUFFER = new uint8_t[PACKET_FORMATTER_BUFFER_SIZE];
+static uint8_t PACKET_BUFFER[PACKET_FORMATTER_BUFFER_SIZE];
 
 PacketStream::PacketStream()
     : packetStream(PACKET_BUFFER),
@@ -19,6 +20,11 @@ uint8_t* PacketStream::next() {
   return packet;
 }
 
+uint8_t PacketSignature::keyOf(const uint8_t* packet) const {
+  const uint8_t byte = v2Encoded ? V2RFEncoding::decodeV2Byte(packet, index) : packet[index];
+  return byte & mask;
+}
+
 PacketFormatter::PacketFormatter(const MiLightRemoteType deviceType, const size_t packetLength, const size_t maxPackets)
   : deviceType(deviceType),
     packetLength(packetLength),
@@ -34,8 +40,22 @@ void PacketFormatter::initialize(GroupStateStore* stateStore, const Settings* se
   this->settings = settings;
 }
 
+void PacketFormatter::setStateless(bool stateless) {
+  this->stateless = stateless;
+}
+
+const GroupState* PacketFormatter::knownState() const {
+  return stateless ? NULL : stateStore->get(deviceId, groupId, deviceType);
+}
+
 bool PacketFormatter::canHandle(const uint8_t *packet, const size_t len) {
-  return len == packetLength;
+  const PacketSignature signature = getPacketSignature();
+  return len == packetLength && signature.keyOf(packet) == signature.value;
+}
+
+// By default, only the length is checked
+PacketSignature PacketFormatter::getPacketSignature() const {
+  return PacketSignature{false, 0, 0, 0};
 }
 
 void PacketFormatter::finalizePacket(uint8_t* packet) { }
@@ -45,7 +65,7 @@ void PacketFormatter::updateStatus(MiLightStatus status) {
 }
 
 void PacketFormatter::toggleStatus() {
-  const GroupState* state = stateStore->get(deviceId, groupId, deviceType);
+  const GroupState* state = knownState();
 
   if (state && state->isSetState() && state->getState() == MiLightStatus::ON) {
     updateStatus(MiLightStatus::OFF);
@@ -147,6 +167,14 @@ void PacketFormatter::reset() {
 }
 
 void PacketFormatter::pushPacket() {
+  if (advancePacket()) {
+    initializePacket(currentPacket);
+  }
+}
+
+// Finalizes the current packet and moves on to the next.  Returns false if
+// the buffer is full.
+bool PacketFormatter::advancePacket() {
   if (numPackets > 0) {
     finalizePacket(currentPacket);
   }
@@ -154,12 +182,54 @@ void PacketFormatter::pushPacket() {
   // Make sure there's enough buffer to add another packet.
   if ((currentPacket + packetLength) >= PACKET_BUFFER + PACKET_FORMATTER_BUFFER_SIZE) {
     Serial.println(F("ERROR: packet buffer full!  Cannot buffer a new packet.  THIS IS A BUG!"));
-    return;
+    return false;
   }
 
   currentPacket = PACKET_BUFFER + (numPackets * packetLength);
   numPackets++;
-  initializePacket(currentPacket);
+
+  return true;
+}
+
+void PacketFormatter::setTemplatesEnabled(bool enabled) {
+  templatesEnabled = enabled;
+}
+
+bool PacketFormatter::supportsTemplates() const {
+  return false;
+}
+
+bool PacketFormatter::pushTemplate(uint8_t command, uint8_t arg) {
+  if (!templatesEnabled || templates == NULL) {
+    return false;
+  }
+
+  const uint8_t* packet = templates->get(templateKey(command, arg));
+
+  if (packet == NULL || !advancePacket()) {
+    return false;
+  }
+
+  memcpy(currentPacket, packet, packetLength);
+  stampSequenceNum(currentPacket);
+
+  return true;
+}
+
+void PacketFormatter::saveTemplate(uint8_t command, uint8_t arg) {
+  if (!templatesEnabled) {
+    return;
+  }
+
+  if (templates == NULL) {
+    templates = new PacketTemplateCache(packetLength);
+  }
+
+  templates->set(templateKey(command, arg), currentPacket);
+}
+
+PacketTemplateCache::Key PacketFormatter::templateKey(uint8_t command, uint8_t arg) const {
+  return PacketTemplateCache::keyOf(deviceId, groupId, command, arg, held);
 }
 
 void PacketFormatter::format(uint8_t const* packet, char* buffer) {
@@ -6,6 +6,7 @@
 #include <GroupState.h>
 #include <GroupStateStore.h>
 #include <Settings.h>
+#include <PacketTemplateCache.h>
 
 #ifndef _PACKET_FORMATTER_H
 #define _PACKET_FORMATTER_H
@@ -27,6 +28,19 @@ struct PacketStream {
   size_t currentPacket;
 };
 
+// How received packets are recognized.  A packet belongs to a formatter if it
+// has the formatter's packet length and (packet[index] & mask) == value.  If
+// v2Encoded is set, packet[index] is V2-decoded first.
+struct PacketSignature {
+  bool v2Encoded;
+  uint8_t index;
+  uint8_t mask;
+  uint8_t value;
+
+  // The masked byte to compare against value
+  uint8_t keyOf(const uint8_t* packet) const;
+};
+
 class PacketFormatter {
 public:
   PacketFormatter(const MiLightRemoteType deviceType, const size_t packetLength, const size_t maxPackets = 1);
@@ -38,9 +52,23 @@ public:
   // For now, just rely on the user calling this method.
   void initialize(GroupStateStore* stateStore, const Settings* settings);
 
+  // While set, commands are formatted as if nothing were known about the
+  // bulb's state.  The packets are then right whatever state the bulb is in
+  // when they're sent (e.g., step sequences drive to the minimum first).
+  void setStateless(bool stateless);
+
+  // Formatters whose packets only depend on the bulb and the command (apart
+  // from the sequence number) can keep the packets they build as templates,
+  // and reuse them for repeated commands.  Enabled by default if
+  // MILIGHT_PACKET_TEMPLATES is set.  The cache is allocated the first time
+  // a packet is saved, and kept if templates are disabled again.
+  void setTemplatesEnabled(bool enabled);
+  virtual bool supportsTemplates() const;
+
   typedef void (PacketFormatter::*StepFunction)();
 
-  virtual bool canHandle(const uint8_t* packet, const size_t len);
+  bool canHandle(const uint8_t* packet, const size_t len);
+  virtual PacketSignature getPacketSignature() const;
 
   void updateStatus(MiLightStatus status);
   void toggleStatus();
@@ -86,6 +114,11 @@ public:
   virtual BulbId parsePacket(const uint8_t* packet, JsonObject result);
   virtual BulbId currentBulbId() const;
 
+  // Gives a finished packet this formatter built earlier the next sequence
+  // number.  Bulbs ignore a packet with the same sequence number as the last
+  // one they received, so packets that are kept and resent need a fresh one.
+  virtual void stampSequenceNum(uint8_t* packet) = 0;
+
   static void formatV1Packet(uint8_t const* packet, char* buffer);
 
   size_t getPacketLength() const;
@@ -102,9 +135,25 @@ protected:
   PacketStream packetStream;
   GroupStateStore* stateStore = NULL;
   const Settings* settings = NULL;
+  bool stateless = false;
+  PacketTemplateCache* templates = NULL;
+  bool templatesEnabled = MILIGHT_PACKET_TEMPLATES;
+
+  // State of the prepared bulb.  NULL if it isn't known or the formatter is
+  // stateless.
+  const GroupState* knownState() const;
 
   void pushPacket();
 
+  // For subclasses with templates, called at the start of command().  If a
+  // template was saved for the command, pushes a copy of it with the next
+  // sequence number and returns true.
+  bool pushTemplate(uint8_t command, uint8_t arg);
+  // Called at the end of command() to save the packet it built.  Anything
+  // written to the packet after command() returns isn't part of the template,
+  // so it's applied on top of reused ones too.
+  void saveTemplate(uint8_t command, uint8_t arg);
+
   // Get field into a desired state using only increment/decrement commands.  Do this by:
   //   1. Driving it down to its minimum value
   //   2. Applying the appropriate number of increase commands to get it to the desired
@@ -115,6 +164,10 @@ protected:
 
   virtual void initializePacket(uint8_t* packetStart) = 0;
   virtual void finalizePacket(uint8_t* packet);
+
+private:
+  bool advancePacket();
+  PacketTemplateCache::Key templateKey(uint8_t command, uint8_t arg) const;
 };
 
 #endif
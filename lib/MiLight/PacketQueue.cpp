@@ -1,42 +1,339 @@
 #include <PacketQueue.h>
+#include <algorithm>
 
 PacketQueue::PacketQueue()
   : droppedPackets(0)
-{ }
+  , coalescedPackets(0)
+  , numFreeSlots(NUM_SLOTS)
+  , lanes()
+  , count(0)
+  , normalCredits(MILIGHT_NORMAL_LANE_WEIGHT)
+  , nextSequence(0)
+{
+  for (size_t i = 0; i < NUM_SLOTS; ++i) {
+    freeSlots[i] = i;
+  }
+}
+
+void PacketQueue::push(
+  const uint8_t* packet,
+  const MiLightRemoteConfig* remoteConfig,
+  const size_t repeatsOverride,
+  const BulbId& bulbId,
+  const PacketCommandClass commandClass,
+  const PacketPriority priority
+) {
+  reorderLowerLanes(bulbId, commandClass, priority);
+
+  SlotId slot = checkoutPacket(priority);
+
+  if (slot == NO_SLOT) {
+    return;
+  }
+
+  fill(slot, packet, remoteConfig, repeatsOverride, bulbId, commandClass);
+
+  QueuedPacket& qp = slots[slot];
+  qp.priority = priority;
+  qp.sequence = nextSequence++;
+  qp.enqueuedAt = micros();
+}
+
+bool PacketQueue::coalesce(
+  const uint8_t* packet,
+  const MiLightRemoteConfig* remoteConfig,
+  const size_t repeatsOverride,
+  const BulbId& bulbId,
+  const PacketCommandClass commandClass,
+  const PacketPriority priority,
+  uint32_t* sequence
+) {
+  if (commandClass == PacketCommandClass::NONE) {
+    return false;
+  }
+
+  // Queued packets in other lanes need to be reordered, which push() handles
+  if (hasLowerLanePackets(bulbId, priority)) {
+    return false;
+  }
+
+  Lane& lane = lanes[static_cast<size_t>(priority)];
+
+  // Walk backwards from the most recently queued packet
+  for (size_t i = lane.count; i > 0; --i) {
+    SlotId slot = at(lane, i - 1);
+    QueuedPacket& qp = slots[slot];
+
+    // Unknown target (e.g., a raw packet).  Can't safely reorder around it.
+    if (qp.bulbId == DEFAULT_BULB_ID) {
+      return false;
+    }
+
+    // Packets for other bulbs don't interact with this one
+    if (! interacts(qp.bulbId, bulbId)) {
+      continue;
+    }
+
+    if (qp.bulbId.groupId == bulbId.groupId && qp.commandClass == commandClass) {
+      fill(slot, packet, remoteConfig, repeatsOverride, bulbId, commandClass);
+      ++coalescedPackets;
 
-void PacketQueue::push(const uint8_t* packet, const MiLightRemoteConfig* remoteConfig, const size_t repeatsOverride) {
-  std::shared_ptr<QueuedPacket> qp = checkoutPacket();
-  memcpy(qp->packet, packet, remoteConfig->packetFormatter->getPacketLength());
-  qp->remoteConfig = remoteConfig;
-  qp->repeatsOverride = repeatsOverride;
+      if (sequence != nullptr) {
+        *sequence = qp.sequence;
+      }
+
+      return true;
+    }
+
+    return false;
+  }
+
+  return false;
 }
 
 bool PacketQueue::isEmpty() const {
-  return queue.size() == 0;
+  return count == 0;
+}
+
+uint32_t PacketQueue::lastSequence() const {
+  return nextSequence - 1;
+}
+
+bool PacketQueue::hasPacketsThrough(uint32_t sequence) const {
+  for (const Lane& lane : lanes) {
+    for (size_t i = 0; i < lane.count; ++i) {
+      const SlotId slot = lane.queue[(lane.head + i) % MILIGHT_MAX_QUEUED_PACKETS];
+
+      // Difference handles the sequence wrapping around
+      if (static_cast<int32_t>(slots[slot].sequence - sequence) <= 0) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+bool PacketQueue::hasPacketsBetween(uint32_t first, uint32_t last) const {
+  for (const Lane& lane : lanes) {
+    for (size_t i = 0; i < lane.count; ++i) {
+      const uint32_t sequence = slots[lane.queue[(lane.head + i) % MILIGHT_MAX_QUEUED_PACKETS]].sequence;
+
+      if (static_cast<int32_t>(sequence - first) >= 0 && static_cast<int32_t>(sequence - last) <= 0) {
+        return true;
+      }
+    }
+  }
+
+  return false;
 }
 
 size_t PacketQueue::getDroppedPacketCount() const {
   return droppedPackets;
 }
 
-std::shared_ptr<QueuedPacket> PacketQueue::pop() {
-  return queue.shift();
+size_t PacketQueue::getCoalescedPacketCount() const {
+  return coalescedPackets;
+}
+
+PacketQueue::SlotId PacketQueue::pop() {
+  const size_t ix = nextLane();
+
+  if (ix == NUM_PACKET_PRIORITIES) {
+    return NO_SLOT;
+  }
+
+  const bool backgroundWaiting = lanes[static_cast<size_t>(PacketPriority::BACKGROUND)].count > 0;
+
+  if (ix == static_cast<size_t>(PacketPriority::NORMAL) && backgroundWaiting) {
+    --normalCredits;
+  } else if (ix == static_cast<size_t>(PacketPriority::BACKGROUND)) {
+    normalCredits = MILIGHT_NORMAL_LANE_WEIGHT;
+  }
+
+  --count;
+  return removeAt(lanes[ix], 0);
+}
+
+PacketQueue::SlotId PacketQueue::peek() const {
+  const size_t ix = nextLane();
+
+  if (ix == NUM_PACKET_PRIORITIES) {
+    return NO_SLOT;
+  }
+
+  return lanes[ix].queue[lanes[ix].head];
+}
+
+size_t PacketQueue::nextLane() const {
+  const Lane& interactive = lanes[static_cast<size_t>(PacketPriority::INTERACTIVE)];
+  const Lane& normal = lanes[static_cast<size_t>(PacketPriority::NORMAL)];
+  const Lane& background = lanes[static_cast<size_t>(PacketPriority::BACKGROUND)];
+
+  if (interactive.count > 0) {
+    return static_cast<size_t>(PacketPriority::INTERACTIVE);
+  } else if (normal.count > 0 && (background.count == 0 || normalCredits > 0)) {
+    return static_cast<size_t>(PacketPriority::NORMAL);
+  } else if (background.count > 0) {
+    return static_cast<size_t>(PacketPriority::BACKGROUND);
+  }
+
+  return NUM_PACKET_PRIORITIES;
+}
+
+QueuedPacket& PacketQueue::get(SlotId slot) {
+  return slots[slot];
+}
+
+const QueuedPacket& PacketQueue::get(SlotId slot) const {
+  return slots[slot];
+}
+
+void PacketQueue::release(SlotId slot) {
+  freeSlots[numFreeSlots++] = slot;
+}
+
+// Returns the slot to write a newly pushed packet into.  When the queue is
+// full, the most recently queued packet in the least urgent lane is dropped to
+// make room.  If there are no packets less urgent than the new one, the most
+// recently queued packet in its own lane is overwritten.
+PacketQueue::SlotId PacketQueue::checkoutPacket(PacketPriority priority) {
+  Lane& lane = lanes[static_cast<size_t>(priority)];
+
+  if (count < MILIGHT_MAX_QUEUED_PACKETS && numFreeSlots > 0) {
+    SlotId slot = freeSlots[--numFreeSlots];
+    append(lane, slot);
+    ++count;
+    return slot;
+  }
+
+  ++droppedPackets;
+
+  for (size_t i = NUM_PACKET_PRIORITIES - 1; i > static_cast<size_t>(priority); --i) {
+    if (lanes[i].count > 0) {
+      SlotId slot = removeAt(lanes[i], lanes[i].count - 1);
+      append(lane, slot);
+      return slot;
+    }
+  }
+
+  return lane.count == 0 ? NO_SLOT : at(lane, lane.count - 1);
+}
+
+void PacketQueue::fill(
+  SlotId slot,
+  const uint8_t* packet,
+  const MiLightRemoteConfig* remoteConfig,
+  const size_t repeatsOverride,
+  const BulbId& bulbId,
+  const PacketCommandClass commandClass
+) {
+  QueuedPacket& qp = slots[slot];
+  memcpy(qp.packet, packet, remoteConfig->packetFormatter->getPacketLength());
+  qp.remoteConfig = remoteConfig;
+  qp.repeatsOverride = repeatsOverride;
+  qp.bulbId = bulbId;
+  qp.commandClass = commandClass;
+}
+
+void PacketQueue::reorderLowerLanes(const BulbId& bulbId, PacketCommandClass commandClass, PacketPriority priority) {
+  if (! hasLowerLanePackets(bulbId, priority)) {
+    return;
+  }
+
+  SlotId promoted[MILIGHT_MAX_QUEUED_PACKETS];
+  size_t numPromoted = 0;
+
+  for (size_t i = static_cast<size_t>(priority) + 1; i < NUM_PACKET_PRIORITIES; ++i) {
+    Lane& lane = lanes[i];
+
+    for (size_t j = 0; j < lane.count; ) {
+      QueuedPacket& qp = slots[at(lane, j)];
+
+      if (! interacts(qp.bulbId, bulbId)) {
+        ++j;
+        continue;
+      }
+
+      SlotId slot = removeAt(lane, j);
+
+      // Superseded if it sets the same field for a subset of the bulbs
+      if (commandClass != PacketCommandClass::NONE
+        && qp.commandClass == commandClass
+        && (qp.bulbId.groupId == bulbId.groupId || bulbId.groupId == 0)) {
+        release(slot);
+        --count;
+        ++coalescedPackets;
+      } else {
+        promoted[numPromoted++] = slot;
+      }
+    }
+  }
+
+  // Lanes are each in order, but need to be merged
+  std::sort(
+    promoted,
+    promoted + numPromoted,
+    [this](SlotId a, SlotId b) { return slots[a].sequence < slots[b].sequence; }
+  );
+
+  Lane& lane = lanes[static_cast<size_t>(priority)];
+  for (size_t i = 0; i < numPromoted; ++i) {
+    slots[promoted[i]].priority = priority;
+    append(lane, promoted[i]);
+  }
+}
+
+bool PacketQueue::hasLowerLanePackets(const BulbId& bulbId, PacketPriority priority) {
+  // Raw packets have no known target and are never reordered
+  if (bulbId.deviceType == REMOTE_TYPE_UNKNOWN) {
+    return false;
+  }
+
+  for (size_t i = static_cast<size_t>(priority) + 1; i < NUM_PACKET_PRIORITIES; ++i) {
+    for (size_t j = 0; j < lanes[i].count; ++j) {
+      if (interacts(slots[at(lanes[i], j)].bulbId, bulbId)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+PacketQueue::SlotId& PacketQueue::at(Lane& lane, size_t ix) {
+  return lane.queue[(lane.head + ix) % MILIGHT_MAX_QUEUED_PACKETS];
+}
+
+void PacketQueue::append(Lane& lane, SlotId slot) {
+  at(lane, lane.count++) = slot;
 }
 
-std::shared_ptr<QueuedPacket> PacketQueue::checkoutPacket() {
-  if (queue.size() == MILIGHT_MAX_QUEUED_PACKETS) {
-    ++droppedPackets;
-    return queue.getLast();
+PacketQueue::SlotId PacketQueue::removeAt(Lane& lane, size_t ix) {
+  SlotId slot = at(lane, ix);
+
+  if (ix == 0) {
+    lane.head = (lane.head + 1) % MILIGHT_MAX_QUEUED_PACKETS;
   } else {
-    std::shared_ptr<QueuedPacket> packet = std::make_shared<QueuedPacket>();
-    queue.add(packet);
-    return packet;
+    for (size_t i = ix; i + 1 < lane.count; ++i) {
+      at(lane, i) = at(lane, i + 1);
+    }
   }
+
+  --lane.count;
+  return slot;
 }
 
-void PacketQueue::checkinPacket(std::shared_ptr<QueuedPacket> packet) {
+bool PacketQueue::interacts(const BulbId& a, const BulbId& b) {
+  return a.deviceId == b.deviceId
+    && a.deviceType == b.deviceType
+    && (a.groupId == b.groupId || a.groupId == 0 || b.groupId == 0);
 }
 
 size_t PacketQueue::size() const {
-  return queue.size();
-}
\ No newline at end of file
+  return count;
+}
+
+size_t PacketQueue::size(PacketPriority priority) const {
+  return lanes[static_cast<size_t>(priority)].count;
+}
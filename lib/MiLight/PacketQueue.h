@@ -10,27 +10,174 @@
 #define MILIGHT_MAX_QUEUED_PACKETS 20
 #endif
 
+// Most packets PacketSender can have popped and in flight at once
+#ifndef MILIGHT_MAX_INTERLEAVED_PACKETS
+#define MILIGHT_MAX_INTERLEAVED_PACKETS 8
+#endif
+
+// Commands for which only the most recent value matters.  A queued packet with
+// one of these classes can be replaced by a newer one for the same bulb.
+enum class PacketCommandClass : uint8_t {
+  // Never coalesced (status, toggles, increments, pairing, raw commands, ...)
+  NONE,
+  BRIGHTNESS,
+  HUE,
+  SATURATION,
+  TEMPERATURE,
+  MODE
+};
+
+// Lanes that packets are queued in, most urgent first.  Packets for the same
+// bulb are always sent in the order they were queued, regardless of lane.
+enum class PacketPriority : uint8_t {
+  // On/off commands.  Always sent before anything else.
+  INTERACTIVE,
+  // Other commands
+  NORMAL,
+  // Transition steps
+  BACKGROUND
+};
+static const size_t NUM_PACKET_PRIORITIES = 3;
+
+// Number of NORMAL packets sent for each BACKGROUND packet when both lanes have
+// packets waiting.  Keeps transitions moving during a burst of updates.
+#ifndef MILIGHT_NORMAL_LANE_WEIGHT
+#define MILIGHT_NORMAL_LANE_WEIGHT 4
+#endif
+
 struct QueuedPacket {
   uint8_t packet[MILIGHT_MAX_PACKET_LENGTH];
   const MiLightRemoteConfig* remoteConfig;
   size_t repeatsOverride;
+  BulbId bulbId;
+  PacketCommandClass commandClass;
+  PacketPriority priority;
+  // Order in which packets were queued, used to keep per-bulb ordering
+  uint32_t sequence;
+  // micros() when first queued.  Kept if the packet is coalesced.
+  unsigned long enqueuedAt;
 };
 
+/*
+ * Priority queue of packets backed by a fixed pool of preallocated slots.
+ * Nothing is allocated when packets are pushed or popped.
+ *
+ * Each priority has its own FIFO lane.  INTERACTIVE packets are always popped
+ * first; NORMAL and BACKGROUND packets are interleaved according to
+ * MILIGHT_NORMAL_LANE_WEIGHT.  When a packet is pushed, queued packets in less
+ * urgent lanes that it could interact with (same device, and same group or
+ * group 0) are either discarded if it supersedes them, or moved into its lane
+ * ahead of it.
+ *
+ * pop() lends the slot at the front of the queue to the caller, who reads it
+ * with get() and must hand it back with release() when done with it.  Up to
+ * MILIGHT_MAX_INTERLEAVED_PACKETS slots can be lent out at once.
+ */
 class PacketQueue {
 public:
+  typedef uint8_t SlotId;
+  static const SlotId NO_SLOT = 0xFF;
+
   PacketQueue();
 
-  void push(const uint8_t* packet, const MiLightRemoteConfig* remoteConfig, const size_t repeatsOverride);
-  std::shared_ptr<QueuedPacket> pop();
+  void push(
+    const uint8_t* packet,
+    const MiLightRemoteConfig* remoteConfig,
+    const size_t repeatsOverride,
+    const BulbId& bulbId = DEFAULT_BULB_ID,
+    const PacketCommandClass commandClass = PacketCommandClass::NONE,
+    const PacketPriority priority = PacketPriority::NORMAL
+  );
+
+  /*
+   * Replaces a queued packet in place if it's superseded by the provided one.
+   * Returns true if a packet was replaced, in which case the provided packet
+   * should not be pushed.
+   *
+   * To preserve ordering, only the most recent packet in the same lane that
+   * could interact with the provided one is considered.  That's the last
+   * packet for the same device and group, or for group 0 of the same device.
+   * It's replaced only if it has the same command class and group.
+   *
+   * The replaced packet keeps its sequence number, which is stored in
+   * sequence if it's not null.
+   */
+  bool coalesce(
+    const uint8_t* packet,
+    const MiLightRemoteConfig* remoteConfig,
+    const size_t repeatsOverride,
+    const BulbId& bulbId,
+    const PacketCommandClass commandClass,
+    const PacketPriority priority = PacketPriority::NORMAL,
+    uint32_t* sequence = nullptr
+  );
+  SlotId pop();
+  // The slot pop() would return next, left in the queue
+  SlotId peek() const;
+  QueuedPacket& get(SlotId slot);
+  const QueuedPacket& get(SlotId slot) const;
+  void release(SlotId slot);
+
   bool isEmpty() const;
+  // Sequence number of the most recently pushed packet
+  uint32_t lastSequence() const;
+  // True if a packet pushed at or before the given sequence number is queued
+  bool hasPacketsThrough(uint32_t sequence) const;
+  // True if a packet with a sequence number from first to last is queued
+  bool hasPacketsBetween(uint32_t first, uint32_t last) const;
   size_t size() const;
+  size_t size(PacketPriority priority) const;
   size_t getDroppedPacketCount() const;
+  size_t getCoalescedPacketCount() const;
+
+  // True if commands for a and b could affect the same bulb
+  static bool interacts(const BulbId& a, const BulbId& b);
 
 private:
+  // Leave room for borrowed slots in addition to a full queue
+  static const size_t NUM_SLOTS = MILIGHT_MAX_QUEUED_PACKETS + MILIGHT_MAX_INTERLEAVED_PACKETS;
+  static_assert(NUM_SLOTS < NO_SLOT, "MILIGHT_MAX_QUEUED_PACKETS is too large");
+
+  // Ring of slot IDs in FIFO order
+  struct Lane {
+    SlotId queue[MILIGHT_MAX_QUEUED_PACKETS];
+    size_t head;
+    size_t count;
+  };
+
   size_t droppedPackets;
+  size_t coalescedPackets;
 
-  std::shared_ptr<QueuedPacket> checkoutPacket();
-  void checkinPacket(std::shared_ptr<QueuedPacket> packet);
+  QueuedPacket slots[NUM_SLOTS];
+  SlotId freeSlots[NUM_SLOTS];
+  size_t numFreeSlots;
 
-  LinkedList<std::shared_ptr<QueuedPacket>> queue;
-};
\ No newline at end of file
+  Lane lanes[NUM_PACKET_PRIORITIES];
+  // Total number of queued packets across all lanes
+  size_t count;
+  // NORMAL packets left to send before a waiting BACKGROUND packet goes
+  size_t normalCredits;
+  uint32_t nextSequence;
+
+  // Index of the lane pop() takes from next, or NUM_PACKET_PRIORITIES if the
+  // queue is empty
+  size_t nextLane() const;
+  SlotId checkoutPacket(PacketPriority priority);
+  void fill(
+    SlotId slot,
+    const uint8_t* packet,
+    const MiLightRemoteConfig* remoteConfig,
+    const size_t repeatsOverride,
+    const BulbId& bulbId,
+    const PacketCommandClass commandClass
+  );
+
+  // Discards or promotes packets in lanes less urgent than priority that
+  // could interact with bulbId.  See class comment.
+  void reorderLowerLanes(const BulbId& bulbId, PacketCommandClass commandClass, PacketPriority priority);
+  bool hasLowerLanePackets(const BulbId& bulbId, PacketPriority priority);
+
+  static SlotId& at(Lane& lane, size_t ix);
+  static void append(Lane& lane, SlotId slot);
+  static SlotId removeAt(Lane& lane, size_t ix);
+};
@@ -1,15 +1,24 @@
 #include <PacketSender.h>
 #include <MiLightRadioConfig.h>
 
+const uint16_t PacketSender::FIRST_SEND_BUCKET_MS[] = {1, 2, 5, 10, 20, 50, 100, 200, 500};
+
 PacketSender::PacketSender(
   RadioSwitchboard& radioSwitchboard,
   Settings& settings,
   PacketSentHandler packetSentHandler
 ) : radioSwitchboard(radioSwitchboard)
   , settings(settings)
-  , currentPacket(nullptr)
-  , packetRepeatsRemaining(0)
+  , numActive(0)
+  , nextActive(0)
   , packetSentHandler(packetSentHandler)
+  , packetLatencyHandler(nullptr)
+  , stats()
+  , firstSendCounts()
+  , numEnqueued(0)
+  , ticketRange(nullptr)
+  , lastSentPacket()
+  , lastSentAt(0)
   , lastSend(0)
   , currentResendCount(settings.packetRepeats)
   , throttleMultiplier(
@@ -19,85 +28,305 @@ PacketSender::PacketSender(
     )
 { }
 
-void PacketSender::enqueue(uint8_t* packet, const MiLightRemoteConfig* remoteConfig, const size_t repeatsOverride) {
+PacketSender::Ticket PacketSender::enqueue(
+  uint8_t* packet,
+  const MiLightRemoteConfig* remoteConfig,
+  const size_t repeatsOverride,
+  const BulbId& bulbId,
+  const PacketCommandClass commandClass,
+  const PacketPriority priority
+) {
 #ifdef DEBUG_PRINTF
   Serial.println("Enqueuing packet");
 #endif
+  ++numEnqueued;
+
   size_t repeats = repeatsOverride == DEFAULT_PACKET_SENDS_VALUE
-    ? this->currentResendCount
+    ? repeatsFor(remoteConfig)
     : repeatsOverride;
 
-  queue.push(packet, remoteConfig, repeats);
+  // A coalesced packet keeps its place (and sequence) in the queue
+  Ticket ticket;
+  if (!settings.packetCoalescing || !queue.coalesce(packet, remoteConfig, repeats, bulbId, commandClass, priority, &ticket)) {
+    queue.push(packet, remoteConfig, repeats, bulbId, commandClass, priority);
+    ticket = lastTicket();
+  }
+
+  if (ticketRange != nullptr) {
+    ticketRange->add(ticket);
+  }
+
+  return ticket;
 }
 
 void PacketSender::loop() {
-  // Switch to the next packet if we're done with the current one
-  if (packetRepeatsRemaining == 0 && !queue.isEmpty()) {
-    nextPacket();
-  }
+  const unsigned long passStart = micros();
+  size_t repeatsLeft = settings.packetRepeatsPerLoop;
+
+  while (repeatsLeft > 0 && !isOverBudget(passStart)) {
+    fillActivePackets();
+
+    if (numActive == 0) {
+      break;
+    }
+
+    if (nextActive >= numActive) {
+      nextActive = 0;
+    }
+
+    // A lone packet sends its repeats back to back.  Interleaved packets take
+    // turns a repeat at a time.
+    const size_t ix = nextActive;
+    const size_t batch = numActive == 1 ? repeatsLeft : 1;
+    const size_t numBefore = numActive;
 
-  // If there's a packet we're handling, deal with it
-  if (currentPacket != nullptr && packetRepeatsRemaining > 0) {
-    handleCurrentPacket();
+    repeatsLeft -= handleActivePacket(ix, batch, passStart);
+
+    // A finished packet is removed, which moves the next one into its place
+    if (numActive == numBefore) {
+      ++nextActive;
+    }
   }
 }
 
 bool PacketSender::isSending() {
-  return packetRepeatsRemaining > 0 || !queue.isEmpty();
+  return numActive > 0 || !queue.isEmpty();
+}
+
+PacketSender::Ticket PacketSender::lastTicket() const {
+  return queue.lastSequence();
 }
 
-void PacketSender::nextPacket() {
+bool PacketSender::isSent(Ticket ticket) const {
+  for (size_t i = 0; i < numActive; ++i) {
+    if (static_cast<int32_t>(queue.get(activePackets[i].slot).sequence - ticket) <= 0) {
+      return false;
+    }
+  }
+
+  return !queue.hasPacketsThrough(ticket);
+}
+
+bool PacketSender::isSent(const TicketRange& range) const {
+  if (range.count == 0) {
+    return true;
+  }
+
+  for (size_t i = 0; i < numActive; ++i) {
+    const Ticket ticket = queue.get(activePackets[i].slot).sequence;
+
+    if (static_cast<int32_t>(ticket - range.first) >= 0 && static_cast<int32_t>(ticket - range.last) <= 0) {
+      return false;
+    }
+  }
+
+  return !queue.hasPacketsBetween(range.first, range.last);
+}
+
+void PacketSender::recordTickets(TicketRange* range) {
+  this->ticketRange = range;
+}
+
+void PacketSender::TicketRange::add(Ticket ticket) {
+  if (count == 0 || static_cast<int32_t>(ticket - first) < 0) {
+    first = ticket;
+  }
+  if (count == 0 || static_cast<int32_t>(ticket - last) > 0) {
+    last = ticket;
+  }
+
+  ++count;
+}
+
+bool PacketSender::isOverBudget(unsigned long passStart) const {
+  return settings.packetSendBudgetMicros > 0 && micros() - passStart >= settings.packetSendBudgetMicros;
+}
+
+bool PacketSender::isEcho(const uint8_t* packet, size_t length) {
+  length = std::min(length, static_cast<size_t>(MILIGHT_MAX_PACKET_LENGTH));
+
+  for (size_t i = 0; i < numActive; ++i) {
+    if (memcmp(queue.get(activePackets[i].slot).packet, packet, length) == 0) {
+      return true;
+    }
+  }
+
+  return millis() - lastSentAt < MILIGHT_ECHO_WINDOW_MS && memcmp(lastSentPacket, packet, length) == 0;
+}
+
+void PacketSender::fillActivePackets() {
+  const size_t width = std::max(
+    std::min(settings.packetInterleaveWidth, static_cast<size_t>(MILIGHT_MAX_INTERLEAVED_PACKETS)),
+    static_cast<size_t>(1)
+  );
+
+  while (numActive < width && !queue.isEmpty()) {
+    // Stop rather than skip ahead, so packets aren't reordered
+    if (numActive > 0 && !canInterleave(queue.get(queue.peek()))) {
+      return;
+    }
+
 #ifdef DEBUG_PRINTF
-  Serial.printf("Switching to next packet, %d packets in queue\n", queue.size());
+    Serial.printf("Switching to next packet, %d packets in queue\n", queue.size());
 #endif
-  currentPacket = queue.pop();
+    const PacketQueue::SlotId slot = queue.pop();
+    const QueuedPacket& packet = queue.get(slot);
+    const size_t repeats = packet.repeatsOverride > 0
+      ? packet.repeatsOverride
+      : settings.packetRepeatsFor(packet.remoteConfig->type);
+
+    // Adjust resend count according to throttling rules
+    updateResendCount();
+
+    // Nothing to send (e.g., 0 repeats).  Hand the slot straight back.
+    if (repeats == 0) {
+      queue.release(slot);
+      continue;
+    }
 
-  if (currentPacket->repeatsOverride > 0) {
-    packetRepeatsRemaining = currentPacket->repeatsOverride;
-  } else {
-    packetRepeatsRemaining = settings.packetRepeats;
+    activePackets[numActive++] = ActivePacket{slot, repeats, false};
+  }
+}
+
+bool PacketSender::canInterleave(const QueuedPacket& packet) const {
+  // Raw packets have no known target, so could be for any bulb
+  if (packet.bulbId.deviceType == REMOTE_TYPE_UNKNOWN) {
+    return false;
   }
 
-  // Adjust resend count according to throttling rules
-  updateResendCount();
+  for (size_t i = 0; i < numActive; ++i) {
+    const QueuedPacket& activePacket = queue.get(activePackets[i].slot);
+    const BulbId& activeBulb = activePacket.bulbId;
+
+    // Taking turns across radio configs would reconfigure the radio (and
+    // flush its FIFO) on every repeat
+    if (&activePacket.remoteConfig->radioConfig != &packet.remoteConfig->radioConfig) {
+      return false;
+    }
+
+    if (activeBulb.deviceType == REMOTE_TYPE_UNKNOWN || PacketQueue::interacts(activeBulb, packet.bulbId)) {
+      return false;
+    }
+  }
+
+  return true;
 }
 
-void PacketSender::handleCurrentPacket() {
+size_t PacketSender::handleActivePacket(size_t ix, size_t maxRepeats, unsigned long passStart) {
+  ActivePacket& active = activePackets[ix];
+  QueuedPacket& currentPacket = queue.get(active.slot);
+
   // Always switch radio.  could've been listening in another context
-  radioSwitchboard.switchRadio(currentPacket->remoteConfig);
+  radioSwitchboard.switchRadio(currentPacket.remoteConfig);
+
+  size_t numSent = sendRepeats(active, std::min(active.repeatsRemaining, maxRepeats), passStart);
+  active.repeatsRemaining -= numSent;
+
+  if (active.repeatsRemaining == 0) {
+    finishPacket(ix);
+  }
 
-  size_t numToSend = std::min(packetRepeatsRemaining, settings.packetRepeatsPerLoop);
-  sendRepeats(numToSend);
-  packetRepeatsRemaining -= numToSend;
+  return numSent;
+}
+
+void PacketSender::finishPacket(size_t ix) {
+  QueuedPacket& currentPacket = queue.get(activePackets[ix].slot);
 
   // If we're done sending this packet, fire the sent packet callback
-  if (packetRepeatsRemaining == 0 && packetSentHandler != nullptr) {
-    packetSentHandler(currentPacket->packet, *currentPacket->remoteConfig);
+  if (packetSentHandler != nullptr) {
+    packetSentHandler(currentPacket.packet, *currentPacket.remoteConfig);
+  }
+
+  const uint32_t latencyMicros = micros() - currentPacket.enqueuedAt;
+  if (packetLatencyHandler != nullptr) {
+    packetLatencyHandler(currentPacket, latencyMicros);
   }
+
+  LaneStats& laneStats = stats[static_cast<size_t>(currentPacket.priority)];
+  uint32_t latency = latencyMicros / 1000;
+  laneStats.sentPackets++;
+  laneStats.totalLatencyMs += latency;
+  laneStats.maxLatencyMs = std::max(laneStats.maxLatencyMs, latency);
+
+  memcpy(lastSentPacket, currentPacket.packet, MILIGHT_MAX_PACKET_LENGTH);
+  lastSentAt = millis();
+
+  queue.release(activePackets[ix].slot);
+  removeActivePacket(ix);
+}
+
+void PacketSender::removeActivePacket(size_t ix) {
+  for (size_t i = ix; i + 1 < numActive; ++i) {
+    activePackets[i] = activePackets[i + 1];
+  }
+
+  --numActive;
 }
 
 size_t PacketSender::queueLength() const {
   return queue.size();
 }
 
+size_t PacketSender::queueLength(PacketPriority priority) const {
+  return queue.size(priority);
+}
+
+const PacketSender::LaneStats& PacketSender::laneStats(PacketPriority priority) const {
+  return stats[static_cast<size_t>(priority)];
+}
+
+const uint32_t* PacketSender::firstSendHistogram() const {
+  return firstSendCounts;
+}
+
+void PacketSender::onPacketLatency(PacketLatencyHandler handler) {
+  this->packetLatencyHandler = handler;
+}
+
 size_t PacketSender::droppedPackets() const {
   return queue.getDroppedPacketCount();
 }
 
-void PacketSender::sendRepeats(size_t num) {
-  size_t len = currentPacket->remoteConfig->packetFormatter->getPacketLength();
+size_t PacketSender::coalescedPackets() const {
+  return queue.getCoalescedPacketCount();
+}
+
+uint32_t PacketSender::enqueuedPackets() const {
+  return numEnqueued;
+}
+
+size_t PacketSender::sendRepeats(ActivePacket& active, size_t num, unsigned long passStart) {
+  QueuedPacket& currentPacket = queue.get(active.slot);
+  size_t len = currentPacket.remoteConfig->packetFormatter->getPacketLength();
 
 #ifdef DEBUG_PRINTF
   Serial.printf_P(PSTR("Sending packet (%d repeats): \n"), num);
   for (size_t i = 0; i < len; i++) {
-    Serial.printf_P(PSTR("%02X "), currentPacket->packet[i]);
+    Serial.printf_P(PSTR("%02X "), currentPacket.packet[i]);
   }
   Serial.println();
   int iStart = millis();
 #endif
 
-  for (size_t i = 0; i < num; ++i) {
-    radioSwitchboard.write(currentPacket->packet, len);
+  size_t sent = 0;
+  while (sent < num) {
+    radioSwitchboard.write(currentPacket.packet, len);
+    ++sent;
+
+    if (! active.started) {
+      active.started = true;
+
+      const uint32_t firstSendMs = (micros() - currentPacket.enqueuedAt) / 1000;
+      size_t bucket = 0;
+      while (bucket < NUM_FIRST_SEND_BUCKETS - 1 && firstSendMs >= FIRST_SEND_BUCKET_MS[bucket]) {
+        ++bucket;
+      }
+      ++firstSendCounts[bucket];
+    }
+
+    if (isOverBudget(passStart)) {
+      break;
+    }
   }
 
 #ifdef DEBUG_PRINTF
@@ -105,6 +334,8 @@ void PacketSender::sendRepeats(size_t num) {
   Serial.print("Elapsed: ");
   Serial.println(iElapsed);
 #endif
+
+  return sent;
 }
 
 void PacketSender::updateResendCount() {
@@ -122,4 +353,14 @@ void PacketSender::updateResendCount() {
 
   this->currentResendCount = signedResends;
   this->lastSend = now;
-}
\ No newline at end of file
+}
+size_t PacketSender::repeatsFor(const MiLightRemoteConfig* remoteConfig) const {
+  const size_t budget = settings.packetRepeatsFor(remoteConfig->type);
+
+  if (budget == settings.packetRepeats || settings.packetRepeats == 0) {
+    return this->currentResendCount;
+  }
+
+  const size_t scaled = (budget * this->currentResendCount) / settings.packetRepeats;
+  return std::max(std::min(scaled, budget), std::min(settings.packetRepeatMinimum, budget));
+}
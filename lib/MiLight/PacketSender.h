@@ -5,26 +5,102 @@
 #include <PacketQueue.h>
 #include <RadioSwitchboard.h>
 
+// How long after its last repeat a sent packet is still recognized by isEcho()
+#ifndef MILIGHT_ECHO_WINDOW_MS
+#define MILIGHT_ECHO_WINDOW_MS 250
+#endif
+
 class PacketSender {
 public:
   typedef std::function<void(uint8_t* packet, const MiLightRemoteConfig& config)> PacketSentHandler;
+  // Called with the time from a packet being queued until its last repeat was sent
+  typedef std::function<void(const QueuedPacket& packet, uint32_t latencyMicros)> PacketLatencyHandler;
+  // Identifies a queued packet.  Pass to isSent() to find out when it and
+  // everything queued before it has been sent.
+  typedef uint32_t Ticket;
+  // Tickets of the packets queued while it was recorded.  A coalesced packet
+  // keeps the ticket it was first queued with, so this is a range.
+  struct TicketRange {
+    TicketRange() : first(0), last(0), count(0) { }
+    void add(Ticket ticket);
+
+    Ticket first;
+    Ticket last;
+    size_t count;
+  };
   static const size_t DEFAULT_PACKET_SENDS_VALUE = 0;
 
+  // Time from a packet being queued until its last repeat was sent
+  struct LaneStats {
+    uint32_t sentPackets;
+    uint32_t totalLatencyMs;
+    uint32_t maxLatencyMs;
+  };
+
+  // Upper bounds of the time-to-first-send histogram buckets.  A final bucket
+  // holds everything slower.
+  static const size_t NUM_FIRST_SEND_BUCKETS = 10;
+  static const uint16_t FIRST_SEND_BUCKET_MS[NUM_FIRST_SEND_BUCKETS - 1];
+
   PacketSender(
     RadioSwitchboard& radioSwitchboard,
     Settings& settings,
     PacketSentHandler packetSentHandler
   );
 
-  void enqueue(uint8_t* packet, const MiLightRemoteConfig* remoteConfig, const size_t repeatsOverride = 0);
+  // If coalescing is enabled and commandClass is set, a queued packet for the
+  // same bulb and command class is replaced rather than queueing a new one.
+  // Returns the ticket of the queued packet that will carry this one.
+  Ticket enqueue(
+    uint8_t* packet,
+    const MiLightRemoteConfig* remoteConfig,
+    const size_t repeatsOverride = 0,
+    const BulbId& bulbId = DEFAULT_BULB_ID,
+    const PacketCommandClass commandClass = PacketCommandClass::NONE,
+    const PacketPriority priority = PacketPriority::NORMAL
+  );
+  // Sends repeats until the time budget for one pass of the main loop is
+  // used up.  At least one repeat is sent if there's anything queued.
+  //
+  // With an interleave width of K > 1, up to K packets for bulbs that don't
+  // interact and share a radio config are taken from the queue at once, and
+  // take turns sending one repeat each.  Every bulb hears its first copy within K repeats, and the
+  // number of repeats sent is the same as sending the packets one by one.
   void loop();
 
   // Return true if there are queued packets
   bool isSending();
 
+  // Ticket of the most recently queued packet
+  Ticket lastTicket() const;
+  // Return true once the packet with this ticket and all packets queued
+  // before it have been sent.  Packets dropped from the queue count as sent.
+  bool isSent(Ticket ticket) const;
+  // Return true once the packets in range have been sent.  Unlike the above,
+  // doesn't wait for packets queued earlier, which may be in a lower lane.
+  bool isSent(const TicketRange& range) const;
+  // Add the ticket of each packet queued from now on to range.  Pass null to
+  // stop.
+  void recordTickets(TicketRange* range);
+
+  // Return true if packet is one we're sending or just sent.  A radio that
+  // listens while another one sends will hear our own packets.
+  bool isEcho(const uint8_t* packet, size_t length);
+
   // Return the number of queued packets
   size_t queueLength() const;
+  size_t queueLength(PacketPriority priority) const;
   size_t droppedPackets() const;
+  size_t coalescedPackets() const;
+  // Number of packets passed to enqueue(), including ones later coalesced or
+  // dropped
+  uint32_t enqueuedPackets() const;
+  const LaneStats& laneStats(PacketPriority priority) const;
+  // Number of packets whose first repeat went out in each bucket of
+  // FIRST_SEND_BUCKET_MS, measured from when they were queued
+  const uint32_t* firstSendHistogram() const;
+
+  void onPacketLatency(PacketLatencyHandler handler);
 
 private:
   RadioSwitchboard& radioSwitchboard;
@@ -32,22 +108,53 @@ private:
   GroupStateStore* stateStore;
   PacketQueue queue;
 
-  // The current packet we're sending and the number of repeats left
-  std::shared_ptr<QueuedPacket> currentPacket;
-  size_t packetRepeatsRemaining;
+  // A packet taken from the queue that's being sent
+  struct ActivePacket {
+    PacketQueue::SlotId slot;
+    size_t repeatsRemaining;
+    bool started;
+  };
+
+  // Packets being sent, in the order they were popped.  nextActive is the one
+  // whose turn it is.
+  ActivePacket activePackets[MILIGHT_MAX_INTERLEAVED_PACKETS];
+  size_t numActive;
+  size_t nextActive;
 
   // Handler called after packets are sent.  Will not be called multiple times
   // per repeat.
   PacketSentHandler packetSentHandler;
+  PacketLatencyHandler packetLatencyHandler;
+
+  LaneStats stats[NUM_PACKET_PRIORITIES];
+  uint32_t firstSendCounts[NUM_FIRST_SEND_BUCKETS];
+  uint32_t numEnqueued;
+  TicketRange* ticketRange;
+
+  // Copy of the last packet that finished sending, for isEcho()
+  uint8_t lastSentPacket[MILIGHT_MAX_PACKET_LENGTH];
+  unsigned long lastSentAt;
 
-  // Send a batch of repeats for the current packet
-  void handleCurrentPacket();
+  // Send up to maxRepeats repeats of the active packet at ix without going
+  // over the budget for the pass started at passStart.  Returns the number
+  // sent.
+  size_t handleActivePacket(size_t ix, size_t maxRepeats, unsigned long passStart);
 
-  // Switch to the next packet in the queue
-  void nextPacket();
+  // Take packets from the queue until the interleave width is reached, or
+  // the next packet can't be sent alongside the active ones
+  void fillActivePackets();
+  bool canInterleave(const QueuedPacket& packet) const;
 
-  // Send repeats of the current packet N times
-  void sendRepeats(size_t num);
+  // Fire callbacks and stats for a packet whose last repeat was sent, and
+  // stop sending it
+  void finishPacket(size_t ix);
+  void removeActivePacket(size_t ix);
+
+  // Send repeats of a packet up to N times, stopping early if the pass's
+  // budget runs out.  Always sends at least one.  Returns the number sent.
+  size_t sendRepeats(ActivePacket& active, size_t num, unsigned long passStart);
+
+  bool isOverBudget(unsigned long passStart) const;
 
   // Used to track auto repeat limiting
   unsigned long lastSend;
@@ -71,4 +178,8 @@ private:
    * increased up to a maximum of the default resend count.
    */
   void updateResendCount();
+
+  // Number of repeats for a packet without an override.  The throttled resend
+  // count is scaled to the remote type's budget from settings.
+  size_t repeatsFor(const MiLightRemoteConfig* remoteConfig) const;
 };
\ No newline at end of file
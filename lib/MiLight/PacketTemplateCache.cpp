@@ -0,0 +1,34 @@
+#include <PacketTemplateCache.h>
+#include <string.h>
+
+PacketTemplateCache::PacketTemplateCache(const size_t packetLength)
+  : packetLength(packetLength),
+    count(0),
+    clock(0)
+{ }
+
+void PacketTemplateCache::set(Key key, const uint8_t* packet) {
+  size_t slot = count;
+
+  if (count < MILIGHT_PACKET_TEMPLATE_SLOTS) {
+    ++count;
+  } else {
+    // Evict the least recently used entry.  Ages are compared rather than
+    // times so that the clock wrapping around doesn't matter.
+    slot = 0;
+
+    for (size_t i = 1; i < count; ++i) {
+      if (clock - lastUsed[i] > clock - lastUsed[slot]) {
+        slot = i;
+      }
+    }
+  }
+
+  keys[slot] = key;
+  lastUsed[slot] = ++clock;
+  memcpy(packets[slot], packet, packetLength);
+}
+
+size_t PacketTemplateCache::size() const {
+  return count;
+}
@@ -0,0 +1,68 @@
+#include <inttypes.h>
+#include <stddef.h>
+#include <MiLightRadioConfig.h>
+
+#ifndef _PACKET_TEMPLATE_CACHE_H
+#define _PACKET_TEMPLATE_CACHE_H
+
+// Set to 1 to have formatters that support it reuse packets they built for
+// the same bulb and command.  Off by default: on the host it's slower than
+// building packets fresh (see --formatters in src/native/main.cpp).
+#ifndef MILIGHT_PACKET_TEMPLATES
+#define MILIGHT_PACKET_TEMPLATES 0
+#endif
+
+// Packets each formatter with templates enabled remembers
+#ifndef MILIGHT_PACKET_TEMPLATE_SLOTS
+#define MILIGHT_PACKET_TEMPLATE_SLOTS 8
+#endif
+
+/*
+ * Small LRU of packets, keyed by the bulb and command they were built for.
+ *
+ * Keys are packed into integers and kept apart from the packets, and each
+ * entry records when it was last used, so a lookup is a scan over a few words
+ * and hits don't move anything.
+ */
+class PacketTemplateCache {
+public:
+  typedef uint64_t Key;
+
+  static Key keyOf(uint16_t deviceId, uint8_t groupId, uint8_t command, uint8_t arg, bool held) {
+    return (static_cast<uint64_t>(held) << 40)
+      | (static_cast<uint64_t>(deviceId) << 24)
+      | (static_cast<uint32_t>(groupId) << 16)
+      | (static_cast<uint32_t>(command) << 8)
+      | arg;
+  }
+
+  PacketTemplateCache(const size_t packetLength);
+
+  // Returns the packet saved for key, or NULL
+  const uint8_t* get(Key key) {
+    for (size_t i = 0; i < count; ++i) {
+      if (keys[i] == key) {
+        lastUsed[i] = ++clock;
+        return packets[i];
+      }
+    }
+
+    return NULL;
+  }
+
+  // Saves a packet for a key that isn't in the cache, evicting the least
+  // recently used one if it's full
+  void set(Key key, const uint8_t* packet);
+
+  size_t size() const;
+
+private:
+  const size_t packetLength;
+  size_t count;
+  uint32_t clock;
+  Key keys[MILIGHT_PACKET_TEMPLATE_SLOTS];
+  uint32_t lastUsed[MILIGHT_PACKET_TEMPLATE_SLOTS];
+  uint8_t packets[MILIGHT_PACKET_TEMPLATE_SLOTS][MILIGHT_MAX_PACKET_LENGTH];
+};
+
+#endif
@@ -11,6 +11,8 @@ RadioSwitchboard::RadioSwitchboard(
     radios.push_back(radio);
   }
 
+  reconfigureCounts.resize(radios.size(), 0);
+
   for (size_t i = 0; i < MiLightRemoteConfig::NUM_REMOTES; i++) {
     MiLightRemoteConfig::ALL_REMOTES[i]->packetFormatter->initialize(stateStore, &settings);
   }
@@ -20,6 +22,10 @@ size_t RadioSwitchboard::getNumRadios() const {
   return radios.size();
 }
 
+uint32_t RadioSwitchboard::getReconfigureCount(size_t index) const {
+  return reconfigureCounts[index];
+}
+
 std::shared_ptr<MiLightRadio> RadioSwitchboard::switchRadio(size_t radioIx) {
   if (radioIx >= getNumRadios()) {
     return NULL;
@@ -28,6 +34,7 @@ std::shared_ptr<MiLightRadio> RadioSwitchboard::switchRadio(size_t radioIx) {
   if (this->currentRadio != radios[radioIx]) {
     this->currentRadio = radios[radioIx];
     this->currentRadio->configure();
+    ++reconfigureCounts[radioIx];
   }
 
   return this->currentRadio;
@@ -59,7 +66,8 @@ size_t RadioSwitchboard::read(uint8_t* packet) {
     return 0;
   }
 
-  size_t length;
+  // Radios treat frame_length as the size of the buffer to copy into
+  size_t length = MILIGHT_MAX_PACKET_LENGTH;
   currentRadio->read(packet, length);
 
   return length;
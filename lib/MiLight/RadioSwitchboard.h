@@ -17,6 +17,9 @@ public:
   std::shared_ptr<MiLightRadio> switchRadio(size_t index);
   size_t getNumRadios() const;
 
+  // Number of times the radio has been reconfigured for the given config
+  uint32_t getReconfigureCount(size_t index) const;
+
   bool available();
   void write(uint8_t* packet, size_t length);
   size_t read(uint8_t* packet);
@@ -24,4 +27,5 @@ public:
 private:
   std::vector<std::shared_ptr<MiLightRadio>> radios;
   std::shared_ptr<MiLightRadio> currentRadio;
+  std::vector<uint32_t> reconfigureCounts;
 };
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include <RepeatCalibrator.h>
+#include <MiLightRadioConfig.h>
+#include <math.h>
+
+RepeatCalibrator::Options::Options()
+  : targetRatio(0.99)
+  , probesPerType(MILIGHT_CALIBRATION_DEFAULT_PROBES)
+  , apply(false)
+{ }
+
+float RepeatCalibrator::Result::hearRatio() const {
+  return sent == 0 ? 0 : static_cast<float>(heard) / sent;
+}
+
+uint32_t RepeatCalibrator::Result::averageWriteMicros() const {
+  return sent == 0 ? 0 : totalWriteMicros / sent;
+}
+
+int32_t RepeatCalibrator::Result::airtimeSavedMicros() const {
+  if (recommendedRepeats == 0) {
+    return 0;
+  }
+
+  return (static_cast<int32_t>(previousRepeats) - static_cast<int32_t>(recommendedRepeats))
+    * static_cast<int32_t>(averageWriteMicros());
+}
+
+RepeatCalibrator::RepeatCalibrator(
+  RadioSwitchboard& radios,
+  std::shared_ptr<RadioSwitchboard> listenRadio,
+  PacketSender& packetSender,
+  Settings& settings
+) : radios(radios)
+  , listenRadio(listenRadio)
+  , packetSender(packetSender)
+  , settings(settings)
+  , completeHandler(nullptr)
+  , state(State::IDLE)
+  , currentResult(0)
+  , currentConfig(nullptr)
+  , listening(false)
+  , sentAt(0)
+  , probe()
+  , probeLength(0)
+{ }
+
+bool RepeatCalibrator::start(const Options& options) {
+  if (! canCalibrate()) {
+    return false;
+  }
+
+  this->options = options;
+  results.clear();
+
+  if (options.remoteTypes.empty()) {
+    for (size_t i = 0; i < MiLightRemoteConfig::NUM_REMOTES; ++i) {
+      this->options.remoteTypes.push_back(MiLightRemoteConfig::ALL_REMOTES[i]->type);
+    }
+  }
+
+  for (MiLightRemoteType type : this->options.remoteTypes) {
+    results.push_back(Result{type, 0, 0, settings.packetRepeatsFor(type), 0, 0});
+  }
+
+  currentResult = 0;
+  currentConfig = nullptr;
+  listening = false;
+  state = State::RUNNING;
+
+  return true;
+}
+
+void RepeatCalibrator::cancel() {
+  results.clear();
+  listening = false;
+  state = State::IDLE;
+}
+
+void RepeatCalibrator::loop() {
+  if (state != State::RUNNING) {
+    return;
+  }
+
+  if (listening) {
+    listenForProbe();
+  } else if (! packetSender.isSending()) {
+    // Only probe while the air is ours, so real commands aren't delayed and
+    // don't collide with probes
+    sendProbe();
+  }
+}
+
+bool RepeatCalibrator::isRunning() const {
+  return state == State::RUNNING;
+}
+
+bool RepeatCalibrator::canCalibrate() const {
+  return listenRadio != nullptr;
+}
+
+RepeatCalibrator::State RepeatCalibrator::getState() const {
+  return state;
+}
+
+const RepeatCalibrator::Options& RepeatCalibrator::getOptions() const {
+  return options;
+}
+
+const std::vector<RepeatCalibrator::Result>& RepeatCalibrator::getResults() const {
+  return results;
+}
+
+void RepeatCalibrator::onComplete(CompleteHandler handler) {
+  this->completeHandler = handler;
+}
+
+size_t RepeatCalibrator::repeatsForTarget(float hearRatio, float targetRatio, size_t maxRepeats) {
+  if (hearRatio <= 0) {
+    return 0;
+  }
+  if (hearRatio >= 1 || targetRatio <= 0) {
+    return 1;
+  }
+  if (targetRatio >= 1) {
+    return maxRepeats;
+  }
+
+  // Smallest r with 1 - (1 - p)^r >= T.  The tolerance stops rounding error
+  // from pushing exact answers up by one.
+  const float repeats = ceilf(logf(1 - targetRatio) / logf(1 - hearRatio) - 1e-4f);
+
+  if (repeats >= maxRepeats) {
+    return maxRepeats;
+  }
+
+  return std::max(static_cast<size_t>(repeats), static_cast<size_t>(1));
+}
+
+void RepeatCalibrator::sendProbe() {
+  if (currentResult >= results.size()) {
+    finish();
+    return;
+  }
+
+  Result& result = results[currentResult];
+
+  if (currentConfig == nullptr || currentConfig->type != result.remoteType) {
+    currentConfig = MiLightRemoteConfig::fromType(result.remoteType);
+
+    if (currentConfig == nullptr) {
+      ++currentResult;
+      return;
+    }
+
+    listenRadio->switchRadio(currentConfig);
+  }
+
+  // Build a fresh probe each time.  Formatters with sequence numbers then
+  // make each probe distinct, so a late echo can't be counted twice.
+  PacketFormatter* formatter = currentConfig->packetFormatter;
+  formatter->prepare(MILIGHT_CALIBRATION_DEVICE_ID, 1);
+  formatter->updateStatus(ON, 1);
+  PacketStream& stream = formatter->buildPackets();
+  probeLength = formatter->getPacketLength();
+  memcpy(probe, stream.next(), probeLength);
+  formatter->reset();
+
+  // Drop anything heard before the probe went out
+  uint8_t packet[MILIGHT_MAX_PACKET_LENGTH];
+  while (listenRadio->available()) {
+    listenRadio->read(packet);
+  }
+
+  radios.switchRadio(currentConfig);
+
+  const uint32_t start = micros();
+  radios.write(probe, probeLength);
+  sentAt = micros();
+
+  result.totalWriteMicros += sentAt - start;
+  ++result.sent;
+  listening = true;
+}
+
+void RepeatCalibrator::listenForProbe() {
+  uint8_t packet[MILIGHT_MAX_PACKET_LENGTH];
+
+  while (listenRadio->available()) {
+    listenRadio->read(packet);
+
+    if (memcmp(packet, probe, probeLength) == 0) {
+      ++results[currentResult].heard;
+      nextProbe();
+      return;
+    }
+  }
+
+  if (micros() - sentAt >= MILIGHT_CALIBRATION_LISTEN_WINDOW_US) {
+    nextProbe();
+  }
+}
+
+void RepeatCalibrator::nextProbe() {
+  listening = false;
+
+  if (results[currentResult].sent >= options.probesPerType) {
+    ++currentResult;
+  }
+
+  if (currentResult >= results.size()) {
+    finish();
+  }
+}
+
+void RepeatCalibrator::finish() {
+  const size_t maxRepeats = settings.packetRepeats;
+  const size_t minRepeats = std::min(std::max(settings.packetRepeatMinimum, static_cast<size_t>(1)), maxRepeats);
+
+  for (Result& result : results) {
+    const size_t repeats = repeatsForTarget(result.hearRatio(), options.targetRatio, maxRepeats);
+
+    result.recommendedRepeats = repeats == 0 ? 0 : std::max(repeats, minRepeats);
+
+    if (options.apply && result.recommendedRepeats > 0) {
+      settings.packetRepeatsByType[result.remoteType] = result.recommendedRepeats;
+    }
+  }
+
+  listening = false;
+  state = State::DONE;
+
+  if (completeHandler != nullptr) {
+    completeHandler();
+  }
+}
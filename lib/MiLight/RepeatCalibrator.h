@@ -0,0 +1,128 @@
+#pragma once
+
+#include <RadioSwitchboard.h>
+#include <PacketSender.h>
+#include <Settings.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Device ID probes are sent from.  Probes turn this device on, so it should
+// not be paired with any bulbs.
+#ifndef MILIGHT_CALIBRATION_DEVICE_ID
+#define MILIGHT_CALIBRATION_DEVICE_ID 0xCA1B
+#endif
+
+// How long to listen for the echo of a probe before counting it as missed
+#ifndef MILIGHT_CALIBRATION_LISTEN_WINDOW_US
+#define MILIGHT_CALIBRATION_LISTEN_WINDOW_US 5000
+#endif
+
+#ifndef MILIGHT_CALIBRATION_DEFAULT_PROBES
+#define MILIGHT_CALIBRATION_DEFAULT_PROBES 50
+#endif
+
+/**
+ * Measures how many repeats each remote type needs by sending probe packets
+ * and counting how many a dedicated listen radio hears back.
+ *
+ * Each probe is a single transmission, so the fraction heard estimates the
+ * chance p that one repeat gets through.  Assuming repeats are lost
+ * independently, the fewest repeats r with 1 - (1 - p)^r >= target is the
+ * recommended budget for the type.
+ *
+ * The listen radio sits next to the sending radio, so p is optimistic
+ * compared to a bulb across the house.  Recommendations are never below
+ * packetRepeatMinimum or above packetRepeats.
+ *
+ * Runs from the main loop a probe at a time, and only while the packet
+ * sender is idle.  Listening must be paused while it runs, otherwise the
+ * probes are handled as commands from a real remote.
+ */
+class RepeatCalibrator {
+public:
+  typedef std::function<void()> CompleteHandler;
+
+  enum class State {
+    IDLE,
+    RUNNING,
+    DONE
+  };
+
+  struct Options {
+    // Fraction of commands which should be delivered, (0, 1)
+    float targetRatio;
+    size_t probesPerType;
+    // Store recommendations in settings when finished
+    bool apply;
+    // Remote types to calibrate.  All of them if empty.
+    std::vector<MiLightRemoteType> remoteTypes;
+
+    Options();
+  };
+
+  struct Result {
+    MiLightRemoteType remoteType;
+    size_t sent;
+    size_t heard;
+    size_t previousRepeats;
+    // Zero if no probes were heard
+    size_t recommendedRepeats;
+    uint32_t totalWriteMicros;
+
+    float hearRatio() const;
+    uint32_t averageWriteMicros() const;
+    // Airtime a command would save by sending recommendedRepeats instead of
+    // previousRepeats.  Negative if the type needs more repeats.
+    int32_t airtimeSavedMicros() const;
+  };
+
+  RepeatCalibrator(
+    RadioSwitchboard& radios,
+    std::shared_ptr<RadioSwitchboard> listenRadio,
+    PacketSender& packetSender,
+    Settings& settings
+  );
+
+  // Returns false if there's no listen radio to measure with
+  bool start(const Options& options);
+  void cancel();
+  void loop();
+
+  bool isRunning() const;
+  bool canCalibrate() const;
+  State getState() const;
+  const Options& getOptions() const;
+  const std::vector<Result>& getResults() const;
+
+  void onComplete(CompleteHandler handler);
+
+  // Fewest repeats at which a packet with hearRatio chance of being heard
+  // each time is heard at least once with probability targetRatio.  Zero if
+  // hearRatio is zero.
+  static size_t repeatsForTarget(float hearRatio, float targetRatio, size_t maxRepeats);
+
+private:
+  RadioSwitchboard& radios;
+  std::shared_ptr<RadioSwitchboard> listenRadio;
+  PacketSender& packetSender;
+  Settings& settings;
+  CompleteHandler completeHandler;
+
+  State state;
+  Options options;
+  std::vector<Result> results;
+
+  // Index into results of the type being probed
+  size_t currentResult;
+  const MiLightRemoteConfig* currentConfig;
+  bool listening;
+  uint32_t sentAt;
+  uint8_t probe[MILIGHT_MAX_PACKET_LENGTH];
+  size_t probeLength;
+
+  void sendProbe();
+  void listenForProbe();
+  void nextProbe();
+  void finish();
+};
@@ -47,7 +47,7 @@ void RgbCctPacketFormatter::updateTemperature(uint8_t value) {
   // in white mode, that makes changing temperature annoying because the current hue/mode
   // is lost.  So lookup our current bulb mode, and if needed, reset the hue/mode after
   // changing the temperature
-  const GroupState* ourState = this->stateStore->get(this->deviceId, this->groupId, REMOTE_TYPE_RGB_CCT);
+  const GroupState* ourState = knownState();
 
   // now make the temperature change
   command(RGB_CCT_KELVIN, cmdValue);
@@ -66,7 +66,7 @@ void RgbCctPacketFormatter::updateTemperature(uint8_t value) {
 // make the change, and switch back again.
 void RgbCctPacketFormatter::updateSaturation(uint8_t value) {
    // look up our current mode
-  const GroupState* ourState = this->stateStore->get(this->deviceId, this->groupId, REMOTE_TYPE_RGB_CCT);
+  const GroupState* ourState = knownState();
   BulbMode originalBulbMode = BulbMode::BULB_MODE_WHITE;
 
   if (ourState != NULL) {
@@ -92,7 +92,7 @@ void RgbCctPacketFormatter::updateSaturation(uint8_t value) {
 void RgbCctPacketFormatter::updateColorWhite() {
   // there is no direct white command, so let's look up our prior temperature and set that, which
   // causes the bulb to go white
-  const GroupState* ourState = this->stateStore->get(this->deviceId, this->groupId, REMOTE_TYPE_RGB_CCT);
+  const GroupState* ourState = knownState();
   uint8_t value =
     ourState == NULL
       ? 0
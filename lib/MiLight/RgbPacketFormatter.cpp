@@ -13,6 +13,10 @@ void RgbPacketFormatter::initializePacket(uint8_t *packet) {
   packet[packetPtr++] = sequenceNum++;
 }
 
+void RgbPacketFormatter::stampSequenceNum(uint8_t* packet) {
+  packet[5] = sequenceNum++;
+}
+
 void RgbPacketFormatter::pair() {
   for (size_t i = 0; i < 5; i++) {
     command(RGB_SPEED_UP, 0);
@@ -29,12 +33,18 @@ void RgbPacketFormatter::updateStatus(MiLightStatus status, uint8_t groupId) {
   command(status == ON ? RGB_ON : RGB_OFF, 0);
 }
 
+bool RgbPacketFormatter::supportsTemplates() const {
+  return true;
+}
+
 void RgbPacketFormatter::command(uint8_t command, uint8_t arg) {
-  pushPacket();
-  if (held) {
-    command |= 0x80;
+  if (pushTemplate(command, arg)) {
+    return;
   }
-  currentPacket[RGB_COMMAND_INDEX] = command;
+
+  pushPacket();
+  currentPacket[RGB_COMMAND_INDEX] = held ? (command | 0x80) : command;
+  saveTemplate(command, arg);
 }
 
 void RgbPacketFormatter::updateHue(uint16_t value) {
@@ -48,7 +58,7 @@ void RgbPacketFormatter::updateColorRaw(uint8_t value) {
 }
 
 void RgbPacketFormatter::updateBrightness(uint8_t value) {
-  const GroupState* state = this->stateStore->get(deviceId, groupId, MiLightRemoteType::REMOTE_TYPE_RGB);
+  const GroupState* state = knownState();
   int8_t knownValue = (state != NULL && state->isSetBrightness()) ? state->getBrightness() / RGB_INTERVALS : -1;
 
   valueByStepFunction(
@@ -42,6 +42,8 @@ public:
   virtual BulbId parsePacket(const uint8_t* packet, JsonObject result);
 
   virtual void initializePacket(uint8_t* packet);
+  virtual void stampSequenceNum(uint8_t* packet);
+  virtual bool supportsTemplates() const;
 };
 
 #endif
@@ -6,8 +6,8 @@
 #define GROUP_FOR_STATUS_COMMAND(buttonId) ( ((buttonId) - 1) / 2 )
 #define STATUS_FOR_COMMAND(buttonId) ( ((buttonId) % 2) == 0 ? OFF : ON )
 
-bool RgbwPacketFormatter::canHandle(const uint8_t *packet, const size_t len) {
-  return len == packetLength && (packet[0] & 0xF0) == RGBW_PROTOCOL_ID_BYTE;
+PacketSignature RgbwPacketFormatter::getPacketSignature() const {
+  return PacketSignature{false, 0, 0xF0, RGBW_PROTOCOL_ID_BYTE};
 }
 
 void RgbwPacketFormatter::initializePacket(uint8_t* packet) {
@@ -22,6 +22,10 @@ void RgbwPacketFormatter::initializePacket(uint8_t* packet) {
   packet[packetPtr++] = sequenceNum++;
 }
 
+void RgbwPacketFormatter::stampSequenceNum(uint8_t* packet) {
+  packet[6] = sequenceNum++;
+}
+
 void RgbwPacketFormatter::unpair() {
   PacketFormatter::updateStatus(ON);
   updateColorWhite();
@@ -44,7 +48,7 @@ void RgbwPacketFormatter::previousMode() {
 }
 
 uint8_t RgbwPacketFormatter::currentMode() {
-  const GroupState* state = stateStore->get(deviceId, groupId, REMOTE_TYPE_RGBW);
+  const GroupState* state = knownState();
   return state != NULL ? state->getMode() : 0;
 }
 
@@ -71,12 +75,18 @@ void RgbwPacketFormatter::updateBrightness(uint8_t value) {
   currentPacket[RGBW_BRIGHTNESS_GROUP_INDEX] |= (packetBrightnessValue << 3);
 }
 
+bool RgbwPacketFormatter::supportsTemplates() const {
+  return true;
+}
+
 void RgbwPacketFormatter::command(uint8_t command, uint8_t arg) {
-  pushPacket();
-  if (held) {
-    command |= 0x80;
+  if (pushTemplate(command, arg)) {
+    return;
   }
-  currentPacket[RGBW_COMMAND_INDEX] = command;
+
+  pushPacket();
+  currentPacket[RGBW_COMMAND_INDEX] = held ? (command | 0x80) : command;
+  saveTemplate(command, arg);
 }
 
 void RgbwPacketFormatter::updateHue(uint16_t value) {
@@ -99,7 +109,7 @@ void RgbwPacketFormatter::enableNightMode() {
 
   // Bulbs must be OFF for night mode to work in RGBW.
   // Turn it off if it isn't already off.
-  const GroupState* state = stateStore->get(deviceId, groupId, REMOTE_TYPE_RGBW);
+  const GroupState* state = knownState();
   if (state == NULL || state->getState() == MiLightStatus::ON) {
     command(button, 0);
   }
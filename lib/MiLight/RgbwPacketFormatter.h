@@ -55,7 +55,7 @@ public:
     : PacketFormatter(REMOTE_TYPE_RGBW, 7)
   { }
 
-  virtual bool canHandle(const uint8_t* packet, const size_t len);
+  virtual PacketSignature getPacketSignature() const;
   virtual void updateStatus(MiLightStatus status, uint8_t groupId);
   virtual void updateBrightness(uint8_t value);
   virtual void command(uint8_t command, uint8_t arg);
@@ -73,6 +73,8 @@ public:
   virtual BulbId parsePacket(const uint8_t* packet, JsonObject result);
 
   virtual void initializePacket(uint8_t* packet);
+  virtual void stampSequenceNum(uint8_t* packet);
+  virtual bool supportsTemplates() const;
 
 protected:
   static bool isStatusCommand(const uint8_t command);
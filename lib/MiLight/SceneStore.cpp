@@ -0,0 +1,518 @@
+#include <SceneStore.h>
+#include <GroupCommandPlanner.h>
+#include <MiLightRemoteConfig.h>
+#include <FileHelpers.h>
+#include <algorithm>
+
+static const uint8_t SCENES_MAGIC[] = {'M', 'L', 'S', 1};
+
+// Name length, then the state, packet and program byte counts
+static const size_t SCENE_HEADER_SIZE = 1 + 3 * sizeof(uint16_t);
+
+const char SceneStore::DEFAULT_PATH[] = "/scenes.bin";
+
+static void writeUint16(uint8_t* buffer, uint16_t value) {
+  buffer[0] = value;
+  buffer[1] = value >> 8;
+}
+
+static uint16_t readUint16(const uint8_t* buffer) {
+  return buffer[0] | (static_cast<uint16_t>(buffer[1]) << 8);
+}
+
+SceneStore::SceneStore(
+  MiLightClient& milightClient,
+  PacketSender& packetSender,
+  GroupStateStore& stateStore,
+  FS& fs,
+  const char* path
+) : milightClient(milightClient)
+  , packetSender(packetSender)
+  , stateStore(stateStore)
+  , fs(fs)
+  , path(path)
+  , loaded(false)
+  , pendingPackets(0)
+{ }
+
+SceneStore::Status SceneStore::define(const String& name, JsonArray updates) {
+  if (name.length() == 0 || name.length() > MILIGHT_MAX_SCENE_NAME_LENGTH || name.indexOf('/') != -1) {
+    return Status::INVALID_NAME;
+  }
+
+  load();
+
+  auto existing = findScene(name);
+
+  if (existing == scenes.end() && scenes.size() >= MILIGHT_MAX_SCENES) {
+    return Status::TOO_MANY_SCENES;
+  }
+
+  Scene scene;
+  scene.name = name;
+  std::vector<uint8_t> program;
+
+  const Status status = compile(updates, scene, program);
+
+  if (status != Status::OK) {
+    return status;
+  }
+
+  cancelActivation();
+
+  // Not in the file yet.  save() writes it from program.
+  scene.offset = 0;
+
+  std::vector<Scene> updated(scenes);
+
+  if (existing != scenes.end()) {
+    updated[existing - scenes.begin()] = scene;
+  } else {
+    updated.push_back(scene);
+  }
+
+  return save(updated, program) ? Status::OK : Status::WRITE_FAILED;
+}
+
+SceneStore::Status SceneStore::remove(const String& name) {
+  load();
+
+  auto it = findScene(name);
+
+  if (it == scenes.end()) {
+    return Status::NOT_FOUND;
+  }
+
+  cancelActivation();
+
+  std::vector<Scene> updated(scenes);
+  updated.erase(updated.begin() + (it - scenes.begin()));
+
+  return save(updated, std::vector<uint8_t>()) ? Status::OK : Status::WRITE_FAILED;
+}
+
+const SceneStore::Scene* SceneStore::find(const String& name) {
+  load();
+
+  auto it = findScene(name);
+  return it == scenes.end() ? nullptr : &*it;
+}
+
+const std::vector<SceneStore::Scene>& SceneStore::getScenes() {
+  load();
+  return scenes;
+}
+
+bool SceneStore::activate(const String& name) {
+  load();
+
+  auto it = findScene(name);
+
+  if (it == scenes.end()) {
+    return false;
+  }
+
+  cancelActivation();
+  activeFile = fs.open(path, "r");
+
+  if (! activeFile || ! activeFile.seek(it->offset)) {
+    cancelActivation();
+    return false;
+  }
+
+  for (size_t i = 0; i < it->numStates; ++i) {
+    uint8_t entry[STATE_ENTRY_SIZE];
+
+    if (activeFile.read(entry, STATE_ENTRY_SIZE) != STATE_ENTRY_SIZE) {
+      cancelActivation();
+      return false;
+    }
+
+    GroupState state;
+    state.load(entry + BULB_ID_SIZE);
+    stateStore.set(decodeBulbId(entry), state);
+  }
+
+  pendingPackets = it->numPackets;
+
+  loop();
+
+  return true;
+}
+
+void SceneStore::loop() {
+  // Queueing more than fits would drop the packets queued before them
+  while (pendingPackets > 0 && packetSender.queueLength() < MILIGHT_MAX_QUEUED_PACKETS) {
+    uint8_t entry[PACKET_HEADER_SIZE + MILIGHT_MAX_PACKET_LENGTH];
+
+    // Entries were checked when the file was loaded, so a short read means
+    // the file has gone
+    if (activeFile.read(entry, PACKET_HEADER_SIZE) != PACKET_HEADER_SIZE) {
+      cancelActivation();
+      return;
+    }
+
+    const BulbId bulbId = decodeBulbId(entry);
+    const MiLightRemoteConfig* remote = MiLightRemoteConfig::fromType(bulbId.deviceType);
+    const size_t length = remote->packetFormatter->getPacketLength();
+    uint8_t* packet = entry + PACKET_HEADER_SIZE;
+
+    if (activeFile.read(packet, length) != length) {
+      cancelActivation();
+      return;
+    }
+
+    remote->packetFormatter->stampSequenceNum(packet);
+
+    packetSender.enqueue(
+      packet,
+      remote,
+      PacketSender::DEFAULT_PACKET_SENDS_VALUE,
+      bulbId,
+      static_cast<PacketCommandClass>(entry[BULB_ID_SIZE]),
+      static_cast<PacketPriority>(entry[BULB_ID_SIZE + 1])
+    );
+
+    if (--pendingPackets == 0) {
+      cancelActivation();
+    }
+  }
+}
+
+bool SceneStore::isActivating() const {
+  return pendingPackets > 0;
+}
+
+const __FlashStringHelper* SceneStore::statusMessage(Status status) {
+  switch (status) {
+    case Status::OK:
+      return F("OK");
+    case Status::INVALID_NAME:
+      return F("Scene names must be 1-32 characters and can't contain '/'");
+    case Status::NO_UPDATES:
+      return F("Must specify an array of gateways and updates");
+    case Status::UNKNOWN_DEVICE_TYPE:
+      return F("Unknown device type");
+    case Status::UNSUPPORTED_UPDATE:
+      return F("Scene updates must set state fields, and can't have transitions, commands, or FUT089 saturation without a hue");
+    case Status::TOO_MANY_PACKETS:
+      return F("Scene has too many packets");
+    case Status::TOO_MANY_SCENES:
+      return F("Too many scenes");
+    case Status::NOT_FOUND:
+      return F("Scene not found");
+    case Status::WRITE_FAILED:
+      return F("Unable to write scenes file");
+    default:
+      return F("Unknown error");
+  }
+}
+
+SceneStore::Status SceneStore::compile(JsonArray updates, Scene& scene, std::vector<uint8_t>& program) {
+  GroupCommandPlanner planner;
+  // Each bulb's state once the scene is applied.  Updates can't hold commands
+  // or increments, so this comes straight from the updates rather than from
+  // parsing packets, which for some remotes depends on the bulbs' live state.
+  std::vector<std::pair<BulbId, GroupState>> states;
+
+  for (JsonObject update : updates) {
+    JsonObject stateUpdate = update[F("update")];
+    const LightCommand command = LightCommand::fromJson(stateUpdate);
+
+    if (command.isEmpty() || command.transition != 0 || GroupCommandPlanner::hasJsonOnlyCommands(stateUpdate)) {
+      return Status::UNSUPPORTED_UPDATE;
+    }
+
+    // FUT089 saturation changes temperature instead if the bulb is in white
+    // mode, and only a hue can switch it to color mode
+    const bool saturationNeedsHue = command.has(LightCommand::SATURATION)
+      && !command.has(LightCommand::HUE)
+      && !command.has(LightCommand::COLOR);
+
+    for (JsonObject gateway : update[F("gateways")].as<JsonArray>()) {
+      const MiLightRemoteType type = MiLightRemoteTypeHelpers::remoteTypeFromName(gateway[F("device_type")] | "");
+
+      if (MiLightRemoteConfig::fromType(type) == nullptr) {
+        return Status::UNKNOWN_DEVICE_TYPE;
+      }
+
+      if (saturationNeedsHue && type == REMOTE_TYPE_FUT089) {
+        return Status::UNSUPPORTED_UPDATE;
+      }
+
+      const BulbId bulbId(gateway[F("device_id")], gateway[F("group_id")], type);
+      planner.add(bulbId, command);
+
+      auto it = std::find_if(
+        states.begin(),
+        states.end(),
+        [&bulbId](const std::pair<BulbId, GroupState>& state) { return state.first == bulbId; }
+      );
+
+      if (it == states.end()) {
+        states.push_back(std::make_pair(bulbId, GroupState()));
+        it = states.end() - 1;
+      }
+
+      const GroupState stateUpdates(&it->second, stateUpdate);
+      it->second.patch(stateUpdates);
+    }
+  }
+
+  if (planner.size() == 0) {
+    return Status::NO_UPDATES;
+  }
+
+  std::vector<uint8_t> packets;
+  size_t numPackets = 0;
+
+  milightClient.setPacketCapture(
+    [&packets, &numPackets](
+      const uint8_t* packet,
+      const MiLightRemoteConfig& remoteConfig,
+      const BulbId& bulbId,
+      PacketCommandClass commandClass,
+      PacketPriority priority
+    ) {
+      const size_t length = remoteConfig.packetFormatter->getPacketLength();
+      const size_t offset = packets.size();
+
+      packets.resize(offset + PACKET_HEADER_SIZE + length);
+      encodeBulbId(BulbId(bulbId.deviceId, bulbId.groupId, remoteConfig.type), &packets[offset]);
+      packets[offset + BULB_ID_SIZE] = static_cast<uint8_t>(commandClass);
+      packets[offset + BULB_ID_SIZE + 1] = static_cast<uint8_t>(priority);
+      memcpy(&packets[offset + PACKET_HEADER_SIZE], packet, length);
+
+      ++numPackets;
+    }
+  );
+
+  planner.run(
+    [this, &numPackets](const BulbId& bulbId, const LightCommand& command, JsonObject) {
+      PacketFormatter* formatter = MiLightRemoteConfig::fromType(bulbId.deviceType)->packetFormatter;
+      const size_t packetsBefore = numPackets;
+
+      formatter->setStateless(true);
+      milightClient.apply(bulbId, command);
+      formatter->setStateless(false);
+
+      return numPackets - packetsBefore;
+    }
+  );
+
+  milightClient.clearPacketCapture();
+
+  if (numPackets > MILIGHT_MAX_SCENE_PACKETS) {
+    return Status::TOO_MANY_PACKETS;
+  }
+
+  program.resize(states.size() * STATE_ENTRY_SIZE);
+
+  for (size_t i = 0; i < states.size(); ++i) {
+    uint8_t* entry = &program[i * STATE_ENTRY_SIZE];
+    encodeBulbId(states[i].first, entry);
+    states[i].second.dump(entry + BULB_ID_SIZE);
+  }
+
+  program.insert(program.end(), packets.begin(), packets.end());
+
+  scene.numStates = states.size();
+  scene.numPackets = numPackets;
+  scene.programLength = program.size();
+
+  return Status::OK;
+}
+
+void SceneStore::load() {
+  if (loaded) {
+    return;
+  }
+  loaded = true;
+
+  char tmpPath[40];
+  FileHelpers::tmpPathFor(path, tmpPath, sizeof(tmpPath));
+  FileHelpers::recover(fs, tmpPath, path);
+
+  if (! fs.exists(path)) {
+    return;
+  }
+
+  File f = fs.open(path, "r");
+  uint8_t header[HEADER_SIZE];
+
+  if (f.read(header, HEADER_SIZE) != HEADER_SIZE || memcmp(header, SCENES_MAGIC, HEADER_SIZE) != 0) {
+    Serial.println(F("SceneStore - unknown scenes file format, ignoring it"));
+    f.close();
+    return;
+  }
+
+  Scene scene;
+
+  while (scenes.size() < MILIGHT_MAX_SCENES && readScene(f, scene)) {
+    scenes.push_back(scene);
+  }
+
+  f.close();
+}
+
+// Rewrites the whole file with the scenes in updated, and makes them the
+// current scenes if that succeeds.  Programs are copied from the current file,
+// except for a scene with offset 0, whose program is given.
+bool SceneStore::save(std::vector<Scene>& updated, const std::vector<uint8_t>& program) {
+  char tmpPath[40];
+  FileHelpers::tmpPathFor(path, tmpPath, sizeof(tmpPath));
+
+  File current;
+  File f = fs.open(tmpPath, "w");
+
+  if (! f) {
+    return false;
+  }
+
+  if (! scenes.empty()) {
+    current = fs.open(path, "r");
+  }
+
+  bool ok = f.write(SCENES_MAGIC, HEADER_SIZE) == HEADER_SIZE;
+
+  for (Scene& scene : updated) {
+    if (! ok) {
+      break;
+    }
+
+    uint8_t header[SCENE_HEADER_SIZE + MILIGHT_MAX_SCENE_NAME_LENGTH];
+    const size_t nameLength = scene.name.length();
+    const size_t headerLength = SCENE_HEADER_SIZE + nameLength;
+
+    header[0] = nameLength;
+    memcpy(header + 1, scene.name.c_str(), nameLength);
+    writeUint16(header + 1 + nameLength, scene.numStates);
+    writeUint16(header + 3 + nameLength, scene.numPackets);
+    writeUint16(header + 5 + nameLength, scene.programLength);
+
+    ok = f.write(header, headerLength) == headerLength;
+    const uint32_t offset = f.position();
+
+    if (ok && scene.offset == 0) {
+      ok = f.write(program.data(), program.size()) == program.size();
+    } else if (ok) {
+      ok = current && current.seek(scene.offset) && copyBytes(current, f, scene.programLength);
+    }
+
+    scene.offset = offset;
+  }
+
+  f.close();
+  current.close();
+
+  if (! ok) {
+    fs.remove(tmpPath);
+    return false;
+  }
+
+  if (! FileHelpers::replace(fs, tmpPath, path)) {
+    // The old file may be gone, so start over from whatever's there
+    loaded = false;
+    scenes.clear();
+    return false;
+  }
+
+  scenes = std::move(updated);
+
+  return true;
+}
+
+std::vector<SceneStore::Scene>::iterator SceneStore::findScene(const String& name) {
+  return std::find_if(
+    scenes.begin(),
+    scenes.end(),
+    [&name](const Scene& scene) { return scene.name == name; }
+  );
+}
+
+void SceneStore::cancelActivation() {
+  pendingPackets = 0;
+  activeFile.close();
+}
+
+bool SceneStore::readScene(File& file, Scene& scene) {
+  uint8_t nameLength;
+  char name[MILIGHT_MAX_SCENE_NAME_LENGTH + 1];
+  uint8_t counts[SCENE_HEADER_SIZE - 1];
+
+  if (file.read(&nameLength, 1) != 1 || nameLength == 0 || nameLength > MILIGHT_MAX_SCENE_NAME_LENGTH) {
+    return false;
+  }
+
+  if (file.read(reinterpret_cast<uint8_t*>(name), nameLength) != nameLength
+    || file.read(counts, sizeof(counts)) != sizeof(counts)) {
+    return false;
+  }
+
+  name[nameLength] = 0;
+  scene.name = name;
+  scene.numStates = readUint16(counts);
+  scene.numPackets = readUint16(counts + 2);
+  scene.programLength = readUint16(counts + 4);
+  scene.offset = file.position();
+
+  return skipProgram(file, scene);
+}
+
+// Moves past a scene's program, checking that every entry is complete and for
+// a known remote type, so that activating the scene doesn't need to
+bool SceneStore::skipProgram(File& file, const Scene& scene) {
+  const size_t end = scene.offset + scene.programLength;
+  size_t offset = scene.offset + scene.numStates * STATE_ENTRY_SIZE;
+
+  for (size_t i = 0; i < scene.numPackets; ++i) {
+    uint8_t header[PACKET_HEADER_SIZE];
+
+    if (offset + PACKET_HEADER_SIZE > end
+      || ! file.seek(offset)
+      || file.read(header, PACKET_HEADER_SIZE) != PACKET_HEADER_SIZE) {
+      return false;
+    }
+
+    const size_t length = packetLength(decodeBulbId(header).deviceType);
+
+    if (length == 0) {
+      return false;
+    }
+
+    offset += PACKET_HEADER_SIZE + length;
+  }
+
+  return offset == end && end <= file.size() && file.seek(end);
+}
+
+bool SceneStore::copyBytes(File& from, File& to, size_t length) {
+  uint8_t buffer[64];
+
+  while (length > 0) {
+    const size_t chunk = std::min(length, sizeof(buffer));
+
+    if (from.read(buffer, chunk) != chunk || to.write(buffer, chunk) != chunk) {
+      return false;
+    }
+
+    length -= chunk;
+  }
+
+  return true;
+}
+
+void SceneStore::encodeBulbId(const BulbId& bulbId, uint8_t* buffer) {
+  writeUint16(buffer, bulbId.deviceId);
+  buffer[2] = bulbId.groupId;
+  buffer[3] = bulbId.deviceType;
+}
+
+BulbId SceneStore::decodeBulbId(const uint8_t* buffer) {
+  return BulbId(readUint16(buffer), buffer[2], static_cast<MiLightRemoteType>(buffer[3]));
+}
+
+size_t SceneStore::packetLength(MiLightRemoteType type) {
+  const MiLightRemoteConfig* remote = MiLightRemoteConfig::fromType(type);
+  return remote == nullptr ? 0 : remote->packetFormatter->getPacketLength();
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <BulbId.h>
+#include <GroupStateStore.h>
+#include <MiLightClient.h>
+#include <PacketSender.h>
+#include <ProjectFS.h>
+#include <vector>
+
+#ifdef ESP32
+  #include <SPIFFS.h>
+#endif
+
+#ifndef MILIGHT_MAX_SCENES
+#define MILIGHT_MAX_SCENES 16
+#endif
+
+// Compiled packets one scene can hold
+#ifndef MILIGHT_MAX_SCENE_PACKETS
+#define MILIGHT_MAX_SCENE_PACKETS 200
+#endif
+
+#define MILIGHT_MAX_SCENE_NAME_LENGTH 32
+
+/**
+ * Scenes set several bulbs at once.  A scene is compiled when it's defined:
+ * its updates are run through the packet formatters, and the packets they
+ * build are kept along with the state each bulb ends up in.  Activating a
+ * scene patches those states and queues those packets as they are, without
+ * building or parsing anything.
+ *
+ * Packets are built as if nothing were known about the bulbs, so they're
+ * right whatever state the bulbs are in when the scene is activated.  Remotes
+ * that only step values up and down (CCT, FUT020, RGB) get sequences that
+ * drive to the minimum first.  Updates that cover every group of a device ID
+ * are compiled to one group 0 command (see GroupCommandPlanner).
+ *
+ * Updates take the same form as a batch update.  Transitions and commands
+ * only JSON carries (command, commands, raw button presses) aren't allowed,
+ * since what they send depends on state when they're applied.  Neither is
+ * saturation without a hue for FUT089 remotes, which use the same command
+ * for saturation and temperature depending on the bulb's mode.
+ *
+ * Only an index of the scenes is kept in memory.  Programs stay in the file,
+ * and are read as a scene is activated, a packet at a time as the queue
+ * drains.  Each packet is given a fresh sequence number as it's queued, so
+ * bulbs don't ignore a repeat activation as a resend of the last one.
+ *
+ * Scenes are stored in one file:
+ *
+ *   4-byte header, then for each scene:
+ *   uint8 name length | name | uint16 states | uint16 packets | uint16 program length | program
+ *
+ * A program is its state entries followed by its packet entries:
+ *
+ *   state:  uint16 deviceId | uint8 groupId | uint8 deviceType | 8 bytes GroupState
+ *   packet: uint16 deviceId | uint8 groupId | uint8 deviceType | uint8 commandClass | uint8 priority | packet
+ *
+ * Packets are as long as their remote type's packets.
+ */
+class SceneStore {
+public:
+  enum class Status : uint8_t {
+    OK,
+    INVALID_NAME,
+    NO_UPDATES,
+    UNKNOWN_DEVICE_TYPE,
+    UNSUPPORTED_UPDATE,
+    TOO_MANY_PACKETS,
+    TOO_MANY_SCENES,
+    NOT_FOUND,
+    WRITE_FAILED
+  };
+
+  struct Scene {
+    String name;
+    uint16_t numStates;
+    uint16_t numPackets;
+    // Where the scene's program is in the file
+    uint32_t offset;
+    uint16_t programLength;
+  };
+
+  static const char DEFAULT_PATH[];
+
+  SceneStore(
+    MiLightClient& milightClient,
+    PacketSender& packetSender,
+    GroupStateStore& stateStore,
+    FS& fs = ProjectFS,
+    const char* path = DEFAULT_PATH
+  );
+
+  // Compiles updates (an array of {gateways, update}, as for a batch update)
+  // and saves them as the scene name, replacing any scene with that name.
+  Status define(const String& name, JsonArray updates);
+  Status remove(const String& name);
+
+  const Scene* find(const String& name);
+  const std::vector<Scene>& getScenes();
+
+  // Patches the state of every bulb in the scene, then queues its packets.
+  // Packets that don't fit in the queue are queued by loop() as it drains.
+  // Activating a scene abandons any packets left from the last one.  Returns
+  // false if there's no scene with this name, or it can't be read.
+  bool activate(const String& name);
+  void loop();
+  bool isActivating() const;
+
+  static const __FlashStringHelper* statusMessage(Status status);
+
+private:
+  static const size_t HEADER_SIZE = 4;
+  static const size_t BULB_ID_SIZE = 4;
+  static const size_t STATE_ENTRY_SIZE = BULB_ID_SIZE + GroupState::SERIALIZED_SIZE;
+  static const size_t PACKET_HEADER_SIZE = BULB_ID_SIZE + 2;
+
+  MiLightClient& milightClient;
+  PacketSender& packetSender;
+  GroupStateStore& stateStore;
+  FS& fs;
+  const char* path;
+  bool loaded;
+  std::vector<Scene> scenes;
+
+  // Scenes file, positioned at the next packet entry of the scene being
+  // activated
+  File activeFile;
+  size_t pendingPackets;
+
+  void load();
+  bool save(std::vector<Scene>& updated, const std::vector<uint8_t>& program);
+  Status compile(JsonArray updates, Scene& scene, std::vector<uint8_t>& program);
+  std::vector<Scene>::iterator findScene(const String& name);
+  void cancelActivation();
+
+  static bool readScene(File& file, Scene& scene);
+  static bool skipProgram(File& file, const Scene& scene);
+  static bool copyBytes(File& from, File& to, size_t length);
+  static void encodeBulbId(const BulbId& bulbId, uint8_t* buffer);
+  static BulbId decodeBulbId(const uint8_t* buffer);
+  static size_t packetLength(MiLightRemoteType type);
+};
@@ -10,16 +10,8 @@ V2PacketFormatter::V2PacketFormatter(const MiLightRemoteType deviceType, uint8_t
     numGroups(numGroups)
 { }
 
-bool V2PacketFormatter::canHandle(const uint8_t *packet, const size_t packetLen) {
-  uint8_t packetCopy[V2_PACKET_LEN];
-  memcpy(packetCopy, packet, V2_PACKET_LEN);
-  V2RFEncoding::decodeV2Packet(packetCopy);
-
-#ifdef DEBUG_PRINTF
-  Serial.printf_P(PSTR("Testing whether formater for ID %d can handle packet: with protocol ID %d...\n"), protocolId, packetCopy[V2_PROTOCOL_ID_INDEX]);
-#endif
-
-  return packetCopy[V2_PROTOCOL_ID_INDEX] == protocolId;
+PacketSignature V2PacketFormatter::getPacketSignature() const {
+  return PacketSignature{true, V2_PROTOCOL_ID_INDEX, 0xFF, protocolId};
 }
 
 void V2PacketFormatter::initializePacket(uint8_t* packet) {
@@ -61,6 +53,13 @@ void V2PacketFormatter::finalizePacket(uint8_t* packet) {
   V2RFEncoding::encodeV2Packet(packet);
 }
 
+// Finished packets are encoded, so decode, stamp and re-encode
+void V2PacketFormatter::stampSequenceNum(uint8_t* packet) {
+  V2RFEncoding::decodeV2Packet(packet);
+  packet[6] = sequenceNum++;
+  V2RFEncoding::encodeV2Packet(packet);
+}
+
 void V2PacketFormatter::format(uint8_t const* packet, char* buffer) {
   buffer += sprintf_P(buffer, PSTR("Raw packet: "));
   for (size_t i = 0; i < packetLength; i++) {
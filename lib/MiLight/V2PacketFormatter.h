@@ -17,7 +17,7 @@ class V2PacketFormatter : public PacketFormatter {
 public:
   V2PacketFormatter(const MiLightRemoteType deviceType, uint8_t protocolId, uint8_t numGroups);
 
-  virtual bool canHandle(const uint8_t* packet, const size_t packetLen);
+  virtual PacketSignature getPacketSignature() const;
   virtual void initializePacket(uint8_t* packet);
 
   virtual void updateStatus(MiLightStatus status, uint8_t group);
@@ -26,6 +26,7 @@ public:
   virtual void unpair();
 
   virtual void finalizePacket(uint8_t* packet);
+  virtual void stampSequenceNum(uint8_t* packet);
 
   uint8_t groupCommandArg(MiLightStatus status, uint8_t groupId);
 
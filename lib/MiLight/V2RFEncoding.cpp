@@ -1,32 +1,44 @@
 #include <V2RFEncoding.h>
 
-#define V2_OFFSET(byte, key, jumpStart) ( \
-  V2_OFFSETS[byte-1][key%4] \
-    + \
-  ((jumpStart > 0 && key >= jumpStart && key < jumpStart+0x80) ? 0x80 : 0) \
-)
-
-uint8_t const V2RFEncoding::V2_OFFSETS[][4] = {
-  { 0x45, 0x1F, 0x14, 0x5C }, // request type
-  { 0x2B, 0xC9, 0xE3, 0x11 }, // id 1
-  { 0x6D, 0x5F, 0x8A, 0x2B }, // id 2
-  { 0xAF, 0x03, 0x1D, 0xF3 }, // command
-  { 0x1A, 0xE2, 0xF0, 0xD1 }, // argument
-  { 0x04, 0xD8, 0x71, 0x42 }, // sequence
-  { 0xAF, 0x04, 0xDD, 0x07 }, // group
-  { 0x61, 0x13, 0x38, 0x64 }  // checksum
+// Offsets for packet bytes 1-8, indexed by the low two bits of the key
+uint8_t const V2RFEncoding::V2_OFFSETS[][8] = {
+  // request type, id 1, id 2, command, argument, sequence, group, checksum
+  { 0x45, 0x2B, 0x6D, 0xAF, 0x1A, 0x04, 0xAF, 0x61 },
+  { 0x1F, 0xC9, 0x5F, 0x03, 0xE2, 0xD8, 0x04, 0x13 },
+  { 0x14, 0xE3, 0x8A, 0x1D, 0xF0, 0x71, 0xDD, 0x38 },
+  { 0x5C, 0x11, 0x2B, 0xF3, 0xD1, 0x42, 0x07, 0x64 }
 };
 
-uint8_t V2RFEncoding::xorKey(uint8_t key) {
-  // Generate most significant nibble
-  const uint8_t shift = (key & 0x0F) < 0x04 ? 0 : 1;
-  const uint8_t x = (((key & 0xF0) >> 4) + shift + 6) % 8;
-  const uint8_t msn = (((4 + x) ^ 1) & 0x0F) << 4;
+namespace {
+  struct XorKeyTable {
+    uint8_t keys[256];
+  };
+
+  constexpr XorKeyTable buildXorKeyTable() {
+    XorKeyTable table = { };
+
+    for (size_t i = 0; i < 256; ++i) {
+      table.keys[i] = V2RFEncoding::computeXorKey(i);
+    }
+
+    return table;
+  }
+
+  constexpr XorKeyTable XOR_KEYS PROGMEM = buildXorKeyTable();
 
-  // Generate least significant nibble
-  const uint8_t lsn = ((((key & 0xF) + 4)^2) & 0x0F);
+  static_assert(XOR_KEYS.keys[0x00] == V2RFEncoding::computeXorKey(0x00), "xor key table mismatch");
+  static_assert(XOR_KEYS.keys[0xFF] == V2RFEncoding::computeXorKey(0xFF), "xor key table mismatch");
 
-  return ( msn | lsn );
+  // Offsets get an extra 0x80 when the key is in
+  // [V2_OFFSET_JUMP_START, V2_OFFSET_JUMP_START + 0x80).  The encoded checksum
+  // is the exception.
+  inline uint8_t offsetJump(uint8_t key) {
+    return static_cast<uint8_t>(key - V2_OFFSET_JUMP_START) < 0x80 ? 0x80 : 0;
+  }
+}
+
+uint8_t V2RFEncoding::xorKey(uint8_t key) {
+  return pgm_read_byte(&XOR_KEYS.keys[key]);
 }
 
 uint8_t V2RFEncoding::decodeByte(uint8_t byte, uint8_t s1, uint8_t xorKey, uint8_t s2) {
@@ -46,21 +58,29 @@ uint8_t V2RFEncoding::encodeByte(uint8_t byte, uint8_t s1, uint8_t xorKey, uint8
 }
 
 void V2RFEncoding::decodeV2Packet(uint8_t *packet) {
-  uint8_t key = xorKey(packet[0]);
+  const uint8_t key = xorKey(packet[0]);
+  const uint8_t jump = offsetJump(packet[0]);
+  const uint8_t* offsets = V2_OFFSETS[packet[0] % 4];
 
   for (size_t i = 1; i <= 8; i++) {
-    packet[i] = decodeByte(packet[i], 0, key, V2_OFFSET(i, packet[0], V2_OFFSET_JUMP_START));
+    packet[i] = decodeByte(packet[i], 0, key, offsets[i - 1] + jump);
   }
 }
 
+uint8_t V2RFEncoding::decodeV2Byte(const uint8_t* packet, size_t index) {
+  return decodeByte(packet[index], 0, xorKey(packet[0]), V2_OFFSETS[packet[0] % 4][index - 1] + offsetJump(packet[0]));
+}
+
 void V2RFEncoding::encodeV2Packet(uint8_t *packet) {
-  uint8_t key = xorKey(packet[0]);
+  const uint8_t key = xorKey(packet[0]);
+  const uint8_t jump = offsetJump(packet[0]);
+  const uint8_t* offsets = V2_OFFSETS[packet[0] % 4];
   uint8_t sum = key;
 
   for (size_t i = 1; i <= 7; i++) {
     sum += packet[i];
-    packet[i] = encodeByte(packet[i], 0, key, V2_OFFSET(i, packet[0], V2_OFFSET_JUMP_START));
+    packet[i] = encodeByte(packet[i], 0, key, offsets[i - 1] + jump);
   }
 
-  packet[8] = encodeByte(sum, 2, key, V2_OFFSET(8, packet[0], 0));
+  packet[8] = encodeByte(sum, 2, key, offsets[7]);
 }
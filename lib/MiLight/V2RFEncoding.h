@@ -10,12 +10,24 @@ class V2RFEncoding {
 public:
   static void encodeV2Packet(uint8_t* packet);
   static void decodeV2Packet(uint8_t* packet);
+  // Decodes one byte of an encoded packet (index in [1, 8])
+  static uint8_t decodeV2Byte(const uint8_t* packet, size_t index);
   static uint8_t xorKey(uint8_t key);
   static uint8_t encodeByte(uint8_t byte, uint8_t s1, uint8_t xorKey, uint8_t s2);
   static uint8_t decodeByte(uint8_t byte, uint8_t s1, uint8_t xorKey, uint8_t s2);
 
+  // Computes xorKey() from scratch rather than reading it from the table.
+  // Used to generate the table.
+  static constexpr uint8_t computeXorKey(uint8_t key) {
+    return
+      // Most significant nibble
+      (((4 + ((((key & 0xF0) >> 4) + ((key & 0x0F) < 0x04 ? 0 : 1) + 6) % 8)) ^ 1) & 0x0F) << 4
+      // Least significant nibble
+      | ((((key & 0xF) + 4) ^ 2) & 0x0F);
+  }
+
 private:
-  static uint8_t const V2_OFFSETS[][4];
+  static uint8_t const V2_OFFSETS[][8];
 };
 
 #endif
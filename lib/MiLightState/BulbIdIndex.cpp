@@ -0,0 +1,34 @@
+#include <BulbIdIndex.h>
+
+BulbIdIndex::BulbIdIndex(const size_t capacity)
+  : mask(sizeFor(capacity) - 1),
+    slots(new uint16_t[mask + 1])
+{
+  for (size_t i = 0; i <= mask; ++i) {
+    slots[i] = NOT_FOUND;
+  }
+}
+
+BulbIdIndex::~BulbIdIndex() {
+  delete[] slots;
+}
+
+size_t BulbIdIndex::sizeFor(size_t capacity) {
+  size_t size = 2;
+
+  while (size < capacity * 2) {
+    size <<= 1;
+  }
+
+  return size;
+}
+
+// BulbId::getCompactId drops the high byte of the device ID, so mix in all of
+// the fields directly (Fibonacci hashing).
+uint32_t BulbIdIndex::hash(const BulbId& id) {
+  uint32_t key = (static_cast<uint32_t>(id.deviceId) << 16)
+    | (static_cast<uint32_t>(id.deviceType) << 8)
+    | id.groupId;
+
+  return (key * 2654435761UL) >> 16;
+}
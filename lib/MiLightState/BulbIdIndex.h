@@ -0,0 +1,92 @@
+#include <BulbId.h>
+
+#ifndef _BULB_ID_INDEX_H
+#define _BULB_ID_INDEX_H
+
+/*
+ * Open-addressing (linear probing) index from BulbIds to positions in an
+ * array owned by the caller.
+ *
+ * Only positions are stored, so every lookup takes a `keyAt` function that
+ * returns the BulbId at a position in the caller's array.  The table is sized
+ * to a power of two at least twice the capacity, and removal uses backward
+ * shifting so probe sequences stay intact without tombstones.
+ */
+class BulbIdIndex {
+public:
+  static const uint16_t NOT_FOUND = 0xFFFF;
+
+  BulbIdIndex(const size_t capacity);
+  ~BulbIdIndex();
+
+  BulbIdIndex(const BulbIdIndex&) = delete;
+  BulbIdIndex& operator=(const BulbIdIndex&) = delete;
+
+  // Returns the position of id, or NOT_FOUND
+  template <typename KeyAt>
+  uint16_t find(const BulbId& id, const KeyAt& keyAt) const {
+    return slots[findSlot(id, keyAt)];
+  }
+
+  // id must not already be indexed
+  template <typename KeyAt>
+  void insert(const BulbId& id, uint16_t position, const KeyAt& keyAt) {
+    slots[findSlot(id, keyAt)] = position;
+  }
+
+  // Must be called while keyAt still returns id for its position
+  template <typename KeyAt>
+  void remove(const BulbId& id, const KeyAt& keyAt) {
+    size_t hole = findSlot(id, keyAt);
+    size_t next = hole;
+
+    if (slots[hole] == NOT_FOUND) {
+      return;
+    }
+
+    while (true) {
+      next = (next + 1) & mask;
+
+      if (slots[next] == NOT_FOUND) {
+        break;
+      }
+
+      size_t home = hash(keyAt(slots[next])) & mask;
+
+      // Entry can't move if its home slot is cyclically within (hole, next]
+      bool inRange = hole <= next
+        ? (hole < home && home <= next)
+        : (hole < home || home <= next);
+
+      if (! inRange) {
+        slots[hole] = slots[next];
+        hole = next;
+      }
+    }
+
+    slots[hole] = NOT_FOUND;
+  }
+
+  static uint32_t hash(const BulbId& id);
+
+private:
+  const size_t mask;
+  uint16_t* slots;
+
+  static size_t sizeFor(size_t capacity);
+
+  // Returns the slot containing the given id, or the empty slot terminating
+  // its probe sequence if it isn't indexed.
+  template <typename KeyAt>
+  size_t findSlot(const BulbId& id, const KeyAt& keyAt) const {
+    size_t slot = hash(id) & mask;
+
+    while (slots[slot] != NOT_FOUND && !(keyAt(slots[slot]) == id)) {
+      slot = (slot + 1) & mask;
+    }
+
+    return slot;
+  }
+};
+
+#endif
@@ -95,11 +95,14 @@ void GroupState::initFields() {
   scratchpad.fields._brightnessScratch      = 0;
   scratchpad.fields._isSetKelvinScratch     = 0;
   scratchpad.fields._kelvinScratch          = 0;
+
+  changedFields = 0;
 }
 
 GroupState& GroupState::operator=(const GroupState& other) {
   memcpy(state.rawData, other.state.rawData, DATA_LONGS * sizeof(uint32_t));
   scratchpad.rawData = other.scratchpad.rawData;
+  changedFields = other.changedFields;
   return *this;
 }
 
@@ -111,6 +114,7 @@ GroupState::GroupState()
 
 GroupState::GroupState(const GroupState& other)
   : previousState(NULL)
+  , changedFields(other.changedFields)
 {
   memcpy(state.rawData, other.state.rawData, DATA_LONGS * sizeof(uint32_t));
   scratchpad.rawData = other.scratchpad.rawData;
@@ -381,6 +385,7 @@ bool GroupState::setState(const MiLightStatus status) {
   }
 
   setDirty();
+  setChanged(GroupStateField::STATE);
   state.fields._isSetState = 1;
   state.fields._state = status == ON ? 1 : 0;
 
@@ -455,6 +460,7 @@ bool GroupState::setBrightness(uint8_t brightness) {
   }
 
   setDirty();
+  setChanged(GroupStateField::BRIGHTNESS);
 
   uint8_t bulbMode = state.fields._bulbMode;
   if (! state.fields._isSetBulbMode) {
@@ -490,6 +496,7 @@ bool GroupState::setHue(uint16_t hue) {
   }
 
   setDirty();
+  setChanged(GroupStateField::HUE);
   state.fields._isSetHue = 1;
   state.fields._hue = Units::rescale<uint16_t, uint16_t>(hue, 255, 360);
 
@@ -504,6 +511,7 @@ bool GroupState::setSaturation(uint8_t saturation) {
   }
 
   setDirty();
+  setChanged(GroupStateField::SATURATION);
   state.fields._isSetSaturation = 1;
   state.fields._saturation = saturation;
 
@@ -522,6 +530,7 @@ bool GroupState::setMode(uint8_t mode) {
   }
 
   setDirty();
+  setChanged(GroupStateField::MODE);
   state.fields._isSetMode = 1;
   state.fields._mode = mode;
 
@@ -539,6 +548,7 @@ bool GroupState::setKelvin(uint8_t kelvin) {
   }
 
   setDirty();
+  setChanged(GroupStateField::KELVIN);
   state.fields._isSetKelvin = 1;
   state.fields._kelvin = kelvin;
 
@@ -567,6 +577,7 @@ bool GroupState::setBulbMode(BulbMode bulbMode) {
   }
 
   setDirty();
+  setChanged(GroupStateField::BULB_MODE);
 
   // As mentioned in isSetBulbMode, NIGHT_MODE is stored separately.
   if (bulbMode == BULB_MODE_NIGHT) {
@@ -587,6 +598,7 @@ bool GroupState::setNightMode(bool nightMode) {
   }
 
   setDirty();
+  setChanged(GroupStateField::BULB_MODE);
   state.fields._isSetNightMode = 1;
   state.fields._isNightMode = nightMode;
 
@@ -611,11 +623,68 @@ bool GroupState::clearMqttDirty() {
   return true;
 }
 
+inline void GroupState::setChanged(GroupStateField field) {
+  changedFields |= (1 << static_cast<uint8_t>(field));
+}
+bool GroupState::isChangedField(GroupStateField field) const {
+  return (changedFields & changedFieldDependencies(field)) != 0;
+}
+bool GroupState::hasChangedFields() const { return changedFields != 0; }
+void GroupState::clearChangedFields() { changedFields = 0; }
+
+void GroupState::resetChangedFields() {
+  changedFields = 0;
+
+  if (isMqttDirty()) {
+    for (size_t i = 0; i < size(ALL_PHYSICAL_FIELDS); ++i) {
+      setChanged(ALL_PHYSICAL_FIELDS[i]);
+    }
+  }
+}
+
+uint16_t GroupState::changedFieldDependencies(GroupStateField field) {
+  // Bulb mode decides which brightness is in effect and whether color,
+  // kelvin and mode are reported at all
+  const uint16_t bulbMode = 1 << static_cast<uint8_t>(GroupStateField::BULB_MODE);
+  const uint16_t hue = 1 << static_cast<uint8_t>(GroupStateField::HUE);
+  const uint16_t saturation = 1 << static_cast<uint8_t>(GroupStateField::SATURATION);
+
+  switch (field) {
+    case GroupStateField::STATE:
+    case GroupStateField::STATUS:
+      return 1 << static_cast<uint8_t>(GroupStateField::STATE);
+    case GroupStateField::BRIGHTNESS:
+    case GroupStateField::LEVEL:
+      return bulbMode | (1 << static_cast<uint8_t>(GroupStateField::BRIGHTNESS));
+    case GroupStateField::HUE:
+      return bulbMode | hue;
+    case GroupStateField::SATURATION:
+      return bulbMode | saturation;
+    case GroupStateField::COLOR:
+    case GroupStateField::OH_COLOR:
+    case GroupStateField::HEX_COLOR:
+    case GroupStateField::COMPUTED_COLOR:
+      return bulbMode | hue | saturation;
+    case GroupStateField::MODE:
+    case GroupStateField::EFFECT:
+      return bulbMode | (1 << static_cast<uint8_t>(GroupStateField::MODE));
+    case GroupStateField::KELVIN:
+    case GroupStateField::COLOR_TEMP:
+      return bulbMode | (1 << static_cast<uint8_t>(GroupStateField::KELVIN));
+    case GroupStateField::BULB_MODE:
+    case GroupStateField::COLOR_MODE:
+      return bulbMode;
+    default:
+      return 0;
+  }
+}
+
 void GroupState::load(Stream& stream) {
   for (size_t i = 0; i < DATA_LONGS; i++) {
     stream.readBytes(reinterpret_cast<uint8_t*>(&state.rawData[i]), 4);
   }
   clearDirty();
+  resetChangedFields();
 }
 
 void GroupState::dump(Stream& stream) const {
@@ -624,6 +693,17 @@ void GroupState::dump(Stream& stream) const {
   }
 }
 
+void GroupState::load(const uint8_t* buffer) {
+  static_assert(SERIALIZED_SIZE == DATA_LONGS * sizeof(uint32_t), "SERIALIZED_SIZE must match StateData");
+  memcpy(state.rawData, buffer, SERIALIZED_SIZE);
+  clearDirty();
+  resetChangedFields();
+}
+
+void GroupState::dump(uint8_t* buffer) const {
+  memcpy(buffer, state.rawData, SERIALIZED_SIZE);
+}
+
 bool GroupState::applyIncrementCommand(GroupStateField field, IncrementDirection dir) {
   if (field != GroupStateField::KELVIN && field != GroupStateField::BRIGHTNESS) {
     Serial.print(F("WARNING: tried to apply increment for unsupported field: "));
@@ -1039,6 +1119,14 @@ void GroupState::applyState(JsonObject partialState, const BulbId& bulbId, const
   }
 }
 
+void GroupState::applyChangedState(JsonObject partialState, const BulbId& bulbId, const std::vector<GroupStateField>& fields) const {
+  for (std::vector<GroupStateField>::const_iterator itr = fields.begin(); itr != fields.end(); ++itr) {
+    if (isChangedField(*itr)) {
+      applyField(partialState, bulbId, *itr);
+    }
+  }
+}
+
 bool GroupState::isPhysicalField(GroupStateField field) {
   for (size_t i = 0; i < size(ALL_PHYSICAL_FIELDS); ++i) {
     if (field == ALL_PHYSICAL_FIELDS[i]) {
@@ -109,6 +109,19 @@ public:
   inline bool setMqttDirty();
   bool clearMqttDirty();
 
+  // Tracks which fields have changed since clearChangedFields() was last
+  // called.  This is separate from the MQTT dirty bit, which tracks whether
+  // the full state needs to be published.  Not persisted: states loaded with
+  // the MQTT dirty bit set count every field as changed, since the changes
+  // that made them dirty aren't known anymore.
+  //
+  // Derived fields (e.g., COLOR, COLOR_TEMP) count as changed when any of the
+  // fields they're computed from changed.  Fields that can't change, like
+  // DEVICE_ID, are never changed.
+  bool isChangedField(GroupStateField field) const;
+  bool hasChangedFields() const;
+  void clearChangedFields();
+
   // Clears all of the fields in THIS GroupState that have different values
   // than the provided group state.
   bool clearNonMatchingFields(const GroupState& other);
@@ -126,6 +139,8 @@ public:
   // keep a reference to its BulbId, which feels too heavy-weight.
   void applyField(JsonObject state, const BulbId& bulbId, GroupStateField field) const;
   void applyState(JsonObject state, const BulbId& bulbId, const std::vector<GroupStateField>& fields) const;
+  // Same as applyState, but skips fields that haven't changed
+  void applyChangedState(JsonObject state, const BulbId& bulbId, const std::vector<GroupStateField>& fields) const;
 
   // Attempt to keep track of increment commands in such a way that we can
   // know what state it's in.  When we get an increment command (like "increase
@@ -152,6 +167,11 @@ public:
   void load(Stream& stream);
   void dump(Stream& stream) const;
 
+  // Raw access to the packed (persistent) state.  Buffers must hold SERIALIZED_SIZE bytes.
+  static const size_t SERIALIZED_SIZE = 8;
+  void load(const uint8_t* buffer);
+  void dump(uint8_t* buffer) const;
+
   void debugState(char const *debugMessage) const;
 
   static const GroupState& defaultState(MiLightRemoteType remoteType);
@@ -213,6 +233,15 @@ private:
   // it here.
   const GroupState* previousState;
 
+  // One bit per physical field, indexed by GroupStateField
+  uint16_t changedFields;
+
+  inline void setChanged(GroupStateField field);
+  // Called after loading the packed state
+  void resetChangedFields();
+  // Mask of the physical fields the given field is computed from
+  static uint16_t changedFieldDependencies(GroupStateField field);
+
   void applyColor(JsonObject state, uint8_t r, uint8_t g, uint8_t b) const;
   void applyColor(JsonObject state) const;
   // Apply OpenHAB-style color, e.g., {"color":"0,0,0"}
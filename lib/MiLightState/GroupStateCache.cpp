@@ -1,16 +1,17 @@
 #include <GroupStateCache.h>
 
 GroupStateCache::GroupStateCache(const size_t maxSize)
-  : maxSize(maxSize)
+  : maxSize(maxSize),
+    count(0),
+    nodes(new GroupCacheNode[maxSize]),
+    keyAt{nodes},
+    index(maxSize),
+    head(nullptr),
+    tail(nullptr)
 { }
 
 GroupStateCache::~GroupStateCache() {
-  ListNode<GroupCacheNode*>* cur = cache.getHead();
-
-  while (cur != NULL) {
-    delete cur->data;
-    cur = cur->next;
-  }
+  delete[] nodes;
 }
 
 GroupState* GroupStateCache::get(const BulbId& id) {
@@ -18,55 +19,99 @@ GroupState* GroupStateCache::get(const BulbId& id) {
 }
 
 GroupState* GroupStateCache::set(const BulbId& id, const GroupState& state) {
-  GroupCacheNode* pushedNode = NULL;
-  if (cache.size() >= maxSize) {
-    pushedNode = cache.pop();
+  GroupState* cachedState = getInternal(id);
+
+  if (cachedState != nullptr) {
+    *cachedState = state;
+    return cachedState;
   }
 
-  GroupState* cachedState = getInternal(id);
+  GroupCacheNode* node;
 
-  if (cachedState == NULL) {
-    if (pushedNode == NULL) {
-      GroupCacheNode* newNode = new GroupCacheNode(id, state);
-      cachedState = &newNode->state;
-      cache.unshift(newNode);
-    } else {
-      pushedNode->id = id;
-      pushedNode->state = state;
-      cachedState = &pushedNode->state;
-      cache.unshift(pushedNode);
-    }
+  if (count < maxSize) {
+    node = &nodes[count++];
   } else {
-    *cachedState = state;
+    // Recycle the least recently used node
+    node = tail;
+    index.remove(node->id, keyAt);
+    unlink(node);
   }
 
-  return cachedState;
+  node->id = id;
+  node->state = state;
+
+  index.insert(id, node - nodes, keyAt);
+  pushFront(node);
+
+  return &node->state;
 }
 
 BulbId GroupStateCache::getLru() {
-  GroupCacheNode* node = cache.getLast();
-  return node->id;
+  return tail == nullptr ? BulbId() : tail->id;
+}
+
+bool GroupStateCache::contains(const BulbId& id) const {
+  return index.find(id, keyAt) != BulbIdIndex::NOT_FOUND;
 }
 
 bool GroupStateCache::isFull() const {
-  return cache.size() >= maxSize;
+  return count >= maxSize;
+}
+
+size_t GroupStateCache::size() const {
+  return count;
 }
 
-ListNode<GroupCacheNode*>* GroupStateCache::getHead() {
-  return cache.getHead();
+GroupCacheNode* GroupStateCache::getHead() {
+  return head;
+}
+
+GroupCacheNode* GroupStateCache::getTail() {
+  return tail;
 }
 
 GroupState* GroupStateCache::getInternal(const BulbId& id) {
-  ListNode<GroupCacheNode*>* cur = cache.getHead();
-
-  while (cur != NULL) {
-    if (cur->data->id == id) {
-      GroupState* result = &cur->data->state;
-      cache.spliceToFront(cur);
-      return result;
-    }
-    cur = cur->next;
+  uint16_t nodeIx = index.find(id, keyAt);
+
+  if (nodeIx == BulbIdIndex::NOT_FOUND) {
+    return nullptr;
+  }
+
+  GroupCacheNode* node = &nodes[nodeIx];
+
+  if (node != head) {
+    unlink(node);
+    pushFront(node);
+  }
+
+  return &node->state;
+}
+
+void GroupStateCache::unlink(GroupCacheNode* node) {
+  if (node->prev != nullptr) {
+    node->prev->next = node->next;
+  } else {
+    head = node->next;
+  }
+
+  if (node->next != nullptr) {
+    node->next->prev = node->prev;
+  } else {
+    tail = node->prev;
+  }
+
+  node->next = node->prev = nullptr;
+}
+
+void GroupStateCache::pushFront(GroupCacheNode* node) {
+  node->prev = nullptr;
+  node->next = head;
+
+  if (head != nullptr) {
+    head->prev = node;
+  } else {
+    tail = node;
   }
 
-  return NULL;
+  head = node;
 }
@@ -1,34 +1,69 @@
 #include <GroupState.h>
-#include <LinkedList.h>
+#include <BulbIdIndex.h>
 
 #ifndef _GROUP_STATE_CACHE_H
 #define _GROUP_STATE_CACHE_H
 
 struct GroupCacheNode {
-  GroupCacheNode() {}
-  GroupCacheNode(const BulbId& id, const GroupState& state)
-    : id(id), state(state) { }
+  GroupCacheNode()
+    : next(nullptr), prev(nullptr) {}
 
   BulbId id;
   GroupState state;
+
+  // Intrusive LRU links.  `next` points towards the least recently used node.
+  GroupCacheNode* next;
+  GroupCacheNode* prev;
 };
 
+/*
+ * Fixed-capacity LRU cache of GroupStates.
+ *
+ * All nodes are allocated up front.  Lookups go through a BulbIdIndex, so
+ * get/set/evict are O(1) and never touch the heap after construction.
+ */
 class GroupStateCache {
 public:
   GroupStateCache(const size_t maxSize);
   ~GroupStateCache();
 
+  GroupStateCache(const GroupStateCache&) = delete;
+  GroupStateCache& operator=(const GroupStateCache&) = delete;
+
   GroupState* get(const BulbId& id);
   GroupState* set(const BulbId& id, const GroupState& state);
   BulbId getLru();
+  // Doesn't change the LRU order
+  bool contains(const BulbId& id) const;
   bool isFull() const;
-  ListNode<GroupCacheNode*>* getHead();
+  size_t size() const;
+
+  // Most recently used node.  Follow `next` to iterate towards the LRU.
+  GroupCacheNode* getHead();
+
+  // Least recently used node, i.e., the next to be evicted.  Doesn't change
+  // the LRU order.
+  GroupCacheNode* getTail();
 
 private:
-  LinkedList<GroupCacheNode*> cache;
+  // Maps positions in the index back to the IDs of nodes
+  struct NodeKey {
+    const GroupCacheNode* nodes;
+    const BulbId& operator()(uint16_t nodeIx) const { return nodes[nodeIx].id; }
+  };
+
   const size_t maxSize;
+  size_t count;
+
+  GroupCacheNode* nodes;
+  const NodeKey keyAt;
+  BulbIdIndex index;
+  GroupCacheNode* head;
+  GroupCacheNode* tail;
 
   GroupState* getInternal(const BulbId& id);
+  void unlink(GroupCacheNode* node);
+  void pushFront(GroupCacheNode* node);
 };
 
 #endif
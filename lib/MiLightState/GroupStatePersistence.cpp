@@ -1,48 +1,330 @@
 #include <GroupStatePersistence.h>
-#include <FS.h>
-#ifdef ESP32
-  #include <SPIFFS.h>
-#endif
-#include "ProjectFS.h"
+#include <FileHelpers.h>
+#include <algorithm>
 
 #ifdef ESP8266
-    static const char FILE_PREFIX[] = "group_states/";
-#elif ESP32
-    static const char FILE_PREFIX[] = "/group_states/";
+    static const char LEGACY_FILE_PREFIX[] = "group_states/";
+#else
+    static const char LEGACY_FILE_PREFIX[] = "/group_states/";
 #endif
 
+static const uint8_t JOURNAL_MAGIC[] = {'M', 'L', 'G', 1};
+
+// Records are read and written in blocks of this many at a time
+static const size_t IO_BLOCK_RECORDS = 16;
+
+const char GroupStatePersistence::DEFAULT_JOURNAL_PATH[] = "/group_states.bin";
+
+GroupStatePersistence::GroupStatePersistence(FS& fs, const char* path)
+  : fs(fs),
+    path(path),
+    loaded(false),
+    needsCompaction(false),
+    journalRecords(0),
+    stats()
+{ }
+
 void GroupStatePersistence::get(const BulbId &id, GroupState& state) {
-  char path[30];
-  memset(path, 0, 30);
-  buildFilename(id, path);
+  load();
 
-  if (ProjectFS.exists(path)) {
-    File f = ProjectFS.open(path, "r");
-    state.load(f);
-    f.close();
+  auto it = find(keyFor(id));
+
+  if (it != records.end() && it->key == keyFor(id)) {
+    state.load(it->data);
+  } else {
+    loadLegacy(id, state);
   }
 }
 
 void GroupStatePersistence::set(const BulbId &id, const GroupState& state) {
+  load();
+
+  Record record;
+  record.key = keyFor(id);
+  state.dump(record.data);
+
+  stage(record);
+}
+
+void GroupStatePersistence::clear(const BulbId &id) {
+  load();
+
+  auto it = find(keyFor(id));
+
+  // Only need a tombstone if there's something to delete
+  if (it != records.end() && it->key == keyFor(id)) {
+    Record record;
+    record.key = keyFor(id) | TOMBSTONE_FLAG;
+    memset(record.data, 0, sizeof(record.data));
+
+    stage(record);
+  }
+
   char path[30];
-  memset(path, 0, 30);
-  buildFilename(id, path);
+  buildLegacyFilename(id, path);
+
+  if (fs.exists(path)) {
+    fs.remove(path);
+  }
+}
+
+bool GroupStatePersistence::hasPending() const {
+  return !pending.empty() || needsCompaction;
+}
+
+void GroupStatePersistence::forEach(const std::function<void(const BulbId& id, const GroupState& state)>& fn) {
+  load();
+
+  for (const auto& record : records) {
+    BulbId id(
+      record.key >> 16,
+      record.key & 0xFF,
+      static_cast<MiLightRemoteType>((record.key >> 8) & 0xFF)
+    );
+    GroupState state;
+    state.load(record.data);
+
+    fn(id, state);
+  }
+}
+
+size_t GroupStatePersistence::size() {
+  load();
+  return records.size();
+}
+
+const GroupStatePersistence::Stats& GroupStatePersistence::getStats() const {
+  return stats;
+}
+
+bool GroupStatePersistence::flush() {
+  if (! hasPending()) {
+    return false;
+  }
+
+  unsigned long start = micros();
+  size_t appended = journalRecords + pending.size();
+
+  if (needsCompaction || appended > (records.size() * 2) + COMPACTION_SLACK) {
+    // Live records already include everything pending
+    if (! compact()) {
+      return false;
+    }
+  } else {
+    File f = fs.open(path, "a");
+
+    if (! f) {
+      return false;
+    }
+
+    const size_t headerSize = journalRecords == 0 && f.size() == 0 ? HEADER_SIZE : 0;
+    const size_t length = headerSize + (pending.size() * RECORD_SIZE);
+    std::vector<uint8_t> buffer(length);
+
+    if (headerSize > 0) {
+      memcpy(buffer.data(), JOURNAL_MAGIC, HEADER_SIZE);
+    }
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+      encode(pending[i], buffer.data() + headerSize + (i * RECORD_SIZE));
+    }
+
+    f.write(buffer.data(), length);
+    f.close();
+
+    journalRecords += pending.size();
+    stats.recordsWritten += pending.size();
+    stats.bytesWritten += length;
+  }
+
+  pending.clear();
+
+  stats.flushes++;
+  stats.lastFlushMicros = micros() - start;
+  stats.maxFlushMicros = std::max(stats.maxFlushMicros, stats.lastFlushMicros);
+
+  return true;
+}
+
+void GroupStatePersistence::load() {
+  if (loaded) {
+    return;
+  }
+  loaded = true;
+
+  char tmpPath[40];
+  FileHelpers::tmpPathFor(path, tmpPath, sizeof(tmpPath));
+  FileHelpers::recover(fs, tmpPath, path);
+
+  if (! fs.exists(path)) {
+    return;
+  }
+
+  File f = fs.open(path, "r");
+  uint8_t buffer[IO_BLOCK_RECORDS * RECORD_SIZE];
+
+  if (f.read(buffer, HEADER_SIZE) != HEADER_SIZE || memcmp(buffer, JOURNAL_MAGIC, HEADER_SIZE) != 0) {
+    // Unknown format.  Start over with an empty journal.
+    f.close();
+    needsCompaction = true;
+    return;
+  }
+
+  size_t read;
+  while ((read = f.read(buffer, sizeof(buffer))) > 0) {
+    const size_t numRecords = read / RECORD_SIZE;
+
+    for (size_t i = 0; i < numRecords; ++i) {
+      Record record;
+      decode(buffer + (i * RECORD_SIZE), record);
+      apply(record);
+    }
+
+    journalRecords += numRecords;
+
+    // A torn trailing record (e.g., from a power loss mid-write) would misalign
+    // subsequent appends.  Rewrite the journal on the next flush.
+    if (read % RECORD_SIZE != 0) {
+      needsCompaction = true;
+      break;
+    }
+  }
 
-  File f = ProjectFS.open(path, "w");
-  state.dump(f);
   f.close();
 }
 
-void GroupStatePersistence::clear(const BulbId &id) {
+// Rewrites the journal with only the live records.  Written to a temporary
+// file first so that a failure part way through doesn't lose everything (see
+// FileHelpers).
+bool GroupStatePersistence::compact() {
+  char tmpPath[40];
+  FileHelpers::tmpPathFor(path, tmpPath, sizeof(tmpPath));
+
+  File f = fs.open(tmpPath, "w");
+
+  if (! f) {
+    return false;
+  }
+
+  uint8_t buffer[IO_BLOCK_RECORDS * RECORD_SIZE];
+  size_t written = f.write(JOURNAL_MAGIC, HEADER_SIZE);
+
+  for (size_t i = 0; i < records.size(); i += IO_BLOCK_RECORDS) {
+    const size_t numRecords = std::min(IO_BLOCK_RECORDS, records.size() - i);
+
+    for (size_t j = 0; j < numRecords; ++j) {
+      encode(records[i + j], buffer + (j * RECORD_SIZE));
+    }
+
+    written += f.write(buffer, numRecords * RECORD_SIZE);
+  }
+
+  f.close();
+
+  if (written != HEADER_SIZE + (records.size() * RECORD_SIZE)) {
+    fs.remove(tmpPath);
+    return false;
+  }
+
+  if (! FileHelpers::replace(fs, tmpPath, path)) {
+    // Whichever of the two files is left has every live record.  Try again
+    // on the next flush.
+    needsCompaction = true;
+    return false;
+  }
+
+  journalRecords = records.size();
+  needsCompaction = false;
+
+  stats.compactions++;
+  stats.recordsWritten += records.size();
+  stats.bytesWritten += written;
+
+  return true;
+}
+
+void GroupStatePersistence::stage(const Record& record) {
+  apply(record);
+
+  const uint32_t key = record.key & ~TOMBSTONE_FLAG;
+
+  for (auto& staged : pending) {
+    if ((staged.key & ~TOMBSTONE_FLAG) == key) {
+      staged = record;
+      return;
+    }
+  }
+
+  pending.push_back(record);
+}
+
+void GroupStatePersistence::apply(const Record& record) {
+  const uint32_t key = record.key & ~TOMBSTONE_FLAG;
+  auto it = find(key);
+  const bool exists = it != records.end() && it->key == key;
+
+  if (record.key & TOMBSTONE_FLAG) {
+    if (exists) {
+      records.erase(it);
+    }
+  } else if (exists) {
+    *it = record;
+  } else {
+    records.insert(it, record);
+  }
+}
+
+std::vector<GroupStatePersistence::Record>::iterator GroupStatePersistence::find(uint32_t key) {
+  return std::lower_bound(
+    records.begin(),
+    records.end(),
+    key,
+    [](const Record& record, uint32_t key) { return record.key < key; }
+  );
+}
+
+uint32_t GroupStatePersistence::keyFor(const BulbId& id) {
+  return (static_cast<uint32_t>(id.deviceId) << 16)
+    | (static_cast<uint32_t>(id.deviceType) << 8)
+    | id.groupId;
+}
+
+void GroupStatePersistence::encode(const Record& record, uint8_t* buffer) {
+  buffer[0] = record.key >> 16;
+  buffer[1] = record.key >> 24;
+  buffer[2] = record.key;
+  buffer[3] = record.key >> 8;
+  memcpy(buffer + KEY_SIZE, record.data, GroupState::SERIALIZED_SIZE);
+}
+
+void GroupStatePersistence::decode(const uint8_t* buffer, Record& record) {
+  record.key = (static_cast<uint32_t>(buffer[1]) << 24)
+    | (static_cast<uint32_t>(buffer[0]) << 16)
+    | (static_cast<uint32_t>(buffer[3]) << 8)
+    | buffer[2];
+  memcpy(record.data, buffer + KEY_SIZE, GroupState::SERIALIZED_SIZE);
+}
+
+bool GroupStatePersistence::loadLegacy(const BulbId& id, GroupState& state) {
   char path[30];
-  buildFilename(id, path);
+  buildLegacyFilename(id, path);
 
-  if (ProjectFS.exists(path)) {
-    ProjectFS.remove(path);
+  if (! fs.exists(path)) {
+    return false;
   }
+
+  File f = fs.open(path, "r");
+  state.load(f);
+  f.close();
+
+  // Move it into the journal
+  set(id, state);
+  fs.remove(path);
+
+  return true;
 }
 
-char* GroupStatePersistence::buildFilename(const BulbId &id, char *buffer) {
+char* GroupStatePersistence::buildLegacyFilename(const BulbId &id, char *buffer) {
   uint32_t compactId = id.getCompactId();
-  return buffer + sprintf(buffer, "%s%x", FILE_PREFIX, compactId);
+  return buffer + sprintf(buffer, "%s%x", LEGACY_FILE_PREFIX, compactId);
 }
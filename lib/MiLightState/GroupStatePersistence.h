@@ -1,18 +1,102 @@
 #include <GroupState.h>
+#include <ProjectFS.h>
+#include <vector>
+#include <functional>
+
+#ifdef ESP32
+  #include <SPIFFS.h>
+#endif
 
 #ifndef _GROUP_STATE_PERSISTENCE_H
 #define _GROUP_STATE_PERSISTENCE_H
 
+/*
+ * Stores GroupStates in a single append-only journal file.
+ *
+ * The journal is read once (lazily, on first access) into an in-memory table.
+ * set() and clear() only stage records; flush() appends everything staged in
+ * a single write.  When the journal grows well past the number of live
+ * records, it's compacted by rewriting only the live records.
+ *
+ * Layout: 4-byte header, followed by 12-byte records:
+ *
+ *   uint16 deviceId | uint8 groupId | uint8 deviceType | 8 bytes GroupState
+ *
+ * A record with TOMBSTONE_FLAG set in its deviceType deletes the state.
+ */
 class GroupStatePersistence {
 public:
+  struct Stats {
+    uint32_t flushes;
+    uint32_t recordsWritten;
+    uint32_t bytesWritten;
+    uint32_t compactions;
+    uint32_t lastFlushMicros;
+    uint32_t maxFlushMicros;
+  };
+
+  static const char DEFAULT_JOURNAL_PATH[];
+
+  GroupStatePersistence(FS& fs = ProjectFS, const char* path = DEFAULT_JOURNAL_PATH);
+
   void get(const BulbId& id, GroupState& state);
-  void set(const BulbId& id, const GroupState& state);
 
+  // Stage a state (or its removal).  Nothing is written until flush().
+  void set(const BulbId& id, const GroupState& state);
   void clear(const BulbId& id);
 
+  /*
+   * Appends all staged records to the journal in a single write, compacting
+   * first if necessary.  Returns true iff anything was written.
+   */
+  bool flush();
+
+  // Calls fn with every stored state, including staged ones.  States still
+  // in legacy per-bulb files aren't included.
+  void forEach(const std::function<void(const BulbId& id, const GroupState& state)>& fn);
+
+  bool hasPending() const;
+  size_t size();
+  const Stats& getStats() const;
+
 private:
+  static const size_t HEADER_SIZE = 4;
+  static const size_t KEY_SIZE = 4;
+  static const size_t RECORD_SIZE = KEY_SIZE + GroupState::SERIALIZED_SIZE;
+  static const uint32_t TOMBSTONE_FLAG = 0x8000;
+  // Number of obsolete records tolerated before compacting
+  static const size_t COMPACTION_SLACK = 64;
+
+  struct Record {
+    uint32_t key;
+    uint8_t data[GroupState::SERIALIZED_SIZE];
+  };
+
+  FS& fs;
+  const char* path;
+  bool loaded;
+  bool needsCompaction;
+  size_t journalRecords;
+  Stats stats;
+
+  // Live records, sorted by key
+  std::vector<Record> records;
+  // Records staged for the next flush.  At most one per key.
+  std::vector<Record> pending;
+
+  void load();
+  bool compact();
+  void stage(const Record& record);
+  void apply(const Record& record);
+  std::vector<Record>::iterator find(uint32_t key);
+
+  static uint32_t keyFor(const BulbId& id);
+  static void encode(const Record& record, uint8_t* buffer);
+  static void decode(const uint8_t* buffer, Record& record);
 
-  static char* buildFilename(const BulbId& id, char* buffer);
+  // Pre-journal storage used one file per bulb.  These are migrated on access.
+  bool loadLegacy(const BulbId& id, GroupState& state);
+  static char* buildLegacyFilename(const BulbId& id, char* buffer);
 };
 
 #endif
@@ -2,7 +2,7 @@
 #include <MiLightRemoteConfig.h>
 
 GroupStateStore::GroupStateStore(const size_t maxSize, const size_t flushRate)
-  : cache(GroupStateCache(maxSize)),
+  : cache(maxSize),
     flushRate(flushRate),
     lastFlush(0)
 { }
@@ -40,6 +40,10 @@ GroupState* GroupStateStore::get(const uint16_t deviceId, const uint8_t groupId,
   return get(bulbId);
 }
 
+GroupState* GroupStateStore::getCached(const BulbId& id) {
+  return cache.get(id);
+}
+
 // Save state for a bulb.
 //
 // Notes:
@@ -50,14 +54,19 @@ GroupState* GroupStateStore::get(const uint16_t deviceId, const uint8_t groupId,
 //
 // * If id.groupId == 0, will iterate across all groups and individually save each group (recursively)
 //
+// * The state for id is fetched after the other groups' are.  Fetching a state can evict the least
+//   recently used one from the cache, so the returned pointer has to be the last one fetched.
+//
 GroupState* GroupStateStore::set(const BulbId &id, const GroupState& state) {
+  const MiLightRemoteConfig* remote = MiLightRemoteConfig::fromType(id.deviceType);
+
+  if (remote == NULL) {
+    return NULL;
+  }
+
   BulbId otherId(id);
-  GroupState* storedState = get(id);
-  storedState->patch(state);
 
   if (id.groupId == 0) {
-    const MiLightRemoteConfig* remote = MiLightRemoteConfig::fromType(id.deviceType);
-
 #ifdef STATE_DEBUG
     Serial.printf_P(PSTR("Fanning out group 0 state for device ID 0x%04X (%d groups in total)\n"), id.deviceId, remote->numGroups);
     state.debugState("group 0 state = ");
@@ -76,6 +85,9 @@ GroupState* GroupStateStore::set(const BulbId &id, const GroupState& state) {
     group0State->clearNonMatchingFields(state);
   }
 
+  GroupState* storedState = get(id);
+  storedState->patch(state);
+
   return storedState;
 }
 
@@ -93,12 +105,36 @@ void GroupStateStore::clear(const BulbId& bulbId) {
   }
 }
 
+void GroupStateStore::forEachMqttDirty(const std::function<void(const BulbId& id)>& fn) {
+  for (GroupCacheNode* node = cache.getHead(); node != NULL; node = node->next) {
+    if (node->state.isMqttDirty()) {
+      fn(node->id);
+    }
+  }
+
+  // Cached states are newer than their persisted copies
+  persistence.forEach([this, &fn](const BulbId& id, const GroupState& state) {
+    if (state.isMqttDirty() && !cache.contains(id)) {
+      fn(id);
+    }
+  });
+}
+
 void GroupStateStore::trackEviction() {
   if (cache.isFull()) {
-    evictedIds.add(cache.getLru());
+    GroupCacheNode* lru = cache.getTail();
+    BulbId bulbId = lru->id;
+
+    // Staged, and written out with the next flush.  States with changes that
+    // haven't been flushed or published yet are kept.  The MQTT dirty bit is
+    // persisted with the state, so it's still pending when it's reloaded.
+    if (lru->state.isDirty() || lru->state.isMqttDirty()) {
+      persistence.set(bulbId, lru->state);
+    } else {
+      persistence.clear(bulbId);
+    }
 
 #ifdef STATE_DEBUG
-    BulbId bulbId = evictedIds.getLast();
     printf(
       "Evicting from cache: 0x%04X / %d / %s\n",
       bulbId.deviceId,
@@ -110,33 +146,32 @@ void GroupStateStore::trackEviction() {
 }
 
 bool GroupStateStore::flush() {
-  ListNode<GroupCacheNode*>* curr = cache.getHead();
-  bool anythingFlushed = false;
+  GroupCacheNode* curr = cache.getHead();
 
-  while (curr != NULL && curr->data->state.isDirty() && !anythingFlushed) {
-    persistence.set(curr->data->id, curr->data->state);
-    curr->data->state.clearDirty();
+  while (curr != NULL) {
+    if (curr->state.isDirty()) {
+      persistence.set(curr->id, curr->state);
+      curr->state.clearDirty();
 
 #ifdef STATE_DEBUG
-    BulbId bulbId = curr->data->id;
-    printf(
-      "Flushing dirty state for 0x%04X / %d / %s\n",
-      bulbId.deviceId,
-      bulbId.groupId,
-      MiLightRemoteConfig::fromType(bulbId.deviceType)->name.c_str()
-    );
+      BulbId bulbId = curr->id;
+      printf(
+        "Flushing dirty state for 0x%04X / %d / %s\n",
+        bulbId.deviceId,
+        bulbId.groupId,
+        MiLightRemoteConfig::fromType(bulbId.deviceType)->name.c_str()
+      );
 #endif
+    }
 
     curr = curr->next;
-    anythingFlushed = true;
   }
 
-  while (evictedIds.size() > 0 && !anythingFlushed) {
-    persistence.clear(evictedIds.shift());
-    anythingFlushed = true;
-  }
+  return persistence.flush();
+}
 
-  return anythingFlushed;
+const GroupStatePersistence::Stats& GroupStateStore::getPersistenceStats() const {
+  return persistence.getStats();
 }
 
 void GroupStateStore::limitedFlush() {
@@ -19,6 +19,12 @@ public:
   GroupState* get(const BulbId& id);
   GroupState* get(const uint16_t deviceId, const uint8_t groupId, const MiLightRemoteType deviceType);
 
+  /*
+   * Returns the state for the given BulbId if it's in the cache, or NULL.
+   * Never loads from persistent storage, so never evicts anything.
+   */
+  GroupState* getCached(const BulbId& id);
+
   /*
    * Sets the state for the given BulbId.  State will be marked as dirty and
    * flushed to persistent storage.
@@ -29,21 +35,28 @@ public:
   void clear(const BulbId& id);
 
   /*
-   * Flushes all states to persistent storage.  Returns true iff anything was
-   * flushed.
+   * Calls fn with the ID of every state waiting for an MQTT publish, including
+   * states that have been evicted from the cache.
+   */
+  void forEachMqttDirty(const std::function<void(const BulbId& id)>& fn);
+
+  /*
+   * Flushes all dirty states to persistent storage in a single batched write.
+   * Returns true iff anything was flushed.
    */
   bool flush();
 
   /*
-   * Flushes at most one dirty state to persistent storage.  Rate limit
-   * specified by Settings.
+   * Flushes all dirty states to persistent storage.  Rate limit specified by
+   * Settings.
    */
   void limitedFlush();
 
+  const GroupStatePersistence::Stats& getPersistenceStats() const;
+
 private:
   GroupStateCache cache;
   GroupStatePersistence persistence;
-  LinkedList<BulbId> evictedIds;
   const size_t flushRate;
   unsigned long lastFlush;
 
@@ -0,0 +1,59 @@
+#include <StaleGroupSet.h>
+
+StaleGroupSet::StaleGroupSet(const size_t capacity)
+  : capacity(capacity),
+    head(0),
+    count(0),
+    entries(new Entry[capacity]),
+    keyAt{entries},
+    index(capacity)
+{ }
+
+StaleGroupSet::~StaleGroupSet() {
+  delete[] entries;
+}
+
+bool StaleGroupSet::add(const BulbId& id, unsigned long now) {
+  if (count >= capacity || contains(id)) {
+    return false;
+  }
+
+  const size_t position = (head + count) % capacity;
+
+  entries[position].id = id;
+  entries[position].since = now;
+  index.insert(id, position, keyAt);
+  ++count;
+
+  return true;
+}
+
+bool StaleGroupSet::contains(const BulbId& id) const {
+  return index.find(id, keyAt) != BulbIdIndex::NOT_FOUND;
+}
+
+BulbId StaleGroupSet::shift() {
+  BulbId id = entries[head].id;
+
+  index.remove(id, keyAt);
+  head = (head + 1) % capacity;
+  --count;
+
+  return id;
+}
+
+size_t StaleGroupSet::size() const {
+  return count;
+}
+
+bool StaleGroupSet::isEmpty() const {
+  return count == 0;
+}
+
+bool StaleGroupSet::isFull() const {
+  return count >= capacity;
+}
+
+unsigned long StaleGroupSet::oldestTime() const {
+  return entries[head].since;
+}
@@ -0,0 +1,59 @@
+#include <BulbId.h>
+#include <BulbIdIndex.h>
+
+#ifndef _STALE_GROUP_SET_H
+#define _STALE_GROUP_SET_H
+
+/*
+ * Fixed-capacity FIFO of BulbIds that ignores duplicates.
+ *
+ * Adding a BulbId that's already queued keeps its original position, so a
+ * group that changes constantly can't starve the others.  Membership goes
+ * through a BulbIdIndex of positions in the ring buffer.
+ */
+class StaleGroupSet {
+public:
+  StaleGroupSet(const size_t capacity);
+  ~StaleGroupSet();
+
+  StaleGroupSet(const StaleGroupSet&) = delete;
+  StaleGroupSet& operator=(const StaleGroupSet&) = delete;
+
+  // Returns false if the BulbId was already queued, or the set is full
+  bool add(const BulbId& id, unsigned long now);
+  bool contains(const BulbId& id) const;
+
+  // Removes and returns the BulbId that has been queued the longest.  Must
+  // not be called on an empty set.
+  BulbId shift();
+
+  size_t size() const;
+  bool isEmpty() const;
+  bool isFull() const;
+
+  // Time (as passed to add) that the oldest entry was queued
+  unsigned long oldestTime() const;
+
+private:
+  struct Entry {
+    BulbId id;
+    unsigned long since;
+  };
+
+  // Maps positions in the index back to the IDs of entries
+  struct EntryKey {
+    const Entry* entries;
+    const BulbId& operator()(uint16_t position) const { return entries[position].id; }
+  };
+
+  const size_t capacity;
+  size_t head;
+  size_t count;
+
+  // Ring buffer, in the order entries were added
+  Entry* entries;
+  const EntryKey keyAt;
+  BulbIdIndex index;
+};
+
+#endif
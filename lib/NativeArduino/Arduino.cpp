@@ -0,0 +1,425 @@
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <random>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+//================================================================================
+// Time
+//================================================================================
+
+static const std::chrono::steady_clock::time_point CLOCK_START = std::chrono::steady_clock::now();
+static uint64_t simulatedMicros = 0;
+
+static uint64_t nowMicros() {
+  const auto elapsed = std::chrono::steady_clock::now() - CLOCK_START;
+  return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + simulatedMicros;
+}
+
+unsigned long millis() {
+  return static_cast<unsigned long>(nowMicros() / 1000);
+}
+
+unsigned long micros() {
+  return static_cast<unsigned long>(nowMicros());
+}
+
+void advanceMicros(uint64_t us) {
+  simulatedMicros += us;
+}
+
+void delay(unsigned long ms) {
+  advanceMicros(static_cast<uint64_t>(ms) * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  advanceMicros(us);
+}
+
+void yield() { }
+
+//================================================================================
+// Misc
+//================================================================================
+
+void pinMode(uint8_t, uint8_t) { }
+void digitalWrite(uint8_t, uint8_t) { }
+int digitalRead(uint8_t) { return LOW; }
+
+static std::minstd_rand rng;
+
+long random(long max) {
+  return random(0, max);
+}
+
+long random(long min, long max) {
+  if (max <= min) {
+    return min;
+  }
+  return min + static_cast<long>(rng() % static_cast<unsigned long>(max - min));
+}
+
+void randomSeed(unsigned long seed) {
+  rng.seed(seed);
+}
+
+int printf_P(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int result = vprintf(format, args);
+  va_end(args);
+  return result;
+}
+
+//================================================================================
+// String
+//================================================================================
+
+static std::string formatInteger(unsigned long value, bool negative, unsigned char base) {
+  char buffer[8 * sizeof(unsigned long) + 2];
+  char* p = buffer + sizeof(buffer) - 1;
+  *p = 0;
+
+  if (base < 2) {
+    base = 10;
+  }
+
+  do {
+    const unsigned char digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= base;
+  } while (value > 0);
+
+  if (negative) {
+    *--p = '-';
+  }
+
+  return std::string(p);
+}
+
+String::String(const char* str)
+  : value(str == nullptr ? "" : str)
+{ }
+
+String::String(const __FlashStringHelper* str)
+  : String(reinterpret_cast<const char*>(str))
+{ }
+
+String::String(const std::string& str)
+  : value(str)
+{ }
+
+String::String(char c)
+  : value(1, c)
+{ }
+
+String::String(int value, unsigned char base)
+  : String(static_cast<long>(value), base)
+{ }
+
+String::String(unsigned int value, unsigned char base)
+  : String(static_cast<unsigned long>(value), base)
+{ }
+
+String::String(long value, unsigned char base)
+  : value(
+      base == 10 && value < 0
+        ? formatInteger(-static_cast<unsigned long>(value), true, base)
+        : formatInteger(static_cast<unsigned long>(value), false, base)
+    )
+{ }
+
+String::String(unsigned long value, unsigned char base)
+  : value(formatInteger(value, false, base))
+{ }
+
+String::String(double value, unsigned char decimalPlaces) {
+  char buffer[40];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimalPlaces, value);
+  this->value = buffer;
+}
+
+String& String::operator=(const char* str) {
+  value = str == nullptr ? "" : str;
+  return *this;
+}
+
+String& String::operator=(char c) {
+  value.assign(1, c);
+  return *this;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+  return value.length() == other.value.length() && strcasecmp(value.c_str(), other.value.c_str()) == 0;
+}
+
+bool String::startsWith(const String& prefix) const {
+  return value.compare(0, prefix.value.length(), prefix.value) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return value.length() >= suffix.value.length()
+    && value.compare(value.length() - suffix.value.length(), suffix.value.length(), suffix.value) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  const size_t ix = value.find(c, from);
+  return ix == std::string::npos ? -1 : static_cast<int>(ix);
+}
+
+int String::indexOf(const String& str, unsigned int from) const {
+  const size_t ix = value.find(str.value, from);
+  return ix == std::string::npos ? -1 : static_cast<int>(ix);
+}
+
+int String::lastIndexOf(char c) const {
+  const size_t ix = value.rfind(c);
+  return ix == std::string::npos ? -1 : static_cast<int>(ix);
+}
+
+String String::substring(unsigned int from) const {
+  return substring(from, value.length());
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    std::swap(from, to);
+  }
+  if (from >= value.length()) {
+    return String();
+  }
+  return String(value.substr(from, to - from));
+}
+
+void String::replace(char find, char replace) {
+  std::replace(value.begin(), value.end(), find, replace);
+}
+
+void String::replace(const String& find, const String& replace) {
+  if (find.value.empty()) {
+    return;
+  }
+  for (size_t ix = value.find(find.value); ix != std::string::npos; ix = value.find(find.value, ix + replace.value.length())) {
+    value.replace(ix, find.value.length(), replace.value);
+  }
+}
+
+void String::remove(unsigned int index) {
+  if (index < value.length()) {
+    value.erase(index);
+  }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if (index < value.length()) {
+    value.erase(index, count);
+  }
+}
+
+void String::trim() {
+  const size_t start = value.find_first_not_of(" \t\r\n");
+
+  if (start == std::string::npos) {
+    value.clear();
+  } else {
+    value = value.substr(start, value.find_last_not_of(" \t\r\n") - start + 1);
+  }
+}
+
+void String::toLowerCase() {
+  for (char& c : value) {
+    c = tolower(c);
+  }
+}
+
+void String::toUpperCase() {
+  for (char& c : value) {
+    c = toupper(c);
+  }
+}
+
+String operator+(const String& lhs, const String& rhs) {
+  return String(lhs.value + rhs.value);
+}
+
+String operator+(const String& lhs, const char* rhs) {
+  return lhs + String(rhs);
+}
+
+String operator+(const char* lhs, const String& rhs) {
+  return String(lhs) + rhs;
+}
+
+//================================================================================
+// Print / Stream
+//================================================================================
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  char* buffer = nullptr;
+  int length = vasprintf(&buffer, format, args);
+  va_end(args);
+
+  if (length < 0) {
+    return 0;
+  }
+
+  size_t written = write(reinterpret_cast<const uint8_t*>(buffer), length);
+  free(buffer);
+
+  return written;
+}
+
+size_t Print::printf_P(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  char* buffer = nullptr;
+  int length = vasprintf(&buffer, format, args);
+  va_end(args);
+
+  if (length < 0) {
+    return 0;
+  }
+
+  size_t written = write(reinterpret_cast<const uint8_t*>(buffer), length);
+  free(buffer);
+
+  return written;
+}
+
+size_t Print::print(const __FlashStringHelper* str) {
+  return write(reinterpret_cast<const char*>(str));
+}
+
+size_t Print::print(const String& str) {
+  return write(str.c_str(), str.length());
+}
+
+size_t Print::print(const char* str) {
+  return write(str);
+}
+
+size_t Print::print(char c) {
+  return write(static_cast<uint8_t>(c));
+}
+
+size_t Print::print(int value, int base) {
+  return print(String(value, base));
+}
+
+size_t Print::print(unsigned int value, int base) {
+  return print(String(value, base));
+}
+
+size_t Print::print(long value, int base) {
+  return print(String(value, base));
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return print(String(value, base));
+}
+
+size_t Print::print(double value, int digits) {
+  return print(String(value, digits));
+}
+
+size_t Print::println() {
+  return write("\r\n");
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+  size_t count = 0;
+
+  while (count < length) {
+    int c = read();
+
+    if (c < 0) {
+      break;
+    }
+
+    buffer[count++] = static_cast<char>(c);
+  }
+
+  return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char* buffer, size_t length) {
+  size_t count = 0;
+
+  while (count < length) {
+    int c = read();
+
+    if (c < 0 || c == terminator) {
+      break;
+    }
+
+    buffer[count++] = static_cast<char>(c);
+  }
+
+  return count;
+}
+
+long Stream::parseInt() {
+  int c;
+
+  while ((c = peek()) >= 0 && c != '-' && !isdigit(c)) {
+    read();
+  }
+
+  bool negative = false;
+  long value = 0;
+
+  if (c == '-') {
+    negative = true;
+    read();
+  }
+
+  while ((c = peek()) >= 0 && isdigit(c)) {
+    value = value * 10 + (c - '0');
+    read();
+  }
+
+  return negative ? -value : value;
+}
+
+String Stream::readString() {
+  String result;
+  int c;
+
+  while ((c = read()) >= 0) {
+    result += static_cast<char>(c);
+  }
+
+  return result;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String result;
+  int c;
+
+  while ((c = read()) >= 0 && c != terminator) {
+    result += static_cast<char>(c);
+  }
+
+  return result;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
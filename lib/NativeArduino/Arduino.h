@@ -0,0 +1,274 @@
+/*
+ * Minimal stand-in for the Arduino core used by the native (host) build.  Only
+ * covers what lib/ uses.
+ *
+ * Time is real (steady clock) plus a simulated offset.  delay() and
+ * delayMicroseconds() advance the offset instead of sleeping, so simulated
+ * radio airtime doesn't slow down benchmarks.
+ */
+
+#ifndef _NATIVE_ARDUINO_H
+#define _NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define _BV(bit) (1 << (bit))
+
+//================================================================================
+// PROGMEM.  Everything lives in RAM on a host.
+//================================================================================
+
+class __FlashStringHelper;
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper*>(p))
+
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t*>(addr))
+#define pgm_read_word(addr) (*reinterpret_cast<const uint16_t*>(addr))
+#define pgm_read_dword(addr) (*reinterpret_cast<const uint32_t*>(addr))
+#define pgm_read_float(addr) (*reinterpret_cast<const float*>(addr))
+#define pgm_read_ptr(addr) (*reinterpret_cast<void* const*>(addr))
+
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+int printf_P(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+//================================================================================
+// Time
+//================================================================================
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// Moves the clock forward without sleeping
+void advanceMicros(uint64_t us);
+
+//================================================================================
+// Misc
+//================================================================================
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+template <typename T, typename L>
+inline auto min(const T& a, const L& b) -> decltype((b < a) ? b : a) {
+  return (b < a) ? b : a;
+}
+
+template <typename T, typename L>
+inline auto max(const T& a, const L& b) -> decltype((b < a) ? b : a) {
+  return (a < b) ? b : a;
+}
+
+template <typename T, typename L, typename H>
+inline T constrain(const T& x, const L& low, const H& high) {
+  return x < low ? low : (x > high ? high : x);
+}
+
+//================================================================================
+// String
+//================================================================================
+
+class String {
+public:
+  String(const char* str = "");
+  String(const __FlashStringHelper* str);
+  String(const std::string& str);
+  String(const String& other) = default;
+  String(String&& other) = default;
+  explicit String(char c);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(double value, unsigned char decimalPlaces = 2);
+
+  String& operator=(const String& other) = default;
+  String& operator=(String&& other) = default;
+  String& operator=(const char* str);
+  String& operator=(char c);
+
+  const char* c_str() const { return value.c_str(); }
+  unsigned int length() const { return value.length(); }
+  bool isEmpty() const { return value.empty(); }
+  bool reserve(unsigned int size) { value.reserve(size); return true; }
+
+  bool concat(const String& str) { value += str.value; return true; }
+  bool concat(const char* str) { if (str) value += str; return str != nullptr; }
+  bool concat(const char* str, unsigned int length) { value.append(str, length); return true; }
+  bool concat(char c) { value += c; return true; }
+  String& operator+=(const String& str) { concat(str); return *this; }
+  String& operator+=(const char* str) { concat(str); return *this; }
+  String& operator+=(char c) { concat(c); return *this; }
+
+  char charAt(unsigned int ix) const { return ix < value.length() ? value[ix] : 0; }
+  char operator[](unsigned int ix) const { return charAt(ix); }
+  char& operator[](unsigned int ix) { return value[ix]; }
+
+  bool equals(const String& other) const { return value == other.value; }
+  bool equals(const char* other) const { return other != nullptr && value == other; }
+  bool equalsIgnoreCase(const String& other) const;
+  bool startsWith(const String& prefix) const;
+  bool endsWith(const String& suffix) const;
+
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String& str, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+
+  void replace(char find, char replace);
+  void replace(const String& find, const String& replace);
+  void remove(unsigned int index);
+  void remove(unsigned int index, unsigned int count);
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+
+  long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(value.c_str(), nullptr); }
+
+  bool operator==(const String& other) const { return equals(other); }
+  bool operator==(const char* other) const { return equals(other); }
+  bool operator!=(const String& other) const { return !equals(other); }
+  bool operator!=(const char* other) const { return !equals(other); }
+  bool operator<(const String& other) const { return value < other.value; }
+
+  friend String operator+(const String& lhs, const String& rhs);
+  friend String operator+(const String& lhs, const char* rhs);
+  friend String operator+(const char* lhs, const String& rhs);
+
+private:
+  std::string value;
+};
+
+//================================================================================
+// Print / Stream
+//================================================================================
+
+class Print {
+public:
+  virtual ~Print() { }
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str) { return str == nullptr ? 0 : write(reinterpret_cast<const uint8_t*>(str), strlen(str)); }
+  size_t write(const char* buffer, size_t size) { return write(reinterpret_cast<const uint8_t*>(buffer), size); }
+  virtual void flush() { }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  size_t printf_P(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  size_t print(const __FlashStringHelper* str);
+  size_t print(const String& str);
+  size_t print(const char* str);
+  size_t print(char c);
+  size_t print(int value, int base = 10);
+  size_t print(unsigned int value, int base = 10);
+  size_t print(long value, int base = 10);
+  size_t print(unsigned long value, int base = 10);
+  size_t print(double value, int digits = 2);
+
+  size_t println();
+  template <typename T>
+  size_t println(const T& value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(const T& value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+
+  virtual size_t readBytes(char* buffer, size_t length);
+  size_t readBytes(uint8_t* buffer, size_t length) { return readBytes(reinterpret_cast<char*>(buffer), length); }
+  size_t readBytesUntil(char terminator, char* buffer, size_t length);
+  // Skips anything before the first digit or '-', and leaves whatever ends the number unread
+  long parseInt();
+  String readString();
+  String readStringUntil(char terminator);
+
+protected:
+  unsigned long timeout = 1000;
+};
+
+// Writes to stdout.  Never has anything to read.
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) { }
+
+  virtual size_t write(uint8_t c) override;
+  virtual size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  virtual int available() override { return 0; }
+  virtual int read() override { return -1; }
+  virtual int peek() override { return -1; }
+  virtual void flush() override { fflush(stdout); }
+};
+
+extern HardwareSerial Serial;
+
+//================================================================================
+// ESP
+//================================================================================
+
+class EspClass {
+public:
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getChipId() { return 0; }
+  String getResetReason() { return F("native"); }
+  String getCoreVersion() { return F("native"); }
+  const char* getSdkVersion() { return "native"; }
+  void restart() { exit(0); }
+};
+
+extern EspClass ESP;
+
+#endif
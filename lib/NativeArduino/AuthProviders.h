@@ -0,0 +1,7 @@
+// Stand-in for RichHttpServer's AuthProviders.h, which Settings.h includes.
+// The web server isn't part of the native (host) build.
+
+#ifndef _NATIVE_AUTH_PROVIDERS_H
+#define _NATIVE_AUTH_PROVIDERS_H
+
+#endif
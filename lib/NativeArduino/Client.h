@@ -0,0 +1,16 @@
+// Stand-in for the Arduino Client interface used by the native (host) build.
+
+#ifndef _NATIVE_CLIENT_H
+#define _NATIVE_CLIENT_H
+
+#include <Arduino.h>
+
+class Client : public Stream {
+public:
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  virtual operator bool() = 0;
+};
+
+#endif
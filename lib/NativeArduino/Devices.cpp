@@ -0,0 +1,5 @@
+#include <SPI.h>
+#include <WiFi.h>
+
+SPIClass SPI;
+WiFiClass WiFi;
@@ -0,0 +1,4 @@
+// Stand-in for Esp.h used by the native (host) build.  EspClass lives in
+// Arduino.h.
+
+#include <Arduino.h>
@@ -0,0 +1,141 @@
+#include <FS.h>
+#include <algorithm>
+
+fs::FS SPIFFS;
+fs::FS LittleFS;
+
+namespace fs {
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if (!data || !writable) {
+    return 0;
+  }
+
+  if (position_ + size > data->size()) {
+    data->resize(position_ + size);
+  }
+
+  std::copy(buffer, buffer + size, data->begin() + position_);
+  position_ += size;
+
+  return size;
+}
+
+int File::available() {
+  return data ? static_cast<int>(data->size() - position_) : 0;
+}
+
+int File::read() {
+  if (!data || position_ >= data->size()) {
+    return -1;
+  }
+
+  return (*data)[position_++];
+}
+
+int File::peek() {
+  if (!data || position_ >= data->size()) {
+    return -1;
+  }
+
+  return (*data)[position_];
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  if (!data || position_ >= data->size()) {
+    return 0;
+  }
+
+  const size_t n = std::min(size, data->size() - position_);
+  std::copy(data->begin() + position_, data->begin() + position_ + n, buffer);
+  position_ += n;
+
+  return n;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!data) {
+    return false;
+  }
+
+  size_t target;
+
+  switch (mode) {
+    case SeekCur: target = position_ + pos; break;
+    case SeekEnd: target = data->size() + pos; break;
+    default:      target = pos; break;
+  }
+
+  if (target > data->size()) {
+    return false;
+  }
+
+  position_ = target;
+  return true;
+}
+
+File FS::open(const char* path, const char* mode) {
+  auto it = files.find(path);
+  const bool exists = it != files.end();
+
+  switch (mode[0]) {
+    case 'r':
+      if (!exists) {
+        return File();
+      }
+      return File(it->second, path, 0, mode[1] == '+');
+
+    case 'w': {
+      auto data = std::make_shared<std::vector<uint8_t>>();
+      files[path] = data;
+      return File(data, path, 0, true);
+    }
+
+    case 'a': {
+      auto data = exists ? it->second : std::make_shared<std::vector<uint8_t>>();
+      files[path] = data;
+      return File(data, path, data->size(), true);
+    }
+
+    default:
+      return File();
+  }
+}
+
+bool FS::exists(const char* path) const {
+  return files.count(path) > 0;
+}
+
+bool FS::remove(const char* path) {
+  return files.erase(path) > 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  auto it = files.find(from);
+
+  if (it == files.end()) {
+    return false;
+  }
+
+  auto data = it->second;
+  files.erase(it);
+  files[to] = data;
+
+  return true;
+}
+
+size_t FS::usedBytes() const {
+  size_t total = 0;
+
+  for (const auto& file : files) {
+    total += file.second->size();
+  }
+
+  return total;
+}
+
+}
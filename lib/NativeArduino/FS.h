@@ -0,0 +1,90 @@
+/*
+ * In-memory stand-in for the Arduino FS API used by the native (host) build.
+ * Files are kept in a map keyed by path and live until the process exits.
+ */
+
+#ifndef _NATIVE_FS_H
+#define _NATIVE_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+class File : public Stream {
+public:
+  File() : position_(0), writable(false) { }
+  File(const std::shared_ptr<std::vector<uint8_t>>& data, const String& path, size_t position, bool writable)
+    : data(data), path(path), position_(position), writable(writable)
+  { }
+
+  virtual size_t write(uint8_t c) override;
+  virtual size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  virtual int available() override;
+  virtual int read() override;
+  virtual int peek() override;
+  size_t read(uint8_t* buffer, size_t size);
+
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const { return position_; }
+  size_t size() const { return data ? data->size() : 0; }
+  const char* name() const { return path.c_str(); }
+  void close() { data.reset(); }
+
+  operator bool() const { return data != nullptr; }
+
+private:
+  std::shared_ptr<std::vector<uint8_t>> data;
+  String path;
+  size_t position_;
+  bool writable;
+};
+
+class FS {
+public:
+  bool begin() { return true; }
+  void end() { }
+  bool format() { files.clear(); return true; }
+
+  // Supports modes "r", "w" and "a" (optionally with "+")
+  File open(const char* path, const char* mode);
+  File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+
+  bool exists(const char* path) const;
+  bool exists(const String& path) const { return exists(path.c_str()); }
+  bool remove(const char* path);
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char*) { return true; }
+
+  size_t usedBytes() const;
+  size_t totalBytes() const { return 1024 * 1024; }
+
+private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+};
+
+}
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+extern fs::FS SPIFFS;
+extern fs::FS LittleFS;
+
+#endif
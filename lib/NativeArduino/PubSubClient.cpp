@@ -0,0 +1,247 @@
+#include <PubSubClient.h>
+#include <algorithm>
+
+LoopbackMqttBroker MqttBroker;
+
+static const uint8_t MQTT_PUBLISH = 0x30;
+static const uint8_t MQTT_RETAIN = 0x01;
+
+PubSubClient::PubSubClient(Client& client)
+  : client(client)
+  , domain(nullptr)
+  , port(0)
+  , connectionState(MQTT_DISCONNECTED)
+  , publishLength(0)
+  , publishWritten(0)
+  , publishCopied(0)
+{ }
+
+PubSubClient::~PubSubClient() {
+  MqttBroker.disconnect(this);
+}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+  this->domain = domain;
+  this->port = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(Callback callback) {
+  this->callback = callback;
+  return *this;
+}
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass) {
+  return connect(id, user, pass, nullptr, 0, false, nullptr);
+}
+
+bool PubSubClient::connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage) {
+  return connect(id, nullptr, nullptr, willTopic, willQos, willRetain, willMessage);
+}
+
+bool PubSubClient::connect(
+  const char*,
+  const char*,
+  const char*,
+  const char*,
+  uint8_t,
+  bool,
+  const char*
+) {
+  if (!client.connect(domain, port)) {
+    connectionState = MQTT_CONNECT_FAILED;
+    return false;
+  }
+
+  connectionState = MQTT_CONNECTED;
+  MqttBroker.connect(this);
+
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  MqttBroker.disconnect(this);
+  client.stop();
+  subscriptions.clear();
+  connectionState = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  const size_t topicLength = strlen(topic);
+  const size_t payloadLength = strlen(payload);
+
+  // Header, topic length and topic, then the payload, all in the buffer
+  if (!connected() || 5 + 2 + topicLength + payloadLength > sizeof(buffer)) {
+    return false;
+  }
+
+  uint8_t* packet = buffer + 5;
+  *packet++ = topicLength >> 8;
+  *packet++ = topicLength & 0xFF;
+  memcpy(packet, topic, topicLength);
+  memcpy(packet + topicLength, payload, payloadLength);
+
+  buffer[0] = MQTT_PUBLISH | (retained ? MQTT_RETAIN : 0);
+  writeHeader(2 + topicLength + payloadLength);
+  client.write(buffer + 5, 2 + topicLength + payloadLength);
+  MqttBroker.received(payloadLength, topicLength + payloadLength, true);
+
+  return true;
+}
+
+bool PubSubClient::beginPublish(const char* topic, unsigned int length, bool retained) {
+  const size_t topicLength = strlen(topic);
+
+  if (!connected() || 5 + 2 + topicLength > sizeof(buffer)) {
+    return false;
+  }
+
+  uint8_t* packet = buffer + 5;
+  *packet++ = topicLength >> 8;
+  *packet++ = topicLength & 0xFF;
+  memcpy(packet, topic, topicLength);
+  publishCopied = topicLength;
+
+  buffer[0] = MQTT_PUBLISH | (retained ? MQTT_RETAIN : 0);
+  writeHeader(2 + topicLength + length);
+  client.write(buffer + 5, 2 + topicLength);
+
+  publishLength = length;
+  publishWritten = 0;
+
+  return true;
+}
+
+int PubSubClient::endPublish() {
+  MqttBroker.received(publishLength, publishCopied, publishWritten == publishLength);
+  publishLength = 0;
+  publishWritten = 0;
+  publishCopied = 0;
+
+  return 1;
+}
+
+size_t PubSubClient::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t PubSubClient::write(const uint8_t* data, size_t size) {
+  publishWritten += size;
+  return client.write(data, size);
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+  if (!connected()) {
+    return false;
+  }
+
+  subscriptions.push_back(topic);
+  return true;
+}
+
+bool PubSubClient::loop() {
+  return connected();
+}
+
+bool PubSubClient::connected() {
+  return connectionState == MQTT_CONNECTED && client.connected();
+}
+
+int PubSubClient::state() {
+  return connectionState;
+}
+
+// Writes the fixed header in buffer[0] and the remaining length
+void PubSubClient::writeHeader(size_t length) {
+  uint8_t header[5] = { buffer[0] };
+  size_t headerLength = 1;
+
+  do {
+    uint8_t digit = length % 128;
+    length /= 128;
+    header[headerLength++] = digit | (length > 0 ? 0x80 : 0);
+  } while (length > 0 && headerLength < sizeof(header));
+
+  client.write(header, headerLength);
+}
+
+void PubSubClient::deliver(const char* topic, const uint8_t* payload, size_t length) {
+  const size_t topicLength = strlen(topic);
+
+  if (!callback || topicLength + 1 + length > sizeof(buffer)) {
+    return;
+  }
+
+  // Like PubSubClient, the topic is NUL-terminated in the buffer, followed by
+  // the payload
+  char* boundTopic = reinterpret_cast<char*>(buffer);
+  memcpy(boundTopic, topic, topicLength + 1);
+  memcpy(buffer + topicLength + 1, payload, length);
+
+  callback(boundTopic, buffer + topicLength + 1, length);
+}
+
+LoopbackMqttBroker::LoopbackMqttBroker()
+  : stats()
+{ }
+
+void LoopbackMqttBroker::publish(const char* topic, const uint8_t* payload, size_t length) {
+  for (PubSubClient* client : clients) {
+    for (const String& filter : client->subscriptions) {
+      if (matches(filter.c_str(), topic)) {
+        client->deliver(topic, payload, length);
+        break;
+      }
+    }
+  }
+}
+
+const LoopbackMqttBroker::Stats& LoopbackMqttBroker::getStats() const {
+  return stats;
+}
+
+void LoopbackMqttBroker::resetStats() {
+  stats = Stats();
+}
+
+bool LoopbackMqttBroker::matches(const char* filter, const char* topic) {
+  while (*filter != 0) {
+    if (*filter == '#') {
+      return true;
+    } else if (*filter == '+') {
+      while (*topic != 0 && *topic != '/') {
+        ++topic;
+      }
+      ++filter;
+    } else if (*filter++ != *topic++) {
+      return false;
+    }
+  }
+
+  return *topic == 0;
+}
+
+void LoopbackMqttBroker::connect(PubSubClient* client) {
+  if (std::find(clients.begin(), clients.end(), client) == clients.end()) {
+    clients.push_back(client);
+  }
+}
+
+void LoopbackMqttBroker::disconnect(PubSubClient* client) {
+  clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+}
+
+void LoopbackMqttBroker::received(size_t payloadLength, size_t copiedBytes, bool complete) {
+  stats.copiedBytes += copiedBytes;
+
+  if (complete) {
+    ++stats.publishes;
+    stats.payloadBytes += payloadLength;
+  } else {
+    ++stats.malformed;
+  }
+}
@@ -0,0 +1,132 @@
+/*
+ * Stand-in for PubSubClient used by the native (host) build.  Whatever server
+ * they're given, clients connect to MqttBroker, a broker that lives in the
+ * same process.
+ *
+ * Like PubSubClient, publish() copies the topic and payload into the client's
+ * packet buffer, and beginPublish() copies the topic, while write() goes
+ * straight to the connection.  The broker counts bytes copied this way.
+ */
+
+#ifndef _NATIVE_PUB_SUB_CLIENT_H
+#define _NATIVE_PUB_SUB_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <functional>
+#include <vector>
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 256
+#endif
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+class PubSubClient : public Print {
+public:
+  typedef std::function<void(char* topic, uint8_t* payload, unsigned int length)> Callback;
+
+  PubSubClient(Client& client);
+  ~PubSubClient();
+
+  PubSubClient& setServer(const char* domain, uint16_t port);
+  PubSubClient& setCallback(Callback callback);
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* user, const char* pass);
+  bool connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage);
+  bool connect(
+    const char* id,
+    const char* user,
+    const char* pass,
+    const char* willTopic,
+    uint8_t willQos,
+    bool willRetain,
+    const char* willMessage
+  );
+  void disconnect();
+
+  bool publish(const char* topic, const char* payload, bool retained = false);
+  // Sends the header of a publish with a payload of length bytes, which the
+  // caller then writes and finishes with endPublish()
+  bool beginPublish(const char* topic, unsigned int length, bool retained);
+  int endPublish();
+  virtual size_t write(uint8_t c) override;
+  virtual size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  bool subscribe(const char* topic);
+  bool loop();
+  bool connected();
+  int state();
+
+private:
+  friend class LoopbackMqttBroker;
+
+  Client& client;
+  const char* domain;
+  uint16_t port;
+  Callback callback;
+  int connectionState;
+  std::vector<String> subscriptions;
+  uint8_t buffer[MQTT_MAX_PACKET_SIZE];
+  // Payload length declared by beginPublish(), bytes written since, and bytes
+  // beginPublish() copied into the buffer
+  size_t publishLength;
+  size_t publishWritten;
+  size_t publishCopied;
+
+  void writeHeader(size_t length);
+  // Called by the broker with a message for one of the subscriptions
+  void deliver(const char* topic, const uint8_t* payload, size_t length);
+};
+
+// The broker every PubSubClient stand-in connects to
+class LoopbackMqttBroker {
+public:
+  struct Stats {
+    // Messages received from clients
+    uint32_t publishes;
+    uint32_t payloadBytes;
+    // Bytes clients copied into their packet buffers to send them
+    uint32_t copiedBytes;
+    // Streamed publishes whose payload didn't match the length they declared
+    uint32_t malformed;
+  };
+
+  LoopbackMqttBroker();
+
+  // Delivers a message to every connected client with a matching
+  // subscription.  Unlike a real broker, it's delivered right away rather
+  // than from the client's loop().
+  void publish(const char* topic, const uint8_t* payload, size_t length);
+
+  const Stats& getStats() const;
+  void resetStats();
+
+  // True if topic matches an MQTT topic filter, with + and # wildcards
+  static bool matches(const char* filter, const char* topic);
+
+private:
+  friend class PubSubClient;
+
+  std::vector<PubSubClient*> clients;
+  Stats stats;
+
+  void connect(PubSubClient* client);
+  void disconnect(PubSubClient* client);
+  void received(size_t payloadLength, size_t copiedBytes, bool complete);
+};
+
+extern LoopbackMqttBroker MqttBroker;
+
+#endif
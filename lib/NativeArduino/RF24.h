@@ -0,0 +1,96 @@
+/*
+ * Stand-in for the RF24 library used by the native (host) build.  Accepts
+ * every call and never receives anything.  Use SimulatedMiLightRadio to
+ * exercise the send path on a host.
+ *
+ * Counts the SPI bytes each call would clock out with RF24 1.3 (command byte
+ * plus register data, including read-modify-writes), so the cost of driving
+ * the radio can be compared on a host.  Payloads passed to write() are
+ * hashed together with the channel they're sent on, so two implementations
+ * can be checked to put the same frames on air.
+ */
+
+#ifndef _NATIVE_RF24_H
+#define _NATIVE_RF24_H
+
+#include <Arduino.h>
+
+typedef enum { RF24_PA_MIN = 0, RF24_PA_LOW, RF24_PA_HIGH, RF24_PA_MAX, RF24_PA_ERROR } rf24_pa_dbm_e;
+typedef enum { RF24_1MBPS = 0, RF24_2MBPS, RF24_250KBPS } rf24_datarate_e;
+typedef enum { RF24_CRC_DISABLED = 0, RF24_CRC_8, RF24_CRC_16 } rf24_crclength_e;
+
+class RF24 {
+public:
+  struct Stats {
+    uint32_t spiBytes;
+    uint32_t writes;
+    uint32_t channelChanges;
+    uint32_t modeChanges;
+    // FNV-1a over (channel, payload) of every write
+    uint32_t frameHash;
+  };
+
+  RF24(uint16_t cePin, uint16_t csnPin)
+    : stats{0, 0, 0, 0, FNV_OFFSET}
+    , addressWidth(5)
+    , payloadSize(32)
+    , channel(0)
+  { }
+
+  bool begin() { stats.spiBytes += 40; return true; }
+  void setAutoAck(bool) { stats.spiBytes += 2; }
+  bool setDataRate(rf24_datarate_e) { stats.spiBytes += 4; return true; }
+  void disableCRC() { stats.spiBytes += 4; }
+  void setAddressWidth(uint8_t width) { addressWidth = width; stats.spiBytes += 2; }
+  // RX_ADDR_P0, TX_ADDR and RX_PW_P0
+  void openWritingPipe(const uint8_t*) { stats.spiBytes += 2 * (1 + addressWidth) + 2; }
+  // RX_ADDR_P1, RX_PW_P1 and a read-modify-write of EN_RXADDR
+  void openReadingPipe(uint8_t, const uint8_t*) { stats.spiBytes += (1 + addressWidth) + 2 + 4; }
+  void setChannel(uint8_t channel) {
+    this->channel = channel;
+    ++stats.channelChanges;
+    stats.spiBytes += 2;
+  }
+  // Only stored by the driver
+  void setPayloadSize(uint8_t size) { payloadSize = size; }
+  void setPALevel(uint8_t) { stats.spiBytes += 4; }
+  // CONFIG and STATUS, RX_ADDR_P0, FEATURE and FLUSH_TX
+  void startListening() { ++stats.modeChanges; stats.spiBytes += 4 + 2 + (1 + addressWidth) + 2 + 1; }
+  // FEATURE, then read-modify-writes of CONFIG and EN_RXADDR
+  void stopListening() { ++stats.modeChanges; stats.spiBytes += 2 + 4 + 4; }
+  bool available() { stats.spiBytes += 1; return false; }
+  void read(void*, uint8_t) { }
+
+  // W_TX_PAYLOAD padded to the payload size, one STATUS poll and clearing
+  // the interrupt flags
+  bool write(const void* buf, uint8_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(buf);
+
+    ++stats.writes;
+    stats.spiBytes += 1 + payloadSize + 1 + 2;
+
+    hash(channel);
+    for (uint8_t i = 0; i < len; ++i) {
+      hash(bytes[i]);
+    }
+
+    return true;
+  }
+
+  const Stats& getStats() const { return stats; }
+
+private:
+  static const uint32_t FNV_OFFSET = 2166136261u;
+  static const uint32_t FNV_PRIME = 16777619u;
+
+  Stats stats;
+  uint8_t addressWidth;
+  uint8_t payloadSize;
+  uint8_t channel;
+
+  void hash(uint8_t byte) {
+    stats.frameHash = (stats.frameHash ^ byte) * FNV_PRIME;
+  }
+};
+
+#endif
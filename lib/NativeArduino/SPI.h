@@ -0,0 +1,28 @@
+// Stand-in for the Arduino SPI API used by the native (host) build.  No-ops.
+
+#ifndef _NATIVE_SPI_H
+#define _NATIVE_SPI_H
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+class SPIClass {
+public:
+  void begin() { }
+  void end() { }
+  void setDataMode(uint8_t) { }
+  void setBitOrder(uint8_t) { }
+  void setFrequency(uint32_t) { }
+  uint8_t transfer(uint8_t) { return 0; }
+};
+
+extern SPIClass SPI;
+
+#endif
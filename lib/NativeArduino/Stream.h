@@ -0,0 +1,4 @@
+// Stand-in for Stream.h used by the native (host) build.  Stream lives in
+// Arduino.h.
+
+#include <Arduino.h>
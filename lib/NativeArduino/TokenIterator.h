@@ -0,0 +1,57 @@
+/*
+ * Stand-in for PathVariableHandlers' TokenIterator used by the native (host)
+ * build.  Apart from UrlTokenBindings (see UrlTokenBindings.h), the rest of
+ * that library depends on the ESP web server, so it isn't part of the native
+ * build.
+ */
+
+#ifndef _NATIVE_TOKEN_ITERATOR_H
+#define _NATIVE_TOKEN_ITERATOR_H
+
+#include <Arduino.h>
+#include <vector>
+
+class TokenIterator {
+public:
+  TokenIterator(const char* data, size_t length, char sep = ',')
+    : data(data, data + length), sep(sep), position(0)
+  {
+    this->data.push_back(0);
+  }
+
+  bool hasNext() const {
+    return position < data.size() - 1;
+  }
+
+  const char* nextToken() {
+    if (!hasNext()) {
+      return nullptr;
+    }
+
+    char* token = &data[position];
+
+    while (position < data.size() - 1 && data[position] != sep) {
+      ++position;
+    }
+
+    data[position++] = 0;
+
+    return token;
+  }
+
+  void reset() {
+    for (size_t i = 0; i < position && i < data.size() - 1; ++i) {
+      if (data[i] == 0) {
+        data[i] = sep;
+      }
+    }
+    position = 0;
+  }
+
+private:
+  std::vector<char> data;
+  char sep;
+  size_t position;
+};
+
+#endif
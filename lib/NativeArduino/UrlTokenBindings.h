@@ -0,0 +1,44 @@
+/*
+ * Stand-in for PathVariableHandlers' UrlTokenBindings used by the native
+ * (host) build.  Binds the :tokens in a pattern to the segments of a path by
+ * walking both iterators side by side, on every lookup.
+ */
+
+#ifndef _NATIVE_URL_TOKEN_BINDINGS_H
+#define _NATIVE_URL_TOKEN_BINDINGS_H
+
+#include <TokenIterator.h>
+#include <memory>
+
+class UrlTokenBindings {
+public:
+  UrlTokenBindings(std::shared_ptr<TokenIterator> patternTokens, std::shared_ptr<TokenIterator> requestTokens)
+    : patternTokens(patternTokens), requestTokens(requestTokens)
+  { }
+
+  bool hasBinding(const char* searchToken) const {
+    return get(searchToken) != nullptr;
+  }
+
+  const char* get(const char* searchToken) const {
+    patternTokens->reset();
+    requestTokens->reset();
+
+    while (patternTokens->hasNext() && requestTokens->hasNext()) {
+      const char* token = patternTokens->nextToken();
+      const char* binding = requestTokens->nextToken();
+
+      if (token[0] == ':' && strcmp(token + 1, searchToken) == 0) {
+        return binding;
+      }
+    }
+
+    return nullptr;
+  }
+
+private:
+  std::shared_ptr<TokenIterator> patternTokens;
+  std::shared_ptr<TokenIterator> requestTokens;
+};
+
+#endif
@@ -0,0 +1,41 @@
+// Stand-in for the WiFi API used by the native (host) build.
+
+#ifndef _NATIVE_WIFI_H
+#define _NATIVE_WIFI_H
+
+#include <Arduino.h>
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} { }
+
+  bool fromString(const String& address) {
+    unsigned int a, b, c, d;
+    if (sscanf(address.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) != 4) {
+      return false;
+    }
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+
+  String toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return buffer;
+  }
+
+  uint8_t operator[](int ix) const { return octets[ix]; }
+
+private:
+  uint8_t octets[4];
+};
+
+class WiFiClass {
+public:
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  String macAddress() { return F("00:00:00:00:00:00"); }
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,44 @@
+// Stand-in for WiFiClient used by the native (host) build.  Connects to
+// nothing: writes are counted and dropped, and there's never anything to read.
+// PubSubClient's stand-in delivers messages itself.
+
+#ifndef _NATIVE_WIFI_CLIENT_H
+#define _NATIVE_WIFI_CLIENT_H
+
+#include <Client.h>
+
+class WiFiClient : public Client {
+public:
+  WiFiClient() : isConnected(false), bytesWritten(0) { }
+
+  virtual int connect(const char*, uint16_t) override {
+    isConnected = true;
+    return 1;
+  }
+  virtual uint8_t connected() override { return isConnected; }
+  virtual void stop() override { isConnected = false; }
+  virtual operator bool() override { return isConnected; }
+
+  virtual size_t write(uint8_t) override {
+    ++bytesWritten;
+    return 1;
+  }
+  virtual size_t write(const uint8_t*, size_t size) override {
+    bytesWritten += size;
+    return size;
+  }
+  using Print::write;
+
+  virtual int available() override { return 0; }
+  virtual int read() override { return -1; }
+  virtual int peek() override { return -1; }
+
+  // Bytes written to the connection since it was created
+  size_t getBytesWritten() const { return bytesWritten; }
+
+private:
+  bool isConnected;
+  size_t bytesWritten;
+};
+
+#endif
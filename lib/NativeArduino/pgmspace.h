@@ -0,0 +1,4 @@
+// Stand-in for pgmspace.h used by the native (host) build.  The PROGMEM
+// macros live in Arduino.h.
+
+#include <Arduino.h>
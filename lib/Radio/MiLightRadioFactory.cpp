@@ -19,6 +19,22 @@ std::shared_ptr<MiLightRadioFactory> MiLightRadioFactory::fromSettings(const Set
   }
 }
 
+std::shared_ptr<MiLightRadioFactory> MiLightRadioFactory::fromSettings(const Settings& settings, const RadioPins& pins) {
+  switch (settings.radioInterfaceType) {
+    case nRF24:
+      return std::make_shared<NRF24Factory>(
+        pins.csnPin,
+        pins.cePin,
+        settings.rf24PowerLevel,
+        settings.rf24Channels,
+        settings.rf24ListenChannel
+      );
+
+    default:
+      return NULL;
+  }
+}
+
 NRF24Factory::NRF24Factory(
   uint8_t csnPin,
   uint8_t cePin,
@@ -46,3 +62,29 @@ LT8900Factory::LT8900Factory(uint8_t csPin, uint8_t resetPin, uint8_t pktFlag)
 std::shared_ptr<MiLightRadio> LT8900Factory::create(const MiLightRadioConfig& config) {
   return std::make_shared<LT8900MiLightRadio>(_csPin, _resetPin, _pktFlag, config);
 }
+
+SimulatedRadioFactory::SimulatedRadioFactory(uint32_t airtimeMicros)
+  : airtimeMicros(airtimeMicros),
+    stats(std::make_shared<SimulatedMiLightRadio::Stats>())
+{ }
+
+std::shared_ptr<MiLightRadio> SimulatedRadioFactory::create(const MiLightRadioConfig& config) {
+  std::shared_ptr<SimulatedMiLightRadio> radio = std::make_shared<SimulatedMiLightRadio>(config, airtimeMicros, stats);
+  radios.push_back(radio);
+
+  return radio;
+}
+
+std::shared_ptr<SimulatedMiLightRadio> SimulatedRadioFactory::getRadio(const MiLightRadioConfig& config) const {
+  for (const std::shared_ptr<SimulatedMiLightRadio>& radio : radios) {
+    if (&radio->config() == &config) {
+      return radio;
+    }
+  }
+
+  return nullptr;
+}
+
+const SimulatedMiLightRadio::Stats& SimulatedRadioFactory::getStats() const {
+  return *stats;
+}
@@ -4,6 +4,7 @@
 #include <MiLightRadio.h>
 #include <NRF24MiLightRadio.h>
 #include <LT8900MiLightRadio.h>
+#include <SimulatedMiLightRadio.h>
 #include <RF24PowerLevel.h>
 #include <RF24Channel.h>
 #include <Settings.h>
@@ -21,6 +22,10 @@ public:
 
   static std::shared_ptr<MiLightRadioFactory> fromSettings(const Settings& settings);
 
+  // Factory for an additional radio module on the given pins.  Returns NULL if
+  // the configured radio type doesn't support more than one module.
+  static std::shared_ptr<MiLightRadioFactory> fromSettings(const Settings& settings, const RadioPins& pins);
+
 };
 
 class NRF24Factory : public MiLightRadioFactory {
@@ -59,4 +64,26 @@ protected:
 
 };
 
+// Creates SimulatedMiLightRadios.  Not selectable from settings; used by
+// native builds.
+class SimulatedRadioFactory : public MiLightRadioFactory {
+public:
+
+  SimulatedRadioFactory(uint32_t airtimeMicros);
+
+  virtual std::shared_ptr<MiLightRadio> create(const MiLightRadioConfig& config);
+
+  const SimulatedMiLightRadio::Stats& getStats() const;
+
+  // The radio created for config, or nullptr if there isn't one
+  std::shared_ptr<SimulatedMiLightRadio> getRadio(const MiLightRadioConfig& config) const;
+
+protected:
+
+  const uint32_t airtimeMicros;
+  std::shared_ptr<SimulatedMiLightRadio::Stats> stats;
+  std::vector<std::shared_ptr<SimulatedMiLightRadio>> radios;
+
+};
+
 #endif
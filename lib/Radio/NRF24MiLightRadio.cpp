@@ -15,6 +15,7 @@ NRF24MiLightRadio::NRF24MiLightRadio(
     listenChannelIx(static_cast<size_t>(listenChannel)),
     _pl1167(PL1167_nRF24(rf24)),
     _config(config),
+    _frame_ready(false),
     _waiting(false)
 { }
 
@@ -112,8 +113,14 @@ int NRF24MiLightRadio::write(uint8_t frame[], size_t frame_length) {
     return -1;
   }
 
-  memcpy(_out_packet + 1, frame, frame_length);
-  _out_packet[0] = frame_length;
+  // Repeats of a packet reuse the frame built the first time it was written
+  if (!_frame_ready || _out_packet[0] != frame_length || memcmp(_out_packet + 1, frame, frame_length) != 0) {
+    memcpy(_out_packet + 1, frame, frame_length);
+    _out_packet[0] = frame_length;
+
+    _pl1167.writeFIFO(_out_packet, _out_packet[0] + 1);
+    _frame_ready = true;
+  }
 
   int retval = resend();
   if (retval < 0) {
@@ -123,11 +130,14 @@ int NRF24MiLightRadio::write(uint8_t frame[], size_t frame_length) {
 }
 
 int NRF24MiLightRadio::resend() {
+  if (!_frame_ready) {
+    return -1;
+  }
+
   for (std::vector<RF24Channel>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
     size_t channelIx = static_cast<uint8_t>(*it);
     uint8_t channel = _config.channels[channelIx];
 
-    _pl1167.writeFIFO(_out_packet, _out_packet[0] + 1);
     _pl1167.transmit(channel);
   }
 
@@ -44,6 +44,8 @@ class NRF24MiLightRadio : public MiLightRadio {
 
     uint8_t _packet[10];
     uint8_t _out_packet[10];
+    // Whether _pl1167 holds the frame for _out_packet
+    bool _frame_ready;
     bool _waiting;
     int _dupes_received;
 };
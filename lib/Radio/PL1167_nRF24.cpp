@@ -14,7 +14,7 @@
 #include <RadioUtils.h>
 #include <MiLightRadioConfig.h>
 
-static uint16_t calc_crc(uint8_t *data, size_t data_length);
+static uint16_t calc_crc(const uint8_t *data, size_t data_length);
 
 PL1167_nRF24::PL1167_nRF24(RF24 &radio)
   : _radio(radio)
@@ -57,6 +57,10 @@ int PL1167_nRF24::recalc_parameters() {
   _radio.setChannel(2 + _channel);
   _radio.setPayloadSize( packet_length );
 
+  // The RF24 is shared between radio configs, and another one may have left
+  // it listening
+  _listening = true;
+
   return 0;
 }
 
@@ -81,6 +85,7 @@ int PL1167_nRF24::receive(uint8_t channel) {
   }
 
   _radio.startListening();
+  _listening = true;
   if (_radio.available()) {
 #ifdef DEBUG_PRINTF
   printf("Radio is available\n");
@@ -115,46 +120,40 @@ int PL1167_nRF24::readFIFO(uint8_t data[], size_t &data_length)
 
 int PL1167_nRF24::writeFIFO(const uint8_t data[], size_t data_length)
 {
-  if (data_length > sizeof(_packet)) {
-    data_length = sizeof(_packet);
+  // +2 for crc
+  if (data_length > sizeof(_frame) - 2) {
+    data_length = sizeof(_frame) - 2;
   }
-  memcpy(_packet, data, data_length);
-  _packet_length = data_length;
+
+  uint16_t crc = calc_crc(data, data_length);
+
+  for (size_t i = 0; i < data_length; i++) {
+    _frame[i] = reverseBits(data[i]);
+  }
+  _frame[data_length] = reverseBits(crc & 0xff);
+  _frame[data_length + 1] = reverseBits(crc >> 8);
+
+  _frame_length = data_length + 2;
   _received = false;
 
   return data_length;
 }
 
 int PL1167_nRF24::transmit(uint8_t channel) {
+  // The syncword and payload size don't depend on the channel, so only the
+  // channel register needs to change
   if (channel != _channel) {
     _channel = channel;
-    int retval = recalc_parameters();
-    if (retval < 0) {
-      return retval;
-    }
+    _radio.setChannel(2 + _channel);
     yield();
   }
 
-  _radio.stopListening();
-  uint8_t tmp[sizeof(_packet)];
-  int outp=0;
-
-  uint16_t crc = calc_crc(_packet, _packet_length);
-
-  // +1 for packet length
-  // +2 for crc
-  // = 3
-  for (int inp = 0; inp < _packet_length + 3; inp++) {
-    if (inp < _packet_length) {
-      tmp[outp++] = reverseBits(_packet[inp]);}
-    else if (inp < _packet_length + 2) {
-      tmp[outp++] = reverseBits((crc >> ( (inp - _packet_length) * 8)) & 0xff);
-    }
+  if (_listening) {
+    _radio.stopListening();
+    _listening = false;
   }
 
-  yield();
-
-  _radio.write(tmp, outp);
+  _radio.write(_frame, _frame_length);
   return 0;
 }
 
@@ -244,7 +243,7 @@ int PL1167_nRF24::internal_receive() {
 
 #define CRC_POLY 0x8408
 
-static uint16_t calc_crc(uint8_t *data, size_t data_length) {
+static uint16_t calc_crc(const uint8_t *data, size_t data_length) {
   uint16_t state = 0;
   for (size_t i = 0; i < data_length; i++) {
     uint8_t byte = data[i];
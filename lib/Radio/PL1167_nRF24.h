@@ -24,6 +24,9 @@ class PL1167_nRF24 {
     int setSyncword(const uint8_t syncword[], size_t syncwordLength);
     int setMaxPacketLength(uint8_t maxPacketLength);
 
+    // Builds the on-air frame (bit-reversed, with CRC) for data.  The frame is
+    // kept until the next writeFIFO, so it can be transmitted any number of
+    // times on any channels without being rebuilt.
     int writeFIFO(const uint8_t data[], size_t data_length);
     int transmit(uint8_t channel);
     int receive(uint8_t channel);
@@ -47,6 +50,11 @@ class PL1167_nRF24 {
     uint8_t _packet[32];
     bool _received = false;
 
+    uint8_t _frame[32];
+    uint8_t _frame_length = 0;
+    // Whether the radio may be in RX mode, so needs switching before sending
+    bool _listening = true;
+
     int recalc_parameters();
     int internal_receive();
 
@@ -0,0 +1,98 @@
+#include <SimulatedMiLightRadio.h>
+#include <algorithm>
+
+SimulatedMiLightRadio::SimulatedMiLightRadio(
+  const MiLightRadioConfig& config,
+  uint32_t airtimeMicros,
+  std::shared_ptr<Stats> stats
+)
+  : _config(config),
+    _airtimeMicros(airtimeMicros),
+    _stats(stats),
+    _out_packet_length(0)
+{ }
+
+int SimulatedMiLightRadio::begin() {
+  return configure();
+}
+
+int SimulatedMiLightRadio::configure() {
+  _stats->configures++;
+  _stats->tuned = this;
+
+  // Reconfiguring a real radio flushes its receive FIFO
+  _received.clear();
+
+  return 0;
+}
+
+bool SimulatedMiLightRadio::available() {
+  return !_received.empty();
+}
+
+int SimulatedMiLightRadio::read(uint8_t frame[], size_t &frame_length) {
+  if (_received.empty()) {
+    frame_length = 0;
+    return -1;
+  }
+
+  const std::vector<uint8_t>& packet = _received.front();
+
+  // Callers don't always initialize frame_length, so cap at the largest packet
+  frame_length = std::min(packet.size(), static_cast<size_t>(MILIGHT_MAX_PACKET_LENGTH));
+  memcpy(frame, packet.data(), frame_length);
+
+  _received.pop_front();
+  _stats->reads++;
+
+  return frame_length;
+}
+
+int SimulatedMiLightRadio::write(uint8_t frame[], size_t frame_length) {
+  if (frame_length > sizeof(_out_packet)) {
+    return -1;
+  }
+
+  memcpy(_out_packet, frame, frame_length);
+  _out_packet_length = frame_length;
+
+  return resend();
+}
+
+int SimulatedMiLightRadio::resend() {
+  delayMicroseconds(_airtimeMicros);
+
+  _stats->writes++;
+  _stats->airtimeMicros += _airtimeMicros;
+
+  return 0;
+}
+
+void SimulatedMiLightRadio::inject(const uint8_t frame[], size_t frame_length) {
+  _received.emplace_back(frame, frame + frame_length);
+}
+
+bool SimulatedMiLightRadio::receive(const uint8_t frame[], size_t frame_length) {
+  if (! isTuned()) {
+    return false;
+  }
+
+  inject(frame, frame_length);
+  return true;
+}
+
+bool SimulatedMiLightRadio::isTuned() const {
+  return _stats->tuned == this;
+}
+
+const uint8_t* SimulatedMiLightRadio::lastPacket() const {
+  return _out_packet;
+}
+
+size_t SimulatedMiLightRadio::lastPacketLength() const {
+  return _out_packet_length;
+}
+
+const MiLightRadioConfig& SimulatedMiLightRadio::config() {
+  return _config;
+}
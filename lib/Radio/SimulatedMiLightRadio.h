@@ -0,0 +1,67 @@
+#include <Arduino.h>
+#include <MiLightRadioConfig.h>
+#include <MiLightRadio.h>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#ifndef _SIMULATED_MILIGHT_RADIO_H_
+#define _SIMULATED_MILIGHT_RADIO_H_
+
+/*
+ * A MiLightRadio that isn't backed by any hardware.  Used to run the send and
+ * receive paths on a host (see the native environment).
+ *
+ * Each write blocks for a configurable amount of airtime and is counted.
+ * Packets passed to inject() are returned by read() as if they had been
+ * received.  Packets passed to receive() are only picked up by the radio that
+ * was most recently configured, like a real radio that can only listen for
+ * one syncword at a time.
+ */
+class SimulatedMiLightRadio : public MiLightRadio {
+  public:
+    // Shared by all radios created by the same factory
+    struct Stats {
+      uint32_t writes;
+      uint32_t reads;
+      uint64_t airtimeMicros;
+      uint32_t configures;
+      // The radio that's currently configured
+      const SimulatedMiLightRadio* tuned;
+    };
+
+    SimulatedMiLightRadio(
+      const MiLightRadioConfig& config,
+      uint32_t airtimeMicros,
+      std::shared_ptr<Stats> stats
+    );
+
+    int begin();
+    bool available();
+    int read(uint8_t frame[], size_t &frame_length);
+    int write(uint8_t frame[], size_t frame_length);
+    int resend();
+    int configure();
+    const MiLightRadioConfig& config();
+
+    void inject(const uint8_t frame[], size_t frame_length);
+
+    // Returns true if the packet was picked up
+    bool receive(const uint8_t frame[], size_t frame_length);
+    bool isTuned() const;
+
+    // The most recently written packet
+    const uint8_t* lastPacket() const;
+    size_t lastPacketLength() const;
+
+  private:
+    const MiLightRadioConfig& _config;
+    const uint32_t _airtimeMicros;
+    std::shared_ptr<Stats> _stats;
+
+    uint8_t _out_packet[MILIGHT_MAX_PACKET_LENGTH];
+    size_t _out_packet_length;
+    std::deque<std::vector<uint8_t>> _received;
+};
+
+#endif
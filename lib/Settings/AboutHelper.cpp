@@ -12,6 +12,8 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+#else
+#include <WiFi.h>
 #endif
 
 #include <ProjectFS.h>
@@ -67,6 +67,41 @@ void Settings::updateGatewayConfigs(JsonArray arr) {
   }
 }
 
+void Settings::updateListenRadioPins(JsonArray arr) {
+  listenRadioPins.clear();
+
+  for (size_t i = 0; i < arr.size(); i++) {
+    JsonArray pins = arr[i];
+
+    if (pins.size() == 2) {
+      listenRadioPins.push_back({pins[0], pins[1]});
+    } else {
+      Serial.print(F("Settings - skipped parsing listen radio pins for element #"));
+      Serial.println(i);
+    }
+  }
+}
+
+void Settings::updatePacketRepeatsByType(JsonObject obj) {
+  packetRepeatsByType.clear();
+
+  for (JsonPair kv : obj) {
+    const MiLightRemoteType type = MiLightRemoteTypeHelpers::remoteTypeFromName(kv.key().c_str());
+
+    if (type != REMOTE_TYPE_UNKNOWN && kv.value().is<size_t>()) {
+      packetRepeatsByType[type] = kv.value().as<size_t>();
+    } else {
+      Serial.print(F("Settings - skipped parsing packet repeats for remote type "));
+      Serial.println(kv.key().c_str());
+    }
+  }
+}
+
+size_t Settings::packetRepeatsFor(MiLightRemoteType type) const {
+  const auto it = packetRepeatsByType.find(type);
+  return it == packetRepeatsByType.end() ? packetRepeats : it->second;
+}
+
 void Settings::patch(JsonObject parsedSettings) {
   if (parsedSettings.isNull()) {
     Serial.println(F("Skipping patching loaded settings.  Parsed settings was null."));
@@ -88,13 +123,16 @@ void Settings::patch(JsonObject parsedSettings) {
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_TOPIC_PATTERN), mqttTopicPattern);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_UPDATE_TOPIC_PATTERN), mqttUpdateTopicPattern);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_STATE_TOPIC_PATTERN), mqttStateTopicPattern);
+  this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_STATE_DELTA_TOPIC_PATTERN), mqttStateDeltaTopicPattern);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_CLIENT_STATUS_TOPIC), mqttClientStatusTopic);
+  this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_SCENE_TOPIC), mqttSceneTopic);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::SIMPLE_MQTT_CLIENT_STATUS), simpleMqttClientStatus);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::DISCOVERY_PORT), discoveryPort);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::LISTEN_REPEATS), listenRepeats);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::STATE_FLUSH_INTERVAL), stateFlushInterval);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_STATE_RATE_LIMIT), mqttStateRateLimit);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_DEBOUNCE_DELAY), mqttDebounceDelay);
+  this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_STATE_FULL_INTERVAL), mqttStateFullInterval);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::MQTT_RETAIN), mqttRetain);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::PACKET_REPEAT_THROTTLE_THRESHOLD), packetRepeatThrottleThreshold);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::PACKET_REPEAT_THROTTLE_SENSITIVITY), packetRepeatThrottleSensitivity);
@@ -106,6 +144,9 @@ void Settings::patch(JsonObject parsedSettings) {
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::WIFI_STATIC_IP_GATEWAY), wifiStaticIPGateway);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::WIFI_STATIC_IP_NETMASK), wifiStaticIPNetmask);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::PACKET_REPEATS_PER_LOOP), packetRepeatsPerLoop);
+  this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::PACKET_SEND_BUDGET_US), packetSendBudgetMicros);
+  this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::PACKET_INTERLEAVE_WIDTH), packetInterleaveWidth);
+  this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::PACKET_COALESCING), packetCoalescing);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::HOME_ASSISTANT_DISCOVERY_PREFIX), homeAssistantDiscoveryPrefix);
   this->setIfPresent(parsedSettings, FPSTR(SettingsKeys::DEFAULT_TRANSITION_PERIOD), defaultTransitionPeriod);
 
@@ -154,6 +195,14 @@ void Settings::patch(JsonObject parsedSettings) {
     JsonArray arr = parsedSettings[FPSTR(SettingsKeys::GATEWAY_CONFIGS)];
     updateGatewayConfigs(arr);
   }
+  if (parsedSettings.containsKey(FPSTR(SettingsKeys::LISTEN_RADIO_PINS))) {
+    JsonArray arr = parsedSettings[FPSTR(SettingsKeys::LISTEN_RADIO_PINS)];
+    updateListenRadioPins(arr);
+  }
+  if (parsedSettings.containsKey(FPSTR(SettingsKeys::PACKET_REPEATS_PER_TYPE))) {
+    JsonObject obj = parsedSettings[FPSTR(SettingsKeys::PACKET_REPEATS_PER_TYPE)];
+    updatePacketRepeatsByType(obj);
+  }
   if (parsedSettings.containsKey(FPSTR(SettingsKeys::GROUP_STATE_FIELDS))) {
     JsonArray arr = parsedSettings[FPSTR(SettingsKeys::GROUP_STATE_FIELDS)];
     groupStateFields = JsonHelpers::jsonArrToVector<GroupStateField, const char*>(arr, GroupStateFieldHelpers::getFieldByName);
@@ -328,13 +377,16 @@ void Settings::serialize(Print& stream, const bool prettyPrint) const {
   root[FPSTR(SettingsKeys::MQTT_TOPIC_PATTERN)] = this->mqttTopicPattern;
   root[FPSTR(SettingsKeys::MQTT_UPDATE_TOPIC_PATTERN)] = this->mqttUpdateTopicPattern;
   root[FPSTR(SettingsKeys::MQTT_STATE_TOPIC_PATTERN)] = this->mqttStateTopicPattern;
+  root[FPSTR(SettingsKeys::MQTT_STATE_DELTA_TOPIC_PATTERN)] = this->mqttStateDeltaTopicPattern;
   root[FPSTR(SettingsKeys::MQTT_CLIENT_STATUS_TOPIC)] = this->mqttClientStatusTopic;
+  root[FPSTR(SettingsKeys::MQTT_SCENE_TOPIC)] = this->mqttSceneTopic;
   root[FPSTR(SettingsKeys::SIMPLE_MQTT_CLIENT_STATUS)] = this->simpleMqttClientStatus;
   root[FPSTR(SettingsKeys::DISCOVERY_PORT)] = this->discoveryPort;
   root[FPSTR(SettingsKeys::LISTEN_REPEATS)] = this->listenRepeats;
   root[FPSTR(SettingsKeys::STATE_FLUSH_INTERVAL)] = this->stateFlushInterval;
   root[FPSTR(SettingsKeys::MQTT_STATE_RATE_LIMIT)] = this->mqttStateRateLimit;
   root[FPSTR(SettingsKeys::MQTT_DEBOUNCE_DELAY)] = this->mqttDebounceDelay;
+  root[FPSTR(SettingsKeys::MQTT_STATE_FULL_INTERVAL)] = this->mqttStateFullInterval;
   root[FPSTR(SettingsKeys::MQTT_RETAIN)] = this->mqttRetain;
   root[FPSTR(SettingsKeys::PACKET_REPEAT_THROTTLE_SENSITIVITY)] = this->packetRepeatThrottleSensitivity;
   root[FPSTR(SettingsKeys::PACKET_REPEAT_THROTTLE_THRESHOLD)] = this->packetRepeatThrottleThreshold;
@@ -352,6 +404,9 @@ void Settings::serialize(Print& stream, const bool prettyPrint) const {
   root[FPSTR(SettingsKeys::WIFI_STATIC_IP_GATEWAY)] = this->wifiStaticIPGateway;
   root[FPSTR(SettingsKeys::WIFI_STATIC_IP_NETMASK)] = this->wifiStaticIPNetmask;
   root[FPSTR(SettingsKeys::PACKET_REPEATS_PER_LOOP)] = this->packetRepeatsPerLoop;
+  root[FPSTR(SettingsKeys::PACKET_SEND_BUDGET_US)] = this->packetSendBudgetMicros;
+  root[FPSTR(SettingsKeys::PACKET_INTERLEAVE_WIDTH)] = this->packetInterleaveWidth;
+  root[FPSTR(SettingsKeys::PACKET_COALESCING)] = this->packetCoalescing;
   root[FPSTR(SettingsKeys::HOME_ASSISTANT_DISCOVERY_PREFIX)] = this->homeAssistantDiscoveryPrefix;
   root[FPSTR(SettingsKeys::WIFI_MODE)] = wifiModeToString(this->wifiMode);
   root[FPSTR(SettingsKeys::DEFAULT_TRANSITION_PERIOD)] = this->defaultTransitionPeriod;
@@ -370,6 +425,18 @@ void Settings::serialize(Print& stream, const bool prettyPrint) const {
     elmt.add(this->gatewayConfigs[i]->protocolVersion);
   }
 
+  JsonArray listenRadioPinsArr = root.createNestedArray(FPSTR(SettingsKeys::LISTEN_RADIO_PINS));
+  for (const RadioPins& pins : this->listenRadioPins) {
+    JsonArray elmt = listenRadioPinsArr.createNestedArray();
+    elmt.add(pins.cePin);
+    elmt.add(pins.csnPin);
+  }
+
+  JsonObject packetRepeatsByTypeObj = root.createNestedObject(FPSTR(SettingsKeys::PACKET_REPEATS_PER_TYPE));
+  for (const auto& kv : this->packetRepeatsByType) {
+    packetRepeatsByTypeObj[MiLightRemoteTypeHelpers::remoteTypeToName(kv.first)] = kv.second;
+  }
+
   JsonArray groupStateFieldArr = root.createNestedArray(FPSTR(SettingsKeys::GROUP_STATE_FIELDS));
   JsonHelpers::vectorToJsonArr<GroupStateField, const char*>(groupStateFieldArr, groupStateFields, GroupStateFieldHelpers::getFieldName);
 
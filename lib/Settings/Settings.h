@@ -39,7 +39,7 @@
 
 #ifdef ESP8266
   #define CSN_DEFAULT_PIN 15
-#elif ESP32
+#else
   #define CSN_DEFAULT_PIN 5
 #endif
 
@@ -47,8 +47,11 @@
 #define MILIGHT_MAX_STATE_ITEMS 100
 #endif
 
+// Number of groups that can be waiting for an MQTT state publish.  If more
+// than this change at once, the oldest is published early, ignoring the rate
+// limit.
 #ifndef MILIGHT_MAX_STALE_MQTT_GROUPS
-#define MILIGHT_MAX_STALE_MQTT_GROUPS 10
+#define MILIGHT_MAX_STALE_MQTT_GROUPS 64
 #endif
 
 #define SETTINGS_FILE  "/config.json"
@@ -92,6 +95,12 @@ struct GatewayConfig {
   const uint8_t protocolVersion;
 };
 
+// Pins for an additional nRF24 module
+struct RadioPins {
+  uint8_t cePin;
+  uint8_t csnPin;
+};
+
 // all keys that appear in JSON
 namespace SettingsKeys {
   static const char ADMIN_USERNAME[] PROGMEM = "admin_username";
@@ -109,7 +118,10 @@ namespace SettingsKeys {
   static const char MQTT_TOPIC_PATTERN[] PROGMEM = "mqtt_topic_pattern";
   static const char MQTT_UPDATE_TOPIC_PATTERN[] PROGMEM = "mqtt_update_topic_pattern";
   static const char MQTT_STATE_TOPIC_PATTERN[] PROGMEM = "mqtt_state_topic_pattern";
+  static const char MQTT_STATE_DELTA_TOPIC_PATTERN[] PROGMEM = "mqtt_state_delta_topic_pattern";
+  static const char MQTT_STATE_FULL_INTERVAL[] PROGMEM = "mqtt_state_full_interval";
   static const char MQTT_CLIENT_STATUS_TOPIC[] PROGMEM = "mqtt_client_status_topic";
+  static const char MQTT_SCENE_TOPIC[] PROGMEM = "mqtt_scene_topic";
   static const char SIMPLE_MQTT_CLIENT_STATUS[] PROGMEM = "simple_mqtt_client_status";
   static const char DISCOVERY_PORT[] PROGMEM = "discovery_port";
   static const char LISTEN_REPEATS[] PROGMEM = "listen_repeats";
@@ -120,6 +132,7 @@ namespace SettingsKeys {
   static const char PACKET_REPEAT_THROTTLE_THRESHOLD[] PROGMEM = "packet_repeat_throttle_threshold";
   static const char PACKET_REPEAT_THROTTLE_SENSITIVITY[] PROGMEM = "packet_repeat_throttle_sensitivity";
   static const char PACKET_REPEAT_MINIMUM[] PROGMEM = "packet_repeat_minimum";
+  static const char PACKET_REPEATS_PER_TYPE[] PROGMEM = "packet_repeats_per_type";
   static const char ENABLE_AUTOMATIC_MODE_SWITCHING[] PROGMEM = "enable_automatic_mode_switching";
   static const char LED_MODE_PACKET_COUNT[] PROGMEM = "led_mode_packet_count";
   static const char HOSTNAME[] PROGMEM = "hostname";
@@ -127,6 +140,9 @@ namespace SettingsKeys {
   static const char WIFI_STATIC_IP_GATEWAY[] PROGMEM = "wifi_static_ip_gateway";
   static const char WIFI_STATIC_IP_NETMASK[] PROGMEM = "wifi_static_ip_netmask";
   static const char PACKET_REPEATS_PER_LOOP[] PROGMEM = "packet_repeats_per_loop";
+  static const char PACKET_SEND_BUDGET_US[] PROGMEM = "packet_send_budget_us";
+  static const char PACKET_INTERLEAVE_WIDTH[] PROGMEM = "packet_interleave_width";
+  static const char PACKET_COALESCING[] PROGMEM = "packet_coalescing";
   static const char HOME_ASSISTANT_DISCOVERY_PREFIX[] PROGMEM = "home_assistant_discovery_prefix";
   static const char DEFAULT_TRANSITION_PERIOD[] PROGMEM = "default_transition_period";
   static const char WIFI_MODE[] PROGMEM = "wifi_mode";
@@ -140,6 +156,7 @@ namespace SettingsKeys {
   static const char RADIO_INTERFACE_TYPE[] PROGMEM = "radio_interface_type";
   static const char DEVICE_IDS[] PROGMEM = "device_ids";
   static const char GATEWAY_CONFIGS[] PROGMEM = "gateway_configs";
+  static const char LISTEN_RADIO_PINS[] PROGMEM = "listen_radio_pins";
   static const char GROUP_STATE_FIELDS[] PROGMEM = "group_state_fields";
   static const char GROUP_ID_ALIASES[] PROGMEM = "group_id_aliases";
 }
@@ -167,6 +184,7 @@ public:
     stateFlushInterval(10000),
     mqttStateRateLimit(500),
     mqttDebounceDelay(500),
+    mqttStateFullInterval(10000),
     mqttRetain(true),
     packetRepeatThrottleThreshold(200),
     packetRepeatThrottleSensitivity(0),
@@ -183,6 +201,9 @@ public:
     groupStateFields(DEFAULT_GROUP_STATE_FIELDS),
     rf24ListenChannel(RF24Channel::RF24_LOW),
     packetRepeatsPerLoop(10),
+    packetSendBudgetMicros(3000),
+    packetInterleaveWidth(1),
+    packetCoalescing(true),
     homeAssistantDiscoveryPrefix("homeassistant/"),
     wifiMode(WifiMode::G),
     defaultTransitionPeriod(500),
@@ -210,9 +231,14 @@ public:
   void serialize(Print& stream, const bool prettyPrint = false) const;
   void updateDeviceIds(JsonArray arr);
   void updateGatewayConfigs(JsonArray arr);
+  void updateListenRadioPins(JsonArray arr);
+  void updatePacketRepeatsByType(JsonObject obj);
   void patch(JsonObject obj);
   String mqttServer();
   uint16_t mqttPort();
+  // Repeat budget for packets to this remote type.  packetRepeats unless
+  // overridden in packetRepeatsByType.
+  size_t packetRepeatsFor(MiLightRemoteType type) const;
   std::map<String, GroupAlias>::const_iterator findAlias(MiLightRemoteType deviceType, uint16_t deviceId, uint8_t groupId);
   std::map<String, GroupAlias>::const_iterator findAliasById(size_t id);
   void addAlias(const char* alias, const BulbId& bulbId);
@@ -235,15 +261,21 @@ public:
   String mqttTopicPattern;
   String mqttUpdateTopicPattern;
   String mqttStateTopicPattern;
+  String mqttStateDeltaTopicPattern;
   String mqttClientStatusTopic;
+  String mqttSceneTopic;
   bool simpleMqttClientStatus;
   size_t stateFlushInterval;
   size_t mqttStateRateLimit;
   size_t mqttDebounceDelay;
+  size_t mqttStateFullInterval;
   bool mqttRetain;
   size_t packetRepeatThrottleThreshold;
   size_t packetRepeatThrottleSensitivity;
   size_t packetRepeatMinimum;
+  // Per-remote-type overrides of packetRepeats.  Newer bulbs need far fewer
+  // repeats than old ones.  Can be measured with repeat calibration.
+  std::map<MiLightRemoteType, size_t> packetRepeatsByType;
   bool enableAutomaticModeSwitching;
   LEDStatus::LEDMode ledModeWifiConfig;
   LEDStatus::LEDMode ledModeWifiFailed;
@@ -256,11 +288,20 @@ public:
   std::vector<RF24Channel> rf24Channels;
   std::vector<GroupStateField> groupStateFields;
   std::vector<std::shared_ptr<GatewayConfig>> gatewayConfigs;
+  // Radios dedicated to listening.  When empty, the radio at cePin/csnPin
+  // is shared between sending and listening.
+  std::vector<RadioPins> listenRadioPins;
   RF24Channel rf24ListenChannel;
   String wifiStaticIP;
   String wifiStaticIPNetmask;
   String wifiStaticIPGateway;
   size_t packetRepeatsPerLoop;
+  // Time packet sending may take per main loop pass.  0 for no limit.
+  size_t packetSendBudgetMicros;
+  // Number of packets for different bulbs on the same radio config whose
+  // repeats are interleaved.  1 sends packets one after the other.
+  size_t packetInterleaveWidth;
+  bool packetCoalescing;
   std::map<String, GroupAlias> groupIdAliases;
   std::map<uint32_t, BulbId> deletedGroupIdAliases;
   String homeAssistantDiscoveryPrefix;
@@ -298,7 +339,7 @@ protected:
       } else {
         var = val.as<T>();
       }
-#elif ESP32
+#else
         if (std::is_same<bool, T>::value) {
             if (val.is<bool>()) {
                 var = val.as<bool>();
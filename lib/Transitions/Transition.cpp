@@ -156,6 +156,10 @@ void Transition::tick() {
   }
 }
 
+unsigned long Transition::nextDue() const {
+  return lastSent + period;
+}
+
 size_t Transition::calculatePeriod(int16_t distance, size_t stepSize, size_t duration) {
   float fPeriod =
     distance != 0
@@ -12,6 +12,12 @@ class Transition {
 public:
   using TransitionFn = std::function<void(const BulbId& bulbId, GroupStateField field, uint16_t value)>;
 
+  // A single field value emitted by a step
+  struct Step {
+    GroupStateField field;
+    uint16_t value;
+  };
+
   // transition commands are in seconds, convert to ms.
   static const uint16_t DURATION_UNIT_MULTIPLIER;
 
@@ -83,6 +89,8 @@ public:
   );
 
   void tick();
+  // Time at which tick() will next step
+  unsigned long nextDue() const;
   virtual bool isFinished() = 0;
   void serialize(JsonObject& doc);
   virtual void step() = 0;
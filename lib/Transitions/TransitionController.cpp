@@ -7,6 +7,7 @@
 
 #include <TransitionController.h>
 #include <LinkedList.h>
+#include <algorithm>
 #include <functional>
 
 using namespace std::placeholders;
@@ -15,6 +16,9 @@ TransitionController::TransitionController()
   : callback(std::bind(&TransitionController::transitionCallback, this, _1, _2, _3))
   , currentId(0)
   , defaultPeriod(500)
+  , batching(false)
+  , stepStats({0, 0, 0})
+  , stepLatenessHandler(nullptr)
 { }
 
 void TransitionController::setDefaultPeriod(uint16_t defaultPeriod) {
@@ -23,12 +27,17 @@ void TransitionController::setDefaultPeriod(uint16_t defaultPeriod) {
 
 void TransitionController::clearListeners() {
   observers.clear();
+  batchObservers.clear();
 }
 
 void TransitionController::addListener(Transition::TransitionFn fn) {
   observers.push_back(fn);
 }
 
+void TransitionController::addBatchListener(BatchFn fn) {
+  batchObservers.push_back(fn);
+}
+
 std::shared_ptr<Transition::Builder> TransitionController::buildColorTransition(const BulbId& bulbId, const ParsedColor& start, const ParsedColor& end) {
   return std::make_shared<ColorTransition::Builder>(
     currentId++,
@@ -74,35 +83,148 @@ std::shared_ptr<Transition::Builder> TransitionController::buildStatusTransition
 
 void TransitionController::addTransition(std::shared_ptr<Transition> transition) {
   activeTransitions.add(transition);
+
+  // New transitions take their first step straight away
+  scheduleTransition(millis(), activeTransitions.getTail());
 }
 
 void TransitionController::transitionCallback(const BulbId& bulbId, GroupStateField field, uint16_t arg) {
   for (auto it = observers.begin(); it != observers.end(); ++it) {
     (*it)(bulbId, field, arg);
   }
+
+  if (batchObservers.empty()) {
+    return;
+  }
+
+  const Transition::Step step = {field, arg};
+
+  if (batching) {
+    pendingSteps.push_back({bulbId, step, pendingSteps.size()});
+  } else {
+    // Outside of loop(), e.g. turning a bulb on at the start of a status transition
+    for (auto it = batchObservers.begin(); it != batchObservers.end(); ++it) {
+      (*it)(bulbId, &step, 1);
+    }
+  }
+}
+
+void TransitionController::flushSteps() {
+  if (pendingSteps.empty()) {
+    return;
+  }
+
+  std::sort(pendingSteps.begin(), pendingSteps.end(), isBefore);
+
+  for (size_t start = 0; start < pendingSteps.size(); ) {
+    const BulbId& bulbId = pendingSteps[start].bulbId;
+    size_t end = start;
+
+    batch.clear();
+    while (end < pendingSteps.size() && pendingSteps[end].bulbId == bulbId) {
+      batch.push_back(pendingSteps[end++].step);
+    }
+
+    for (auto it = batchObservers.begin(); it != batchObservers.end(); ++it) {
+      (*it)(bulbId, batch.data(), batch.size());
+    }
+
+    start = end;
+  }
+
+  pendingSteps.clear();
 }
 
 void TransitionController::clear() {
   activeTransitions.clear();
+  schedule.clear();
 }
 
 void TransitionController::loop() {
-  auto current = activeTransitions.getHead();
+  const unsigned long now = millis();
 
-  while (current != nullptr) {
-    auto next = current->next;
+  // Pop everything that's due before stepping any of it, so that a
+  // transition with a zero period is only stepped once per loop
+  while (!schedule.empty() && static_cast<long>(now - schedule.front().due) >= 0) {
+    std::pop_heap(schedule.begin(), schedule.end(), isDueLater);
+    dueTransitions.push_back(schedule.back());
+    schedule.pop_back();
+  }
+
+  batching = true;
+
+  for (const ScheduledTransition& scheduled : dueTransitions) {
+    Transition& t = *scheduled.node->data;
+    const uint32_t lateness = now - scheduled.due;
+
+    ++stepStats.steps;
+    stepStats.totalLatenessMs += lateness;
+    stepStats.maxLatenessMs = std::max(stepStats.maxLatenessMs, lateness);
+
+    if (stepLatenessHandler != nullptr) {
+      stepLatenessHandler(t, lateness);
+    }
 
-    Transition& t = *current->data;
     t.tick();
 
     if (t.isFinished()) {
-      activeTransitions.remove(current);
+      activeTransitions.remove(scheduled.node);
+    } else {
+      scheduleTransition(t.nextDue(), scheduled.node);
     }
+  }
 
-    current = next;
+  batching = false;
+  dueTransitions.clear();
+
+  flushSteps();
+}
+
+void TransitionController::scheduleTransition(unsigned long due, ListNode<std::shared_ptr<Transition>>* node) {
+  schedule.push_back({due, node});
+  std::push_heap(schedule.begin(), schedule.end(), isDueLater);
+}
+
+void TransitionController::unschedule(ListNode<std::shared_ptr<Transition>>* node) {
+  for (auto it = schedule.begin(); it != schedule.end(); ++it) {
+    if (it->node == node) {
+      *it = schedule.back();
+      schedule.pop_back();
+      std::make_heap(schedule.begin(), schedule.end(), isDueLater);
+      return;
+    }
   }
 }
 
+// Heap comparator.  Compares the difference so that millis() rollover is handled.
+bool TransitionController::isDueLater(const ScheduledTransition& a, const ScheduledTransition& b) {
+  return static_cast<long>(a.due - b.due) > 0;
+}
+
+// Groups steps by bulb, keeping the order they were taken in within a bulb
+bool TransitionController::isBefore(const PendingStep& a, const PendingStep& b) {
+  if (a.bulbId.deviceId != b.bulbId.deviceId) {
+    return a.bulbId.deviceId < b.bulbId.deviceId;
+  } else if (a.bulbId.groupId != b.bulbId.groupId) {
+    return a.bulbId.groupId < b.bulbId.groupId;
+  } else if (a.bulbId.deviceType != b.bulbId.deviceType) {
+    return a.bulbId.deviceType < b.bulbId.deviceType;
+  }
+  return a.seq < b.seq;
+}
+
+size_t TransitionController::numActiveTransitions() const {
+  return activeTransitions.size();
+}
+
+const TransitionController::StepStats& TransitionController::getStepStats() const {
+  return stepStats;
+}
+
+void TransitionController::onStepLateness(StepLatenessHandler handler) {
+  this->stepLatenessHandler = handler;
+}
+
 ListNode<std::shared_ptr<Transition>>* TransitionController::getTransitions() {
   return activeTransitions.getHead();
 }
@@ -136,6 +258,7 @@ bool TransitionController::deleteTransition(size_t id) {
   if (node == nullptr) {
     return false;
   } else {
+    unschedule(node);
     activeTransitions.remove(node);
     return true;
   }
@@ -7,12 +7,33 @@
 
 #pragma once
 
+/**
+ * Runs active transitions.  Transitions are kept in a min-heap keyed on when
+ * their next step is due, so loop() only touches the ones that are due.
+ *
+ * Steps taken in the same loop() are also passed to batch listeners grouped
+ * by bulb, so that e.g. a color and a brightness fade on one bulb turn into a
+ * single update rather than one per field.
+ */
 class TransitionController {
 public:
+  // Called once per bulb per loop() with all of the steps taken for it
+  typedef std::function<void(const BulbId& bulbId, const Transition::Step* steps, size_t numSteps)> BatchFn;
+
+  // Called with how late a step fired relative to when it was due
+  typedef std::function<void(const Transition& transition, uint32_t latenessMs)> StepLatenessHandler;
+
+  struct StepStats {
+    uint32_t steps;
+    uint32_t totalLatenessMs;
+    uint32_t maxLatenessMs;
+  };
+
   TransitionController();
 
   void clearListeners();
   void addListener(Transition::TransitionFn fn);
+  void addBatchListener(BatchFn fn);
   void setDefaultPeriod(uint16_t period);
 
   std::shared_ptr<Transition::Builder> buildColorTransition(const BulbId& bulbId, const ParsedColor& start, const ParsedColor& end);
@@ -28,12 +49,46 @@ public:
   ListNode<std::shared_ptr<Transition>>* findTransition(size_t id);
   bool deleteTransition(size_t id);
 
+  size_t numActiveTransitions() const;
+  const StepStats& getStepStats() const;
+  void onStepLateness(StepLatenessHandler handler);
+
 private:
+  struct ScheduledTransition {
+    unsigned long due;
+    ListNode<std::shared_ptr<Transition>>* node;
+  };
+
+  struct PendingStep {
+    BulbId bulbId;
+    Transition::Step step;
+    // Order the step was taken in, so sorting by bulb keeps steps in order
+    size_t seq;
+  };
+
   Transition::TransitionFn callback;
   LinkedList<std::shared_ptr<Transition>> activeTransitions;
   std::vector<Transition::TransitionFn> observers;
+  std::vector<BatchFn> batchObservers;
   size_t currentId;
   uint16_t defaultPeriod;
 
+  // Min-heap on due time.  Nodes are owned by activeTransitions.
+  std::vector<ScheduledTransition> schedule;
+  // Scratch space for loop(), kept to avoid reallocating
+  std::vector<ScheduledTransition> dueTransitions;
+  // Steps taken during loop(), flushed to batch listeners at the end of it
+  std::vector<PendingStep> pendingSteps;
+  std::vector<Transition::Step> batch;
+  bool batching;
+
+  StepStats stepStats;
+  StepLatenessHandler stepLatenessHandler;
+
   void transitionCallback(const BulbId& bulbId, GroupStateField field, uint16_t arg);
+  void flushSteps();
+  void scheduleTransition(unsigned long due, ListNode<std::shared_ptr<Transition>>* node);
+  void unschedule(ListNode<std::shared_ptr<Transition>>* node);
+  static bool isDueLater(const ScheduledTransition& a, const ScheduledTransition& b);
+  static bool isBefore(const PendingStep& a, const PendingStep& b);
 };
\ No newline at end of file
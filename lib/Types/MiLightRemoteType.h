@@ -16,7 +16,9 @@ enum MiLightRemoteType {
 class MiLightRemoteTypeHelpers {
 public:
   static const MiLightRemoteType remoteTypeFromString(const String& type);
+  static const MiLightRemoteType remoteTypeFromName(const char* type);
   static const String remoteTypeToString(const MiLightRemoteType type);
+  static const char* remoteTypeToName(const MiLightRemoteType type);
   static const bool supportsRgb(const MiLightRemoteType type);
   static const bool supportsRgbw(const MiLightRemoteType type);
   static const bool supportsColorTemp(const MiLightRemoteType type);
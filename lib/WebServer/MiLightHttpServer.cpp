@@ -94,10 +94,29 @@ void MiLightHttpServer::begin() {
     .on(HTTP_GET, std::bind(&MiLightHttpServer::handleListTransitions, this, _1))
     .on(HTTP_POST, std::bind(&MiLightHttpServer::handleCreateTransition, this, _1));
 
+  server
+    .buildHandler("/scenes")
+    .on(HTTP_GET, std::bind(&MiLightHttpServer::handleListScenes, this, _1))
+    .on(HTTP_POST, std::bind(&MiLightHttpServer::handleCreateScene, this, _1));
+
+  server
+    .buildHandler("/scenes/:name/activate")
+    .on(HTTP_POST, std::bind(&MiLightHttpServer::handleActivateScene, this, _1));
+
+  server
+    .buildHandler("/scenes/:name")
+    .on(HTTP_GET, std::bind(&MiLightHttpServer::handleGetScene, this, _1))
+    .on(HTTP_DELETE, std::bind(&MiLightHttpServer::handleDeleteScene, this, _1));
+
   server
     .buildHandler("/raw_commands/:type")
     .on(HTTP_ANY, std::bind(&MiLightHttpServer::handleSendRaw, this, _1));
 
+  server
+    .buildHandler("/repeat_calibration")
+    .on(HTTP_GET, std::bind(&MiLightHttpServer::handleGetRepeatCalibration, this, _1))
+    .on(HTTP_POST, std::bind(&MiLightHttpServer::handleStartRepeatCalibration, this, _1));
+
   server
     .buildHandler("/about")
     .on(HTTP_GET, std::bind(&MiLightHttpServer::handleAbout, this, _1));
@@ -147,6 +166,33 @@ void MiLightHttpServer::onAbout(AboutHandler handler) {
   this->aboutHandler = handler;
 }
 
+void MiLightHttpServer::waitForPackets(PacketSender::Ticket ticket) {
+  // Nothing else runs meanwhile: MQTT, UDP and transitions would otherwise
+  // send commands with this request still on the stack.
+  while (! packetSender->isSent(ticket)) {
+    packetSender->loop();
+    yield();
+  }
+}
+
+void MiLightHttpServer::waitForPackets(const PacketSender::TicketRange& tickets) {
+  while (! packetSender->isSent(tickets)) {
+    packetSender->loop();
+    yield();
+  }
+}
+
+void MiLightHttpServer::recordRequestPackets(PacketSender::TicketRange* tickets) {
+  packetSender->recordTickets(tickets);
+
+  // The client is waiting on these, so they go ahead of other queued packets
+  if (tickets != nullptr && server.arg("blockOnQueue").equalsIgnoreCase("true")) {
+    milightClient->setPriorityOverride(PacketPriority::INTERACTIVE);
+  } else {
+    milightClient->clearPriorityOverride();
+  }
+}
+
 void MiLightHttpServer::handleClient() {
   server.handleClient();
   wsServer.loop();
@@ -227,6 +273,40 @@ void MiLightHttpServer::handleAbout(RequestContext& request) {
   JsonObject queueStats = request.response.json.createNestedObject("queue_stats");
   queueStats[F("length")] = packetSender->queueLength();
   queueStats[F("dropped_packets")] = packetSender->droppedPackets();
+  queueStats[F("coalesced_packets")] = packetSender->coalescedPackets();
+
+  static const char* LANE_NAMES[NUM_PACKET_PRIORITIES] = {"interactive", "normal", "background"};
+  JsonObject lanes = queueStats.createNestedObject(F("lanes"));
+
+  for (size_t i = 0; i < NUM_PACKET_PRIORITIES; ++i) {
+    const PacketPriority priority = static_cast<PacketPriority>(i);
+    const PacketSender::LaneStats& stats = packetSender->laneStats(priority);
+    JsonObject lane = lanes.createNestedObject(LANE_NAMES[i]);
+
+    lane[F("length")] = packetSender->queueLength(priority);
+    lane[F("sent_packets")] = stats.sentPackets;
+    lane[F("avg_latency_ms")] = stats.sentPackets == 0 ? 0 : stats.totalLatencyMs / stats.sentPackets;
+    lane[F("max_latency_ms")] = stats.maxLatencyMs;
+  }
+
+  const uint32_t* firstSend = packetSender->firstSendHistogram();
+  JsonArray firstSendBuckets = queueStats.createNestedArray(F("first_send_ms"));
+
+  for (size_t i = 0; i < PacketSender::NUM_FIRST_SEND_BUCKETS; ++i) {
+    JsonObject bucket = firstSendBuckets.createNestedObject();
+
+    if (i < PacketSender::NUM_FIRST_SEND_BUCKETS - 1) {
+      bucket[F("max_ms")] = PacketSender::FIRST_SEND_BUCKET_MS[i];
+    }
+    bucket[F("packets")] = firstSend[i];
+  }
+
+  const TransitionController::StepStats& stepStats = transitions.getStepStats();
+  JsonObject transitionStats = request.response.json.createNestedObject(F("transition_stats"));
+  transitionStats[F("active")] = transitions.numActiveTransitions();
+  transitionStats[F("steps")] = stepStats.steps;
+  transitionStats[F("avg_lateness_ms")] = stepStats.steps == 0 ? 0 : stepStats.totalLatenessMs / stepStats.steps;
+  transitionStats[F("max_lateness_ms")] = stepStats.maxLatenessMs;
 }
 
 void MiLightHttpServer::handleGetRadioConfigs(RequestContext& request) {
@@ -417,14 +497,21 @@ void MiLightHttpServer::handleListenGateway(RequestContext& request) {
   request.response.json["packet_info"] = responseBody;
 }
 
-void MiLightHttpServer::sendGroupState(bool allowAsync, BulbId& bulbId, RichHttp::Response& response) {
+void MiLightHttpServer::sendGroupState(
+  bool allowAsync,
+  BulbId& bulbId,
+  RichHttp::Response& response,
+  const PacketSender::TicketRange* tickets
+) {
   bool blockOnQueue = server.arg("blockOnQueue").equalsIgnoreCase("true");
   bool normalizedFormat = server.arg("fmt").equalsIgnoreCase("normalized");
 
-  // Wait for packet queue to flush out.  State will not have been updated before that.
-  // Bit hacky to call loop outside of main loop, but should be fine.
-  while (blockOnQueue && packetSender->isSending()) {
-    packetSender->loop();
+  // Wait for the request's packets to go out, or with none, everything queued
+  // so far.  State will not have been updated before that.
+  if (blockOnQueue && tickets != nullptr) {
+    waitForPackets(*tickets);
+  } else if (blockOnQueue) {
+    waitForPackets(packetSender->lastTicket());
   }
 
   JsonObject obj = response.json.to<JsonObject>();
@@ -540,13 +627,18 @@ void MiLightHttpServer::handleUpdateGroupAlias(RequestContext& request) {
     return;
   }
 
+  PacketSender::TicketRange tickets;
   milightClient->prepare(config, bulbId.deviceId, bulbId.groupId);
+  recordRequestPackets(&tickets);
   handleRequest(request.getJsonBody().as<JsonObject>());
-  sendGroupState(false, bulbId, request.response);
+  recordRequestPackets(nullptr);
+  sendGroupState(false, bulbId, request.response, &tickets);
 }
 
 void MiLightHttpServer::handleUpdateGroup(RequestContext& request) {
   JsonObject reqObj = request.getJsonBody().as<JsonObject>();
+  // Parsed once and sent to each matching group
+  const LightCommand command = LightCommand::fromJson(reqObj);
 
   String _deviceIds = request.pathVariables.get(GroupStateFieldNames::DEVICE_ID);
   String _groupIds = request.pathVariables.get(GroupStateFieldNames::GROUP_ID);
@@ -564,6 +656,7 @@ void MiLightHttpServer::handleUpdateGroup(RequestContext& request) {
 
   BulbId foundBulbId;
   size_t groupCount = 0;
+  PacketSender::TicketRange tickets;
 
   while (remoteTypesItr.hasNext()) {
     const char* _remoteType = remoteTypesItr.nextToken();
@@ -586,7 +679,9 @@ void MiLightHttpServer::handleUpdateGroup(RequestContext& request) {
         const uint8_t groupId = atoi(groupIdItr.nextToken());
 
         milightClient->prepare(config, deviceId, groupId);
-        handleRequest(reqObj);
+        recordRequestPackets(&tickets);
+        handleRequest(command, reqObj);
+        recordRequestPackets(nullptr);
         foundBulbId = BulbId(deviceId, groupId, config->type);
         groupCount++;
       }
@@ -594,17 +689,21 @@ void MiLightHttpServer::handleUpdateGroup(RequestContext& request) {
   }
 
   if (groupCount == 1) {
-    sendGroupState(false, foundBulbId, request.response);
+    sendGroupState(false, foundBulbId, request.response, &tickets);
   } else {
     request.response.json["success"] = true;
   }
 }
 
 void MiLightHttpServer::handleRequest(const JsonObject& request) {
+  handleRequest(LightCommand::fromJson(request), request);
+}
+
+void MiLightHttpServer::handleRequest(const LightCommand& command, const JsonObject& request) {
   milightClient->setRepeatsOverride(
-    settings.httpRepeatFactor * settings.packetRepeats
+    settings.httpRepeatFactor * settings.packetRepeatsFor(milightClient->currentRemoteConfig().type)
   );
-  milightClient->update(request);
+  milightClient->update(command, request);
   milightClient->clearRepeatsOverride();
 }
 
@@ -624,19 +723,98 @@ void MiLightHttpServer::handleSendRaw(RequestContext& request) {
   const String& hexPacket = requestBody["packet"];
   hexStrToBytes<uint8_t>(hexPacket.c_str(), hexPacket.length(), packet, MILIGHT_MAX_PACKET_LENGTH);
 
-  size_t numRepeats = settings.packetRepeats;
+  size_t numRepeats = settings.packetRepeatsFor(config->type);
   if (requestBody.containsKey("num_repeats")) {
     numRepeats = requestBody["num_repeats"];
   }
 
-  packetSender->enqueue(packet, config, numRepeats);
+  // To make this response synchronous, wait for packet to be sent
+  PacketSender::TicketRange tickets;
+  tickets.add(packetSender->enqueue(packet, config, numRepeats));
+  waitForPackets(tickets);
 
-  // To make this response synchronous, wait for packet to be flushed
-  while (packetSender->isSending()) {
-    packetSender->loop();
+  request.response.json["success"] = true;
+}
+
+void MiLightHttpServer::handleGetRepeatCalibration(RequestContext& request) {
+  static const char* STATE_NAMES[] = {"idle", "running", "done"};
+  const RepeatCalibrator::Options& options = repeatCalibrator->getOptions();
+
+  request.response.json[F("available")] = repeatCalibrator->canCalibrate();
+  request.response.json[F("state")] = STATE_NAMES[static_cast<size_t>(repeatCalibrator->getState())];
+  request.response.json[F("target_ratio")] = options.targetRatio;
+  request.response.json[F("probes")] = options.probesPerType;
+  request.response.json[F("apply")] = options.apply;
+
+  JsonArray results = request.response.json.createNestedArray(F("results"));
+  for (const RepeatCalibrator::Result& result : repeatCalibrator->getResults()) {
+    JsonObject resultObj = results.createNestedObject();
+
+    resultObj[F("remote_type")] = MiLightRemoteTypeHelpers::remoteTypeToName(result.remoteType);
+    resultObj[F("sent")] = result.sent;
+    resultObj[F("heard")] = result.heard;
+    resultObj[F("hear_ratio")] = result.hearRatio();
+    resultObj[F("previous_repeats")] = result.previousRepeats;
+    resultObj[F("recommended_repeats")] = result.recommendedRepeats;
+    resultObj[F("avg_write_us")] = result.averageWriteMicros();
+    resultObj[F("airtime_saved_us")] = result.airtimeSavedMicros();
   }
+}
 
-  request.response.json["success"] = true;
+void MiLightHttpServer::handleStartRepeatCalibration(RequestContext& request) {
+  JsonObject body = request.getJsonBody().as<JsonObject>();
+
+  if (! repeatCalibrator->canCalibrate()) {
+    request.response.setCode(400);
+    request.response.json[F("error")] = F("Repeat calibration needs a dedicated listen radio (listen_radio_pins)");
+    return;
+  }
+
+  if (repeatCalibrator->isRunning()) {
+    request.response.setCode(409);
+    request.response.json[F("error")] = F("Repeat calibration is already running");
+    return;
+  }
+
+  RepeatCalibrator::Options options;
+
+  if (body.containsKey(F("target_ratio"))) {
+    options.targetRatio = body[F("target_ratio")];
+  }
+  if (body.containsKey(F("probes"))) {
+    options.probesPerType = body[F("probes")];
+  }
+  if (body.containsKey(F("apply"))) {
+    options.apply = body[F("apply")];
+  }
+
+  if (options.targetRatio <= 0 || options.targetRatio >= 1 || options.probesPerType == 0) {
+    request.response.setCode(400);
+    request.response.json[F("error")] = F("target_ratio must be between 0 and 1, and probes must be positive");
+    return;
+  }
+
+  if (body.containsKey(F("remote_types"))) {
+    JsonArray remoteTypes = body[F("remote_types")];
+
+    for (JsonVariant remoteType : remoteTypes) {
+      const char* name = remoteType | "";
+      const MiLightRemoteType type = MiLightRemoteTypeHelpers::remoteTypeFromName(name);
+
+      if (type == REMOTE_TYPE_UNKNOWN) {
+        char buffer[50];
+        snprintf_P(buffer, sizeof(buffer), PSTR("Unknown device type: %s"), name);
+        request.response.setCode(400);
+        request.response.json[F("error")] = buffer;
+        return;
+      }
+
+      options.remoteTypes.push_back(type);
+    }
+  }
+
+  repeatCalibrator->start(options);
+  request.response.json[F("success")] = true;
 }
 
 void MiLightHttpServer::handleWsEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length) {
@@ -965,6 +1143,79 @@ void MiLightHttpServer::handleUpdateAliases(RequestContext& request) {
   request.response.json[F("success")] = true;
 }
 
+void MiLightHttpServer::handleListScenes(RequestContext& request) {
+  const std::vector<SceneStore::Scene>& scenes = sceneStore->getScenes();
+
+  JsonArray list = request.response.json.to<JsonObject>().createNestedArray(F("scenes"));
+  request.response.json[F("count")] = scenes.size();
+
+  for (const SceneStore::Scene& scene : scenes) {
+    JsonObject json = list.createNestedObject();
+    json[F("name")] = scene.name;
+    json[F("states")] = scene.numStates;
+    json[F("packets")] = scene.numPackets;
+  }
+}
+
+void MiLightHttpServer::handleCreateScene(RequestContext& request) {
+  JsonObject body = request.getJsonBody().as<JsonObject>();
+
+  if (! body.containsKey(F("name")) || ! body[F("updates")].is<JsonArray>()) {
+    request.response.setCode(400);
+    request.response.json[F("error")] = F("Must specify required keys: name, updates");
+    return;
+  }
+
+  const String name = body[F("name")];
+  const SceneStore::Status status = sceneStore->define(name, body[F("updates")].as<JsonArray>());
+
+  if (status != SceneStore::Status::OK) {
+    request.response.setCode(status == SceneStore::Status::WRITE_FAILED ? 500 : 400);
+    request.response.json[F("error")] = SceneStore::statusMessage(status);
+    return;
+  }
+
+  const SceneStore::Scene* scene = sceneStore->find(name);
+
+  request.response.json[F("success")] = true;
+  request.response.json[F("states")] = scene->numStates;
+  request.response.json[F("packets")] = scene->numPackets;
+}
+
+void MiLightHttpServer::handleGetScene(RequestContext& request) {
+  const SceneStore::Scene* scene = sceneStore->find(request.pathVariables.get("name"));
+
+  if (scene == nullptr) {
+    request.response.setCode(404);
+    request.response.json[F("error")] = F("Scene not found");
+    return;
+  }
+
+  request.response.json[F("name")] = scene->name;
+  request.response.json[F("states")] = scene->numStates;
+  request.response.json[F("packets")] = scene->numPackets;
+}
+
+void MiLightHttpServer::handleDeleteScene(RequestContext& request) {
+  const SceneStore::Status status = sceneStore->remove(request.pathVariables.get("name"));
+
+  if (status == SceneStore::Status::OK) {
+    request.response.json[F("success")] = true;
+  } else {
+    request.response.setCode(status == SceneStore::Status::NOT_FOUND ? 404 : 500);
+    request.response.json[F("error")] = SceneStore::statusMessage(status);
+  }
+}
+
+void MiLightHttpServer::handleActivateScene(RequestContext& request) {
+  if (sceneStore->activate(request.pathVariables.get("name"))) {
+    request.response.json[F("success")] = true;
+  } else {
+    request.response.setCode(404);
+    request.response.json[F("error")] = F("Scene not found");
+  }
+}
+
 void MiLightHttpServer::saveSettings() {
   settings.save();
 
@@ -1068,9 +1319,12 @@ void MiLightHttpServer::handleBatchUpdateGroups(RequestContext& request) {
     return;
   }
 
+  GroupCommandPlanner planner;
+
   for (auto update : body) {
     JsonArray gateways = update[F("gateways")].as<JsonArray>();
     JsonObject stateUpdate = update[F("update")].as<JsonObject>();
+    const LightCommand command = LightCommand::fromJson(stateUpdate);
 
     for (auto gateway : gateways) {
       BulbId bulbId(
@@ -1079,14 +1333,26 @@ void MiLightHttpServer::handleBatchUpdateGroups(RequestContext& request) {
         MiLightRemoteTypeHelpers::remoteTypeFromString(gateway[F("device_type")].as<const char*>())
       );
 
+      planner.add(bulbId, command, stateUpdate);
+    }
+  }
+
+  // Updates that cover every group of a device ID are sent once, to group 0
+  const GroupCommandPlanner::Result result = planner.run(
+    [this](const BulbId& bulbId, const LightCommand& command, JsonObject stateUpdate) {
+      const uint32_t enqueuedBefore = packetSender->enqueuedPackets();
+
       this->milightClient->prepare(
         bulbId.deviceType,
         bulbId.deviceId,
         bulbId.groupId
       );
-      handleRequest(stateUpdate);
+      handleRequest(command, stateUpdate);
+
+      return static_cast<size_t>(packetSender->enqueuedPackets() - enqueuedBefore);
     }
-  }
+  );
 
   request.response.json[F("success")] = true;
+  request.response.json[F("packets_saved")] = result.packetsSaved;
 }
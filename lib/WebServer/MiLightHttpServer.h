@@ -5,6 +5,9 @@
 #include <GroupStateStore.h>
 #include <RadioSwitchboard.h>
 #include <PacketSender.h>
+#include <GroupCommandPlanner.h>
+#include <RepeatCalibrator.h>
+#include <SceneStore.h>
 #include <TransitionController.h>
 
 #ifndef _MILIGHT_HTTP_SERVER
@@ -41,6 +44,8 @@ public:
     GroupStateStore*& stateStore,
     PacketSender*& packetSender,
     RadioSwitchboard*& radios,
+    RepeatCalibrator*& repeatCalibrator,
+    SceneStore*& sceneStore,
     TransitionController& transitions
   )
     : authProvider(settings)
@@ -52,6 +57,8 @@ public:
     , stateStore(stateStore)
     , packetSender(packetSender)
     , radios(radios)
+    , repeatCalibrator(repeatCalibrator)
+    , sceneStore(sceneStore)
     , transitions(transitions)
   { }
 
@@ -68,7 +75,21 @@ protected:
 
   bool serveFile(const char* file, const char* contentType = "text/html");
   void handleServe_P(const char* data, size_t length, const char* contentType);
-  void sendGroupState(bool allowAsync, BulbId& bulbId, RichHttp::Response& response);
+  // With blockOnQueue set, waits for tickets, or if that's null, for the whole
+  // queue, before responding with the group's state
+  void sendGroupState(
+    bool allowAsync,
+    BulbId& bulbId,
+    RichHttp::Response& response,
+    const PacketSender::TicketRange* tickets = nullptr
+  );
+  // Sends packets until everything up to ticket has been sent
+  void waitForPackets(PacketSender::Ticket ticket);
+  // Sends packets until the ones in tickets have been sent
+  void waitForPackets(const PacketSender::TicketRange& tickets);
+  // Adds the tickets of the packets queued from now on to tickets.  Pass null
+  // to stop.
+  void recordRequestPackets(PacketSender::TicketRange* tickets);
 
   void serveSettings();
   void handleUpdateSettings(RequestContext& request);
@@ -83,6 +104,8 @@ protected:
   void handleFirmwarePost();
   void handleListenGateway(RequestContext& request);
   void handleSendRaw(RequestContext& request);
+  void handleGetRepeatCalibration(RequestContext& request);
+  void handleStartRepeatCalibration(RequestContext& request);
 
   void handleUpdateGroup(RequestContext& request);
   void handleUpdateGroupAlias(RequestContext& request);
@@ -110,10 +133,18 @@ protected:
   void handleDeleteAliases(RequestContext& request);
   void handleUpdateAliases(RequestContext& request);
 
+  // CRUD methods for /scenes
+  void handleListScenes(RequestContext& request);
+  void handleCreateScene(RequestContext& request);
+  void handleGetScene(RequestContext& request);
+  void handleDeleteScene(RequestContext& request);
+  void handleActivateScene(RequestContext& request);
+
   void handleCreateBackup(RequestContext& request);
   void handleRestoreBackup(RequestContext& request);
 
   void handleRequest(const JsonObject& request);
+  void handleRequest(const LightCommand& command, const JsonObject& request);
   void handleWsEvent(uint8_t num, WStype_t type, uint8_t * payload, size_t length);
 
   void saveSettings();
@@ -132,6 +163,8 @@ protected:
   THandlerFunction _handleRootPage;
   PacketSender*& packetSender;
   RadioSwitchboard*& radios;
+  RepeatCalibrator*& repeatCalibrator;
+  SceneStore*& sceneStore;
   TransitionController& transitions;
   AboutHandler aboutHandler;
 
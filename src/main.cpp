@@ -19,6 +19,9 @@
 #include <BulbStateUpdater.h>
 #include <RadioSwitchboard.h>
 #include <PacketSender.h>
+#include <RepeatCalibrator.h>
+#include <SceneStore.h>
+#include <ListenScheduler.h>
 #include <HomeAssistantDiscoveryClient.h>
 #include <TransitionController.h>
 #include <ProjectWifi.h>
@@ -53,11 +56,16 @@ Settings settings;
 MiLightClient* milightClient = NULL;
 RadioSwitchboard* radios = nullptr;
 PacketSender* packetSender = nullptr;
+RepeatCalibrator* repeatCalibrator = nullptr;
+SceneStore* sceneStore = nullptr;
+// One scheduler per listening radio.  Without dedicated listen radios there's
+// a single scheduler sharing the sending radio.
+std::vector<std::shared_ptr<ListenScheduler>> listenSchedulers;
+std::vector<std::shared_ptr<RadioSwitchboard>> listenRadios;
 std::shared_ptr<MiLightRadioFactory> radioFactory;
 MiLightHttpServer *httpServer = NULL;
 MqttClient* mqttClient = NULL;
 MiLightDiscoveryServer* discoveryServer = NULL;
-uint8_t currentRadioType = 0;
 
 // For tracking and managing group state
 GroupStateStore* stateStore = NULL;
@@ -108,10 +116,10 @@ void initMilightUdpServers() {
 /**
  * Milight RF packet handler.
  *
- * Called both when a packet is sent locally, and when an intercepted packet
- * is read.
+ * Called both when a packet is sent locally (sentByHub), and when an
+ * intercepted packet is read.
  */
-void onPacketSentHandler(uint8_t* packet, const MiLightRemoteConfig& config) {
+void handlePacket(uint8_t* packet, const MiLightRemoteConfig& config, bool sentByHub) {
   StaticJsonDocument<200> buffer;
   JsonObject result = buffer.to<JsonObject>();
 
@@ -137,8 +145,9 @@ void onPacketSentHandler(uint8_t* packet, const MiLightRemoteConfig& config) {
   if (groupState != NULL) {
     groupState->patch(stateUpdates);
 
-    // Copy state before setting it to avoid group 0 re-initialization clobbering it
-    stateStore->set(bulbId, stateUpdates);
+    // Copy state before setting it to avoid group 0 re-initialization clobbering it.
+    // Group 0 fans out to every group, which can evict groupState from the cache.
+    groupState = stateStore->set(bulbId, stateUpdates);
   }
 
   if (mqttClient) {
@@ -150,48 +159,113 @@ void onPacketSentHandler(uint8_t* packet, const MiLightRemoteConfig& config) {
     // Sends the entire state
     if (groupState != NULL) {
       bulbStateUpdater->enqueueUpdate(bulbId, *groupState);
+
+      // Group 0 changed every group's state, so publish those too.  Only done
+      // for our own packets (e.g., batch updates collapsed into group 0), and
+      // only for states already in the cache, so a remote's group 0 button
+      // doesn't load states from flash.
+      BulbId individualId(bulbId);
+      for (size_t i = 1; sentByHub && bulbId.groupId == 0 && i <= remoteConfig.numGroups; ++i) {
+        individualId.groupId = i;
+        GroupState* individualState = stateStore->getCached(individualId);
+
+        if (individualState != NULL) {
+          bulbStateUpdater->enqueueUpdate(individualId, *individualState);
+        }
+      }
     }
   }
 
   httpServer->handlePacketSent(packet, remoteConfig, bulbId, result);
 }
 
+void onPacketSentHandler(uint8_t* packet, const MiLightRemoteConfig& config) {
+  handlePacket(packet, config, true);
+}
+
+/**
+ * Packet handler for packets heard while listening on the sending radio.
+ */
+void onPacketHeardHandler(uint8_t* packet, const MiLightRemoteConfig& config) {
+  handlePacket(packet, config, false);
+}
+
+/**
+ * Packet handler for dedicated listen radios.  These hear our own packets
+ * while the sending radio is busy, so drop those.
+ */
+void onPacketReceivedHandler(uint8_t* packet, const MiLightRemoteConfig& config) {
+  if (packetSender->isEcho(packet, config.packetFormatter->getPacketLength())) {
+    return;
+  }
+
+  onPacketHeardHandler(packet, config);
+}
+
 /**
- * Listen for packets on one radio config.  Cycles through all configs as its
- * called.
+ * Listen for packets on one radio config per listening radio.  The listen
+ * schedulers decide which, favoring configs that have recently had traffic.
  */
 void handleListen() {
-  // Do not handle listens while there are packets enqueued to be sent
-  // Doing so causes the radio module to need to be reinitialized inbetween
-  // repeats, which slows things down.
-  if (! settings.listenRepeats || packetSender->isSending()) {
+  if (! settings.listenRepeats) {
     return;
   }
 
-  std::shared_ptr<MiLightRadio> radio = radios->switchRadio(currentRadioType++ % radios->getNumRadios());
+  // The calibrator reads the listen radio itself.  Probes it sends would
+  // otherwise be handled as commands from a remote.
+  if (repeatCalibrator->isRunning()) {
+    return;
+  }
 
-  for (size_t i = 0; i < settings.listenRepeats; i++) {
-    if (radios->available()) {
-      uint8_t readPacket[MILIGHT_MAX_PACKET_LENGTH];
-      size_t packetLen = radios->read(readPacket);
+  // Without dedicated listen radios, do not handle listens while there are
+  // packets enqueued to be sent.  Doing so causes the radio module to need to
+  // be reinitialized inbetween repeats, which slows things down.
+  if (listenRadios.empty() && packetSender->isSending()) {
+    return;
+  }
 
-      const MiLightRemoteConfig* remoteConfig = MiLightRemoteConfig::fromReceivedPacket(
-        radio->config(),
-        readPacket,
-        packetLen
-      );
+  for (const std::shared_ptr<ListenScheduler>& scheduler : listenSchedulers) {
+    scheduler->listen(settings.listenRepeats);
+  }
+}
 
-      if (remoteConfig == NULL) {
-        // This can happen under normal circumstances, so not an error condition
-#ifdef DEBUG_PRINTF
-        Serial.println(F("WARNING: Couldn't find remote for received packet"));
-#endif
-        return;
-      }
+/**
+ * Set up radios dedicated to listening, if any are configured, splitting the
+ * radio configs between them.  Otherwise listen on the sending radio.
+ */
+void initListenRadios() {
+  listenSchedulers.clear();
+  listenRadios.clear();
 
-      // update state to reflect this packet
-      onPacketSentHandler(readPacket, *remoteConfig);
+  const size_t numListenRadios = std::min(settings.listenRadioPins.size(), radios->getNumRadios());
+
+  for (size_t i = 0; i < numListenRadios; ++i) {
+    std::shared_ptr<MiLightRadioFactory> factory = MiLightRadioFactory::fromSettings(settings, settings.listenRadioPins[i]);
+
+    if (factory == NULL) {
+      Serial.println(F("ERROR: radio type does not support dedicated listen radios"));
+      break;
     }
+
+    std::shared_ptr<RadioSwitchboard> listenRadio = std::make_shared<RadioSwitchboard>(factory, stateStore, settings);
+    listenRadios.push_back(listenRadio);
+    listenSchedulers.push_back(
+      std::make_shared<ListenScheduler>(*listenRadio, onPacketReceivedHandler, i, numListenRadios)
+    );
+  }
+
+  if (listenSchedulers.empty()) {
+    listenSchedulers.push_back(std::make_shared<ListenScheduler>(*radios, onPacketHeardHandler));
+  }
+}
+
+/**
+ * Persist per-type repeat budgets if the calibration run was asked to apply
+ * them.
+ */
+void onRepeatCalibrationComplete() {
+  if (repeatCalibrator->getOptions().apply) {
+    settings.save();
   }
 }
 
@@ -232,6 +306,14 @@ void applySettings() {
   if (stateStore) {
     delete stateStore;
   }
+  if (repeatCalibrator) {
+    delete repeatCalibrator;
+  }
+  if (sceneStore) {
+    delete sceneStore;
+  }
+  listenSchedulers.clear();
+  listenRadios.clear();
   if (packetSender) {
     delete packetSender;
   }
@@ -251,6 +333,15 @@ void applySettings() {
 
   radios = new RadioSwitchboard(radioFactory, stateStore, settings);
   packetSender = new PacketSender(*radios, settings, onPacketSentHandler);
+  initListenRadios();
+
+  repeatCalibrator = new RepeatCalibrator(
+    *radios,
+    listenRadios.empty() ? nullptr : listenRadios[0],
+    *packetSender,
+    settings
+  );
+  repeatCalibrator->onComplete(onRepeatCalibrationComplete);
 
   milightClient = new MiLightClient(
     *radios,
@@ -262,6 +353,8 @@ void applySettings() {
   milightClient->onUpdateBegin(onUpdateBegin);
   milightClient->onUpdateEnd(onUpdateEnd);
 
+  sceneStore = new SceneStore(*milightClient, *packetSender, *stateStore);
+
   if (settings.mqttServer().length() > 0) {
     mqttClient = new MqttClient(settings, milightClient);
     mqttClient->begin();
@@ -275,6 +368,8 @@ void applySettings() {
       }
     });
 
+    mqttClient->onSceneActivate([](const char* name) { return sceneStore->activate(name); });
+
     bulbStateUpdater = new BulbStateUpdater(settings, *mqttClient, *stateStore);
   }
 
@@ -349,6 +444,46 @@ void aboutHandler(JsonDocument& json) {
   if (mqttClient) {
     mqtt[FPSTR("connected")] = mqttClient->isConnected();
     mqtt[FPSTR("status")] = mqttClient->getConnectionStatusString();
+
+    const MqttClient::PublishStats& stats = mqttClient->getStatePublishStats();
+    JsonObject statePublishes = mqtt.createNestedObject(FPSTR("state_publishes"));
+    statePublishes[FPSTR("count")] = stats.publishes;
+    statePublishes[FPSTR("payload_bytes")] = stats.payloadBytes;
+    statePublishes[FPSTR("copied_bytes")] = stats.copiedBytes;
+    statePublishes[FPSTR("heap_allocations")] = stats.heapAllocations;
+  }
+
+  if (bulbStateUpdater) {
+    const BulbStateUpdater::Stats stats = bulbStateUpdater->getStats();
+    JsonObject pendingStates = mqtt.createNestedObject(FPSTR("pending_states"));
+    pendingStates[FPSTR("count")] = stats.pending;
+    pendingStates[FPSTR("oldest_age")] = stats.oldestPendingAge;
+    pendingStates[FPSTR("full_states")] = stats.pendingFullStates;
+    pendingStates[FPSTR("overflow_scans")] = stats.overflowScans;
+  }
+
+  // Keyed by the first remote type that uses each radio config
+  JsonObject listenStats = json.createNestedObject(FPSTR("listen_stats"));
+  for (size_t radioIx = 0; radioIx < listenSchedulers.size(); ++radioIx) {
+    ListenScheduler& scheduler = *listenSchedulers[radioIx];
+
+    for (size_t i = 0; i < scheduler.getNumConfigs(); ++i) {
+      const ListenScheduler::ConfigStats& stats = scheduler.getStats(i);
+      const size_t configIx = scheduler.getConfigIndex(i);
+      const char* name = nullptr;
+
+      for (size_t j = 0; j < MiLightRemoteConfig::NUM_REMOTES && name == nullptr; ++j) {
+        if (&MiLightRemoteConfig::ALL_REMOTES[j]->radioConfig == &MiLightRadioConfig::ALL_CONFIGS[configIx]) {
+          name = MiLightRemoteConfig::ALL_REMOTES[j]->name.c_str();
+        }
+      }
+
+      JsonObject configStats = listenStats.createNestedObject(name);
+      configStats[FPSTR("radio")] = radioIx;
+      configStats[FPSTR("listens")] = stats.listens;
+      configStats[FPSTR("hits")] = stats.hits;
+      configStats[FPSTR("reconfigures")] = scheduler.getRadioSwitchboard().getReconfigureCount(configIx);
+    }
   }
 }
 
@@ -383,22 +518,28 @@ void postConnectSetup() {
   SSDP.setDeviceType("upnp:rootdevice");
   SSDP.begin();
 
-  httpServer = new MiLightHttpServer(settings, milightClient, stateStore, packetSender, radios, transitions);
+  httpServer = new MiLightHttpServer(settings, milightClient, stateStore, packetSender, radios, repeatCalibrator, sceneStore, transitions);
   httpServer->onSettingsSaved(applySettings);
   httpServer->onGroupDeleted(onGroupDeleted);
   httpServer->onAbout(aboutHandler);
   httpServer->on("/description.xml", HTTP_GET, []() { SSDP.schema(httpServer->client()); });
   httpServer->begin();
 
-  transitions.addListener(
-      [](const BulbId& bulbId, GroupStateField field, uint16_t value) {
-          StaticJsonDocument<100> buffer;
-
-          const char* fieldName = GroupStateFieldHelpers::getFieldName(field);
-          buffer[fieldName] = value;
-
-          milightClient->prepare(bulbId.deviceType, bulbId.deviceId, bulbId.groupId);
-          milightClient->update(buffer.as<JsonObject>());
+  transitions.addBatchListener(
+      [](const BulbId& bulbId, const Transition::Step* steps, size_t numSteps) {
+          // Steps are queued behind other commands so they don't delay them.
+          // Status changes (e.g., at the end of a fade) are still interactive.
+          LightCommand command;
+          for (size_t i = 0; i < numSteps; ++i) {
+            command.set(steps[i].field, steps[i].value);
+          }
+
+          if (!command.has(LightCommand::STATUS)) {
+            milightClient->setPriorityOverride(PacketPriority::BACKGROUND);
+          }
+
+          milightClient->apply(bulbId, command);
+          milightClient->clearPriorityOverride();
       }
   );
 
@@ -549,6 +690,8 @@ void loop() {
 
     stateStore->limitedFlush();
     packetSender->loop();
+    repeatCalibrator->loop();
+    sceneStore->loop();
 
     transitions.loop();
   }
@@ -0,0 +1,1722 @@
+/**
+ * Host benchmark driver.  Replays JSON command scripts through MiLightClient,
+ * PacketSender and a simulated radio, and reports throughput, queue latency,
+ * radio reconfigures, a histogram of time to each packet's first repeat and
+ * the longest the main loop was held up, by one PacketSender::loop() or by
+ * sending one step.
+ *
+ * Usage:
+ *   program [--airtime-us N] [--settings JSON] [--iterations N] [--block-on-queue]
+ *           script.json [script.json ...]
+ *
+ * A script is a JSON array of steps:
+ *
+ *   [
+ *     {"delay_ms": 16, "device_id": 1, "device_type": "rgb_cct", "group_id": 1, "update": {"brightness": 50}},
+ *     ...
+ *   ]
+ *
+ * delay_ms is simulated time to wait before sending the step (default 0).
+ * With --block-on-queue, each step is sent the way an HTTP PUT with
+ * blockOnQueue=true is, waiting for the step's packets before going on.
+ *
+ * With --listen, simulates remotes instead and reports how many of their
+ * bursts the listen scheduler catches:
+ *
+ *   program --listen rgbw:5,rgb_cct:1 [--listen-seconds N] [--burst-ms N] [--loops-per-ms N]
+ *           [--tx-rate N] [--listen-radios N]
+ *
+ * Each remote type sends the given number of bursts per second.  A burst
+ * repeats the same packet for --burst-ms, and is only heard if a radio is
+ * configured for that remote while it's being sent.  --tx-rate has the hub
+ * send that many commands per second at the same time.  --listen-radios adds
+ * that many radios dedicated to listening (default 0: listen on the sending
+ * radio when it's idle).
+ *
+ * With --decode N, classifies N received packets with
+ * MiLightRemoteConfig::fromReceivedPacket, and reports packets decoded per
+ * second of host CPU time.  Packets are replayed round-robin from --corpus (see
+ * scripts/packets.txt for the format), or generated for each remote type.
+ *
+ * With --transitions N, runs N concurrent brightness transitions, staggered
+ * over the first period, through TransitionController alone.  Reports host
+ * time per TransitionController::loop() and how late steps fired.
+ *
+ * With --commands N, applies the same update N times through the JSON path
+ * (deserializeJson and MiLightClient::update, as MQTT does) and N times as a
+ * LightCommand through MiLightClient::apply.  Reports host time per command
+ * and the size of the request representation each path keeps on the stack.
+ *
+ * With --group-batches N, sends N batch updates that give every group of an
+ * rgb_cct, fut089 and rgbw device ID the same state, first one command per
+ * group and then through GroupCommandPlanner.  Reports the usual send stats
+ * for each, and the packets the planner saved.
+ *
+ * With --scenes N, activates a scene of three batch updates covering seven
+ * rgb_cct, fut089 and cct groups N times, first by parsing the batch JSON and running it
+ * through GroupCommandPlanner and MiLightClient, and then as a scene defined
+ * once in SceneStore on the in-memory FS.  Reports host time and packets per
+ * activation for each path, and packets dropped because the queue was full.
+ *
+ * With --formatters N, builds N requests of each of a few commands through
+ * every remote type's PacketFormatter, cycling through 16 combinations of group
+ * and argument.  Reports host time per packet.  For formatters that support
+ * packet templates (see PacketTemplateCache), builds them again with templates
+ * enabled, and counts packets that differ from freshly built ones by more than
+ * the sequence number.  No bulb state is known, so step sequences start from
+ * the minimum.
+ *
+ * With --cache N, runs N lookups against GroupStateCache and against the
+ * LinkedList-backed cache it replaced, at 100, 500 and 2000 entries.  Keys are
+ * drawn from 1.25x the capacity, and misses are inserted the way
+ * GroupStateStore does, evicting the least recently used entry.  Reports
+ * lookups per second and hits for each.
+ *
+ * With --persistence N, applies N state updates spread over 64 bulbs, flushing
+ * every 16 updates, first with the one-file-per-bulb layout GroupStatePersistence
+ * used to have and then with its journal.  Both run against the in-memory FS.
+ * Reports files opened and bytes written per update, flush latency, and
+ * whether every bulb's latest state reloads.
+ *
+ * With --nrf24 N, writes N packets through NRF24MiLightRadio on the stub RF24
+ * (lib/NativeArduino/RF24.h), first repeating one packet and then changing it
+ * every write.  Reports host time, SPI bytes and register changes per repeat,
+ * and a hash of the frames put on air so implementations can be compared.
+ *
+ * With --mqtt N, publishes N state updates spread over 64 bulbs through
+ * BulbStateUpdater and MqttClient, to the in-process broker behind the
+ * PubSubClient stand-in (lib/NativeArduino/PubSubClient.h).  Then publishes
+ * them again the way BulbStateUpdater used to, serialized into a buffer and
+ * sent with MqttClient::sendState(remoteConfig, ...).  Reports host time,
+ * payload bytes, bytes copied on the way to the connection and heap
+ * allocations per publish for each path.
+ *
+ * With --mqtt-topics N, matches N command topics for each of a few
+ * mqtt_topic_pattern settings, with MqttTopicMatcher and with the
+ * TokenIterator and UrlTokenBindings lookups MqttClient used before it.
+ * Topics cycle through hex and decimal IDs, every remote type plus an unknown
+ * one, and known and unknown aliases.  Reports topics where the two disagree,
+ * and messages matched per second and heap allocations per message for each.
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <BulbStateUpdater.h>
+#include <FS.h>
+#include <GroupCommandPlanner.h>
+#include <GroupStatePersistence.h>
+#include <GroupStateCache.h>
+#include <GroupStateStore.h>
+#include <IntParsing.h>
+#include <LinkedList.h>
+#include <MiLightClient.h>
+#include <MiLightRadioFactory.h>
+#include <MqttClient.h>
+#include <MqttTopicMatcher.h>
+#include <NRF24MiLightRadio.h>
+#include <PacketSender.h>
+#include <PubSubClient.h>
+#include <ListenScheduler.h>
+#include <RadioSwitchboard.h>
+#include <SceneStore.h>
+#include <Settings.h>
+#include <TransitionController.h>
+#include <UrlTokenBindings.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+static const uint32_t DEFAULT_AIRTIME_US = 500;
+static const size_t SCRIPT_BUFFER_SIZE = 64 * 1024;
+
+// Every operator new in the process, for modes that report heap allocations
+static size_t heapAllocations = 0;
+
+void* operator new(size_t size) {
+  ++heapAllocations;
+
+  void* ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+struct ListenSource {
+  const MiLightRemoteConfig* remote;
+  double burstsPerSecond;
+};
+
+struct BenchmarkOptions {
+  uint32_t airtimeMicros = DEFAULT_AIRTIME_US;
+  size_t iterations = 1;
+  bool blockOnQueue = false;
+  String settingsJson;
+  std::vector<std::string> scripts;
+
+  std::vector<ListenSource> listenSources;
+  unsigned long listenSeconds = 60;
+  unsigned long burstMillis = 40;
+  size_t loopsPerMilli = 10;
+  size_t listenRadios = 0;
+  double txRate = 0;
+
+  size_t decodePackets = 0;
+  std::string corpus;
+
+  size_t transitions = 0;
+  float transitionSeconds = 30;
+
+  size_t commandCount = 0;
+
+  size_t groupBatches = 0;
+
+  size_t sceneActivations = 0;
+
+  size_t formatterRequests = 0;
+
+  size_t cacheLookups = 0;
+
+  size_t persistenceUpdates = 0;
+
+  size_t nrf24Writes = 0;
+
+  size_t mqttPublishes = 0;
+
+  size_t topicMatches = 0;
+};
+
+static void printUsage(const char* program) {
+  fprintf(
+    stderr,
+    "Usage: %s [--airtime-us N] [--settings JSON] [--iterations N] [--block-on-queue]\n"
+    "          script.json [script.json ...]\n"
+    "       %s --listen TYPE:RATE[,TYPE:RATE...] [--listen-seconds N] [--burst-ms N] [--loops-per-ms N]\n"
+    "          [--tx-rate N] [--listen-radios N]\n"
+    "       %s --decode N [--corpus FILE]\n"
+    "       %s --transitions N [--transition-seconds N] [--loops-per-ms N]\n"
+    "       %s --commands N\n"
+    "       %s --group-batches N\n"
+    "       %s --scenes N\n"
+    "       %s --formatters N\n"
+    "       %s --cache N\n"
+    "       %s --persistence N\n"
+    "       %s --nrf24 N\n"
+    "       %s --mqtt N\n"
+    "       %s --mqtt-topics N\n",
+    program,
+    program,
+    program,
+    program,
+    program,
+    program,
+    program,
+    program,
+    program,
+    program,
+    program,
+    program,
+    program
+  );
+}
+
+// Parses a list like "rgbw:5,rgb_cct:1"
+static bool parseListenSources(const char* arg, std::vector<ListenSource>& sources) {
+  std::stringstream list(arg);
+  std::string item;
+
+  while (std::getline(list, item, ',')) {
+    const size_t sep = item.find(':');
+    const MiLightRemoteConfig* remote = MiLightRemoteConfig::fromType(
+      MiLightRemoteTypeHelpers::remoteTypeFromName(item.substr(0, sep).c_str())
+    );
+
+    if (remote == nullptr) {
+      fprintf(stderr, "Unknown remote type: %s\n", item.c_str());
+      return false;
+    }
+
+    sources.push_back({remote, sep == std::string::npos ? 1.0 : atof(item.c_str() + sep + 1)});
+  }
+
+  return !sources.empty();
+}
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+
+    if (arg == "--airtime-us" && hasValue) {
+      options.airtimeMicros = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--iterations" && hasValue) {
+      options.iterations = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--block-on-queue") {
+      options.blockOnQueue = true;
+    } else if (arg == "--settings" && hasValue) {
+      options.settingsJson = argv[++i];
+    } else if (arg == "--listen" && hasValue) {
+      if (!parseListenSources(argv[++i], options.listenSources)) {
+        return false;
+      }
+    } else if (arg == "--listen-seconds" && hasValue) {
+      options.listenSeconds = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--burst-ms" && hasValue) {
+      options.burstMillis = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--listen-radios" && hasValue) {
+      options.listenRadios = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--tx-rate" && hasValue) {
+      options.txRate = atof(argv[++i]);
+    } else if (arg == "--decode" && hasValue) {
+      options.decodePackets = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--corpus" && hasValue) {
+      options.corpus = argv[++i];
+    } else if (arg == "--transitions" && hasValue) {
+      options.transitions = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--transition-seconds" && hasValue) {
+      options.transitionSeconds = atof(argv[++i]);
+    } else if (arg == "--commands" && hasValue) {
+      options.commandCount = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--group-batches" && hasValue) {
+      options.groupBatches = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--scenes" && hasValue) {
+      options.sceneActivations = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--formatters" && hasValue) {
+      options.formatterRequests = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--cache" && hasValue) {
+      options.cacheLookups = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--persistence" && hasValue) {
+      options.persistenceUpdates = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--nrf24" && hasValue) {
+      options.nrf24Writes = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--mqtt" && hasValue) {
+      options.mqttPublishes = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--mqtt-topics" && hasValue) {
+      options.topicMatches = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--loops-per-ms" && hasValue) {
+      options.loopsPerMilli = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+    } else if (arg.rfind("--", 0) == 0) {
+      return false;
+    } else {
+      options.scripts.push_back(arg);
+    }
+  }
+
+  return !options.scripts.empty()
+    || !options.listenSources.empty()
+    || options.decodePackets > 0
+    || options.transitions > 0
+    || options.commandCount > 0
+    || options.groupBatches > 0
+    || options.sceneActivations > 0
+    || options.formatterRequests > 0
+    || options.cacheLookups > 0
+    || options.persistenceUpdates > 0
+    || options.nrf24Writes > 0
+    || options.mqttPublishes > 0
+    || options.topicMatches > 0;
+}
+
+static bool readFile(const std::string& path, std::string& contents) {
+  std::ifstream in(path);
+
+  if (!in) {
+    return false;
+  }
+
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  contents = buffer.str();
+
+  return true;
+}
+
+static uint32_t percentile(std::vector<uint32_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+
+  size_t ix = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(ix, sorted.size() - 1)];
+}
+
+// The LinkedList-backed GroupStateCache, before it was indexed.  Only kept to
+// compare against.
+class LinkedListGroupStateCache {
+public:
+  struct Node {
+    BulbId id;
+    GroupState state;
+  };
+
+  LinkedListGroupStateCache(size_t maxSize) : maxSize(maxSize) { }
+
+  ~LinkedListGroupStateCache() {
+    for (ListNode<Node*>* cur = cache.getHead(); cur != nullptr; cur = cur->next) {
+      delete cur->data;
+    }
+  }
+
+  GroupState* get(const BulbId& id) {
+    for (ListNode<Node*>* cur = cache.getHead(); cur != nullptr; cur = cur->next) {
+      if (cur->data->id == id) {
+        GroupState* result = &cur->data->state;
+        cache.spliceToFront(cur);
+        return result;
+      }
+    }
+
+    return nullptr;
+  }
+
+  GroupState* set(const BulbId& id, const GroupState& state) {
+    Node* node = cache.size() >= maxSize ? cache.pop() : new Node();
+    node->id = id;
+    node->state = state;
+    cache.unshift(node);
+
+    return &node->state;
+  }
+
+private:
+  LinkedList<Node*> cache;
+  const size_t maxSize;
+};
+
+template <typename Cache>
+static double timeCacheLookups(Cache& cache, size_t capacity, size_t lookups, size_t& hits) {
+  const GroupState state = GroupState::defaultState(REMOTE_TYPE_RGB_CCT);
+  const size_t keys = capacity + capacity / 4;
+
+  randomSeed(1);
+  hits = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < lookups; ++i) {
+    const size_t key = random(keys);
+    const BulbId id(0x1000 + key / 8, 1 + (key % 8), REMOTE_TYPE_RGB_CCT);
+
+    if (cache.get(id) != nullptr) {
+      ++hits;
+    } else {
+      cache.set(id, state);
+    }
+  }
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Compares GroupStateCache with the LinkedList-backed cache it replaced
+static void cacheLookups(size_t lookups) {
+  printf("%-8s %16s %16s %10s\n", "entries", "linked list/s", "indexed/s", "hit rate");
+
+  for (size_t capacity : {100, 500, 2000}) {
+    size_t listHits;
+    size_t indexedHits;
+
+    LinkedListGroupStateCache listCache(capacity);
+    const double listSeconds = timeCacheLookups(listCache, capacity, lookups, listHits);
+
+    GroupStateCache indexedCache(capacity);
+    const double indexedSeconds = timeCacheLookups(indexedCache, capacity, lookups, indexedHits);
+
+    printf(
+      "%-8zu %16.0f %16.0f %9.1f%%\n",
+      capacity,
+      lookups / listSeconds,
+      lookups / indexedSeconds,
+      100.0 * indexedHits / lookups
+    );
+
+    // Both evict least recently used entries, so should hit the same lookups
+    if (listHits != indexedHits) {
+      printf("  hits differ: linked list=%zu indexed=%zu\n", listHits, indexedHits);
+    }
+  }
+}
+
+// Compares write amplification and flush latency of the journal with the
+// one-file-per-bulb layout it replaced
+static void persistenceWrites(size_t updates) {
+  static const size_t NUM_BULBS = 64;
+  static const size_t UPDATES_PER_FLUSH = 16;
+  static const char JOURNAL_PATH[] = "/bench_states.bin";
+
+  auto bulbFor = [](size_t i) { return BulbId(0x7000 + (i % NUM_BULBS) / 4, 1 + (i % 4), REMOTE_TYPE_RGB_CCT); };
+  auto stateFor = [](size_t i) {
+    GroupState state = GroupState::defaultState(REMOTE_TYPE_RGB_CCT);
+    state.setBrightness(i % 101);
+    return state;
+  };
+
+  struct Result {
+    size_t flushes = 0;
+    size_t fileOpens = 0;
+    size_t bytesWritten = 0;
+    double totalFlushMicros = 0;
+    double maxFlushMicros = 0;
+
+    void addFlush(std::chrono::steady_clock::time_point start) {
+      const double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+      totalFlushMicros += micros;
+      maxFlushMicros = std::max(maxFlushMicros, micros);
+      ++flushes;
+    }
+  };
+
+  // One file per bulb, rewritten for every dirty bulb on each flush
+  Result perBulb;
+  {
+    std::vector<bool> dirty(NUM_BULBS);
+    std::vector<GroupState> states(NUM_BULBS);
+
+    for (size_t i = 0; i < updates; ++i) {
+      states[i % NUM_BULBS] = stateFor(i);
+      dirty[i % NUM_BULBS] = true;
+
+      if ((i + 1) % UPDATES_PER_FLUSH == 0 || i + 1 == updates) {
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t bulb = 0; bulb < NUM_BULBS; ++bulb) {
+          if (dirty[bulb]) {
+            char path[30];
+            sprintf(path, "/group_states/%x", bulbFor(bulb).getCompactId());
+
+            File f = ProjectFS.open(path, "w");
+            states[bulb].dump(f);
+            perBulb.bytesWritten += f.size();
+            perBulb.fileOpens++;
+            f.close();
+
+            dirty[bulb] = false;
+          }
+        }
+
+        perBulb.addFlush(start);
+      }
+    }
+  }
+
+  Result journal;
+  size_t compactions;
+  {
+    ProjectFS.remove(JOURNAL_PATH);
+    GroupStatePersistence persistence(ProjectFS, JOURNAL_PATH);
+
+    for (size_t i = 0; i < updates; ++i) {
+      persistence.set(bulbFor(i), stateFor(i));
+
+      if ((i + 1) % UPDATES_PER_FLUSH == 0 || i + 1 == updates) {
+        const auto start = std::chrono::steady_clock::now();
+        persistence.flush();
+        journal.addFlush(start);
+      }
+    }
+
+    const GroupStatePersistence::Stats& stats = persistence.getStats();
+    journal.fileOpens = stats.flushes;
+    journal.bytesWritten = stats.bytesWritten;
+    compactions = stats.compactions;
+  }
+
+  // Every bulb's last update should come back
+  GroupStatePersistence reloaded(ProjectFS, JOURNAL_PATH);
+  size_t mismatches = 0;
+
+  for (size_t i = updates > NUM_BULBS ? updates - NUM_BULBS : 0; i < updates; ++i) {
+    GroupState state;
+    reloaded.get(bulbFor(i), state);
+    mismatches += !state.isEqualIgnoreDirty(stateFor(i));
+  }
+
+  printf("updates:             %zu over %zu bulbs, flushed every %zu\n", updates, NUM_BULBS, UPDATES_PER_FLUSH);
+
+  for (const auto& entry : {std::make_pair("per bulb", &perBulb), std::make_pair("journal", &journal)}) {
+    const Result& result = *entry.second;
+
+    printf("%s:\n", entry.first);
+    printf("  flushes:             %zu\n", result.flushes);
+    printf("  files opened/update: %.3f\n", static_cast<double>(result.fileOpens) / updates);
+    printf("  bytes/update:        %.2f\n", static_cast<double>(result.bytesWritten) / updates);
+    printf("  write amplification: %.2fx\n", static_cast<double>(result.bytesWritten) / (updates * GroupState::SERIALIZED_SIZE));
+    printf("  flush us (avg/max):  %.1f / %.1f\n", result.totalFlushMicros / result.flushes, result.maxFlushMicros);
+  }
+
+  printf("journal compactions: %zu\n", compactions);
+  printf("reload mismatches:   %zu\n", mismatches);
+}
+
+// MqttClient::publishCallback's topic handling before MqttTopicMatcher
+static MqttTopicMatcher::MatchResult legacyMatch(
+  Settings& settings,
+  char* topic,
+  uint16_t& deviceId,
+  uint8_t& groupId,
+  const MiLightRemoteConfig*& config
+) {
+  deviceId = 0;
+  groupId = 0;
+  config = &FUT092Config;
+
+  auto patternIterator = std::make_shared<TokenIterator>(settings.mqttTopicPattern.c_str(), settings.mqttTopicPattern.length(), '/');
+  auto topicIterator = std::make_shared<TokenIterator>(topic, strlen(topic), '/');
+  UrlTokenBindings tokenBindings(patternIterator, topicIterator);
+
+  if (tokenBindings.hasBinding("device_alias")) {
+    String alias = tokenBindings.get("device_alias");
+    auto itr = settings.groupIdAliases.find(alias);
+
+    if (itr == settings.groupIdAliases.end()) {
+      return MqttTopicMatcher::MatchResult::UNKNOWN_ALIAS;
+    }
+
+    BulbId bulbId = itr->second.bulbId;
+
+    deviceId = bulbId.deviceId;
+    config = MiLightRemoteConfig::fromType(bulbId.deviceType);
+    groupId = bulbId.groupId;
+  } else {
+    if (tokenBindings.hasBinding("device_id")) {
+      deviceId = parseInt<uint16_t>(tokenBindings.get("device_id"));
+    } else if (tokenBindings.hasBinding("hex_device_id")) {
+      deviceId = parseInt<uint16_t>(tokenBindings.get("hex_device_id"));
+    } else if (tokenBindings.hasBinding("dec_device_id")) {
+      deviceId = parseInt<uint16_t>(tokenBindings.get("dec_device_id"));
+    }
+
+    if (tokenBindings.hasBinding("group_id")) {
+      groupId = parseInt<uint16_t>(tokenBindings.get("group_id"));
+    }
+
+    if (tokenBindings.hasBinding("device_type")) {
+      config = MiLightRemoteConfig::fromType(tokenBindings.get("device_type"));
+    }
+  }
+
+  return config == NULL ? MqttTopicMatcher::MatchResult::UNKNOWN_DEVICE_TYPE : MqttTopicMatcher::MatchResult::OK;
+}
+
+// Checks MqttTopicMatcher against the lookups it replaced, and compares their
+// throughput
+static void topicMatching(size_t messages) {
+  static const char* PATTERNS[] = {
+    "milight/commands/:device_id/:device_type/:group_id",
+    "milight/:hex_device_id/:device_type/:group_id",
+    "milight/:dec_device_id/:group_id",
+    "milight/aliases/:device_alias",
+    "home/:device_type/:dec_device_id/:group_id/set"
+  };
+  static const size_t NUM_TOPICS = 256;
+  static const size_t NUM_ALIASES = 32;
+
+  Settings settings;
+  char name[MAX_ALIAS_LEN + 1];
+
+  for (size_t i = 0; i < NUM_ALIASES; ++i) {
+    const BulbId bulbId(0x2000 + i, 1 + (i % 4), MiLightRemoteConfig::ALL_REMOTES[i % MiLightRemoteConfig::NUM_REMOTES]->type);
+
+    sprintf(name, "room_%zu", i);
+    settings.groupIdAliases[name] = GroupAlias(i, name, bulbId);
+  }
+
+  for (const char* pattern : PATTERNS) {
+    settings.mqttTopicPattern = pattern;
+    MqttTopicMatcher matcher(settings);
+
+    // Every 64th topic has an unknown remote type, and a few more aliases are
+    // used than there are
+    std::vector<String> topics;
+    for (size_t i = 0; i < NUM_TOPICS; ++i) {
+      const uint16_t deviceId = 0x1000 + i * 37;
+      const size_t remote = i % 64 == 63 ? MiLightRemoteConfig::NUM_REMOTES : i % MiLightRemoteConfig::NUM_REMOTES;
+      String topic = pattern;
+
+      topic.replace(":hex_device_id", String("0x") + String(deviceId, 16));
+      topic.replace(":dec_device_id", String(deviceId));
+      topic.replace(":device_id", i % 2 ? String("0x") + String(deviceId, 16) : String(deviceId));
+      topic.replace(":group_id", String(i % 9));
+      topic.replace(
+        ":device_type",
+        remote < MiLightRemoteConfig::NUM_REMOTES ? MiLightRemoteConfig::ALL_REMOTES[remote]->name : String("fut999")
+      );
+      sprintf(name, "room_%zu", i % (NUM_ALIASES + 8));
+      topic.replace(":device_alias", name);
+
+      topics.push_back(topic);
+    }
+
+    char topic[128];
+    size_t mismatches = 0;
+    // Unknown types are logged to Serial by both, so they're left out of the
+    // timed runs
+    std::vector<size_t> timedTopics;
+
+    for (size_t i = 0; i < NUM_TOPICS; ++i) {
+      const String& source = topics[i];
+      uint16_t legacyDeviceId, deviceId;
+      uint8_t legacyGroupId, groupId;
+      const MiLightRemoteConfig* legacyConfig;
+      const MiLightRemoteConfig* config;
+      const char* alias;
+
+      strcpy(topic, source.c_str());
+      const MqttTopicMatcher::MatchResult legacyResult = legacyMatch(settings, topic, legacyDeviceId, legacyGroupId, legacyConfig);
+      strcpy(topic, source.c_str());
+      const MqttTopicMatcher::MatchResult result = matcher.match(topic, deviceId, groupId, config, alias);
+
+      if (result != legacyResult
+        || (result == MqttTopicMatcher::MatchResult::OK
+          && (deviceId != legacyDeviceId || groupId != legacyGroupId || config != legacyConfig))) {
+        ++mismatches;
+      }
+      if (result != MqttTopicMatcher::MatchResult::UNKNOWN_DEVICE_TYPE) {
+        timedTopics.push_back(i);
+      }
+    }
+
+    double nanos[2] = { };
+    size_t allocations[2] = { };
+    uint32_t checksum = 0;
+
+    for (size_t path = 0; path < 2; ++path) {
+      const size_t allocationsBefore = heapAllocations;
+      const auto start = std::chrono::steady_clock::now();
+
+      for (size_t i = 0; i < messages; ++i) {
+        uint16_t deviceId;
+        uint8_t groupId;
+        const MiLightRemoteConfig* config;
+        const char* alias;
+
+        // Both match in place, as they would in the packet buffer
+        strcpy(topic, topics[timedTopics[i % timedTopics.size()]].c_str());
+
+        if (path == 0) {
+          legacyMatch(settings, topic, deviceId, groupId, config);
+        } else {
+          matcher.match(topic, deviceId, groupId, config, alias);
+        }
+        checksum += deviceId + groupId;
+      }
+
+      nanos[path] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      allocations[path] = heapAllocations - allocationsBefore;
+    }
+
+    // Keeps the loops from being optimized away
+    if (checksum == 0xFFFFFFFF) {
+      printf("\n");
+    }
+
+    printf("%s:\n", pattern);
+    printf("  mismatches:          %zu of %zu topics\n", mismatches, NUM_TOPICS);
+    printf("  msgs/sec:            legacy=%.0f matcher=%.0f\n", messages * 1e9 / nanos[0], messages * 1e9 / nanos[1]);
+    printf("  heap allocs/msg:     legacy=%.2f matcher=%.2f\n",
+      static_cast<double>(allocations[0]) / messages, static_cast<double>(allocations[1]) / messages);
+  }
+}
+
+// Measures the cost of each write through the nRF24 driver stack, for repeats
+// of one packet and for a new packet every write
+static void nrf24Writes(const Settings& settings, size_t writes) {
+  static const char* MODES[] = {"repeated", "changing"};
+  const MiLightRadioConfig& config = MiLightRadioConfig::ALL_CONFIGS[2];
+
+  for (size_t mode = 0; mode < 2; ++mode) {
+    RF24 rf24(0, 0);
+    NRF24MiLightRadio radio(rf24, config, settings.rf24Channels, settings.rf24ListenChannel);
+    radio.begin();
+
+    uint8_t packet[MILIGHT_MAX_PACKET_LENGTH] = {0x20, 0x31, 0x42, 0x53, 0x64, 0x75, 0x86, 0x97, 0xA8};
+    const RF24::Stats before = rf24.getStats();
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < writes; ++i) {
+      if (mode == 1) {
+        packet[config.packetLength - 1] = i;
+      }
+      radio.write(packet, config.packetLength);
+    }
+
+    const double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    const RF24::Stats& stats = rf24.getStats();
+
+    printf("%s packet:\n", MODES[mode]);
+    printf("  host ns/repeat:      %.1f\n", nanos / writes);
+    printf("  spi bytes/repeat:    %.1f\n", static_cast<double>(stats.spiBytes - before.spiBytes) / writes);
+    printf("  channel sets/repeat: %.2f\n", static_cast<double>(stats.channelChanges - before.channelChanges) / writes);
+    printf("  mode sets/repeat:    %.2f\n", static_cast<double>(stats.modeChanges - before.modeChanges) / writes);
+    printf("  frame hash:          %08x\n", stats.frameHash);
+  }
+}
+
+class Benchmark {
+public:
+  Benchmark(Settings& settings, uint32_t airtimeMicros)
+    : settings(settings)
+    , radioFactory(std::make_shared<SimulatedRadioFactory>(airtimeMicros))
+    , stateStore(MILIGHT_MAX_STATE_ITEMS, settings.stateFlushInterval)
+    , radios(radioFactory, &stateStore, settings)
+    , packetSender(radios, settings, [](uint8_t*, const MiLightRemoteConfig&) { })
+    , milightClient(radios, packetSender, &stateStore, settings, transitions)
+    , commands(0)
+    , maxStallMicros(0)
+  {
+    transitions.setDefaultPeriod(settings.defaultTransitionPeriod);
+
+    // Same as the transition listener in src/main.cpp
+    transitions.addBatchListener(
+      [this](const BulbId& bulbId, const Transition::Step* steps, size_t numSteps) {
+        LightCommand command;
+        for (size_t i = 0; i < numSteps; ++i) {
+          command.set(steps[i].field, steps[i].value);
+        }
+
+        if (!command.has(LightCommand::STATUS)) {
+          milightClient.setPriorityOverride(PacketPriority::BACKGROUND);
+        }
+
+        milightClient.apply(bulbId, command);
+        milightClient.clearPriorityOverride();
+      }
+    );
+
+    packetSender.onPacketLatency(
+      [this](const QueuedPacket&, uint32_t latencyMicros) {
+        latencies.push_back(latencyMicros);
+      }
+    );
+  }
+
+  void run(JsonArray script, bool blockOnQueue) {
+    for (JsonObject step : script) {
+      runFor(step["delay_ms"] | 0ul);
+
+      const unsigned long start = micros();
+      const MiLightRemoteType type = MiLightRemoteTypeHelpers::remoteTypeFromString(step["device_type"] | "rgb_cct");
+      PacketSender::TicketRange tickets;
+
+      // Same as MiLightHttpServer::recordRequestPackets and waitForPackets
+      milightClient.prepare(type, step["device_id"] | 1, step["group_id"] | 1);
+      if (blockOnQueue) {
+        packetSender.recordTickets(&tickets);
+        milightClient.setPriorityOverride(PacketPriority::INTERACTIVE);
+      }
+      milightClient.update(step["update"].as<JsonObject>());
+      packetSender.recordTickets(nullptr);
+      milightClient.clearPriorityOverride();
+
+      while (!packetSender.isSent(tickets)) {
+        packetSender.loop();
+      }
+
+      maxStallMicros = std::max(maxStallMicros, static_cast<uint32_t>(micros() - start));
+      ++commands;
+    }
+  }
+
+  // Runs until there are no queued packets or running transitions
+  void drain() {
+    while (packetSender.isSending() || transitions.getTransitions() != nullptr) {
+      step();
+    }
+  }
+
+  // Simulates remotes sending bursts at the configured rates while the
+  // schedulers listen, and reports the fraction of bursts that were heard.
+  // Mirrors handleListen() and initListenRadios() in src/main.cpp.
+  void listen(const BenchmarkOptions& options) {
+    struct Burst {
+      size_t source;
+      unsigned long endsAt;
+      std::vector<uint8_t> packet;
+      bool heard;
+    };
+
+    std::vector<Burst> active;
+
+    ListenScheduler::PacketHandler onPacket = [this, &active](uint8_t* packet, const MiLightRemoteConfig& remote) {
+      if (packetSender.isEcho(packet, remote.packetFormatter->getPacketLength())) {
+        return;
+      }
+
+      for (Burst& burst : active) {
+        if (memcmp(burst.packet.data(), packet, burst.packet.size()) == 0) {
+          burst.heard = true;
+        }
+      }
+    };
+
+    // Each physical radio hears the air independently
+    std::vector<std::shared_ptr<SimulatedRadioFactory>> receivers;
+    std::vector<std::shared_ptr<RadioSwitchboard>> listenRadios;
+    std::vector<std::shared_ptr<ListenScheduler>> schedulers;
+
+    for (size_t i = 0; i < options.listenRadios; ++i) {
+      std::shared_ptr<SimulatedRadioFactory> factory = std::make_shared<SimulatedRadioFactory>(options.airtimeMicros);
+      std::shared_ptr<RadioSwitchboard> listenRadio = std::make_shared<RadioSwitchboard>(factory, &stateStore, settings);
+
+      receivers.push_back(factory);
+      listenRadios.push_back(listenRadio);
+      schedulers.push_back(std::make_shared<ListenScheduler>(*listenRadio, onPacket, i, options.listenRadios));
+    }
+
+    if (schedulers.empty()) {
+      receivers.push_back(radioFactory);
+      schedulers.push_back(std::make_shared<ListenScheduler>(radios, onPacket));
+    }
+
+    const size_t numSources = options.listenSources.size();
+    std::vector<size_t> bursts(numSources, 0);
+    std::vector<size_t> heard(numSources, 0);
+    uint16_t deviceId = 0;
+
+    srand(1);
+
+    for (unsigned long ms = 0; ms < options.listenSeconds * 1000; ++ms) {
+      for (size_t i = 0; i < numSources; ++i) {
+        const ListenSource& source = options.listenSources[i];
+
+        if (rand() < source.burstsPerSecond / 1000.0 * RAND_MAX) {
+          PacketFormatter* formatter = source.remote->packetFormatter;
+          formatter->prepare(++deviceId, 1);
+          formatter->updateStatus(ON);
+
+          PacketStream& stream = formatter->buildPackets();
+          uint8_t* packet = stream.next();
+
+          active.push_back({i, millis() + options.burstMillis, std::vector<uint8_t>(packet, packet + formatter->getPacketLength()), false});
+          formatter->reset();
+          ++bursts[i];
+        }
+      }
+
+      // Commands from the hub itself, each for a different bulb so that none
+      // are coalesced
+      if (rand() < options.txRate / 1000.0 * RAND_MAX) {
+        milightClient.prepare(REMOTE_TYPE_RGB_CCT, 0x1000 + (++commands % 256), 1);
+        milightClient.updateBrightness(rand() % 100);
+      }
+
+      for (size_t loop = 0; loop < options.loopsPerMilli; ++loop) {
+        const unsigned long start = micros();
+
+        packetSender.loop();
+
+        // Radios only pick up bursts that are on the air for the config
+        // they're tuned to
+        for (const Burst& burst : active) {
+          const MiLightRemoteConfig* remote = options.listenSources[burst.source].remote;
+
+          if (millis() < burst.endsAt) {
+            for (const std::shared_ptr<SimulatedRadioFactory>& receiver : receivers) {
+              receiver->getRadio(remote->radioConfig)->receive(burst.packet.data(), burst.packet.size());
+            }
+          }
+        }
+
+        if (! listenRadios.empty() || ! packetSender.isSending()) {
+          for (const std::shared_ptr<ListenScheduler>& scheduler : schedulers) {
+            scheduler->listen(settings.listenRepeats);
+          }
+        }
+
+        if (micros() - start < 1000 / options.loopsPerMilli) {
+          advanceMicros(1000 / options.loopsPerMilli - (micros() - start));
+        }
+      }
+
+      for (auto it = active.begin(); it != active.end(); ) {
+        if (it->endsAt <= millis()) {
+          heard[it->source] += it->heard;
+          it = active.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    size_t totalBursts = 0;
+    size_t totalHeard = 0;
+
+    for (size_t i = 0; i < numSources; ++i) {
+      const MiLightRemoteConfig* remote = options.listenSources[i].remote;
+
+      printf("%-10s bursts=%-6zu heard=%-6zu capture=%.1f%%\n",
+        remote->name.c_str(),
+        bursts[i],
+        heard[i],
+        bursts[i] == 0 ? 0.0 : 100.0 * heard[i] / bursts[i]
+      );
+
+      totalBursts += bursts[i];
+      totalHeard += heard[i];
+    }
+
+    printf("capture rate:        %.1f%%\n", totalBursts == 0 ? 0.0 : 100.0 * totalHeard / totalBursts);
+    printf("hub commands:        %zu\n", commands);
+    printf("packets sent:        %zu\n", latencies.size());
+
+    for (size_t radioIx = 0; radioIx < schedulers.size(); ++radioIx) {
+      ListenScheduler& scheduler = *schedulers[radioIx];
+
+      for (size_t i = 0; i < scheduler.getNumConfigs(); ++i) {
+        printf("radio %zu config %zu: listens=%u hits=%u reconfigures=%u\n",
+          radioIx,
+          scheduler.getConfigIndex(i),
+          scheduler.getStats(i).listens,
+          scheduler.getStats(i).hits,
+          scheduler.getRadioSwitchboard().getReconfigureCount(scheduler.getConfigIndex(i))
+        );
+      }
+    }
+  }
+
+  // Measures how fast received packets are matched to a remote type
+  void decode(const BenchmarkOptions& options) {
+    struct Sample {
+      const MiLightRemoteConfig* remote;
+      std::vector<uint8_t> packet;
+    };
+
+    std::vector<Sample> samples;
+
+    if (!options.corpus.empty()) {
+      std::ifstream in(options.corpus);
+      std::string line;
+
+      while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string type;
+        unsigned int byte;
+
+        if (!(fields >> type) || type[0] == '#') {
+          continue;
+        }
+
+        Sample sample{MiLightRemoteConfig::fromType(MiLightRemoteTypeHelpers::remoteTypeFromName(type.c_str())), {}};
+        while (fields >> std::hex >> byte) {
+          sample.packet.push_back(byte);
+        }
+
+        if (sample.remote != nullptr && !sample.packet.empty()) {
+          samples.push_back(sample);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < MiLightRemoteConfig::NUM_REMOTES && options.corpus.empty(); ++i) {
+      const MiLightRemoteConfig* remote = MiLightRemoteConfig::ALL_REMOTES[i];
+      PacketFormatter* formatter = remote->packetFormatter;
+
+      for (uint8_t group = 1; group <= 4; ++group) {
+        formatter->prepare(0x1234, group);
+        formatter->updateStatus(ON);
+
+        PacketStream& stream = formatter->buildPackets();
+        while (stream.hasNext()) {
+          uint8_t* packet = stream.next();
+          samples.push_back({remote, std::vector<uint8_t>(packet, packet + formatter->getPacketLength())});
+        }
+
+        formatter->reset();
+      }
+    }
+
+    if (samples.empty()) {
+      fprintf(stderr, "No packets to decode\n");
+      return;
+    }
+
+    size_t mismatches = 0;
+    const std::clock_t cpuStart = std::clock();
+
+    uint8_t packet[MILIGHT_MAX_PACKET_LENGTH];
+
+    for (size_t i = 0; i < options.decodePackets; ++i) {
+      const Sample& sample = samples[i % samples.size()];
+
+      // Radios read into a fixed size buffer
+      memcpy(packet, sample.packet.data(), std::min(sample.packet.size(), sizeof(packet)));
+
+      const MiLightRemoteConfig* remote = MiLightRemoteConfig::fromReceivedPacket(
+        sample.remote->radioConfig,
+        packet,
+        sample.packet.size()
+      );
+
+      mismatches += remote != sample.remote;
+    }
+
+    const double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    printf("packets decoded:     %zu\n", options.decodePackets);
+    printf("host cpu time:       %.3f s\n", cpuSeconds);
+    printf("packets/sec:         %.0f\n", options.decodePackets / cpuSeconds);
+    printf("misclassified:       %zu\n", mismatches);
+  }
+
+  // Times building packets for a few commands through every formatter, with
+  // and without packet templates where the formatter supports them
+  void formatterThroughput(const BenchmarkOptions& options) {
+    typedef void (*Command)(PacketFormatter& formatter, uint8_t variant);
+
+    static const size_t NUM_KEYS = 16;
+    static const char* COMMAND_NAMES[] = {"status", "hue", "brightness"};
+    static const Command COMMANDS[] = {
+      [](PacketFormatter& formatter, uint8_t variant) { formatter.updateStatus(variant % 2 == 0 ? ON : OFF); },
+      [](PacketFormatter& formatter, uint8_t variant) { formatter.updateHue(variant * 90); },
+      [](PacketFormatter& formatter, uint8_t variant) { formatter.updateBrightness(variant * 25); }
+    };
+
+    // Builds the request for key into packets and returns the number built
+    auto build = [](PacketFormatter* formatter, Command command, size_t key, std::vector<uint8_t>& packets) {
+      formatter->prepare(0x1234, 1 + (key % 4));
+      command(*formatter, key / 4);
+
+      PacketStream& stream = formatter->buildPackets();
+      packets.clear();
+
+      while (stream.hasNext()) {
+        const uint8_t* packet = stream.next();
+        packets.insert(packets.end(), packet, packet + formatter->getPacketLength());
+      }
+
+      formatter->reset();
+      return stream.numPackets;
+    };
+
+    // Builds N requests, cycling through the keys, and returns the time taken
+    auto run = [&](PacketFormatter* formatter, Command command, size_t& totalPackets) {
+      std::vector<uint8_t> packets;
+      uint32_t checksum = 0;
+      auto start = std::chrono::steady_clock::now();
+
+      totalPackets = 0;
+
+      for (size_t i = 0; i < options.formatterRequests; ++i) {
+        totalPackets += build(formatter, command, i % NUM_KEYS, packets);
+        checksum += packets[0];
+      }
+
+      // Keeps the loop from being optimized away
+      if (checksum == 0xFFFFFFFF) {
+        printf("\n");
+      }
+
+      return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    printf("%-8s %-11s %9s %12s %15s %10s\n", "remote", "command", "packets", "fresh ns/pkt", "template ns/pkt", "mismatched");
+
+    for (size_t r = 0; r < MiLightRemoteConfig::NUM_REMOTES; ++r) {
+      const MiLightRemoteConfig* remote = MiLightRemoteConfig::ALL_REMOTES[r];
+      PacketFormatter* formatter = remote->packetFormatter;
+      const size_t length = formatter->getPacketLength();
+
+      for (size_t c = 0; c < sizeof(COMMANDS) / sizeof(COMMANDS[0]); ++c) {
+        std::vector<uint8_t> fresh;
+        std::vector<uint8_t> templated;
+        size_t mismatched = 0;
+        size_t totalPackets = 0;
+
+        formatter->setTemplatesEnabled(false);
+        build(formatter, COMMANDS[c], 0, fresh);
+
+        if (fresh.empty()) {
+          continue;
+        }
+
+        const double freshNanos = run(formatter, COMMANDS[c], totalPackets);
+        char templateColumn[16] = "-";
+        char mismatchedColumn[16] = "-";
+
+        if (formatter->supportsTemplates()) {
+          formatter->setTemplatesEnabled(true);
+
+          const double templateNanos = run(formatter, COMMANDS[c], totalPackets);
+
+          // Packets built from templates should only differ from fresh ones in
+          // their sequence number
+          for (size_t key = 0; key < NUM_KEYS; ++key) {
+            formatter->setTemplatesEnabled(false);
+            build(formatter, COMMANDS[c], key, fresh);
+            formatter->setTemplatesEnabled(true);
+            build(formatter, COMMANDS[c], key, templated);
+            build(formatter, COMMANDS[c], key, templated);
+
+            for (size_t offset = 0; offset < fresh.size(); offset += length) {
+              size_t differences = 0;
+
+              for (size_t i = offset; i < offset + length; ++i) {
+                differences += templated[i] != fresh[i];
+              }
+
+              mismatched += differences > 1;
+            }
+          }
+
+          snprintf(templateColumn, sizeof(templateColumn), "%.1f", templateNanos / totalPackets);
+          snprintf(mismatchedColumn, sizeof(mismatchedColumn), "%zu", mismatched);
+        }
+
+        formatter->setTemplatesEnabled(MILIGHT_PACKET_TEMPLATES);
+
+        printf(
+          "%-8s %-11s %9.1f %12.1f %15s %10s\n",
+          MiLightRemoteTypeHelpers::remoteTypeToString(remote->type).c_str(),
+          COMMAND_NAMES[c],
+          static_cast<double>(totalPackets) / options.formatterRequests,
+          freshNanos / totalPackets,
+          templateColumn,
+          mismatchedColumn
+        );
+      }
+    }
+  }
+
+  // Measures scheduling overhead with many transitions running at once
+  void transitionLoad(const BenchmarkOptions& options) {
+    TransitionController controller;
+    std::vector<uint32_t> lateness;
+    size_t steps = 0;
+
+    controller.addListener([&steps](const BulbId&, GroupStateField, uint16_t) { ++steps; });
+    controller.onStepLateness([&lateness](const Transition&, uint32_t latenessMs) { lateness.push_back(latenessMs); });
+
+    const size_t period = settings.defaultTransitionPeriod;
+
+    for (size_t i = 0; i < options.transitions; ++i) {
+      // Builders keep a reference to the BulbId until build()
+      const BulbId bulbId(0x2000 + i, 1, REMOTE_TYPE_RGB_CCT);
+      std::shared_ptr<Transition::Builder> builder = controller.buildFieldTransition(
+        bulbId,
+        GroupStateField::LEVEL,
+        0,
+        100
+      );
+      builder->setDuration(options.transitionSeconds);
+      builder->setPeriod(period);
+
+      controller.addTransition(builder->build());
+      advanceMicros(period * 1000 / options.transitions);
+    }
+
+    size_t loops = 0;
+    double loopNanos = 0;
+    double maxLoopNanos = 0;
+
+    while (controller.getTransitions() != nullptr) {
+      const auto start = std::chrono::steady_clock::now();
+      controller.loop();
+      const double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+      loopNanos += nanos;
+      maxLoopNanos = std::max(maxLoopNanos, nanos);
+      ++loops;
+
+      advanceMicros(1000 / options.loopsPerMilli);
+    }
+
+    std::sort(lateness.begin(), lateness.end());
+
+    printf("transitions:         %zu\n", options.transitions);
+    printf("steps:               %zu\n", steps);
+    printf("loops:               %zu\n", loops);
+    printf("loop cost (ns):      avg=%.0f max=%.0f\n", loopNanos / loops, maxLoopNanos);
+    printf("step lateness (ms):  p50=%u p99=%u max=%u\n",
+      percentile(lateness, 0.50),
+      percentile(lateness, 0.99),
+      lateness.empty() ? 0 : lateness.back()
+    );
+  }
+
+  // Compares the JSON and LightCommand paths through MiLightClient
+  void commandThroughput(const BenchmarkOptions& options) {
+    static const char PAYLOAD[] = "{\"status\":\"ON\",\"hue\":120,\"saturation\":80,\"level\":50}";
+
+    // Same capacity as MqttClient uses for command payloads
+    typedef StaticJsonDocument<400> CommandDocument;
+
+    LightCommand command;
+    command.setStatus(ON).setHue(120).setSaturation(80).setLevel(50);
+
+    double jsonNanos = 0;
+    double typedNanos = 0;
+
+    for (size_t i = 0; i < options.commandCount; ++i) {
+      const BulbId bulbId(0x3000 + (i % 256), 1, REMOTE_TYPE_RGB_CCT);
+
+      auto start = std::chrono::steady_clock::now();
+      {
+        CommandDocument buffer;
+        deserializeJson(buffer, PAYLOAD);
+        milightClient.prepare(bulbId.deviceType, bulbId.deviceId, bulbId.groupId);
+        milightClient.update(buffer.as<JsonObject>());
+      }
+      jsonNanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      drain();
+
+      start = std::chrono::steady_clock::now();
+      milightClient.apply(bulbId, command);
+      typedNanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      drain();
+    }
+
+    printf("commands:            %zu per path\n", options.commandCount);
+    printf("json (ns/command):   %.0f\n", jsonNanos / options.commandCount);
+    printf("typed (ns/command):  %.0f\n", typedNanos / options.commandCount);
+    printf("request size (B):    json=%zu typed=%zu\n", sizeof(CommandDocument), sizeof(LightCommand));
+  }
+
+  // Publishes state updates through BulbStateUpdater, and again the way it
+  // used to: serialized into a buffer, with the topic bound into a String
+  void statePublishes(const BenchmarkOptions& options) {
+    static const size_t NUM_BULBS = 64;
+    static const char* PATHS[] = {"streamed", "buffered"};
+
+    settings._mqttServer = "broker.local";
+    settings.mqttStateDeltaTopicPattern = "";
+    settings.mqttStateRateLimit = 0;
+    settings.mqttDebounceDelay = 0;
+
+    MiLightClient* client = &milightClient;
+    MqttClient mqttClient(settings, client);
+    BulbStateUpdater updater(settings, mqttClient, stateStore);
+
+    mqttClient.onConnect([]() { });
+    mqttClient.begin();
+    mqttClient.handleClient();
+
+    for (size_t path = 0; path < 2; ++path) {
+      const MqttClient::PublishStats clientBefore = mqttClient.getStatePublishStats();
+      size_t bufferedBytes = 0;
+      size_t allocations = 0;
+      double nanos = 0;
+
+      MqttBroker.resetStats();
+
+      for (size_t i = 0; i < options.mqttPublishes; ++i) {
+        const BulbId bulbId(0x6000 + (i % NUM_BULBS) / 4, 1 + (i % 4), REMOTE_TYPE_RGB_CCT);
+        GroupState* state = stateStore.get(bulbId);
+
+        state->setState(ON);
+        state->setBrightness(i % 101);
+        state->setHue((i * 7) % 360);
+
+        const size_t allocationsBefore = heapAllocations;
+        const auto start = std::chrono::steady_clock::now();
+
+        if (path == 0) {
+          updater.enqueueUpdate(bulbId, *state);
+          // Rate limit and debounce are 0, but a flush still needs the clock to
+          // move past the enqueue
+          advanceMicros(1000);
+          updater.loop();
+        } else {
+          StaticJsonDocument<MILIGHT_MQTT_JSON_BUFFER_SIZE> json;
+          JsonObject message = json.to<JsonObject>();
+          state->applyState(message, bulbId, settings.groupStateFields);
+
+          char buffer[MILIGHT_MQTT_JSON_BUFFER_SIZE];
+          bufferedBytes += serializeJson(json, buffer);
+
+          mqttClient.sendState(*MiLightRemoteConfig::fromType(bulbId.deviceType), bulbId.deviceId, bulbId.groupId, buffer);
+          state->clearMqttDirty();
+        }
+
+        nanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        allocations += heapAllocations - allocationsBefore;
+      }
+
+      const LoopbackMqttBroker::Stats& broker = MqttBroker.getStats();
+      const size_t copiedBytes = broker.copiedBytes + bufferedBytes
+        + mqttClient.getStatePublishStats().copiedBytes - clientBefore.copiedBytes;
+
+      printf("%s:\n", PATHS[path]);
+      printf("  ns/publish:          %.0f\n", nanos / options.mqttPublishes);
+      printf("  broker publishes:    %u (%u malformed)\n", broker.publishes, broker.malformed);
+      printf("  payload bytes/pub:   %.1f\n", static_cast<double>(broker.payloadBytes) / options.mqttPublishes);
+      printf("  copied bytes/pub:    %.1f\n", static_cast<double>(copiedBytes) / options.mqttPublishes);
+      printf("  heap allocs/pub:     %.2f\n", static_cast<double>(allocations) / options.mqttPublishes);
+    }
+  }
+
+  // Sends batches that set every group of a few device IDs to the same state,
+  // optionally collapsing them with GroupCommandPlanner.  Returns the packets
+  // the planner saved.
+  size_t groupBatches(const BenchmarkOptions& options, bool plan) {
+    static const MiLightRemoteType TYPES[] = {REMOTE_TYPE_RGB_CCT, REMOTE_TYPE_FUT089, REMOTE_TYPE_RGBW};
+
+    GroupCommandPlanner planner;
+    size_t packetsSaved = 0;
+
+    auto send = [this](const BulbId& bulbId, const LightCommand& command) {
+      const uint32_t enqueuedBefore = packetSender.enqueuedPackets();
+      milightClient.apply(bulbId, command);
+      ++commands;
+      return static_cast<size_t>(packetSender.enqueuedPackets() - enqueuedBefore);
+    };
+
+    for (size_t batch = 0; batch < options.groupBatches; ++batch) {
+      LightCommand command;
+      command.setStatus(ON).setLevel(batch % 100);
+
+      for (MiLightRemoteType type : TYPES) {
+        const MiLightRemoteConfig* remote = MiLightRemoteConfig::fromType(type);
+
+        for (uint8_t group = 1; group <= remote->numGroups; ++group) {
+          const BulbId bulbId(0x5000, group, type);
+
+          if (plan) {
+            planner.add(bulbId, command);
+          } else {
+            send(bulbId, command);
+          }
+        }
+      }
+
+      if (plan) {
+        packetsSaved += planner.run(
+          [&send](const BulbId& bulbId, const LightCommand& command, JsonObject) { return send(bulbId, command); }
+        ).packetsSaved;
+      }
+
+      drain();
+    }
+
+    return packetsSaved;
+  }
+
+  // Compares sending a batch update the way the batch endpoint does with
+  // activating the same updates compiled as a scene
+  void sceneActivation(const BenchmarkOptions& options) {
+    static const char UPDATES[] =
+      "["
+        "{\"gateways\":["
+          "{\"device_id\":1,\"device_type\":\"rgb_cct\",\"group_id\":1},"
+          "{\"device_id\":1,\"device_type\":\"rgb_cct\",\"group_id\":2},"
+          "{\"device_id\":1,\"device_type\":\"rgb_cct\",\"group_id\":3},"
+          "{\"device_id\":1,\"device_type\":\"rgb_cct\",\"group_id\":4}"
+        "],\"update\":{\"status\":\"ON\",\"hue\":200,\"saturation\":70,\"level\":60}},"
+        "{\"gateways\":["
+          "{\"device_id\":2,\"device_type\":\"fut089\",\"group_id\":1},"
+          "{\"device_id\":2,\"device_type\":\"fut089\",\"group_id\":2}"
+        "],\"update\":{\"status\":\"ON\",\"kelvin\":40,\"level\":80}},"
+        "{\"gateways\":["
+          "{\"device_id\":3,\"device_type\":\"cct\",\"group_id\":1}"
+        "],\"update\":{\"status\":\"ON\",\"kelvin\":40,\"level\":60}}"
+      "]";
+
+    SceneStore scenes(milightClient, packetSender, stateStore, ProjectFS, "/bench_scenes.bin");
+    {
+      DynamicJsonDocument buffer(2048);
+      deserializeJson(buffer, UPDATES);
+
+      const SceneStore::Status status = scenes.define("bench", buffer.as<JsonArray>());
+      if (status != SceneStore::Status::OK) {
+        printf("couldn't define scene: %s\n", reinterpret_cast<const char*>(SceneStore::statusMessage(status)));
+        return;
+      }
+    }
+
+    double batchNanos = 0;
+    double sceneNanos = 0;
+    uint32_t batchPackets = 0;
+    uint32_t scenePackets = 0;
+    size_t batchDropped = 0;
+    size_t sceneDropped = 0;
+
+    for (size_t i = 0; i < options.sceneActivations; ++i) {
+      uint32_t enqueuedBefore = packetSender.enqueuedPackets();
+      size_t droppedBefore = packetSender.droppedPackets();
+
+      auto start = std::chrono::steady_clock::now();
+      {
+        DynamicJsonDocument buffer(2048);
+        deserializeJson(buffer, UPDATES);
+
+        GroupCommandPlanner planner;
+        for (JsonObject update : buffer.as<JsonArray>()) {
+          JsonObject stateUpdate = update[F("update")];
+          const LightCommand command = LightCommand::fromJson(stateUpdate);
+
+          for (JsonObject gateway : update[F("gateways")].as<JsonArray>()) {
+            planner.add(
+              BulbId(
+                gateway[F("device_id")],
+                gateway[F("group_id")],
+                MiLightRemoteTypeHelpers::remoteTypeFromString(gateway[F("device_type")].as<const char*>())
+              ),
+              command,
+              stateUpdate
+            );
+          }
+        }
+
+        planner.run(
+          [this](const BulbId& bulbId, const LightCommand& command, JsonObject stateUpdate) {
+            const uint32_t before = packetSender.enqueuedPackets();
+            milightClient.prepare(bulbId.deviceType, bulbId.deviceId, bulbId.groupId);
+            milightClient.update(command, stateUpdate);
+            return static_cast<size_t>(packetSender.enqueuedPackets() - before);
+          }
+        );
+      }
+      batchNanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      batchPackets += packetSender.enqueuedPackets() - enqueuedBefore;
+      batchDropped += packetSender.droppedPackets() - droppedBefore;
+      drain();
+
+      enqueuedBefore = packetSender.enqueuedPackets();
+      droppedBefore = packetSender.droppedPackets();
+
+      start = std::chrono::steady_clock::now();
+      scenes.activate("bench");
+      sceneNanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+      // Packets that didn't fit are queued as the queue drains
+      while (scenes.isActivating() || packetSender.isSending()) {
+        step();
+
+        start = std::chrono::steady_clock::now();
+        scenes.loop();
+        sceneNanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      }
+
+      scenePackets += packetSender.enqueuedPackets() - enqueuedBefore;
+      sceneDropped += packetSender.droppedPackets() - droppedBefore;
+    }
+
+    printf("activations:         %zu per path\n", options.sceneActivations);
+    printf("batch (ns/activation): %.0f\n", batchNanos / options.sceneActivations);
+    printf("scene (ns/activation): %.0f\n", sceneNanos / options.sceneActivations);
+    printf("packets/activation:  batch=%.1f scene=%.1f\n",
+      static_cast<double>(batchPackets) / options.sceneActivations,
+      static_cast<double>(scenePackets) / options.sceneActivations
+    );
+    printf("dropped packets:     batch=%zu scene=%zu\n", batchDropped, sceneDropped);
+  }
+
+  void report(unsigned long simulatedMicros, double cpuSeconds) {
+    const SimulatedMiLightRadio::Stats& radioStats = radioFactory->getStats();
+    const double simulatedSeconds = simulatedMicros / 1e6;
+
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("commands:            %zu\n", commands);
+    printf("simulated time:      %.3f s\n", simulatedSeconds);
+    printf("host cpu time:       %.3f s\n", cpuSeconds);
+    printf("commands/sec:        %.1f\n", commands / simulatedSeconds);
+    printf("radio writes:        %u\n", radioStats.writes);
+    printf("radio writes/sec:    %.1f\n", radioStats.writes / simulatedSeconds);
+
+    uint32_t reconfigures = 0;
+    for (size_t i = 0; i < radios.getNumRadios(); ++i) {
+      reconfigures += radios.getReconfigureCount(i);
+    }
+    printf("radio reconfigures:  %u\n", reconfigures);
+    printf("airtime utilization: %.1f%%\n", 100.0 * radioStats.airtimeMicros / simulatedMicros);
+    printf("packets sent:        %zu\n", latencies.size());
+    printf("dropped packets:     %zu\n", packetSender.droppedPackets());
+    printf("coalesced packets:   %zu\n", packetSender.coalescedPackets());
+    printf("queue latency (ms):  p50=%.1f p90=%.1f p99=%.1f max=%.1f\n",
+      percentile(latencies, 0.50) / 1000.0,
+      percentile(latencies, 0.90) / 1000.0,
+      percentile(latencies, 0.99) / 1000.0,
+      (latencies.empty() ? 0 : latencies.back()) / 1000.0
+    );
+    printf("max loop stall (ms): %.1f\n", maxStallMicros / 1000.0);
+
+    const uint32_t* firstSend = packetSender.firstSendHistogram();
+    printf("first send (ms):    ");
+    for (size_t i = 0; i < PacketSender::NUM_FIRST_SEND_BUCKETS; ++i) {
+      if (i < PacketSender::NUM_FIRST_SEND_BUCKETS - 1) {
+        printf(" <%u=%u", PacketSender::FIRST_SEND_BUCKET_MS[i], firstSend[i]);
+      } else {
+        printf(" more=%u", firstSend[i]);
+      }
+    }
+    printf("\n");
+  }
+
+private:
+  Settings& settings;
+  std::shared_ptr<SimulatedRadioFactory> radioFactory;
+  GroupStateStore stateStore;
+  RadioSwitchboard radios;
+  PacketSender packetSender;
+  TransitionController transitions;
+  MiLightClient milightClient;
+
+  size_t commands;
+  std::vector<uint32_t> latencies;
+  // Longest a single PacketSender::loop() or script step held up the main loop
+  uint32_t maxStallMicros;
+
+  void step() {
+    const unsigned long start = micros();
+
+    packetSender.loop();
+    maxStallMicros = std::max(maxStallMicros, static_cast<uint32_t>(micros() - start));
+    transitions.loop();
+    stateStore.limitedFlush();
+
+    // Nothing was sent (sends advance the clock by the radio airtime).  Skip
+    // ahead rather than spinning on the host clock.
+    if (micros() - start < 1000) {
+      advanceMicros(1000 - (micros() - start));
+    }
+  }
+
+  void runFor(unsigned long ms) {
+    const unsigned long start = millis();
+
+    while (millis() - start < ms) {
+      step();
+    }
+  }
+};
+
+int main(int argc, char** argv) {
+  BenchmarkOptions options;
+
+  if (!parseOptions(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  Settings settings;
+
+  if (options.settingsJson.length() > 0) {
+    DynamicJsonDocument settingsDoc(4096);
+    DeserializationError error = deserializeJson(settingsDoc, options.settingsJson.c_str());
+
+    if (error) {
+      fprintf(stderr, "Invalid --settings JSON: %s\n", error.c_str());
+      return 1;
+    }
+
+    settings.patch(settingsDoc.as<JsonObject>());
+  }
+
+  if (options.nrf24Writes > 0) {
+    nrf24Writes(settings, options.nrf24Writes);
+    return 0;
+  }
+
+  if (options.cacheLookups > 0) {
+    cacheLookups(options.cacheLookups);
+    return 0;
+  }
+
+  if (options.persistenceUpdates > 0) {
+    persistenceWrites(options.persistenceUpdates);
+    return 0;
+  }
+
+  if (options.topicMatches > 0) {
+    topicMatching(options.topicMatches);
+    return 0;
+  }
+
+  if (options.groupBatches > 0) {
+    for (bool plan : {false, true}) {
+      Benchmark benchmark(settings, options.airtimeMicros);
+      const unsigned long simulatedStart = micros();
+      const std::clock_t cpuStart = std::clock();
+
+      const size_t packetsSaved = benchmark.groupBatches(options, plan);
+
+      printf("%s:\n", plan ? "planned" : "per group");
+      benchmark.report(micros() - simulatedStart, static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC);
+      printf("packets saved:       %zu\n", packetsSaved);
+    }
+
+    return 0;
+  }
+
+  DynamicJsonDocument scriptDoc(SCRIPT_BUFFER_SIZE);
+  Benchmark benchmark(settings, options.airtimeMicros);
+
+  if (options.sceneActivations > 0) {
+    benchmark.sceneActivation(options);
+    return 0;
+  }
+
+  if (!options.listenSources.empty()) {
+    benchmark.listen(options);
+    return 0;
+  }
+
+  if (options.decodePackets > 0) {
+    benchmark.decode(options);
+    return 0;
+  }
+
+  if (options.formatterRequests > 0) {
+    benchmark.formatterThroughput(options);
+    return 0;
+  }
+
+  if (options.transitions > 0) {
+    benchmark.transitionLoad(options);
+    return 0;
+  }
+
+  if (options.commandCount > 0) {
+    benchmark.commandThroughput(options);
+    return 0;
+  }
+
+  if (options.mqttPublishes > 0) {
+    benchmark.statePublishes(options);
+    return 0;
+  }
+
+  const unsigned long simulatedStart = micros();
+  const std::clock_t cpuStart = std::clock();
+
+  for (size_t i = 0; i < options.iterations; ++i) {
+    for (const std::string& path : options.scripts) {
+      std::string contents;
+
+      if (!readFile(path, contents)) {
+        fprintf(stderr, "Unable to read script: %s\n", path.c_str());
+        return 1;
+      }
+
+      DeserializationError error = deserializeJson(scriptDoc, contents);
+
+      if (error || !scriptDoc.is<JsonArray>()) {
+        fprintf(stderr, "Invalid script %s: %s\n", path.c_str(), error ? error.c_str() : "expected an array");
+        return 1;
+      }
+
+      benchmark.run(scriptDoc.as<JsonArray>(), options.blockOnQueue);
+    }
+  }
+
+  benchmark.drain();
+
+  const unsigned long simulatedMicros = micros() - simulatedStart;
+  const double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+  benchmark.report(simulatedMicros, cpuSeconds);
+
+  return 0;
+}
@@ -6,10 +6,20 @@
 #include <GroupState.h>
 #include <GroupStateStore.h>
 #include <GroupStateCache.h>
+#include <StaleGroupSet.h>
 #include <GroupStatePersistence.h>
 
 #include <RgbCctPacketFormatter.h>
 #include <FUT091PacketFormatter.h>
+#include <CctPacketFormatter.h>
+#include <FUT089PacketFormatter.h>
+#include <PacketTemplateCache.h>
+#include <PacketQueue.h>
+#include <RepeatCalibrator.h>
+#include <LightCommand.h>
+#include <GroupCommandPlanner.h>
+#include <MiLightRemoteConfig.h>
+#include <V2RFEncoding.h>
 #include <Units.h>
 
 #include "unity.h"
@@ -103,6 +113,518 @@ void test_fut091_packet_formatter() {
   );
 }
 
+void test_stateless_packet_formatting() {
+  GroupStateStore stateStore(10, 0);
+  Settings settings;
+  CctPacketFormatter cctFormatter;
+  cctFormatter.initialize(&stateStore, &settings);
+
+  GroupState known;
+  known.setBrightness(30);
+  stateStore.set(BulbId(1, 1, REMOTE_TYPE_CCT), known);
+
+  cctFormatter.prepare(1, 1);
+  cctFormatter.updateBrightness(50);
+  TEST_ASSERT_EQUAL_MESSAGE(2, cctFormatter.buildPackets().numPackets, "Should step from the known brightness");
+  cctFormatter.reset();
+
+  cctFormatter.setStateless(true);
+  cctFormatter.prepare(1, 1);
+  cctFormatter.updateBrightness(50);
+  TEST_ASSERT_EQUAL_MESSAGE(CCT_INTERVALS + 5, cctFormatter.buildPackets().numPackets, "Should drive to the minimum first");
+  cctFormatter.reset();
+  cctFormatter.setStateless(false);
+
+  // Kelvin and saturation share a command, so switch to white mode first
+  FUT089PacketFormatter fut089Formatter;
+  fut089Formatter.initialize(&stateStore, &settings);
+  fut089Formatter.setStateless(true);
+  fut089Formatter.prepare(1, 1);
+  fut089Formatter.updateTemperature(50);
+  TEST_ASSERT_EQUAL(2, fut089Formatter.buildPackets().numPackets);
+  fut089Formatter.reset();
+
+  // Only a hue can switch to color mode, so saturation needs one first
+  fut089Formatter.prepare(1, 1);
+  fut089Formatter.updateSaturation(50);
+  TEST_ASSERT_EQUAL_MESSAGE(0, fut089Formatter.buildPackets().numPackets, "Shouldn't send saturation without a hue");
+  fut089Formatter.reset();
+
+  fut089Formatter.updateHue(100);
+  fut089Formatter.buildPackets();
+  fut089Formatter.reset();
+  fut089Formatter.updateSaturation(50);
+  TEST_ASSERT_EQUAL_MESSAGE(1, fut089Formatter.buildPackets().numPackets, "Should send saturation after a hue");
+  fut089Formatter.reset();
+
+  fut089Formatter.updateColorWhite();
+  fut089Formatter.buildPackets();
+  fut089Formatter.reset();
+  fut089Formatter.updateSaturation(50);
+  TEST_ASSERT_EQUAL_MESSAGE(0, fut089Formatter.buildPackets().numPackets, "Shouldn't send saturation after switching to white");
+  fut089Formatter.reset();
+  fut089Formatter.setStateless(false);
+}
+
+// Stamping a packet should give the same bytes as building it with the next
+// sequence number
+void test_packet_sequence_stamping() {
+  for (size_t i = 0; i < MiLightRemoteConfig::NUM_REMOTES; ++i) {
+    const MiLightRemoteConfig* remote = MiLightRemoteConfig::ALL_REMOTES[i];
+    PacketFormatter* formatter = remote->packetFormatter;
+    const size_t length = formatter->getPacketLength();
+    uint8_t original[MILIGHT_MAX_PACKET_LENGTH];
+    uint8_t stamped[MILIGHT_MAX_PACKET_LENGTH];
+    uint8_t scratch[MILIGHT_MAX_PACKET_LENGTH];
+
+    formatter->prepare(0x1234, 1);
+    formatter->updateStatus(ON, 1);
+    memcpy(original, formatter->buildPackets().next(), length);
+    formatter->reset();
+
+    memcpy(stamped, original, length);
+    formatter->stampSequenceNum(stamped);
+    TEST_ASSERT_FALSE_MESSAGE(memcmp(original, stamped, length) == 0, "Stamping should change the packet");
+
+    // Wind the sequence number round to the one the stamp used
+    memcpy(scratch, original, length);
+    for (size_t j = 0; j < 255; ++j) {
+      formatter->stampSequenceNum(scratch);
+    }
+
+    formatter->prepare(0x1234, 1);
+    formatter->updateStatus(ON, 1);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(formatter->buildPackets().next(), stamped, length, remote->name.c_str());
+    formatter->reset();
+  }
+}
+
+// Commands for test_packet_templates.  Hue and brightness run the same command
+// with different values, and mode/hue/brightness write to the packet after it.
+static const size_t NUM_TEMPLATE_OPS = 9;
+
+static void runTemplateOp(PacketFormatter* formatter, size_t op) {
+  switch (op) {
+    case 0: formatter->updateStatus(ON, 1); break;
+    case 1: formatter->updateStatus(OFF, 1); break;
+    case 2: formatter->updateHue(0); break;
+    case 3: formatter->updateHue(180); break;
+    case 4: formatter->updateBrightness(20); break;
+    case 5: formatter->updateBrightness(80); break;
+    case 6: formatter->updateColorWhite(); break;
+    case 7: formatter->updateMode(3); break;
+    case 8:
+      formatter->setHeld(true);
+      formatter->increaseBrightness();
+      break;
+  }
+}
+
+// Copies the packets built for op into packets and returns how many there were
+static size_t buildTemplateOp(PacketFormatter* formatter, uint16_t deviceId, size_t op, uint8_t* packets) {
+  const size_t length = formatter->getPacketLength();
+  size_t numPackets = 0;
+
+  formatter->prepare(deviceId, 1);
+  runTemplateOp(formatter, op);
+
+  PacketStream& stream = formatter->buildPackets();
+  while (stream.hasNext()) {
+    memcpy(packets + (numPackets++ * length), stream.next(), length);
+  }
+
+  formatter->reset();
+  return numPackets;
+}
+
+// Packets built from templates should match freshly formatted ones, apart from
+// the sequence number, which should carry on from the fresh packets.
+void test_packet_templates() {
+  const uint16_t deviceIds[] = { 0x1234, 0x4321 };
+
+  for (size_t i = 0; i < MiLightRemoteConfig::NUM_REMOTES; ++i) {
+    const MiLightRemoteConfig* remote = MiLightRemoteConfig::ALL_REMOTES[i];
+    PacketFormatter* formatter = remote->packetFormatter;
+    const size_t length = formatter->getPacketLength();
+    uint8_t fresh[PACKET_FORMATTER_BUFFER_SIZE];
+    uint8_t templated[PACKET_FORMATTER_BUFFER_SIZE];
+
+    // Only packets without a checksum or a scrambled sequence number can be
+    // reused as they are
+    size_t sequenceIndex;
+    switch (remote->type) {
+      case REMOTE_TYPE_FUT020:
+      case REMOTE_TYPE_RGB:
+        sequenceIndex = 5;
+        break;
+      case REMOTE_TYPE_RGBW:
+        sequenceIndex = 6;
+        break;
+      default:
+        TEST_ASSERT_FALSE_MESSAGE(formatter->supportsTemplates(), remote->name.c_str());
+        continue;
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(formatter->supportsTemplates(), remote->name.c_str());
+
+    // Steps from the bottom for brightness instead of looking up a state
+    formatter->setStateless(true);
+
+    // The first templated build saves the packets, the second reuses them
+    for (size_t pass = 0; pass < 2; ++pass) {
+      for (size_t d = 0; d < 2; ++d) {
+        for (size_t op = 0; op < NUM_TEMPLATE_OPS; ++op) {
+          formatter->setTemplatesEnabled(false);
+          const size_t numFresh = buildTemplateOp(formatter, deviceIds[d], op, fresh);
+          formatter->setTemplatesEnabled(true);
+          const size_t numTemplated = buildTemplateOp(formatter, deviceIds[d], op, templated);
+
+          TEST_ASSERT_EQUAL_MESSAGE(numFresh, numTemplated, remote->name.c_str());
+
+          for (size_t p = 0; p < numFresh; ++p) {
+            uint8_t* expected = fresh + (p * length);
+            uint8_t* actual = templated + (p * length);
+
+            TEST_ASSERT_EQUAL_HEX8_MESSAGE(static_cast<uint8_t>(expected[sequenceIndex] + numFresh), actual[sequenceIndex], remote->name.c_str());
+
+            expected[sequenceIndex] = actual[sequenceIndex];
+            TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected, actual, length, remote->name.c_str());
+          }
+        }
+      }
+    }
+
+    formatter->setTemplatesEnabled(MILIGHT_PACKET_TEMPLATES);
+    formatter->setStateless(false);
+  }
+}
+
+// Templates are kept in most recently used order
+void test_packet_template_cache() {
+  PacketTemplateCache cache(6);
+  uint8_t packet[6] = { 0 };
+
+  for (size_t i = 0; i < MILIGHT_PACKET_TEMPLATE_SLOTS; ++i) {
+    packet[0] = i;
+    cache.set(PacketTemplateCache::keyOf(0x1234, 1, static_cast<uint8_t>(i), 0, false), packet);
+  }
+
+  TEST_ASSERT_EQUAL(MILIGHT_PACKET_TEMPLATE_SLOTS, cache.size());
+
+  // Touch the oldest, so the second oldest is evicted next
+  const uint8_t* oldest = cache.get(PacketTemplateCache::keyOf(0x1234, 1, 0, 0, false));
+  TEST_ASSERT_NOT_NULL(oldest);
+  TEST_ASSERT_EQUAL(0, oldest[0]);
+
+  packet[0] = 0xFF;
+  cache.set(PacketTemplateCache::keyOf(0x1234, 1, 0xFF, 0, false), packet);
+
+  TEST_ASSERT_EQUAL(MILIGHT_PACKET_TEMPLATE_SLOTS, cache.size());
+  TEST_ASSERT_NULL(cache.get(PacketTemplateCache::keyOf(0x1234, 1, 1, 0, false)));
+  TEST_ASSERT_NOT_NULL(cache.get(PacketTemplateCache::keyOf(0x1234, 1, 0, 0, false)));
+  TEST_ASSERT_NULL(cache.get(PacketTemplateCache::keyOf(0x1234, 1, 2, 0, true)));
+  TEST_ASSERT_EQUAL(0xFF, cache.get(PacketTemplateCache::keyOf(0x1234, 1, 0xFF, 0, false))[0]);
+}
+
+//================================================================================
+// V2 RF encoding
+//================================================================================
+
+// Previous implementation of V2RFEncoding, computing the key and offsets for
+// every byte.  The table-driven version should match it exactly.
+namespace ReferenceV2Encoding {
+  const uint8_t OFFSETS[][4] = {
+    { 0x45, 0x1F, 0x14, 0x5C },
+    { 0x2B, 0xC9, 0xE3, 0x11 },
+    { 0x6D, 0x5F, 0x8A, 0x2B },
+    { 0xAF, 0x03, 0x1D, 0xF3 },
+    { 0x1A, 0xE2, 0xF0, 0xD1 },
+    { 0x04, 0xD8, 0x71, 0x42 },
+    { 0xAF, 0x04, 0xDD, 0x07 },
+    { 0x61, 0x13, 0x38, 0x64 }
+  };
+
+  uint8_t offset(size_t byte, uint8_t key, uint8_t jumpStart) {
+    return OFFSETS[byte - 1][key % 4] + ((jumpStart > 0 && key >= jumpStart && key < jumpStart + 0x80) ? 0x80 : 0);
+  }
+
+  uint8_t xorKey(uint8_t key) {
+    const uint8_t shift = (key & 0x0F) < 0x04 ? 0 : 1;
+    const uint8_t x = (((key & 0xF0) >> 4) + shift + 6) % 8;
+    const uint8_t msn = (((4 + x) ^ 1) & 0x0F) << 4;
+    const uint8_t lsn = ((((key & 0xF) + 4)^2) & 0x0F);
+
+    return ( msn | lsn );
+  }
+
+  void decode(uint8_t* packet) {
+    uint8_t key = xorKey(packet[0]);
+
+    for (size_t i = 1; i <= 8; i++) {
+      packet[i] = V2RFEncoding::decodeByte(packet[i], 0, key, offset(i, packet[0], V2_OFFSET_JUMP_START));
+    }
+  }
+
+  void encode(uint8_t* packet) {
+    uint8_t key = xorKey(packet[0]);
+    uint8_t sum = key;
+
+    for (size_t i = 1; i <= 7; i++) {
+      sum += packet[i];
+      packet[i] = V2RFEncoding::encodeByte(packet[i], 0, key, offset(i, packet[0], V2_OFFSET_JUMP_START));
+    }
+
+    packet[8] = V2RFEncoding::encodeByte(sum, 2, key, offset(8, packet[0], 0));
+  }
+}
+
+void test_v2_encoding_tables() {
+  uint8_t packet[V2_PACKET_LEN];
+  uint8_t expected[V2_PACKET_LEN];
+
+  for (size_t key = 0; key < 256; ++key) {
+    TEST_ASSERT_EQUAL_HEX8_MESSAGE(ReferenceV2Encoding::xorKey(key), V2RFEncoding::xorKey(key), "XOR key should match");
+
+    for (size_t seed = 0; seed < 16; ++seed) {
+      packet[0] = key;
+      for (size_t i = 1; i < V2_PACKET_LEN; ++i) {
+        packet[i] = (key * 31 + seed * 17 + i * 59) & 0xFF;
+      }
+
+      memcpy(expected, packet, V2_PACKET_LEN);
+      V2RFEncoding::decodeV2Packet(packet);
+      ReferenceV2Encoding::decode(expected);
+      TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected, packet, V2_PACKET_LEN, "Decoded packet should match");
+
+      memcpy(expected, packet, V2_PACKET_LEN);
+      V2RFEncoding::encodeV2Packet(packet);
+      ReferenceV2Encoding::encode(expected);
+      TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(expected, packet, V2_PACKET_LEN, "Encoded packet should match");
+    }
+  }
+}
+
+void test_received_packet_classification() {
+  uint8_t fut091Packet[] = {0x00, 0xDC, 0xE1, 0x24, 0x66, 0xCA, 0xBA, 0x66, 0xB5};
+  uint8_t fut092Packet[] = {0x00, 0xDB, 0xE1, 0x24, 0x66, 0xCA, 0x54, 0x66, 0xD2};
+
+  TEST_ASSERT_EQUAL_PTR_MESSAGE(
+    &FUT091Config,
+    MiLightRemoteConfig::fromReceivedPacket(FUT091Config.radioConfig, fut091Packet, sizeof(fut091Packet)),
+    "Should classify FUT091 packet"
+  );
+  TEST_ASSERT_EQUAL_PTR_MESSAGE(
+    &FUT092Config,
+    MiLightRemoteConfig::fromReceivedPacket(FUT092Config.radioConfig, fut092Packet, sizeof(fut092Packet)),
+    "Should classify FUT092 packet"
+  );
+}
+
+//================================================================================
+// Packet queue
+//================================================================================
+
+void test_packet_queue_coalescing() {
+  PacketQueue queue;
+  const MiLightRemoteConfig* remote = &FUT092Config;
+  uint8_t packet[MILIGHT_MAX_PACKET_LENGTH] = {0};
+
+  BulbId group1(1, 1, REMOTE_TYPE_RGB_CCT);
+  BulbId group2(1, 2, REMOTE_TYPE_RGB_CCT);
+
+  packet[0] = 1;
+  queue.push(packet, remote, 0, group1, PacketCommandClass::BRIGHTNESS);
+  const uint32_t firstSequence = queue.lastSequence();
+  packet[0] = 2;
+  queue.push(packet, remote, 0, group2, PacketCommandClass::BRIGHTNESS);
+
+  packet[0] = 3;
+  uint32_t sequence = 0;
+  TEST_ASSERT_TRUE_MESSAGE(
+    queue.coalesce(packet, remote, 0, group1, PacketCommandClass::BRIGHTNESS, PacketPriority::NORMAL, &sequence),
+    "Should replace queued brightness packet for the same group"
+  );
+  TEST_ASSERT_EQUAL_MESSAGE(firstSequence, sequence, "Replaced packet should keep its sequence");
+  TEST_ASSERT_EQUAL_INT(2, queue.size());
+  TEST_ASSERT_EQUAL_INT(1, queue.getCoalescedPacketCount());
+
+  TEST_ASSERT_FALSE_MESSAGE(
+    queue.coalesce(packet, remote, 0, group1, PacketCommandClass::HUE),
+    "Should not replace packets for a different command"
+  );
+
+  queue.push(packet, remote, 0, group1, PacketCommandClass::NONE);
+  TEST_ASSERT_FALSE_MESSAGE(
+    queue.coalesce(packet, remote, 0, group1, PacketCommandClass::BRIGHTNESS),
+    "Should not reorder around a status command for the same group"
+  );
+
+  PacketQueue::SlotId slot = queue.pop();
+  TEST_ASSERT_EQUAL_INT_MESSAGE(3, queue.get(slot).packet[0], "Replaced packet should keep its place in the queue");
+  queue.release(slot);
+}
+
+void test_packet_queue_priorities() {
+  PacketQueue queue;
+  const MiLightRemoteConfig* remote = &FUT092Config;
+  uint8_t packet[MILIGHT_MAX_PACKET_LENGTH] = {0};
+
+  BulbId bulb1(1, 1, REMOTE_TYPE_RGB_CCT);
+  BulbId bulb2(2, 1, REMOTE_TYPE_RGB_CCT);
+
+  packet[0] = 1;
+  queue.push(packet, remote, 0, bulb1, PacketCommandClass::HUE, PacketPriority::BACKGROUND);
+  packet[0] = 2;
+  queue.push(packet, remote, 0, bulb2, PacketCommandClass::HUE, PacketPriority::BACKGROUND);
+  packet[0] = 3;
+  queue.push(packet, remote, 0, bulb1, PacketCommandClass::NONE, PacketPriority::INTERACTIVE);
+
+  // Earlier packet for the same bulb is moved ahead of the interactive one,
+  // packets for other bulbs wait.
+  const uint8_t expected[] = {1, 3, 2};
+  for (size_t i = 0; i < sizeof(expected); ++i) {
+    PacketQueue::SlotId next = queue.peek();
+    PacketQueue::SlotId slot = queue.pop();
+    TEST_ASSERT_EQUAL_INT_MESSAGE(next, slot, "peek() should return the slot pop() takes");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(expected[i], queue.get(slot).packet[0], "Should send packets in priority order");
+    queue.release(slot);
+  }
+
+  TEST_ASSERT_EQUAL_INT(PacketQueue::NO_SLOT, queue.peek());
+}
+
+void test_packet_queue_tickets() {
+  PacketQueue queue;
+  const MiLightRemoteConfig* remote = &FUT092Config;
+  uint8_t packet[MILIGHT_MAX_PACKET_LENGTH] = {0};
+
+  queue.push(packet, remote, 0, BulbId(1, 1, REMOTE_TYPE_RGB_CCT));
+  const uint32_t ticket = queue.lastSequence();
+  queue.push(packet, remote, 0, BulbId(2, 1, REMOTE_TYPE_RGB_CCT));
+
+  TEST_ASSERT_TRUE_MESSAGE(queue.hasPacketsThrough(ticket), "Ticket's packet is still queued");
+
+  PacketQueue::SlotId slot = queue.pop();
+  queue.release(slot);
+
+  TEST_ASSERT_FALSE_MESSAGE(queue.hasPacketsThrough(ticket), "Packets queued after a ticket shouldn't hold it up");
+  TEST_ASSERT_TRUE(queue.hasPacketsThrough(queue.lastSequence()));
+
+  // An interactive packet goes first, so a range with just it is done while
+  // an earlier packet is still queued
+  const uint32_t before = queue.lastSequence();
+  queue.push(packet, remote, 0, BulbId(3, 1, REMOTE_TYPE_RGB_CCT), PacketCommandClass::NONE, PacketPriority::INTERACTIVE);
+  TEST_ASSERT_TRUE(queue.hasPacketsBetween(before + 1, queue.lastSequence()));
+
+  slot = queue.pop();
+  queue.release(slot);
+
+  TEST_ASSERT_FALSE_MESSAGE(queue.hasPacketsBetween(before + 1, queue.lastSequence()), "Earlier packets shouldn't hold up a range");
+  TEST_ASSERT_TRUE(queue.hasPacketsBetween(before, before));
+}
+
+void test_repeat_calibration_budget() {
+  // 1 - 0.5^7 > 0.99 > 1 - 0.5^6
+  TEST_ASSERT_EQUAL(7, RepeatCalibrator::repeatsForTarget(0.5, 0.99, 50));
+  TEST_ASSERT_EQUAL_MESSAGE(1, RepeatCalibrator::repeatsForTarget(1, 0.99, 50), "Every repeat heard needs one repeat");
+  TEST_ASSERT_EQUAL_MESSAGE(0, RepeatCalibrator::repeatsForTarget(0, 0.99, 50), "Nothing heard gives no recommendation");
+  TEST_ASSERT_EQUAL_MESSAGE(50, RepeatCalibrator::repeatsForTarget(0.01, 0.99, 50), "Should cap at the maximum");
+}
+
+//================================================================================
+// Light commands
+//================================================================================
+
+void test_light_command_parsing() {
+  StaticJsonDocument<256> doc;
+  deserializeJson(doc, "{\"state\":\"OFF\",\"status\":\"ON\",\"level\":20,\"hue\":180,\"effect\":\"night_mode\",\"transition\":2,\"foo\":1}");
+
+  LightCommand command = LightCommand::fromJson(doc.as<JsonObject>());
+
+  TEST_ASSERT_EQUAL_MESSAGE(
+    LightCommand::STATUS | LightCommand::LEVEL | LightCommand::HUE | LightCommand::NIGHT_MODE,
+    command.fields,
+    "Should only set the fields in the request"
+  );
+  TEST_ASSERT_EQUAL_MESSAGE(ON, command.status, "Status should take precedence over state");
+  TEST_ASSERT_EQUAL(20, command.level);
+  TEST_ASSERT_EQUAL(180, command.hue);
+  TEST_ASSERT_EQUAL_FLOAT(2, command.transition);
+
+  // Numeric effects set the mode
+  deserializeJson(doc, "{\"effect\":\"3\"}");
+  command = LightCommand::fromJson(doc.as<JsonObject>());
+
+  TEST_ASSERT_EQUAL(LightCommand::MODE, command.fields);
+  TEST_ASSERT_EQUAL(3, command.mode);
+
+  // A numeric effect takes precedence over mode, whatever the key order.  The
+  // JSON-only update() sent both, ending on the effect; this sends one packet.
+  deserializeJson(doc, "{\"effect\":\"3\",\"mode\":5}");
+  command = LightCommand::fromJson(doc.as<JsonObject>());
+  TEST_ASSERT_EQUAL(LightCommand::MODE, command.fields);
+  TEST_ASSERT_EQUAL(3, command.mode);
+
+  deserializeJson(doc, "{\"mode\":5,\"effect\":\"3\"}");
+  command = LightCommand::fromJson(doc.as<JsonObject>());
+  TEST_ASSERT_EQUAL(3, command.mode);
+
+  // Same for temperature over kelvin.  color_temp is still its own field, sent
+  // after them.
+  deserializeJson(doc, "{\"temperature\":30,\"kelvin\":70,\"color_temp\":250}");
+  command = LightCommand::fromJson(doc.as<JsonObject>());
+  TEST_ASSERT_EQUAL(LightCommand::KELVIN | LightCommand::COLOR_TEMP, command.fields);
+  TEST_ASSERT_EQUAL(30, command.kelvin);
+  TEST_ASSERT_EQUAL(250, command.colorTemp);
+
+  deserializeJson(doc, "{\"kelvin\":70,\"temperature\":30}");
+  command = LightCommand::fromJson(doc.as<JsonObject>());
+  TEST_ASSERT_EQUAL(30, command.kelvin);
+
+  // Values emitted by transitions round trip
+  LightCommand step;
+  TEST_ASSERT_TRUE(step.set(GroupStateField::COLOR_TEMP, 250));
+  TEST_ASSERT_FALSE(step.set(GroupStateField::COLOR, 1));
+  TEST_ASSERT_EQUAL(LightCommand::COLOR_TEMP, step.fields);
+  TEST_ASSERT_EQUAL(250, step.get(GroupStateField::COLOR_TEMP));
+}
+
+void test_group_command_planner() {
+  GroupCommandPlanner planner;
+  LightCommand command;
+  command.setStatus(ON).setLevel(40);
+
+  for (uint8_t group = 1; group <= 4; ++group) {
+    planner.add(BulbId(1, group, REMOTE_TYPE_RGB_CCT), command);
+  }
+  // Missing group 4, so can't use group 0
+  for (uint8_t group = 1; group <= 3; ++group) {
+    planner.add(BulbId(2, group, REMOTE_TYPE_RGB_CCT), command);
+  }
+
+  std::vector<BulbId> sent;
+  GroupCommandPlanner::Result result = planner.run(
+    [&sent](const BulbId& bulbId, const LightCommand&, JsonObject) {
+      sent.push_back(bulbId);
+      return static_cast<size_t>(2);
+    }
+  );
+
+  TEST_ASSERT_EQUAL(4, sent.size());
+  TEST_ASSERT_TRUE_MESSAGE(sent[0] == BulbId(1, 0, REMOTE_TYPE_RGB_CCT), "Should send to group 0 when every group is covered");
+  TEST_ASSERT_TRUE_MESSAGE(sent[1] == BulbId(2, 1, REMOTE_TYPE_RGB_CCT), "Should send group by group when a group is missing");
+  TEST_ASSERT_EQUAL(4, result.collapsedUpdates);
+  TEST_ASSERT_EQUAL(6, result.packetsSaved);
+
+  // Different updates for one group
+  for (uint8_t group = 1; group <= 4; ++group) {
+    planner.add(BulbId(1, group, REMOTE_TYPE_RGB_CCT), group == 4 ? LightCommand().setLevel(10) : command);
+  }
+
+  result = planner.run([](const BulbId&, const LightCommand&, JsonObject) { return static_cast<size_t>(1); });
+  TEST_ASSERT_EQUAL_MESSAGE(4, result.commands, "Shouldn't collapse differing updates");
+}
+
 //================================================================================
 // Group State
 //================================================================================
@@ -147,6 +669,56 @@ void test_state_updates() {
   TEST_ASSERT_EQUAL(s.getBrightness(), 100);
 }
 
+void test_changed_fields() {
+  GroupState s = color();
+  s.clearChangedFields();
+
+  TEST_ASSERT_FALSE(s.hasChangedFields());
+
+  // Setting the same value isn't a change
+  s.setBrightness(100);
+  TEST_ASSERT_FALSE(s.hasChangedFields());
+
+  s.setBrightness(50);
+  TEST_ASSERT_TRUE(s.isChangedField(GroupStateField::BRIGHTNESS));
+  TEST_ASSERT_TRUE(s.isChangedField(GroupStateField::LEVEL));
+  TEST_ASSERT_FALSE(s.isChangedField(GroupStateField::HUE));
+  TEST_ASSERT_FALSE(s.isChangedField(GroupStateField::STATE));
+  TEST_ASSERT_FALSE(s.isChangedField(GroupStateField::DEVICE_ID));
+
+  // Tracked separately from the MQTT dirty bit
+  s.clearChangedFields();
+  TEST_ASSERT_TRUE(s.isMqttDirty());
+  TEST_ASSERT_FALSE(s.hasChangedFields());
+
+  // Derived fields change with the fields they're computed from
+  s.setHue(200);
+  TEST_ASSERT_TRUE(s.isChangedField(GroupStateField::COLOR));
+  TEST_ASSERT_FALSE(s.isChangedField(GroupStateField::COLOR_TEMP));
+
+  s.clearChangedFields();
+  s.setBulbMode(BulbMode::BULB_MODE_WHITE);
+  TEST_ASSERT_TRUE(s.isChangedField(GroupStateField::BRIGHTNESS));
+  TEST_ASSERT_TRUE(s.isChangedField(GroupStateField::COLOR_TEMP));
+  TEST_ASSERT_FALSE(s.isChangedField(GroupStateField::STATE));
+
+  // Which fields changed isn't persisted, so a loaded state that still needs
+  // publishing counts everything as changed
+  uint8_t buffer[GroupState::SERIALIZED_SIZE];
+  s.dump(buffer);
+  s.load(buffer);
+  TEST_ASSERT_TRUE(s.isChangedField(GroupStateField::STATE));
+  TEST_ASSERT_TRUE(s.isChangedField(GroupStateField::COLOR));
+  TEST_ASSERT_TRUE(s.isChangedField(GroupStateField::COLOR_TEMP));
+  TEST_ASSERT_FALSE(s.isChangedField(GroupStateField::DEVICE_ID));
+
+  // Otherwise it starts out unchanged
+  s.clearMqttDirty();
+  s.dump(buffer);
+  s.load(buffer);
+  TEST_ASSERT_FALSE(s.hasChangedFields());
+}
+
 void test_cache() {
   BulbId id1(1, 1, REMOTE_TYPE_FUT089);
   BulbId id2(1, 2, REMOTE_TYPE_FUT089);
@@ -177,6 +749,67 @@ void test_cache() {
   TEST_ASSERT_NULL_MESSAGE(storedState, "Should evict old entry from cache");
 }
 
+void test_cache_lru() {
+  GroupStateCache cache(8);
+  GroupState s = color();
+
+  for (uint16_t deviceId = 1; deviceId <= 8; ++deviceId) {
+    cache.set(BulbId(deviceId, 1, REMOTE_TYPE_FUT089), s);
+  }
+
+  TEST_ASSERT_TRUE_MESSAGE(cache.isFull(), "Cache should be full");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(1, cache.getLru().deviceId, "First inserted entry should be LRU");
+
+  // Touch the LRU entry so that the next one in line is evicted instead
+  TEST_ASSERT_NOT_NULL(cache.get(BulbId(1, 1, REMOTE_TYPE_FUT089)));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(2, cache.getLru().deviceId, "Fetching an entry should make it MRU");
+
+  cache.set(BulbId(9, 1, REMOTE_TYPE_FUT089), s);
+
+  TEST_ASSERT_NULL_MESSAGE(cache.get(BulbId(2, 1, REMOTE_TYPE_FUT089)), "Should evict LRU entry");
+  TEST_ASSERT_NOT_NULL_MESSAGE(cache.get(BulbId(1, 1, REMOTE_TYPE_FUT089)), "Should keep recently used entry");
+  TEST_ASSERT_NOT_NULL_MESSAGE(cache.get(BulbId(9, 1, REMOTE_TYPE_FUT089)), "Should store new entry");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(8, cache.size(), "Size should be bounded by capacity");
+
+  // Device IDs that only differ in the high byte must not collide
+  cache.set(BulbId(0x0101, 1, REMOTE_TYPE_FUT089), s);
+  TEST_ASSERT_NULL_MESSAGE(cache.get(BulbId(0x0201, 1, REMOTE_TYPE_FUT089)), "Should distinguish full device ID");
+}
+
+void test_stale_group_set() {
+  StaleGroupSet stale(16);
+
+  // Group 0 fan-out on two remotes
+  for (uint16_t deviceId = 1; deviceId <= 2; ++deviceId) {
+    for (uint8_t groupId = 0; groupId <= 8; ++groupId) {
+      stale.add(BulbId(deviceId, groupId, REMOTE_TYPE_FUT089), deviceId);
+    }
+  }
+
+  TEST_ASSERT_TRUE_MESSAGE(stale.isFull(), "Set should be full");
+  TEST_ASSERT_FALSE_MESSAGE(stale.add(BulbId(3, 1, REMOTE_TYPE_FUT089), 3), "Should not add to a full set");
+
+  BulbId first = stale.shift();
+  TEST_ASSERT_EQUAL_INT_MESSAGE(1, first.deviceId, "Should shift the oldest entry first");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, first.groupId, "Should shift the oldest entry first");
+  TEST_ASSERT_FALSE_MESSAGE(stale.contains(first), "Shifted entry should be removed");
+
+  // Re-adding a queued group doesn't move it to the back
+  TEST_ASSERT_FALSE_MESSAGE(stale.add(BulbId(1, 1, REMOTE_TYPE_FUT089), 10), "Should ignore duplicates");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(1, stale.oldestTime(), "Duplicate should keep its original time");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(15, stale.size(), "Duplicates should not take up space");
+
+  TEST_ASSERT_TRUE(stale.add(first, 10));
+  TEST_ASSERT_TRUE(stale.contains(first));
+
+  size_t shifted = 0;
+  while (!stale.isEmpty()) {
+    stale.shift();
+    ++shifted;
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(16, shifted, "Should shift every entry exactly once");
+}
+
 void test_persistence() {
   BulbId id1(1, 1, REMOTE_TYPE_FUT089);
   BulbId id2(1, 2, REMOTE_TYPE_FUT089);
@@ -185,6 +818,7 @@ void test_persistence() {
 
   persistence.clear(id1);
   persistence.clear(id2);
+  persistence.flush();
 
   GroupState storedState;
   GroupState s = color();
@@ -220,6 +854,74 @@ void test_persistence() {
   TEST_ASSERT_TRUE_MESSAGE(storedState.isEqualIgnoreDirty(newState), "Should retrieve modified state");
 }
 
+void test_persistence_journal() {
+  static const char JOURNAL_PATH[] = "/test_states.bin";
+  BulbId id1(1, 1, REMOTE_TYPE_FUT089);
+  BulbId id2(1, 2, REMOTE_TYPE_FUT089);
+
+  ProjectFS.remove(JOURNAL_PATH);
+
+  GroupState s = color();
+  GroupState storedState;
+  GroupState defaultState = GroupState::defaultState(REMOTE_TYPE_FUT089);
+
+  {
+    GroupStatePersistence persistence(ProjectFS, JOURNAL_PATH);
+    persistence.set(id1, s);
+    persistence.set(id2, s);
+
+    TEST_ASSERT_TRUE_MESSAGE(persistence.flush(), "Should write staged records");
+    TEST_ASSERT_FALSE_MESSAGE(persistence.flush(), "Should not write anything when nothing is staged");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, persistence.getStats().flushes, "Should batch records into one write");
+  }
+
+  {
+    GroupStatePersistence persistence(ProjectFS, JOURNAL_PATH);
+    persistence.get(id1, storedState);
+    TEST_ASSERT_TRUE_MESSAGE(storedState.isEqualIgnoreDirty(s), "Should load state from journal");
+
+    persistence.clear(id1);
+    persistence.flush();
+  }
+
+  {
+    GroupStatePersistence persistence(ProjectFS, JOURNAL_PATH);
+    storedState = defaultState;
+    persistence.get(id1, storedState);
+    TEST_ASSERT_TRUE_MESSAGE(storedState.isEqualIgnoreDirty(defaultState), "Cleared state should not be loaded");
+
+    // Rewrite the same record enough times to trigger compaction
+    for (size_t i = 0; i < 100; ++i) {
+      s.setBrightness(i);
+      persistence.set(id2, s);
+      persistence.flush();
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(persistence.getStats().compactions > 0, "Journal should be compacted");
+  }
+
+  {
+    GroupStatePersistence persistence(ProjectFS, JOURNAL_PATH);
+    persistence.get(id2, storedState);
+    TEST_ASSERT_TRUE_MESSAGE(storedState.isEqualIgnoreDirty(s), "Should load latest state after compaction");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, persistence.size(), "Should only have live records");
+  }
+
+  // Compaction interrupted after removing the journal, before renaming the
+  // rewritten one into place
+  ProjectFS.rename(JOURNAL_PATH, "/test_states.bin.tmp");
+
+  {
+    GroupStatePersistence persistence(ProjectFS, JOURNAL_PATH);
+    storedState = defaultState;
+    persistence.get(id2, storedState);
+    TEST_ASSERT_TRUE_MESSAGE(storedState.isEqualIgnoreDirty(s), "Should recover the rewritten journal");
+    TEST_ASSERT_FALSE(ProjectFS.exists("/test_states.bin.tmp"));
+  }
+
+  ProjectFS.remove(JOURNAL_PATH);
+}
+
 void test_store() {
   BulbId id1(1, 1, REMOTE_TYPE_FUT089);
   BulbId id2(1, 2, REMOTE_TYPE_FUT089);
@@ -229,6 +931,7 @@ void test_store() {
 
   persistence.clear(id1);
   persistence.clear(id2);
+  persistence.flush();
 
   GroupState initState = color();
   GroupState initState2 = color();
@@ -258,6 +961,53 @@ void test_store() {
   TEST_ASSERT_TRUE_MESSAGE(storedState->isEqualIgnoreDirty(initState), "Should return persisted state");
 }
 
+void test_store_eviction() {
+  BulbId id1(1, 1, REMOTE_TYPE_FUT089);
+  BulbId other1(2, 1, REMOTE_TYPE_FUT089);
+  BulbId other2(3, 1, REMOTE_TYPE_FUT089);
+
+  // Room for id1 and its group 0
+  GroupStateStore store(2, 0);
+  GroupStatePersistence persistence;
+
+  persistence.clear(id1);
+  persistence.clear(other1);
+  persistence.clear(other2);
+  persistence.flush();
+
+  GroupState initState = color();
+  store.set(id1, initState);
+
+  store.get(other1);
+  store.get(other2);
+  TEST_ASSERT_NULL_MESSAGE(store.getCached(id1), "getCached shouldn't load evicted states");
+
+  size_t pending = 0;
+  store.forEachMqttDirty([&pending, &id1](const BulbId& bulbId) {
+    if (bulbId == id1) {
+      ++pending;
+    }
+  });
+  TEST_ASSERT_EQUAL_INT_MESSAGE(1, pending, "Evicted state should still be waiting for an MQTT publish");
+
+  GroupState* storedState = store.get(id1);
+  TEST_ASSERT_TRUE_MESSAGE(storedState->isEqualIgnoreDirty(initState), "Evicted state shouldn't be lost before it's flushed");
+  TEST_ASSERT_TRUE_MESSAGE(storedState->isMqttDirty(), "Evicted state should still be MQTT dirty");
+  TEST_ASSERT_TRUE_MESSAGE(storedState->isChangedField(GroupStateField::BRIGHTNESS), "Evicted state's next delta should include every field");
+
+  storedState->clearMqttDirty();
+  store.get(other1);
+  store.get(other2);
+
+  storedState = store.get(id1);
+  TEST_ASSERT_FALSE_MESSAGE(storedState->isMqttDirty(), "Published state shouldn't be MQTT dirty when reloaded");
+
+  persistence.clear(id1);
+  persistence.clear(other1);
+  persistence.clear(other2);
+  persistence.flush();
+}
+
 void test_group_0() {
   BulbId group0Id(1, 0, REMOTE_TYPE_FUT089);
   BulbId id1(1, 1, REMOTE_TYPE_FUT089);
@@ -269,6 +1019,7 @@ void test_group_0() {
 
   persistence.clear(id1);
   persistence.clear(id2);
+  persistence.flush();
 
   GroupState initState = color();
   GroupState initState2 = color();
@@ -354,13 +1105,32 @@ void setup() {
 
   RUN_TEST(test_init_state);
   RUN_TEST(test_state_updates);
+  RUN_TEST(test_changed_fields);
   RUN_TEST(test_cache);
+  RUN_TEST(test_cache_lru);
+  RUN_TEST(test_stale_group_set);
   RUN_TEST(test_persistence);
+  RUN_TEST(test_persistence_journal);
   RUN_TEST(test_store);
+  RUN_TEST(test_store_eviction);
   RUN_TEST(test_group_0);
 
   RUN_TEST(test_fut091_packet_formatter);
   RUN_TEST(test_fut092_packet_formatter);
+  RUN_TEST(test_stateless_packet_formatting);
+  RUN_TEST(test_packet_sequence_stamping);
+  RUN_TEST(test_packet_templates);
+  RUN_TEST(test_packet_template_cache);
+  RUN_TEST(test_v2_encoding_tables);
+  RUN_TEST(test_received_packet_classification);
+
+  RUN_TEST(test_packet_queue_coalescing);
+  RUN_TEST(test_packet_queue_priorities);
+  RUN_TEST(test_packet_queue_tickets);
+  RUN_TEST(test_repeat_calibration_budget);
+
+  RUN_TEST(test_light_command_parsing);
+  RUN_TEST(test_group_command_planner);
 
   UNITY_END();
 }
@@ -14,6 +14,7 @@ module MqttHelpers
       mqtt_password: ENV.fetch('ESPMH_MQTT_PASSWORD'),
       mqtt_topic_pattern: "#{topic_prefix}commands/:device_id/:device_type/:group_id",
       mqtt_state_topic_pattern: "#{topic_prefix}state/:device_id/:device_type/:group_id",
+      mqtt_state_delta_topic_pattern: "",
       mqtt_update_topic_pattern: "#{topic_prefix}updates/:device_id/:device_type/:group_id"
     }.merge(overrides)
   end
@@ -48,6 +48,10 @@ class MqttClient
     on_id_message('state', id_params, timeout, &block)
   end
 
+  def on_state_delta(id_params = nil, timeout = DEFAULT_TIMEOUT, &block)
+    on_id_message('state_delta', id_params, timeout, &block)
+  end
+
   def on_id_message(path, id_params, timeout, &block)
     sub_topic = "#{@topic_prefix}#{path}/#{id_topic_suffix(nil)}"
 
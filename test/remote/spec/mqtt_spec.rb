@@ -269,6 +269,48 @@ RSpec.describe 'MQTT' do
     end
   end
 
+  context 'state deltas' do
+    before(:each) do
+      @client.put(
+        '/settings',
+        mqtt_update_topic_pattern: '',
+        mqtt_state_delta_topic_pattern: "#{@topic_prefix}state_delta/:device_id/:device_type/:group_id",
+        mqtt_state_full_interval: 2000,
+        packet_repeats: 1
+      )
+
+      @client.patch_state({status: 'ON', level: 10}, { **@id_params, blockOnQueue: true })
+    end
+
+    it 'should only send changed fields' do
+      delta = nil
+
+      @mqtt_client.on_state_delta(@id_params) do |id, message|
+        delta = message
+        message['level'] == 50
+      end
+
+      @mqtt_client.patch_state(@id_params, level: 50)
+      @mqtt_client.wait_for_listeners
+
+      expect(delta.keys).to eq(['level'])
+    end
+
+    it 'should eventually send the full state' do
+      seen_state = nil
+
+      @mqtt_client.on_state(@id_params) do |id, message|
+        seen_state = message
+        message['level'] == 60
+      end
+
+      @mqtt_client.patch_state(@id_params, level: 60)
+      @mqtt_client.wait_for_listeners
+
+      expect(seen_state).to include('status' => 'ON', 'level' => 60)
+    end
+  end
+
   context ':device_id token for command topic' do
     it 'should support hexadecimal device IDs' do
       seen = false
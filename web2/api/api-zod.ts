@@ -214,6 +214,43 @@ const UpdateBatch = z
   })
   .partial()
   .passthrough();
+const UpdateBatchResponse = z
+  .object({
+    success: z.boolean(),
+    packets_saved: z
+      .number()
+      .int()
+      .describe(
+        "Packets not sent because updates covering every group of a device ID were sent once to group 0"
+      )
+      .optional(),
+  })
+  .passthrough();
+const QueueLaneStats = z
+  .object({
+    length: z
+      .number()
+      .int()
+      .describe("Number of packets queued in this lane"),
+    sent_packets: z
+      .number()
+      .int()
+      .describe("Number of packets sent from this lane since last reboot"),
+    avg_latency_ms: z
+      .number()
+      .int()
+      .describe(
+        "Average time from queueing a packet to sending its last repeat"
+      ),
+    max_latency_ms: z
+      .number()
+      .int()
+      .describe(
+        "Maximum time from queueing a packet to sending its last repeat"
+      ),
+  })
+  .partial()
+  .passthrough();
 const About = z
   .object({
     firmware: z.string().describe("Always set to 'milight-hub'"),
@@ -240,17 +277,138 @@ const About = z
           .describe(
             "Number of packets that have been dropped since last reboot"
           ),
+        coalesced_packets: z
+          .number()
+          .int()
+          .describe(
+            "Number of queued packets that were replaced by a newer packet for the same bulb and command since last reboot"
+          ),
+        lanes: z
+          .object({
+            interactive: QueueLaneStats,
+            normal: QueueLaneStats,
+            background: QueueLaneStats,
+          })
+          .partial()
+          .passthrough()
+          .describe(
+            "Stats for each priority lane.  On/off commands are sent from the `interactive` lane before anything else.  Transition steps are sent from the `background` lane.  Everything else uses the `normal` lane.\n\nLatency is measured from when a packet is queued until its last repeat is sent."
+          ),
+        first_send_ms: z
+          .array(
+            z
+              .object({ max_ms: z.number().int(), packets: z.number().int() })
+              .partial()
+              .passthrough()
+          )
+          .describe(
+            "Histogram of the time from when a packet is queued until its first repeat is sent, since last reboot.  Each bucket counts packets faster than `max_ms` and at least as fast as the previous bucket.  The last bucket has no `max_ms`."
+          ),
       })
       .partial()
       .passthrough(),
+    transition_stats: z
+      .object({
+        active: z.number().int().describe("Number of running transitions"),
+        steps: z
+          .number()
+          .int()
+          .describe("Number of transition steps since last reboot"),
+        avg_lateness_ms: z.number().int(),
+        max_lateness_ms: z.number().int(),
+      })
+      .partial()
+      .passthrough()
+      .describe(
+        "Lateness is how long after it was due a transition step fired."
+      ),
     mqtt: z
       .object({
         configured: z.boolean(),
         connected: z.boolean(),
         status: z.string(),
+        state_publishes: z
+          .object({
+            count: z.number().int(),
+            payload_bytes: z
+              .number()
+              .int()
+              .describe("Total size of published state messages"),
+            copied_bytes: z
+              .number()
+              .int()
+              .describe(
+                "Bytes copied through intermediate buffers before being written to the connection"
+              ),
+            heap_allocations: z
+              .number()
+              .int()
+              .describe(
+                "Heap allocations made while publishing.  Only non-zero when a bound topic is too long for the stack buffer."
+              ),
+          })
+          .partial()
+          .passthrough()
+          .describe("Counters for state messages published since last reboot"),
+        pending_states: z
+          .object({
+            count: z.number().int(),
+            oldest_age: z
+              .number()
+              .int()
+              .describe(
+                "Milliseconds the longest-waiting group has been waiting"
+              ),
+            full_states: z
+              .number()
+              .int()
+              .describe(
+                "Groups waiting for a full state publish after being sent a delta.  Only non-zero with mqtt_state_delta_topic_pattern."
+              ),
+            overflow_scans: z
+              .number()
+              .int()
+              .describe(
+                "Times the state store was scanned for groups that didn't fit in the queue.  These are still published within the rate limit."
+              ),
+          })
+          .partial()
+          .passthrough()
+          .describe("Groups waiting for a state publish"),
       })
       .partial()
       .passthrough(),
+    listen_stats: z
+      .record(
+        z
+          .object({
+            radio: z
+              .number()
+              .int()
+              .describe(
+                "Index of the radio listening on this config.  Nonzero only with listen_radio_pins."
+              ),
+            listens: z
+              .number()
+              .int()
+              .describe("Number of loops spent listening on this config"),
+            hits: z
+              .number()
+              .int()
+              .describe("Number of packets heard on this config"),
+            reconfigures: z
+              .number()
+              .int()
+              .describe(
+                "Number of times the radio was reconfigured for this config, for both listening and sending"
+              ),
+          })
+          .partial()
+          .passthrough()
+      )
+      .describe(
+        "Passive listening stats for each radio config, keyed by the first remote type that uses the config.  Configs that have recently had traffic are listened to for longer."
+      ),
   })
   .partial()
   .passthrough();
@@ -375,9 +533,19 @@ const Settings = z
       .describe(
         "Topic pattern device state will be sent to.  More detail on the format in README."
       ),
+    mqtt_state_delta_topic_pattern: z
+      .string()
+      .describe(
+        "If set, state updates only include the fields that changed and are sent to this topic pattern instead of the state topic.  They are not retained.  The full state is still published to the state topic, see mqtt_state_full_interval.  Leave blank to always send the full state."
+      ),
     mqtt_client_status_topic: z
       .string()
       .describe("Topic client status will be sent to."),
+    mqtt_scene_topic: z
+      .string()
+      .describe(
+        "If set, publishing the name of a scene to this topic activates it.  See /scenes."
+      ),
     mqtt_retain: z
       .boolean()
       .describe(
@@ -431,6 +599,13 @@ const Settings = z
         "Controls how much time has to pass after the last status update was queued."
       )
       .default(500),
+    mqtt_state_full_interval: z
+      .number()
+      .int()
+      .describe(
+        "When mqtt_state_delta_topic_pattern is set, controls how many milliseconds after the first delta the full state is published to the state topic."
+      )
+      .default(10000),
     packet_repeat_throttle_threshold: z
       .number()
       .int()
@@ -454,6 +629,11 @@ const Settings = z
         "Controls how far throttling can decrease the number of repeated packets"
       )
       .default(3),
+    packet_repeats_per_type: z
+      .record(z.number().int())
+      .describe(
+        "Number of repeats for packets to each remote type, overriding packet_repeats.  Keys are remote types.  Throttling scales these in proportion.  Can be measured with /repeat_calibration."
+      ),
     enable_automatic_mode_switching: z
       .boolean()
       .describe(
@@ -499,6 +679,28 @@ const Settings = z
         "Packets are sent asynchronously.  This number controls the number of repeats sent during each iteration.  Increase this number to improve packet throughput.  Decrease to improve system multi-tasking."
       )
       .default(10),
+    packet_send_budget_us: z
+      .number()
+      .int()
+      .describe(
+        "Maximum time, in microseconds, spent sending repeats during each iteration.  Sending stops early when either this or the repeats per iteration is reached.  At least one repeat is always sent.  Set to 0 for no time limit."
+      )
+      .default(3000),
+    packet_interleave_width: z
+      .number()
+      .int()
+      .gte(1)
+      .lte(8)
+      .describe(
+        "Number of queued packets for different bulbs that are sent at the same time, taking turns a repeat at a time.  When one command updates several groups, every group then receives its first copy almost immediately instead of waiting for the previous groups' repeats.  The total number of repeats sent is unchanged.  Set to 1 to send packets one after the other."
+      )
+      .default(1),
+    packet_coalescing: z
+      .boolean()
+      .describe(
+        "If enabled, a queued packet that hasn't been sent yet is replaced by a newer command of the same kind (e.g., brightness) for the same bulb.  Reduces latency when many updates are sent in quick succession, such as when dragging a slider."
+      )
+      .default(true),
     home_assistant_discovery_prefix: z
       .string()
       .describe(
@@ -521,6 +723,11 @@ const Settings = z
       .describe(
         "List of UDP servers, stored as 3-long arrays.  Elements are 1) remote ID to bind to, 2) UDP port to listen on, 3) protocol version (5 or 6)"
       ),
+    listen_radio_pins: z
+      .array(z.array(z.number().int()))
+      .describe(
+        "Additional nRF24 modules dedicated to listening, stored as 2-long arrays of [CE pin, CSN pin].  When set, the radio at ce_pin/csn_pin only sends, and the radio configs are split between these modules so that packets from remotes are still heard while sending.  Not supported with LT8900."
+      ),
     group_state_fields: z.array(GroupStateField),
     group_id_aliases: z.object({}).partial().passthrough()
       .describe(`DEPRECATED (use /aliases routes instead)
@@ -576,6 +783,99 @@ const TransitionData = TransitionArgs.and(
     .passthrough()
 );
 const postTransitions_Body = TransitionData.and(BulbId);
+const Scene = z
+  .object({
+    name: z.string(),
+    states: z
+      .number()
+      .int()
+      .describe("Number of bulbs whose state the scene sets"),
+    packets: z
+      .number()
+      .int()
+      .describe("Number of packets sent when the scene is activated"),
+  })
+  .partial()
+  .passthrough();
+const SceneDefinition = z
+  .object({
+    name: z.string().max(32).describe("Can't contain `/`"),
+    updates: z.array(UpdateBatch),
+  })
+  .passthrough();
+const RepeatCalibrationResult = z
+  .object({
+    remote_type: RemoteType,
+    sent: z.number().int().describe("Number of probes sent"),
+    heard: z
+      .number()
+      .int()
+      .describe("Number of probes heard by the listen radio"),
+    hear_ratio: z.number().describe("Fraction of single repeats heard"),
+    previous_repeats: z
+      .number()
+      .int()
+      .describe("Repeats for this remote type when calibration started"),
+    recommended_repeats: z
+      .number()
+      .int()
+      .describe(
+        "Fewest repeats reaching target_ratio.  0 if no probes were heard."
+      ),
+    avg_write_us: z
+      .number()
+      .int()
+      .describe("Average airtime of one repeat in microseconds"),
+    airtime_saved_us: z
+      .number()
+      .int()
+      .describe(
+        "Airtime each command saves with recommended_repeats instead of previous_repeats, in microseconds.  Negative if more repeats are needed."
+      ),
+  })
+  .partial()
+  .passthrough();
+const RepeatCalibration = z
+  .object({
+    available: z
+      .boolean()
+      .describe(
+        "False if there's no dedicated listen radio to calibrate with"
+      ),
+    state: z.enum(["idle", "running", "done"]),
+    target_ratio: z.number(),
+    probes: z.number().int(),
+    apply: z.boolean(),
+    results: z.array(RepeatCalibrationResult),
+  })
+  .partial()
+  .passthrough();
+const postRepeat_calibration_Body = z
+  .object({
+    target_ratio: z
+      .number()
+      .describe(
+        "Fraction of commands that should be delivered.  Must be between 0 and 1."
+      )
+      .default(0.99),
+    probes: z
+      .number()
+      .int()
+      .gte(1)
+      .describe("Number of probes to send for each remote type")
+      .default(50),
+    remote_types: z
+      .array(RemoteType)
+      .describe("Remote types to calibrate.  All of them if unspecified."),
+    apply: z
+      .boolean()
+      .describe(
+        "Save the recommended repeats to packet_repeats_per_type when finished"
+      )
+      .default(false),
+  })
+  .partial()
+  .passthrough();
 const PacketMessage = z
   .object({
     t: z.literal("packet").describe("Type of message").optional(),
@@ -618,6 +918,8 @@ export const schemas = {
   GroupStateCommands,
   GroupState,
   UpdateBatch,
+  UpdateBatchResponse,
+  QueueLaneStats,
   About,
   BooleanResponseWithMessage,
   postSystem_Body,
@@ -631,6 +933,11 @@ export const schemas = {
   postRaw_commandsRemoteType_Body,
   TransitionData,
   postTransitions_Body,
+  Scene,
+  SceneDefinition,
+  RepeatCalibrationResult,
+  RepeatCalibration,
+  postRepeat_calibration_Body,
   PacketMessage,
   WebSocketMessage,
   DeviceId,
@@ -833,7 +1140,7 @@ const endpoints = makeApi([
         schema: z.array(UpdateBatch),
       },
     ],
-    response: BooleanResponse,
+    response: UpdateBatchResponse,
   },
   {
     method: "get",
@@ -1099,6 +1406,39 @@ if &#x60;fmt&#x60; is set to &#x60;normalized&#x60;, the response will be in nor
     requestFormat: "json",
     response: z.void(),
   },
+  {
+    method: "get",
+    path: "/repeat_calibration",
+    alias: "getRepeat_calibration",
+    requestFormat: "json",
+    response: RepeatCalibration,
+  },
+  {
+    method: "post",
+    path: "/repeat_calibration",
+    alias: "postRepeat_calibration",
+    requestFormat: "json",
+    parameters: [
+      {
+        name: "body",
+        type: "Body",
+        schema: postRepeat_calibration_Body,
+      },
+    ],
+    response: BooleanResponse,
+    errors: [
+      {
+        status: 400,
+        description: `Invalid options, or there are no dedicated listen radios`,
+        schema: BooleanResponse,
+      },
+      {
+        status: 409,
+        description: `Calibration is already running`,
+        schema: BooleanResponse,
+      },
+    ],
+  },
   {
     method: "get",
     path: "/settings",
@@ -1239,6 +1579,110 @@ if &#x60;fmt&#x60; is set to &#x60;normalized&#x60;, the response will be in nor
       },
     ],
   },
+  {
+    method: "get",
+    path: "/scenes",
+    alias: "getScenes",
+    requestFormat: "json",
+    response: z
+      .object({ scenes: z.array(Scene), count: z.number().int() })
+      .partial()
+      .passthrough(),
+  },
+  {
+    method: "post",
+    path: "/scenes",
+    alias: "postScenes",
+    description: `Define a scene, replacing any scene with the same name.  The updates are compiled to packets when the scene is defined, so activating it doesn't build any.
+
+Updates take the same form as a batch update (see &#x60;PUT /gateways&#x60;).  Transitions and commands (&#x60;command&#x60;, &#x60;commands&#x60;) are not allowed.
+`,
+    requestFormat: "json",
+    parameters: [
+      {
+        name: "body",
+        type: "Body",
+        schema: SceneDefinition,
+      },
+    ],
+    response: BooleanResponse.and(Scene),
+    errors: [
+      {
+        status: 400,
+        description: `Invalid name or updates, or too many scenes or packets`,
+        schema: BooleanResponse,
+      },
+      {
+        status: 500,
+        description: `Scene could not be saved`,
+        schema: BooleanResponse,
+      },
+    ],
+  },
+  {
+    method: "get",
+    path: "/scenes/:name",
+    alias: "getScenesName",
+    requestFormat: "json",
+    parameters: [
+      {
+        name: "name",
+        type: "Path",
+        schema: z.string().describe("Name of the scene"),
+      },
+    ],
+    response: Scene,
+    errors: [
+      {
+        status: 404,
+        description: `Provided scene name not found`,
+        schema: z.void(),
+      },
+    ],
+  },
+  {
+    method: "delete",
+    path: "/scenes/:name",
+    alias: "deleteScenesName",
+    requestFormat: "json",
+    parameters: [
+      {
+        name: "name",
+        type: "Path",
+        schema: z.string().describe("Name of the scene"),
+      },
+    ],
+    response: BooleanResponse,
+    errors: [
+      {
+        status: 404,
+        description: `Provided scene name not found`,
+        schema: BooleanResponse,
+      },
+    ],
+  },
+  {
+    method: "post",
+    path: "/scenes/:name/activate",
+    alias: "postScenesNameActivate",
+    description: `Updates the state of every bulb in the scene and sends its packets.  Packets that don't fit in the send queue are queued as it drains.`,
+    requestFormat: "json",
+    parameters: [
+      {
+        name: "name",
+        type: "Path",
+        schema: z.string().describe("Name of the scene"),
+      },
+    ],
+    response: BooleanResponse,
+    errors: [
+      {
+        status: 404,
+        description: `Provided scene name not found`,
+        schema: BooleanResponse,
+      },
+    ],
+  },
 ]);
 
 export const api = new Zodios(endpoints);
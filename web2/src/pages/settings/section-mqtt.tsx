@@ -27,7 +27,9 @@ const TOPIC_PRESETS: Record<string, Partial<Settings>> = {
     mqtt_topic_pattern: "milight/commands/:device_id/:device_type/:group_id",
     mqtt_update_topic_pattern: "",
     mqtt_state_topic_pattern: "milight/state/:device_id/:device_type/:group_id",
+    mqtt_state_delta_topic_pattern: "",
     mqtt_client_status_topic: "milight/client_status",
+    mqtt_scene_topic: "",
     simple_mqtt_client_status: true,
   },
   Custom: {},
@@ -131,7 +133,9 @@ const TopicFieldsSelector: React.FC<{}> = ({}) => {
             "mqtt_topic_pattern",
             "mqtt_update_topic_pattern",
             "mqtt_state_topic_pattern",
+            "mqtt_state_delta_topic_pattern",
             "mqtt_client_status_topic",
+            "mqtt_scene_topic",
             "simple_mqtt_client_status",
           ]}
         />
@@ -216,7 +220,12 @@ export const MQTTSettings: React.FC<NavChildProps<"mqtt">> = () => (
     />
     <FieldSection
       title="Advanced"
-      fields={["mqtt_state_rate_limit", "mqtt_debounce_delay", "mqtt_retain"]}
+      fields={[
+        "mqtt_state_rate_limit",
+        "mqtt_debounce_delay",
+        "mqtt_state_full_interval",
+        "mqtt_retain",
+      ]}
     />
   </FieldSections>
 );
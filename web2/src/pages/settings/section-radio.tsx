@@ -15,7 +15,14 @@ export const RadioSettings: React.FC<NavChildProps<"radio">> = () => (
     />
     <FieldSection
       title="🔁 Repeats"
-      fields={["packet_repeats", "packet_repeats_per_loop", "listen_repeats"]}
+      fields={[
+        "packet_repeats",
+        "packet_repeats_per_loop",
+        "packet_send_budget_us",
+        "packet_interleave_width",
+        "packet_coalescing",
+        "listen_repeats",
+      ]}
     />
     <FieldSection
       title="⏱️ Throttling"